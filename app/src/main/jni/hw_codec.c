@@ -11,13 +11,16 @@
 #include "sys/wait.h"
 #include "termios.h"
 #include "unistd.h"
+#include "pthread.h"
 
 #include "media/NdkMediaError.h"
 #include "media/NdkMediaFormat.h"
 #include "media/NdkMediaCodec.h"
 
 /////////////////////////////////////////////////////////////////////////////////////
-//the local control parameters for the MSDK encoder.
+//the local control parameters for one MSDK encoder instance.
+struct MSDKEncoder
+{
    AMediaCodec*           m_VideoEncoder;
    AMediaFormat*          m_VideoFormat;
    MSdkInputParam         m_InitParams;
@@ -26,6 +29,12 @@
    uint32_t               m_nFramesProcessed;
    uint32_t               m_SpsPpsLength;
    uint32_t               m_SpsPpsHeader[64];
+};
+
+//the number of created encoder instances, and the device codec limit.
+static pthread_mutex_t    g_InstanceLock  = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t           g_InstanceCount = 0;
+static uint32_t           g_InstanceLimit = MSDK_DEFAULT_INSTANCE_LIMIT;
 
    /*int BLENDER(int a, int b, int f)
    {
@@ -270,124 +279,190 @@ int scaler_I420Mirror(const uint8_t* src_y, int src_stride_y,
 
 
 /////////////////////////////////////////////////////////////////////////////////////
-int32_t OpenEncoder(MSdkInputParam *InputParam)
+static int32_t OpenEncoder(struct MSDKEncoder *pMEncoder, MSdkInputParam *InputParam)
 {
     media_status_t sts = AMEDIA_OK;
     
-    //Only one instance of MSDK encoder could be created now.
-    if (m_CodecInitFlag != 0)
+    //Every instance keeps its own codec state, and could be opened once.
+    if (pMEncoder->m_CodecInitFlag != 0)
     {
         return MCODEC_ERROR;
     }
     
     //Save the input MSDK encoder and VPP configure parameters.
-    m_InitParams.InStreamType    = InputParam->InStreamType;
-    m_InitParams.InFrameRate     = InputParam->InFrameRate;
-    m_InitParams.InWidth         = InputParam->InWidth;
-    m_InitParams.InHeight        = InputParam->InHeight;
-    
-    m_InitParams.nFrameRate      = InputParam->nFrameRate;
-    m_InitParams.nWidth          = InputParam->nWidth;
-    m_InitParams.nHeight         = InputParam->nHeight;
-    m_InitParams.nTargetKbps     = InputParam->nTargetKbps;
-    m_InitParams.nTemporalLayers = InputParam->nTemporalLayers;
-    m_InitParams.nSpatialId      = InputParam->nSpatialId;
-    m_InitParams.nMemType        = InputParam->nMemType;
+    pMEncoder->m_InitParams.InStreamType    = InputParam->InStreamType;
+    pMEncoder->m_InitParams.InFrameRate     = InputParam->InFrameRate;
+    pMEncoder->m_InitParams.InWidth         = InputParam->InWidth;
+    pMEncoder->m_InitParams.InHeight        = InputParam->InHeight;
+    
+    pMEncoder->m_InitParams.nFrameRate      = InputParam->nFrameRate;
+    pMEncoder->m_InitParams.nWidth          = InputParam->nWidth;
+    pMEncoder->m_InitParams.nHeight         = InputParam->nHeight;
+    pMEncoder->m_InitParams.nTargetKbps     = InputParam->nTargetKbps;
+    pMEncoder->m_InitParams.nTemporalLayers = InputParam->nTemporalLayers;
+    pMEncoder->m_InitParams.nSpatialId      = InputParam->nSpatialId;
+    pMEncoder->m_InitParams.nMemType        = InputParam->nMemType;
     
     //create a mediacodec encoder instance.
-    m_VideoEncoder = AMediaCodec_createEncoderByType("video/avc");
-    if (m_VideoEncoder == NULL)
+    pMEncoder->m_VideoEncoder = AMediaCodec_createEncoderByType("video/avc");
+    if (pMEncoder->m_VideoEncoder == NULL)
     {
         return MCODEC_ERROR;
     }
     
     //create the media format configure instance.
-    if (m_VideoFormat == NULL)
+    if (pMEncoder->m_VideoFormat == NULL)
     {
-        m_VideoFormat = AMediaFormat_new();
-        if (m_VideoFormat == NULL)
+        pMEncoder->m_VideoFormat = AMediaFormat_new();
+        if (pMEncoder->m_VideoFormat == NULL)
         {
             return MCODEC_ERROR;
         }
     }
     
     //update the encoder input and output format.
-    AMediaFormat_setInt32(m_VideoFormat, "width", m_InitParams.nWidth);
-    AMediaFormat_setInt32(m_VideoFormat, "height", m_InitParams.nHeight);
-    AMediaFormat_setString(m_VideoFormat, "mime", "video/avc");
-    AMediaFormat_setInt32(m_VideoFormat, "color-format", 21);
-    AMediaFormat_setInt32(m_VideoFormat, "bitrate", m_InitParams.nTargetKbps * 1000);
-    AMediaFormat_setFloat(m_VideoFormat, "frame-rate", m_InitParams.nFrameRate);
-    AMediaFormat_setInt32(m_VideoFormat, "i-frame-interval", 5);
+    AMediaFormat_setInt32(pMEncoder->m_VideoFormat, "width", pMEncoder->m_InitParams.nWidth);
+    AMediaFormat_setInt32(pMEncoder->m_VideoFormat, "height", pMEncoder->m_InitParams.nHeight);
+    AMediaFormat_setString(pMEncoder->m_VideoFormat, "mime", "video/avc");
+    AMediaFormat_setInt32(pMEncoder->m_VideoFormat, "color-format", 21);
+    AMediaFormat_setInt32(pMEncoder->m_VideoFormat, "bitrate", pMEncoder->m_InitParams.nTargetKbps * 1000);
+    AMediaFormat_setFloat(pMEncoder->m_VideoFormat, "frame-rate", pMEncoder->m_InitParams.nFrameRate);
+    AMediaFormat_setInt32(pMEncoder->m_VideoFormat, "i-frame-interval", 5);
     
     //configure and initialize the encoder.
     uint32_t flags = AMEDIACODEC_CONFIGURE_FLAG_ENCODE;
-    sts = AMediaCodec_configure(m_VideoEncoder, m_VideoFormat, NULL, NULL, flags);
+    sts = AMediaCodec_configure(pMEncoder->m_VideoEncoder, pMEncoder->m_VideoFormat, NULL, NULL, flags);
     if (sts != AMEDIA_OK)
     {
-        AMediaCodec_delete(m_VideoEncoder);
-        m_VideoEncoder = NULL;
+        AMediaCodec_delete(pMEncoder->m_VideoEncoder);
+        pMEncoder->m_VideoEncoder = NULL;
         return MCODEC_ERROR;
     }
     
     //start the android hardware video encoder device.
-    sts = AMediaCodec_start(m_VideoEncoder);
+    sts = AMediaCodec_start(pMEncoder->m_VideoEncoder);
     if (sts != AMEDIA_OK)
     {
-        AMediaCodec_delete(m_VideoEncoder);
-        m_VideoEncoder = NULL;
+        AMediaCodec_delete(pMEncoder->m_VideoEncoder);
+        pMEncoder->m_VideoEncoder = NULL;
         return MCODEC_ERROR;
     }
     
     //Reset and initialize the local MSDK control parameters.
-    memset(m_SpsPpsHeader, 0, sizeof(m_SpsPpsHeader));
-    m_ForDatashare     = 0;
-    m_nFramesProcessed = 0;
-    m_SpsPpsLength     = 0;
-    m_CodecInitFlag    = 1;
+    memset(pMEncoder->m_SpsPpsHeader, 0, sizeof(pMEncoder->m_SpsPpsHeader));
+    pMEncoder->m_ForDatashare     = 0;
+    pMEncoder->m_nFramesProcessed = 0;
+    pMEncoder->m_SpsPpsLength     = 0;
+    pMEncoder->m_CodecInitFlag    = 1;
     
     //Succed to open the MSDK encoder, return the result.
     return MCODEC_SUCCEED;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
-int32_t CloseEncoder()
+static int32_t CloseEncoder(struct MSDKEncoder *pMEncoder)
 {
     //if the MSDK device was not opened, do nothing and exit.
-    if (m_CodecInitFlag == 0)
+    if (pMEncoder->m_CodecInitFlag == 0)
     {
         return MCODEC_ERROR;
     }
     
     //Update the MSDK initialize flag to close device.
-    if (m_VideoEncoder != NULL)
+    if (pMEncoder->m_VideoEncoder != NULL)
     {
-        AMediaCodec_stop(m_VideoEncoder);
-        AMediaCodec_delete(m_VideoEncoder);
-        m_VideoEncoder = NULL;
+        AMediaCodec_stop(pMEncoder->m_VideoEncoder);
+        AMediaCodec_delete(pMEncoder->m_VideoEncoder);
+        pMEncoder->m_VideoEncoder = NULL;
     }
     
     //delete the video format instance when close device.
-    if (m_VideoFormat != NULL)
+    if (pMEncoder->m_VideoFormat != NULL)
     {
-        AMediaFormat_delete(m_VideoFormat);
-        m_VideoFormat = NULL;
+        AMediaFormat_delete(pMEncoder->m_VideoFormat);
+        pMEncoder->m_VideoFormat = NULL;
     }
     
     //Update the MSDK initialize flag to close device.
-    m_CodecInitFlag = 0;
+    pMEncoder->m_CodecInitFlag = 0;
     
     //Succed to close the encoder, return the result.
     return MCODEC_SUCCEED;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
-int32_t EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer)
+struct MSDKEncoder *CreateEncoder(MSdkInputParam *InputParam)
+{
+    struct MSDKEncoder *pMEncoder = NULL;
+    
+    //the device could only run a limited number of codec instances.
+    pthread_mutex_lock(&g_InstanceLock);
+    if (g_InstanceCount >= g_InstanceLimit)
+    {
+        pthread_mutex_unlock(&g_InstanceLock);
+        return NULL;
+    }
+    g_InstanceCount++;
+    pthread_mutex_unlock(&g_InstanceLock);
+    
+    //Create the encoder instance, and open it with its own parameters.
+    pMEncoder = (struct MSDKEncoder *)calloc(1, sizeof(struct MSDKEncoder));
+    if ((pMEncoder == NULL) || (OpenEncoder(pMEncoder, InputParam) != MCODEC_SUCCEED))
+    {
+        if ((pMEncoder != NULL) && (pMEncoder->m_VideoFormat != NULL))
+        {
+            AMediaFormat_delete(pMEncoder->m_VideoFormat);
+        }
+        free(pMEncoder);
+        
+        pthread_mutex_lock(&g_InstanceLock);
+        g_InstanceCount--;
+        pthread_mutex_unlock(&g_InstanceLock);
+        return NULL;
+    }
+    
+    //return the pointer of the allocated encoder instance.
+    return pMEncoder;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void DeleteEncoder(struct MSDKEncoder *pMEncoder)
+{
+    //Delete the MSDK encoder and release memory.
+    if (pMEncoder != NULL)
+    {
+        CloseEncoder(pMEncoder);
+        free(pMEncoder);
+        
+        pthread_mutex_lock(&g_InstanceLock);
+        g_InstanceCount--;
+        pthread_mutex_unlock(&g_InstanceLock);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t SetEncoderInstanceLimit(uint32_t Limit)
+{
+    //the limit should not be zero, and not lower than the opened instances.
+    pthread_mutex_lock(&g_InstanceLock);
+    if ((Limit == 0) || (Limit < g_InstanceCount))
+    {
+        pthread_mutex_unlock(&g_InstanceLock);
+        return MCODEC_ERROR;
+    }
+    g_InstanceLimit = Limit;
+    pthread_mutex_unlock(&g_InstanceLock);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t EncodeFrame(struct MSDKEncoder *pMEncoder, SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer)
 {
     size_t BufSize = 0;
     
     //if the MSDK device was not opened, do nothing and exit.
-    if (m_CodecInitFlag == 0)
+    if ((pMEncoder == NULL) || (pMEncoder->m_CodecInitFlag == 0))
     {
         return MCODEC_ERROR;
     }
@@ -399,14 +474,14 @@ int32_t EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer)
     }
     
     //Get a memory block from buffer array to save YUV frame.
-    ssize_t bufIndex = AMediaCodec_dequeueInputBuffer(m_VideoEncoder, -1ll);
+    ssize_t bufIndex = AMediaCodec_dequeueInputBuffer(pMEncoder->m_VideoEncoder, -1ll);
     if (bufIndex < 0)
     {
         return MCODEC_ERROR;
     }
     
     //Get an input buffer, with the buffer index that previously obtained.
-    uint8_t *inputBuffer = AMediaCodec_getInputBuffer(m_VideoEncoder, bufIndex, &BufSize);
+    uint8_t *inputBuffer = AMediaCodec_getInputBuffer(pMEncoder->m_VideoEncoder, bufIndex, &BufSize);
     if (inputBuffer == NULL)
     {
         return MCODEC_ERROR;
@@ -415,8 +490,8 @@ int32_t EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer)
     //Get the YUV image parameters from the input frame.
     int32_t srcWidth  = pSrcPic->iPicWidth;
     int32_t srcHeight = pSrcPic->iPicHeight;
-    int32_t dstWidth  = m_InitParams.nWidth;
-    int32_t dstHeight = m_InitParams.nHeight;
+    int32_t dstWidth  = pMEncoder->m_InitParams.nWidth;
+    int32_t dstHeight = pMEncoder->m_InitParams.nHeight;
     
     uint8_t *encPlaneY = inputBuffer;
     uint8_t *encPlaneU = encPlaneY + dstWidth * dstHeight;
@@ -451,33 +526,33 @@ int32_t EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer)
     media_status_t sts = AMEDIA_OK;
     uint64_t time = pSrcPic->uiTimeStamp * 1000;
     
-    sts = AMediaCodec_queueInputBuffer(m_VideoEncoder, bufIndex, 0, BufSize, time, 0);
+    sts = AMediaCodec_queueInputBuffer(pMEncoder->m_VideoEncoder, bufIndex, 0, BufSize, time, 0);
     if (sts != AMEDIA_OK)
     {
         return MCODEC_ERROR;
     }
     
     //Update the total encoded frame counter for debug.
-    m_nFramesProcessed++;
+    pMEncoder->m_nFramesProcessed++;
     
     //Succeed to start the MSDK encoder, return the results.
     return MCODEC_SUCCEED;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
-int32_t GetBitstream(SLayerBSInfo* pBsLayer)
+int32_t GetBitstream(struct MSDKEncoder *pMEncoder, SLayerBSInfo* pBsLayer)
 {
     size_t BufSize = 0;
     AMediaCodecBufferInfo BufInfo;
     
     //if the MSDK device was not opened, do nothing and exit.
-    if (m_CodecInitFlag == 0)
+    if ((pMEncoder == NULL) || (pMEncoder->m_CodecInitFlag == 0))
     {
         return MCODEC_ERROR;
     }
     
     //Get bitstream buffer from android buffer array, with blocking mode.
-    ssize_t bufIndex = AMediaCodec_dequeueOutputBuffer(m_VideoEncoder, &BufInfo, -1ll);
+    ssize_t bufIndex = AMediaCodec_dequeueOutputBuffer(pMEncoder->m_VideoEncoder, &BufInfo, -1ll);
     if ((bufIndex < 0) && (bufIndex != AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED))
     {
         return MCODEC_ERROR;
@@ -486,7 +561,7 @@ int32_t GetBitstream(SLayerBSInfo* pBsLayer)
     //if the return value is "INFO_FORMAT_CHANGED", read buffer array again.
     if (bufIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED)
     {
-        bufIndex = AMediaCodec_dequeueOutputBuffer(m_VideoEncoder, &BufInfo, -1ll);
+        bufIndex = AMediaCodec_dequeueOutputBuffer(pMEncoder->m_VideoEncoder, &BufInfo, -1ll);
         if (bufIndex < 0)
         {
             return MCODEC_ERROR;
@@ -494,7 +569,7 @@ int32_t GetBitstream(SLayerBSInfo* pBsLayer)
     }
     
     //Get an output buffer, with the buffer index that previously obtained.
-    uint8_t *outputBuffer = AMediaCodec_getOutputBuffer(m_VideoEncoder, bufIndex, &BufSize);
+    uint8_t *outputBuffer = AMediaCodec_getOutputBuffer(pMEncoder->m_VideoEncoder, bufIndex, &BufSize);
     if (outputBuffer == NULL)
     {
         return MCODEC_ERROR;
@@ -509,21 +584,21 @@ int32_t GetBitstream(SLayerBSInfo* pBsLayer)
         if (nal_type == 7)
         {
             //save SPS/PPS unit to local buffer, for repeat them every IDR frame.
-            memcpy((uint8_t *)m_SpsPpsHeader, src_buf, BufInfo.size);
-            m_SpsPpsLength = BufInfo.size;
+            memcpy((uint8_t *)pMEncoder->m_SpsPpsHeader, src_buf, BufInfo.size);
+            pMEncoder->m_SpsPpsLength = BufInfo.size;
             
             //release the output bitstream buffer, for the next encoding.
-            AMediaCodec_releaseOutputBuffer(m_VideoEncoder, bufIndex, false);
+            AMediaCodec_releaseOutputBuffer(pMEncoder->m_VideoEncoder, bufIndex, false);
             
             //lookup the buffer array again, to find out the encoded bitstream.
-            bufIndex = AMediaCodec_dequeueOutputBuffer(m_VideoEncoder, &BufInfo, -1ll);
+            bufIndex = AMediaCodec_dequeueOutputBuffer(pMEncoder->m_VideoEncoder, &BufInfo, -1ll);
             if (bufIndex < 0)
             {
                 return MCODEC_ERROR;
             }
             
             //Get an output buffer, with the buffer index that previously obtained.
-            outputBuffer = AMediaCodec_getOutputBuffer(m_VideoEncoder, bufIndex, &BufSize);
+            outputBuffer = AMediaCodec_getOutputBuffer(pMEncoder->m_VideoEncoder, bufIndex, &BufSize);
             if (outputBuffer == NULL)
             {
                 return MCODEC_ERROR;
@@ -536,8 +611,8 @@ int32_t GetBitstream(SLayerBSInfo* pBsLayer)
     {
         uint8_t *src_buf = outputBuffer;
         uint8_t *dst_buf = pBsLayer->pBsBuf;
-        uint8_t *sps_buf = (uint8_t *)m_SpsPpsHeader;
-        int32_t layerId  = m_InitParams.nSpatialId;
+        uint8_t *sps_buf = (uint8_t *)pMEncoder->m_SpsPpsHeader;
+        int32_t layerId  = pMEncoder->m_InitParams.nSpatialId;
         int32_t nal_type = src_buf[4] & 0x1F;
         
         //Define the default SVC prefix NAL unit data, for H264/AVC.
@@ -561,7 +636,7 @@ int32_t GetBitstream(SLayerBSInfo* pBsLayer)
         if (nal_type == 5)
         {
             int32_t layer_length = 0;
-            int32_t sps_length = m_SpsPpsLength;
+            int32_t sps_length = pMEncoder->m_SpsPpsLength;
             
             //Save the encoded SPS/PPS and NAL data to output buffer.
             memcpy(dst_buf, sps_buf + 4, sps_length - 4);
@@ -609,36 +684,36 @@ int32_t GetBitstream(SLayerBSInfo* pBsLayer)
         }
         
         //release the output bitstream buffer, for the next encoding.
-        AMediaCodec_releaseOutputBuffer(m_VideoEncoder, bufIndex, false);
+        AMediaCodec_releaseOutputBuffer(pMEncoder->m_VideoEncoder, bufIndex, false);
         
         //succeed to output bitstream, return state code.
         return MCODEC_SUCCEED;
     }
     
     //release the output bitstream buffer, for the next encoding.
-    AMediaCodec_releaseOutputBuffer(m_VideoEncoder, bufIndex, false);
+    AMediaCodec_releaseOutputBuffer(pMEncoder->m_VideoEncoder, bufIndex, false);
     
     //succeed to encode this frame, but no bitstream to output.
     return MCODEC_ERROR;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
-int32_t InsertKeyFrame(void)
+int32_t InsertKeyFrame(struct MSDKEncoder *pMEncoder)
 {
     //if the MSDK device was not opened, do nothing and exit.
-    if (m_CodecInitFlag == 0)
+    if ((pMEncoder == NULL) || (pMEncoder->m_CodecInitFlag == 0))
     {
         return MCODEC_ERROR;
     }
     
     //With API between 21~25, setParameters() do not supportted.
-    if (MCODEC_SUCCEED != CloseEncoder())
+    if (MCODEC_SUCCEED != CloseEncoder(pMEncoder))
     {
         return MCODEC_ERROR;
     }
     
     //Open the encoder again, which will only generate an IDR frame.
-    if (MCODEC_SUCCEED != OpenEncoder(&m_InitParams))
+    if (MCODEC_SUCCEED != OpenEncoder(pMEncoder, &pMEncoder->m_InitParams))
     {
         return MCODEC_ERROR;
     }
@@ -648,10 +723,10 @@ int32_t InsertKeyFrame(void)
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
-int32_t UpdateBitrate(uint32_t Bitrate, uint32_t Framerate)
+int32_t UpdateBitrate(struct MSDKEncoder *pMEncoder, uint32_t Bitrate, uint32_t Framerate)
 {
     //if the MSDK device was not opened, do nothing and exit.
-    if (m_CodecInitFlag == 0)
+    if ((pMEncoder == NULL) || (pMEncoder->m_CodecInitFlag == 0))
     {
         return MCODEC_ERROR;
     }
@@ -663,17 +738,17 @@ int32_t UpdateBitrate(uint32_t Bitrate, uint32_t Framerate)
     }
     
     //With API between 21~25, setParameters() do not supportted.
-    if (MCODEC_SUCCEED != CloseEncoder())
+    if (MCODEC_SUCCEED != CloseEncoder(pMEncoder))
     {
         return MCODEC_ERROR;
     }
     
     //Update the target bitrate of video encoder, only for CBR.
-    m_InitParams.nTargetKbps = Bitrate;
-    m_InitParams.nFrameRate = Framerate;
+    pMEncoder->m_InitParams.nTargetKbps = Bitrate;
+    pMEncoder->m_InitParams.nFrameRate = Framerate;
     
     //Open the encoder again, which will generate an IDR frame.
-    if (MCODEC_SUCCEED != OpenEncoder(&m_InitParams))
+    if (MCODEC_SUCCEED != OpenEncoder(pMEncoder, &pMEncoder->m_InitParams))
     {
         return MCODEC_ERROR;
     }
@@ -681,9 +756,3 @@ int32_t UpdateBitrate(uint32_t Bitrate, uint32_t Framerate)
     //Succeed to update target bitrate, return the results.
     return MCODEC_SUCCEED;
 }
-
-
-
-
-
-
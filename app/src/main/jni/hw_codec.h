@@ -21,6 +21,8 @@
 #define VIDEO_CODEC_TYPE_HEVC      2
 #define VIDEO_CODEC_TYPE_VC1       3
 
+#define MSDK_DEFAULT_INSTANCE_LIMIT  4
+
 
 //the Intel MSDK encoder single pipeline interface parameters.
 typedef struct
@@ -46,27 +48,31 @@ typedef struct
 }MSdkInputParam;
 
 /////////////////////////////////////////////////////////////////////////////////////
-    
-    //Create the Intel MSDK encoder pipeline, and configure it.
-    int32_t OpenEncoder(MSdkInputParam *InputParam);
-    
-    //Delete the Intel MSDK encoder and release memory.
-    int32_t CloseEncoder(void);
-    
-    //Encode a frame asynchronously, without outputing bitstream.
-    int32_t EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer);
-    
-    //Synchronize the encoder and output bitstream data.
-    int32_t GetBitstream(SLayerBSInfo* pBsLayer);
-    
-    //Update the target bitrate online of specified pipeline.
-    int32_t UpdateBitrate(uint32_t Bitrate, uint32_t Framerate);
-    
-    //Request to encoder the current frame as IDR frame.
-    int32_t InsertKeyFrame(void);
-    
+//Each encoder instance owns its codec state. The calls on one instance are not
+//reentrant and should be made from one thread, or serialized by the caller;
+//different instances could be used from different threads concurrently.
+struct MSDKEncoder;
+
+//Create an MSDK encoder instance, return NULL if the device limit is reached.
+struct MSDKEncoder *CreateEncoder(MSdkInputParam *InputParam);
+
+//Delete the MSDK encoder instance and release memory.
+void DeleteEncoder(struct MSDKEncoder *pMEncoder);
+
+//Set the max number of encoder instances that the device codec supports.
+int32_t SetEncoderInstanceLimit(uint32_t Limit);
+
+//Encode a frame asynchronously, without outputing bitstream.
+int32_t EncodeFrame(struct MSDKEncoder *pMEncoder, SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer);
+
+//Synchronize the encoder and output bitstream data.
+int32_t GetBitstream(struct MSDKEncoder *pMEncoder, SLayerBSInfo* pBsLayer);
+
+//Update the target bitrate online of specified pipeline.
+int32_t UpdateBitrate(struct MSDKEncoder *pMEncoder, uint32_t Bitrate, uint32_t Framerate);
 
-   
+//Request to encoder the current frame as IDR frame.
+int32_t InsertKeyFrame(struct MSDKEncoder *pMEncoder);
 
 #endif  // End of __GPU_MSDK_CODEC_H__
 
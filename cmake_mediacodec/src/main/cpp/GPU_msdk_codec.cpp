@@ -1,12 +1,96 @@
 /////////////////////////////////////////////////////////////////////////////////////
 
 #include "GPU_msdk_codec.h"
+#ifdef MCODEC_OPENH264
+#include "GPU_soft_codec.h"
+#endif
 #include "image_scaler.h"
+#include "nal_parser.h"
+#include "trace_events.h"
 #include "include/GPU_codec_api.h"
 
-#include "media/NdkMediaCodec.h"
-#include "media/NdkMediaError.h"
-#include "media/NdkMediaFormat.h"
+/////////////////////////////////////////////////////////////////////////////////////
+//The SVC prefix NAL units for H264/AVC, indexed by IDR type and spatial layerId,
+//the temporal_id is filled per layer when the encoder is opened.
+static const uint8_t s_SvcPrefixNal[2][8][MSDK_SVC_PREFIX_LENGTH] =
+{
+    {
+        {0x00, 0x00, 0x00, 0x01, 0x2E, 0x80, 0x80, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x2E, 0x80, 0x90, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x2E, 0x80, 0xA0, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x2E, 0x80, 0xB0, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x2E, 0x80, 0xC0, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x2E, 0x80, 0xD0, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x2E, 0x80, 0xE0, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x2E, 0x80, 0xF0, 0x07, 0x20},
+    },
+    {
+        {0x00, 0x00, 0x00, 0x01, 0x6E, 0xC0, 0x80, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x6E, 0xC0, 0x90, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x6E, 0xC0, 0xA0, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x6E, 0xC0, 0xB0, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x6E, 0xC0, 0xC0, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x6E, 0xC0, 0xD0, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x6E, 0xC0, 0xE0, 0x07, 0x20},
+        {0x00, 0x00, 0x00, 0x01, 0x6E, 0xC0, 0xF0, 0x07, 0x20},
+    },
+};
+
+//the hardware encoder is blocked for the device, only software encoders are created.
+static std::atomic<bool> s_HardwareBlocked(false);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Append a segment to the borrowed bitstream, and record the NAL units in it.
+//the segment always starts a new NAL unit, with or without the start code.
+static void AddSegment(MSdkBitstream* pBitstream, const uint8_t* pData, int32_t Length,
+                       const MSdkNalUnit* pNalUnits, int32_t NalCount, uint32_t CodecType)
+{
+    MSdkNalUnit LocalUnits[MAX_NAL_UNITS_IN_LAYER];
+    
+    //Split the small segment here, if the caller has not parsed it.
+    if (pNalUnits == NULL)
+    {
+        NalCount  = nal_SplitAnnexB(pData, Length, LocalUnits, MAX_NAL_UNITS_IN_LAYER, CodecType);
+        pNalUnits = LocalUnits;
+    }
+    
+    pBitstream->Segments[pBitstream->SegmentCount].iov_base = (void *)pData;
+    pBitstream->Segments[pBitstream->SegmentCount].iov_len  = Length;
+    pBitstream->SegmentCount++;
+    
+    //the NAL units beyond the limit are merged into the last one.
+    for (int32_t i = 0; i < NalCount; i++)
+    {
+        if (pBitstream->NalCount < MAX_NAL_UNITS_IN_LAYER)
+        {
+            pBitstream->NalLengthInByte[pBitstream->NalCount++] = pNalUnits[i].Length;
+        }
+        else
+        {
+            pBitstream->NalLengthInByte[MAX_NAL_UNITS_IN_LAYER - 1] += pNalUnits[i].Length;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Map the rate control of the input parameters to the MediaCodec bitrate-mode.
+static int32_t MapRCMode(int32_t RCMode)
+{
+    switch (RCMode)
+    {
+        case MSDK_RC_MODE_CQ:
+            return MSDK_BITRATE_MODE_CQ;
+        
+        case MSDK_RC_MODE_VBR:
+            return MSDK_BITRATE_MODE_VBR;
+        
+        case MSDK_RC_MODE_CBR:
+            return MSDK_BITRATE_MODE_CBR;
+        
+        default:
+            return MSDK_BITRATE_MODE_DEFAULT;
+    }
+}
 
 /////////////////////////////////////////////////////////////////////////////////////
 CMSDKEncoder::CMSDKEncoder(void)
@@ -15,9 +99,34 @@ CMSDKEncoder::CMSDKEncoder(void)
     m_CodecInitFlag    = 0;
     m_ForDatashare     = 0;
     m_nFramesProcessed = 0;
-    m_SpsPpsLength     = 0;
+    m_nFramesOutput    = 0;
+    m_nOpened          = 0;
+    m_nBorrowedBuffers.store(0);
+    m_SentSetGeneration = 0;
+    m_nTemporalLayers  = 1;
+    m_nTemporalFrame   = 0;
+    m_LastReference    = false;
+    m_nKeyFrameInput.store(0);
+    m_nBitrateMode     = MSDK_BITRATE_MODE_DEFAULT;
+    m_RcDrainedBytes   = 0;
+    m_RcLastTimeStamp  = -1;
     m_VideoEncoder     = NULL;
-    m_VideoFormat      = NULL;
+    m_nLtrFrames       = 0;
+    m_LtrAckedSlot     = -1;
+    m_LtrUseSlot       = -1;
+    m_nLtrMarkFrame    = 0;
+    m_RcOutputBytes.store(0);
+    memset(&m_FrameOutput, 0, sizeof(MSdkFrameBuffer));
+    
+    //the latency is counted for the whole life of the instance.
+    for (int32_t i = 0; i < MSDK_LATENCY_FRAMES; i++)
+    {
+        m_FrameTiming[i].TimeStamp.store(-1);
+    }
+    for (int32_t i = 0; i < MSDK_LATENCY_STAGES; i++)
+    {
+        latency_Reset(&m_Latency[i]);
+    }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -28,46 +137,70 @@ CMSDKEncoder::~CMSDKEncoder(void)
     {
         CloseEncoder();
     }
+    
+    bitstream_FreeFrame(&m_FrameOutput);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
 VM_MSDKEncoder* VM_MSDKEncoder::CreateEncoder(MSdkInputParam *InputParam)
 {
-    CMSDKEncoder *pMEncoder = NULL;
+    //the software encoder is requested, or the hardware one is blocked.
+    bool software = (InputParam->nBackend == MSDK_BACKEND_OPENH264) || s_HardwareBlocked.load();
     
     //Create the Intel MSDK encoder pipeline, and configure it.
-    pMEncoder = new (std::nothrow)CMSDKEncoder;
-    if (pMEncoder != NULL)
+    if (!software)
     {
-        int32_t status = pMEncoder->OpenEncoder(InputParam);
-        if (status != MCODEC_SUCCEED)
+        CMSDKEncoder *pMEncoder = new (std::nothrow)CMSDKEncoder;
+        if (pMEncoder != NULL)
         {
+            int32_t status = pMEncoder->OpenEncoder(InputParam);
+            if (status == MCODEC_SUCCEED)
+            {
+                return (VM_MSDKEncoder*)pMEncoder;
+            }
             delete pMEncoder;
-            return NULL;
         }
     }
+
+#ifdef MCODEC_OPENH264
+    //fall back to the OpenH264 encoder, when no hardware encoder could be opened.
+    CSoftEncoder *pSEncoder = new (std::nothrow)CSoftEncoder;
+    if (pSEncoder != NULL)
+    {
+        int32_t status = pSEncoder->OpenEncoder(InputParam);
+        if (status == MCODEC_SUCCEED)
+        {
+            return (VM_MSDKEncoder*)pSEncoder;
+        }
+        delete pSEncoder;
+    }
+#endif
     
-    //return the pointer of the allocated encoder instance.
-    return (VM_MSDKEncoder*)pMEncoder;
+    return NULL;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
 void VM_MSDKEncoder::DeleteEncoder(VM_MSDKEncoder *pMEncoder)
 {
-    //Delete the Intel MSDK encoder and release memory.
+    //Delete the encoder, which is closed by its destructor.
     if (pMEncoder != NULL)
     {
-        ((CMSDKEncoder *)pMEncoder)->CloseEncoder();
         delete pMEncoder;
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+void VM_MSDKEncoder::SetHardwareBlocked(bool Blocked)
+{
+    s_HardwareBlocked.store(Blocked);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////
 int32_t CMSDKEncoder::OpenEncoder(MSdkInputParam *InputParam)
 {
-    media_status_t sts = AMEDIA_OK;
+    int32_t sts = MCODEC_SUCCEED;
     
-    //Only one instance of MSDK encoder could be created now.
+    //Every instance keeps its own codec state, and could be opened once.
     if (m_CodecInitFlag != 0)
     {
         return MCODEC_ERROR;
@@ -86,63 +219,314 @@ int32_t CMSDKEncoder::OpenEncoder(MSdkInputParam *InputParam)
     m_InitParams.nTemporalLayers = InputParam->nTemporalLayers;
     m_InitParams.nSpatialId      = InputParam->nSpatialId;
     m_InitParams.nMemType        = InputParam->nMemType;
+    m_InitParams.nCodecType      = InputParam->nCodecType;
+    m_InitParams.nRCMode         = InputParam->nRCMode;
+    m_InitParams.nLatencyBudgetMs = InputParam->nLatencyBudgetMs;
+    m_InitParams.nBackend        = InputParam->nBackend;
+    m_InitParams.nLtrFrames      = InputParam->nLtrFrames;
+    m_InitParams.nSliceMode      = InputParam->nSliceMode;
+    m_InitParams.nSliceArgument  = InputParam->nSliceArgument;
+    
+    //Only the H264/AVC and H265/HEVC encoders are supported now.
+    const char *mime = NULL;
+    if (m_InitParams.nCodecType == VIDEO_CODEC_TYPE_AVC)
+    {
+        mime = "video/avc";
+    }
+    else if (m_InitParams.nCodecType == VIDEO_CODEC_TYPE_HEVC)
+    {
+        mime = "video/hevc";
+    }
+    else
+    {
+        return MCODEC_ERROR;
+    }
     
-    //create a mediacodec encoder instance.
-    m_VideoEncoder = AMediaCodec_createEncoderByType("video/avc");
+    //create the encoder instance of the backend, mediacodec on the device.
+    m_VideoEncoder = backend_Create(m_InitParams.nBackend);
     if (m_VideoEncoder == NULL)
     {
         return MCODEC_ERROR;
     }
     
-    //create the media format configure instance.
-    if (m_VideoFormat == NULL)
+    if (m_VideoEncoder->Create(mime) != MCODEC_SUCCEED)
     {
-        m_VideoFormat = AMediaFormat_new();
-        if (m_VideoFormat == NULL)
-        {
-            return MCODEC_ERROR;
-        }
+        delete m_VideoEncoder;
+        m_VideoEncoder = NULL;
+        return MCODEC_ERROR;
     }
     
-    //update the encoder input and output format.
-    AMediaFormat_setInt32(m_VideoFormat, "width", m_InitParams.nWidth);
-    AMediaFormat_setInt32(m_VideoFormat, "height", m_InitParams.nHeight);
-    AMediaFormat_setString(m_VideoFormat, "mime", "video/avc");
-    AMediaFormat_setInt32(m_VideoFormat, "color-format", 19);
-    AMediaFormat_setInt32(m_VideoFormat, "bitrate", m_InitParams.nTargetKbps * 1000);
-    AMediaFormat_setFloat(m_VideoFormat, "frame-rate", m_InitParams.nFrameRate);
-    AMediaFormat_setInt32(m_VideoFormat, "i-frame-interval", 5);
+    //the temporal layers are encoded with the android ts-schema, 3 layers at most.
+    m_nTemporalLayers = m_InitParams.nTemporalLayers;
+    if (m_nTemporalLayers < 1)
+    {
+        m_nTemporalLayers = 1;
+    }
+    else if (m_nTemporalLayers > MSDK_MAX_TEMPORAL_LAYERS)
+    {
+        m_nTemporalLayers = MSDK_MAX_TEMPORAL_LAYERS;
+    }
+    
+    //the long-term references are found by frame_num, which is H264/AVC only.
+    m_nLtrFrames = m_InitParams.nLtrFrames;
+    if ((m_nLtrFrames > MSDK_MAX_LTR_FRAMES) || (m_InitParams.nCodecType != VIDEO_CODEC_TYPE_AVC))
+    {
+        m_nLtrFrames = (m_InitParams.nCodecType != VIDEO_CODEC_TYPE_AVC) ? 0 : MSDK_MAX_LTR_FRAMES;
+    }
+    
+    //the rate control mode is probed by configure, the requested one first.
+    m_nBitrateMode = MapRCMode(m_InitParams.nRCMode);
     
     //configure and initialize the encoder.
-    uint32_t flags = AMEDIACODEC_CONFIGURE_FLAG_ENCODE;
-    sts = AMediaCodec_configure(m_VideoEncoder, m_VideoFormat, NULL, NULL, flags);
-    if (sts != AMEDIA_OK)
+    sts = ConfigureEncoder(mime);
+    while (sts != MCODEC_SUCCEED)
     {
-        AMediaCodec_delete(m_VideoEncoder);
-        m_VideoEncoder = NULL;
-        return MCODEC_ERROR;
+        //drop the settings the device refuses one by one, CBR/CQ falls back to
+        //VBR, then the vendor default mode, then a single temporal layer.
+        if ((m_nBitrateMode == MSDK_BITRATE_MODE_CBR) || (m_nBitrateMode == MSDK_BITRATE_MODE_CQ))
+        {
+            m_nBitrateMode = MSDK_BITRATE_MODE_VBR;
+        }
+        else if (m_nBitrateMode == MSDK_BITRATE_MODE_VBR)
+        {
+            m_nBitrateMode = MSDK_BITRATE_MODE_DEFAULT;
+        }
+        else if (m_nTemporalLayers > 1)
+        {
+            m_nTemporalLayers = 1;
+        }
+        else
+        {
+            delete m_VideoEncoder;
+            m_VideoEncoder = NULL;
+            return MCODEC_ERROR;
+        }
+        
+        //the codec is in error state after a failed configure, create it again.
+        if (m_VideoEncoder->Create(mime) != MCODEC_SUCCEED)
+        {
+            delete m_VideoEncoder;
+            m_VideoEncoder = NULL;
+            return MCODEC_ERROR;
+        }
+        sts = ConfigureEncoder(mime);
     }
     
     //start the android hardware video encoder device.
-    sts = AMediaCodec_start(m_VideoEncoder);
-    if (sts != AMEDIA_OK)
+    sts = m_VideoEncoder->Start();
+    if (sts != MCODEC_SUCCEED)
     {
-        AMediaCodec_delete(m_VideoEncoder);
+        delete m_VideoEncoder;
         m_VideoEncoder = NULL;
         return MCODEC_ERROR;
     }
     
     //Reset and initialize the local MSDK control parameters.
-    memset(m_SpsPpsHeader, 0, sizeof(m_SpsPpsHeader));
+    m_ParamSets.Reset(m_InitParams.nCodecType);
+    m_ParamSets.ReleaseRetired();
+    
+    //the SVC prefix units of the spatial layer, one for every temporal layer.
+    for (int32_t idr = 0; idr < 2; idr++)
+    {
+        for (int32_t tid = 0; tid < MSDK_MAX_TEMPORAL_LAYERS; tid++)
+        {
+            memcpy(m_SvcPrefixNal[idr][tid], s_SvcPrefixNal[idr][m_InitParams.nSpatialId & 0x07], MSDK_SVC_PREFIX_LENGTH);
+            m_SvcPrefixNal[idr][tid][7] = (uint8_t)((tid << 5) | 0x07);
+        }
+    }
+    
+    m_nTemporalFrame   = 0;
+    m_LastReference    = false;
+    m_nKeyFrameInput.store(0);
+    m_RcDrainedBytes   = 0;
+    m_RcLastTimeStamp  = -1;
+    m_RcOutputBytes.store(0);
+    m_FrcNextTimeUs    = -1;
+    
+    //the new stream starts with an IDR frame, no reference is kept over it.
+    for (int32_t i = 0; i < MSDK_MAX_LTR_FRAMES; i++)
+    {
+        m_LtrSlots[i].TimeStamp = -1;
+        m_LtrSlots[i].FrameNum  = -1;
+        m_LtrSlots[i].Acked     = false;
+    }
+    m_LtrAckedSlot     = -1;
+    m_LtrUseSlot       = -1;
+    m_nLtrMarkFrame    = 0;
+    
+    //the drop level is kept over the reopen for a rate or key frame request,
+    //the device is not faster than before.
+    if (m_nOpened++ == 0)
+    {
+        m_DropScheduler.Configure(m_InitParams.nLatencyBudgetMs);
+    }
+    m_DropScheduler.ResetInFlight();
     m_ForDatashare     = 0;
     m_nFramesProcessed = 0;
-    m_SpsPpsLength     = 0;
+    m_nFramesOutput    = 0;
+    m_nBorrowedBuffers.store(0);
     m_CodecInitFlag    = 1;
     
     //Succed to open the MSDK encoder, return the result.
     return MCODEC_SUCCEED;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncoder::ConfigureEncoder(const char *mime)
+{
+    MSdkBackendFormat format;
+    
+    //update the encoder input and output format.
+    format.Mime           = mime;
+    format.Width          = m_InitParams.nWidth;
+    format.Height         = m_InitParams.nHeight;
+    format.ColorFormat    = 19;
+    format.Bitrate        = m_InitParams.nTargetKbps * 1000;
+    format.FrameRate      = m_InitParams.nFrameRate;
+    format.IFrameInterval = 5;
+    
+    //request the L1T2 or L1T3 reference structure, since API 25.
+    format.TemporalLayers = m_nTemporalLayers.load();
+    
+    //the rate control mode, or the vendor default if it is not set.
+    format.BitrateMode    = m_nBitrateMode;
+    
+    //the long-term reference frames of the vendor extension.
+    format.LtrFrames      = m_nLtrFrames;
+    
+    //the slices limited by size, every slice NAL unit fits in a packet.
+    format.SliceBytes     = 0;
+    if (m_InitParams.nSliceMode == SM_SIZELIMITED_SLICE)
+    {
+        format.SliceBytes = m_InitParams.nSliceArgument;
+    }
+    
+    return m_VideoEncoder->Configure(&format);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+bool CMSDKEncoder::CheckOvershoot(uint64_t TimeStamp)
+{
+    int64_t output_bytes = m_RcOutputBytes.load();
+    
+    //the constant quality mode has no bitrate target to keep.
+    if ((m_nBitrateMode == MSDK_BITRATE_MODE_CQ) || (m_InitParams.nTargetKbps == 0))
+    {
+        return false;
+    }
+    
+    //drain the bucket with the target bitrate, by the elapsed time of frames.
+    if ((m_RcLastTimeStamp >= 0) && ((int64_t)TimeStamp > m_RcLastTimeStamp))
+    {
+        m_RcDrainedBytes += ((int64_t)TimeStamp - m_RcLastTimeStamp) * m_InitParams.nTargetKbps / 8;
+    }
+    m_RcLastTimeStamp = (int64_t)TimeStamp;
+    
+    //an empty bucket saves no credit, for the later frames to burst.
+    if (m_RcDrainedBytes > output_bytes)
+    {
+        m_RcDrainedBytes = output_bytes;
+    }
+    
+    //skip the frame when the bytes above the target exceed the bucket size.
+    int64_t bucket_size = (int64_t)m_InitParams.nTargetKbps * MSDK_RC_BUCKET_MS / 8;
+    return (output_bytes - m_RcDrainedBytes) > bucket_size;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+bool CMSDKEncoder::CheckFrameRate(int64_t TimeStamp)
+{
+    uint32_t in_rate  = m_InitParams.InFrameRate;
+    uint32_t out_rate = m_InitParams.nFrameRate;
+    
+    //no decimation if the input is not faster than the target.
+    if ((in_rate == 0) || (out_rate == 0) || (in_rate <= out_rate))
+    {
+        return false;
+    }
+    
+    //the frame is kept if it comes at most half an input interval before the due
+    //time, so a jittered timestamp does not skip the frame which should be kept.
+    int64_t time_us     = TimeStamp * 1000;
+    int64_t interval_us = 1000000 / out_rate;
+    int64_t jitter_us   = 500000 / in_rate;
+    
+    //start the pacing at the first frame, and restart it when the timestamp goes
+    //back or jumps over a whole interval, for a new stream or a capture gap.
+    if ((m_FrcNextTimeUs < 0) || (time_us + interval_us < m_FrcNextTimeUs) ||
+        (time_us > m_FrcNextTimeUs + interval_us))
+    {
+        m_FrcNextTimeUs = time_us + interval_us;
+        return false;
+    }
+    
+    if (time_us + jitter_us < m_FrcNextTimeUs)
+    {
+        return true;
+    }
+    
+    //the due time moves on by the target interval, not from this timestamp, so
+    //the kept frames are paced to the target rate on average.
+    m_FrcNextTimeUs += interval_us;
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncoder::GetTemporalId(bool KeyFrame, bool Reference)
+{
+    //the layering restarts from the base layer at every key frame.
+    if (KeyFrame)
+    {
+        m_nTemporalFrame = 0;
+        m_LastReference  = true;
+        return 0;
+    }
+    
+    //two reference pictures in a row, the encoder ignores the ts-schema. the
+    //upper layers would be referenced, so all pictures are put to base layer.
+    if ((m_nTemporalLayers > 1) && Reference && m_LastReference)
+    {
+        m_nTemporalLayers = 1;
+    }
+    m_LastReference = Reference;
+    
+    if (m_nTemporalLayers == 1)
+    {
+        return 0;
+    }
+    
+    //the non-reference pictures are the top layer, as 0-1-0-1 or 0-2-1-2.
+    if (!Reference)
+    {
+        return m_nTemporalLayers - 1;
+    }
+    
+    //the reference pictures of L1T3 are on layer 0 and 1 by turns.
+    m_nTemporalFrame++;
+    return (m_nTemporalLayers == 3) ? (int32_t)(m_nTemporalFrame & 1) : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+uint32_t CMSDKEncoder::GetInputTemporalId(void)
+{
+    //the frames are output in the queued order, and the layering restarts at the
+    //last key frame output, so the position after it gives the same pattern.
+    uint32_t layers   = m_nTemporalLayers.load();
+    uint32_t position = m_nFramesProcessed - m_nKeyFrameInput.load();
+    
+    if ((layers <= 1) || (position == 0))
+    {
+        return 0;
+    }
+    
+    //the odd positions are the top layer, the even ones are the references.
+    if (position & 1)
+    {
+        return layers - 1;
+    }
+    return (layers == 3) ? ((position >> 1) & 1) : 0;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////
 int32_t CMSDKEncoder::CloseEncoder()
 {
@@ -155,18 +539,11 @@ int32_t CMSDKEncoder::CloseEncoder()
     //Update the MSDK initialize flag to close device.
     if (m_VideoEncoder != NULL)
     {
-        AMediaCodec_stop(m_VideoEncoder);
-        AMediaCodec_delete(m_VideoEncoder);
+        m_VideoEncoder->Stop();
+        delete m_VideoEncoder;
         m_VideoEncoder = NULL;
     }
     
-    //delete the video format instance when close device.
-    if (m_VideoFormat != NULL)
-    {
-        AMediaFormat_delete(m_VideoFormat);
-        m_VideoFormat = NULL;
-    }
-    
     //Update the MSDK initialize flag to close device.
     m_CodecInitFlag = 0;
     
@@ -177,7 +554,9 @@ int32_t CMSDKEncoder::CloseEncoder()
 /////////////////////////////////////////////////////////////////////////////////////
 int32_t CMSDKEncoder::EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer)
 {
+    CTraceScope trace("EncodeFrame");
     size_t BufSize = 0;
+    int64_t StartUs = latency_NowUs();
     
     //if the MSDK device was not opened, do nothing and exit.
     if (m_CodecInitFlag == 0)
@@ -191,15 +570,41 @@ int32_t CMSDKEncoder::EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLaye
         return MCODEC_ERROR;
     }
     
+    //the input is faster than the target frame rate, skip this frame.
+    if ((pSrcPic != NULL) && CheckFrameRate(pSrcPic->uiTimeStamp))
+    {
+        return MCODEC_SKIPPED;
+    }
+    
+    //the encoder falls behind the latency budget, drop this frame.
+    if (m_DropScheduler.ShouldDrop(m_nTemporalLayers.load(), GetInputTemporalId()))
+    {
+        return MCODEC_SKIPPED;
+    }
+    
+    //the encoder output is too far above the target bitrate, drop this frame.
+    if ((pSrcPic != NULL) && CheckOvershoot(pSrcPic->uiTimeStamp))
+    {
+        return MCODEC_SKIPPED;
+    }
+    
     //Get a memory block from buffer array to save YUV frame.
-    ssize_t bufIndex = AMediaCodec_dequeueInputBuffer(m_VideoEncoder, -1ll);
+    int64_t WaitUs = latency_NowUs();
+    ssize_t bufIndex = -1;
+    {
+        CTraceScope wait_trace("WaitInputBuffer");
+        bufIndex = m_VideoEncoder->DequeueInputBuffer(MSDK_INPUT_TIMEOUT_US);
+    }
     if (bufIndex < 0)
     {
         return MCODEC_ERROR;
     }
     
+    int64_t ScaleUs = latency_NowUs();
+    latency_Record(&m_Latency[MSDK_LATENCY_INPUT_WAIT], ScaleUs - WaitUs);
+    
     //Get an input buffer, with the buffer index that previously obtained.
-    uint8_t *inputBuffer = AMediaCodec_getInputBuffer(m_VideoEncoder, bufIndex, &BufSize);
+    uint8_t *inputBuffer = m_VideoEncoder->GetInputBuffer(bufIndex, &BufSize);
     if (inputBuffer == NULL)
     {
         return MCODEC_ERROR;
@@ -218,6 +623,7 @@ int32_t CMSDKEncoder::EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLaye
     //scale the input image to encoder size.
     if ((srcWidth != dstWidth) || (srcHeight != dstHeight))
     {
+        CTraceScope scale_trace("I420Scale");
         scaler_I420Scale(pSrcPic->pData[0], pSrcPic->iStride[0],
                          pSrcPic->pData[1], pSrcPic->iStride[1],
                          pSrcPic->pData[2], pSrcPic->iStride[2],
@@ -231,6 +637,7 @@ int32_t CMSDKEncoder::EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLaye
     //with the same frame size, copy YUV image to encoder buffer.
     else
     {
+        CTraceScope scale_trace("I420Mirror");
         scaler_I420Mirror(pSrcPic->pData[0], pSrcPic->iStride[0],
                           pSrcPic->pData[1], pSrcPic->iStride[1],
                           pSrcPic->pData[2], pSrcPic->iStride[2],
@@ -240,83 +647,118 @@ int32_t CMSDKEncoder::EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLaye
                           dstWidth, dstHeight);
     }
     
+    int64_t QueuedUs = latency_NowUs();
+    latency_Record(&m_Latency[MSDK_LATENCY_SCALE], QueuedUs - ScaleUs);
+    
+    //save the stage times before queueing, the output may come at once.
+    MSdkFrameTiming *pTiming = &m_FrameTiming[m_nFramesProcessed % MSDK_LATENCY_FRAMES];
+    pTiming->TimeStamp.store(-1);
+    pTiming->StartUs.store(StartUs, std::memory_order_relaxed);
+    pTiming->QueuedUs.store(QueuedUs, std::memory_order_relaxed);
+    pTiming->TimeStamp.store(pSrcPic->uiTimeStamp);
+    
     //put the incoming frame to the encoding queue to encode.
-    media_status_t sts = AMEDIA_OK;
+    int32_t sts = MCODEC_SUCCEED;
     uint64_t time = pSrcPic->uiTimeStamp * 1000;
     
-    sts = AMediaCodec_queueInputBuffer(m_VideoEncoder, bufIndex, 0, BufSize, time, 0);
-    if (sts != AMEDIA_OK)
+    ApplyLtr(pSrcPic->uiTimeStamp);
+    sts = m_VideoEncoder->QueueInputBuffer(bufIndex, BufSize, time, 0);
+    if (sts != MCODEC_SUCCEED)
     {
+        pTiming->TimeStamp.store(-1);
         return MCODEC_ERROR;
     }
     
     //Update the total encoded frame counter for debug.
     m_nFramesProcessed++;
+    m_DropScheduler.OnQueued();
     
     //Succeed to start the MSDK encoder, return the results.
     return MCODEC_SUCCEED;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
-int32_t CMSDKEncoder::GetBitstream(SLayerBSInfo* pBsLayer)
+int32_t CMSDKEncoder::DequeueOutput(MSdkBufferInfo *pBufInfo, uint8_t **ppOutput, ssize_t *pIndex)
 {
+    CTraceScope trace("WaitOutputBuffer");
     size_t BufSize = 0;
-    AMediaCodecBufferInfo BufInfo;
     
-    //if the MSDK device was not opened, do nothing and exit.
-    if (m_CodecInitFlag == 0)
+    //Get bitstream buffer from android buffer array, with a bounded wait.
+    ssize_t bufIndex = m_VideoEncoder->DequeueOutputBuffer(pBufInfo, MSDK_OUTPUT_TIMEOUT_US);
+    if (bufIndex == MSDK_BACKEND_TRY_AGAIN)
     {
-        return MCODEC_ERROR;
+        return MCODEC_SKIPPED;
     }
-    
-    //Get bitstream buffer from android buffer array, with blocking mode.
-    ssize_t bufIndex = AMediaCodec_dequeueOutputBuffer(m_VideoEncoder, &BufInfo, -1ll);
-    if ((bufIndex < 0) && (bufIndex != AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED))
+    if ((bufIndex < 0) && (bufIndex != MSDK_BACKEND_FORMAT_CHANGED))
     {
         return MCODEC_ERROR;
     }
     
     //if the return value is "INFO_FORMAT_CHANGED", read buffer array again.
-    if (bufIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED)
+    if (bufIndex == MSDK_BACKEND_FORMAT_CHANGED)
     {
-        bufIndex = AMediaCodec_dequeueOutputBuffer(m_VideoEncoder, &BufInfo, -1ll);
+        bufIndex = m_VideoEncoder->DequeueOutputBuffer(pBufInfo, MSDK_OUTPUT_TIMEOUT_US);
         if (bufIndex < 0)
         {
-            return MCODEC_ERROR;
+            return (bufIndex == MSDK_BACKEND_TRY_AGAIN) ? MCODEC_SKIPPED : MCODEC_ERROR;
         }
     }
     
     //Get an output buffer, with the buffer index that previously obtained.
-    uint8_t *outputBuffer = AMediaCodec_getOutputBuffer(m_VideoEncoder, bufIndex, &BufSize);
+    uint8_t *outputBuffer = m_VideoEncoder->GetOutputBuffer(bufIndex, &BufSize);
     if (outputBuffer == NULL)
     {
         return MCODEC_ERROR;
     }
     
     //for SPS/PPS unit, save them and read NAL unit again.
-    if ((outputBuffer != NULL) && (BufInfo.size > 0))
+    if (pBufInfo->size > 0)
     {
-        uint8_t *src_buf = outputBuffer;
-        int32_t nal_type = src_buf[4] & 0x1F;
+        uint8_t *src_buf = outputBuffer + pBufInfo->offset;
+        MSdkNalUnit NalUnits[MAX_NAL_UNITS_IN_LAYER];
+        uint32_t codec = m_InitParams.nCodecType;
+        int32_t nal_count = nal_SplitAnnexB(src_buf, pBufInfo->size, NalUnits, MAX_NAL_UNITS_IN_LAYER, codec);
+        int32_t ps_count = 0;
         
-        if (nal_type == 7)
+        //the VPS/SPS/PPS units are at the head of buffer, maybe followed by slices.
+        while ((ps_count < nal_count) && nal_IsParamSet(NalUnits[ps_count].NalType, codec))
+        {
+            ps_count++;
+        }
+        
+        //save each parameter set by its id, for repeat them every IDR frame. a set
+        //replaced with new content is sent with the next frame, and traced.
+        for (int32_t i = 0; i < ps_count; i++)
+        {
+            int32_t sc_len = NalUnits[i].StartCodeLen;
+            if ((m_ParamSets.Update(src_buf + NalUnits[i].Offset + sc_len, NalUnits[i].Length - sc_len) == MSDK_PS_CHANGED) &&
+                trace_IsEnabled())
+            {
+                trace_Record("ParamSetChanged", 'i');
+            }
+        }
+        
+        //the slices are in the same buffer, skip the SPS/PPS units.
+        if ((ps_count > 0) && (ps_count < nal_count))
+        {
+            pBufInfo->offset += NalUnits[ps_count].Offset;
+            pBufInfo->size   -= NalUnits[ps_count].Offset;
+        }
+        else if (ps_count > 0)
         {
-            //save SPS/PPS unit to local buffer, for repeat them every IDR frame.
-            memcpy((uint8_t *)m_SpsPpsHeader, src_buf, BufInfo.size);
-            m_SpsPpsLength = BufInfo.size;
-            
             //release the output bitstream buffer, for the next encoding.
-            AMediaCodec_releaseOutputBuffer(m_VideoEncoder, bufIndex, false);
+            m_VideoEncoder->ReleaseOutputBuffer(bufIndex);
             
             //lookup the buffer array again, to find out the encoded bitstream.
-            bufIndex = AMediaCodec_dequeueOutputBuffer(m_VideoEncoder, &BufInfo, -1ll);
+            //the saved parameter sets are not lost if it times out.
+            bufIndex = m_VideoEncoder->DequeueOutputBuffer(pBufInfo, MSDK_OUTPUT_TIMEOUT_US);
             if (bufIndex < 0)
             {
-                return MCODEC_ERROR;
+                return (bufIndex == MSDK_BACKEND_TRY_AGAIN) ? MCODEC_SKIPPED : MCODEC_ERROR;
             }
             
             //Get an output buffer, with the buffer index that previously obtained.
-            outputBuffer = AMediaCodec_getOutputBuffer(m_VideoEncoder, bufIndex, &BufSize);
+            outputBuffer = m_VideoEncoder->GetOutputBuffer(bufIndex, &BufSize);
             if (outputBuffer == NULL)
             {
                 return MCODEC_ERROR;
@@ -324,106 +766,328 @@ int32_t CMSDKEncoder::GetBitstream(SLayerBSInfo* pBsLayer)
         }
     }
     
-    //there is bitstream in the encoder buffer, save it to output buffer.
-    if (BufInfo.size > 0)
+    //return the output buffer and its index, the caller should release it.
+    *ppOutput = outputBuffer + pBufInfo->offset;
+    *pIndex   = bufIndex;
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncoder::LockBitstream(MSdkBitstream* pBitstream)
+{
+    CTraceScope trace("LockBitstream");
+    uint8_t *outputBuffer = NULL;
+    MSdkBufferInfo BufInfo;
+    
+    //if the MSDK device was not opened, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pBitstream == NULL))
     {
-        uint8_t *src_buf = outputBuffer;
-        uint8_t *dst_buf = pBsLayer->pBsBuf;
-        uint8_t *sps_buf = (uint8_t *)m_SpsPpsHeader;
-        int32_t layerId  = m_InitParams.nSpatialId;
-        int32_t nal_type = src_buf[4] & 0x1F;
-        
-        //Define the default SVC prefix NAL unit data, for H264/AVC.
-        uint8_t SvcPrefixCode[12] = {0x00, 0x00, 0x00, 0x01, 0x0E, 0x80, 0x80, 0x07, 0x20};
-        int32_t SvcPrefixLen = 9;
-        
-        //Update the IDR_type and Spatial layerId in SVC prefix.
-        if ((nal_type == 7) || (nal_type == 5))
-        {
-            SvcPrefixCode[4] |= 0x60;
-            SvcPrefixCode[5] |= 0x40;
-            SvcPrefixCode[6] |= ((layerId << 4) & 0x70);
-        }
-        else
+        return MCODEC_ERROR;
+    }
+    
+    //Get the output buffer with encoded bitstream, which is kept by caller.
+    ssize_t bufIndex = -1;
+    int32_t status = DequeueOutput(&BufInfo, &outputBuffer, &bufIndex);
+    if (status != MCODEC_SUCCEED)
+    {
+        return status;
+    }
+    
+    //the frame has been in the hardware since it was queued.
+    MSdkFrameTiming *pTiming = FindTiming(BufInfo.presentationTimeUs / 1000);
+    int64_t EncodeUs = -1;
+    if (pTiming != NULL)
+    {
+        int64_t OutputUs = latency_NowUs();
+        pTiming->OutputUs.store(OutputUs, std::memory_order_relaxed);
+        EncodeUs = OutputUs - pTiming->QueuedUs.load(std::memory_order_relaxed);
+        latency_Record(&m_Latency[MSDK_LATENCY_ENCODE], EncodeUs);
+    }
+    m_DropScheduler.OnOutput(EncodeUs);
+    uint32_t OutputIndex = m_nFramesOutput++;
+    
+    //succeed to encode this frame, but no bitstream to output.
+    if (BufInfo.size <= 0)
+    {
+        m_VideoEncoder->ReleaseOutputBuffer(bufIndex);
+        return MCODEC_ERROR;
+    }
+    
+    uint8_t *src_buf = outputBuffer;
+    int32_t layerId  = m_InitParams.nSpatialId;
+    uint32_t codec   = m_InitParams.nCodecType;
+    bool IdrFrame    = false;
+    bool KeyFrame    = false;
+    int32_t TemporalId = 0;
+    
+    //Split the encoded data into NAL units, to find out the IDR/IRAP slices.
+    MSdkNalUnit NalUnits[MAX_NAL_UNITS_IN_LAYER];
+    int32_t nal_count = nal_SplitAnnexB(src_buf, BufInfo.size, NalUnits, MAX_NAL_UNITS_IN_LAYER, codec);
+    for (int32_t i = 0; i < nal_count; i++)
+    {
+        if (nal_IsIRAP(NalUnits[i].NalType, codec))
         {
-            SvcPrefixCode[4] |= 0x20;
-            SvcPrefixCode[6] |= ((layerId << 4) & 0x70);
+            IdrFrame = nal_IsIDR(NalUnits[i].NalType, codec);
+            KeyFrame = true;
+            break;
         }
+    }
+    
+    //the input side predicts the layers from this key frame on.
+    if (KeyFrame)
+    {
+        m_nKeyFrameInput.store(OutputIndex);
+    }
+    
+    //the HEVC NAL header carries the temporal id of the picture.
+    if ((codec == VIDEO_CODEC_TYPE_HEVC) && (nal_count > 0))
+    {
+        TemporalId = NalUnits[nal_count - 1].TemporalId;
+    }
+    
+    UpdateLtr(BufInfo.presentationTimeUs / 1000, IdrFrame, src_buf, NalUnits, nal_count);
+    
+    pBitstream->SegmentCount = 0;
+    pBitstream->NalCount     = 0;
+    
+    //For key frame, lend the cached parameter sets by pointer. the sets new or
+    //changed since the last ones sent go out with this frame, before any slice
+    //refers to them.
+    uint32_t generation = m_ParamSets.GetGeneration();
+    if (KeyFrame || (generation != m_SentSetGeneration))
+    {
+        m_SentSetGeneration = generation;
         
-        //For IDR frame without SPS/PPS, copy them and output NAL data.
-        if (nal_type == 5)
+        struct iovec ParamSets[MSDK_MAX_BS_SEGMENTS - 2];
+        int32_t ps_count = m_ParamSets.GetActiveSets(ParamSets, MSDK_MAX_BS_SEGMENTS - 2);
+        
+        for (int32_t i = 0; i < ps_count; i++)
         {
-            int32_t layer_length = 0;
-            int32_t sps_length = m_SpsPpsLength;
-            
-            //Save the encoded SPS/PPS and NAL data to output buffer.
-            memcpy(dst_buf, sps_buf + 4, sps_length - 4);
-            layer_length += sps_length - 4;
-            
-            memcpy(dst_buf + layer_length, SvcPrefixCode, SvcPrefixLen);
-            layer_length += SvcPrefixLen;
-            
-            memcpy(dst_buf + layer_length, src_buf, BufInfo.size);
-            layer_length += BufInfo.size;
-            
-            //Save the spatial layer encoded parameters to output buffer.
-            pBsLayer->iNalCount = 2;
-            pBsLayer->pNalLengthInByte[0] = sps_length - 4;
-            pBsLayer->pNalLengthInByte[1] = BufInfo.size + SvcPrefixLen;
-            pBsLayer->eFrameType = videoFrameTypeIDR;
-            
-            pBsLayer->uiTemporalId = (SvcPrefixCode[7] >> 5) & 0x07;
-            pBsLayer->uiQualityId  = (SvcPrefixCode[6]) & 0x0F;
-            pBsLayer->uiSpatialId  = layerId;
-            pBsLayer->uiLayerType  = 1;
+            AddSegment(pBitstream, (uint8_t *)ParamSets[i].iov_base, ParamSets[i].iov_len, NULL, 0, codec);
         }
+    }
+    
+    //the SVC prefix NAL unit is only defined for H264/AVC, with the temporal id.
+    if ((codec == VIDEO_CODEC_TYPE_AVC) && (nal_count > 0))
+    {
+        TemporalId = GetTemporalId(KeyFrame, NalUnits[nal_count - 1].Reference != 0);
         
-        //Copy the P bitstream to output buffer without SPS/PPS.
-        else
+        const uint8_t *SvcPrefixCode = m_SvcPrefixNal[IdrFrame ? 1 : 0][TemporalId];
+        AddSegment(pBitstream, SvcPrefixCode, MSDK_SVC_PREFIX_LENGTH, NULL, 0, codec);
+    }
+    
+    //the encoded NAL data stays in the codec output buffer.
+    AddSegment(pBitstream, src_buf, BufInfo.size, NalUnits, nal_count, codec);
+    
+    pBitstream->eFrameType = IdrFrame ? videoFrameTypeIDR : (KeyFrame ? videoFrameTypeI : videoFrameTypeP);
+    
+    //Save the spatial layer encoded parameters to the bitstream.
+    pBitstream->uiTemporalId = TemporalId;
+    pBitstream->uiQualityId  = 0;
+    pBitstream->uiSpatialId  = layerId;
+    pBitstream->uiTimeStamp  = BufInfo.presentationTimeUs / 1000;
+    pBitstream->BufferIndex  = (int32_t)bufIndex;
+    
+    //count the output bytes in the leaky bucket of overshoot guard.
+    int64_t frame_bytes = 0;
+    for (int32_t i = 0; i < pBitstream->SegmentCount; i++)
+    {
+        frame_bytes += pBitstream->Segments[i].iov_len;
+    }
+    m_RcOutputBytes.fetch_add(frame_bytes);
+    
+    //the buffer is lent to caller, until UnlockBitstream() is called.
+    m_nBorrowedBuffers.fetch_add(1);
+    
+    //succeed to output bitstream, return state code.
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncoder::UnlockBitstream(MSdkBitstream* pBitstream)
+{
+    //if the MSDK device was not opened, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pBitstream == NULL) || (pBitstream->BufferIndex < 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the output stage ends when the bitstream is copied or sent by caller.
+    MSdkFrameTiming *pTiming = FindTiming(pBitstream->uiTimeStamp);
+    if (pTiming != NULL)
+    {
+        int64_t DoneUs = latency_NowUs();
+        latency_Record(&m_Latency[MSDK_LATENCY_OUTPUT], DoneUs - pTiming->OutputUs.load(std::memory_order_relaxed));
+        latency_Record(&m_Latency[MSDK_LATENCY_TOTAL], DoneUs - pTiming->StartUs.load(std::memory_order_relaxed));
+        pTiming->TimeStamp.store(-1);
+    }
+    
+    //release the output bitstream buffer, for the next encoding.
+    m_VideoEncoder->ReleaseOutputBuffer(pBitstream->BufferIndex);
+    pBitstream->BufferIndex  = -1;
+    pBitstream->SegmentCount = 0;
+    
+    //no output refers to the replaced parameter sets any more, free them.
+    if (m_nBorrowedBuffers.fetch_sub(1) == 1)
+    {
+        m_ParamSets.ReleaseRetired();
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+MSdkFrameTiming* CMSDKEncoder::FindTiming(int64_t TimeStamp)
+{
+    //the pipeline is short, look up all the slots of the frames in it.
+    for (int32_t i = 0; i < MSDK_LATENCY_FRAMES; i++)
+    {
+        if (m_FrameTiming[i].TimeStamp.load() == TimeStamp)
         {
-            int32_t layer_length = 0;
-            
-            //Save the encoded NAL data to the output buffer.
-            memcpy(dst_buf, SvcPrefixCode + 4, SvcPrefixLen - 4);
-            layer_length += SvcPrefixLen - 4;
-            
-            memcpy(dst_buf + layer_length, src_buf, BufInfo.size);
-            layer_length += BufInfo.size;
-            
-            //Save the spatial layer encoded parameters to output buffer.
-            pBsLayer->iNalCount = 1;
-            pBsLayer->pNalLengthInByte[0] = layer_length;
-            pBsLayer->eFrameType = videoFrameTypeP;
-            
-            pBsLayer->uiTemporalId = (SvcPrefixCode[7] >> 5) & 0x07;
-            pBsLayer->uiQualityId  = (SvcPrefixCode[6]) & 0x0F;
-            pBsLayer->uiSpatialId  = layerId;
-            pBsLayer->uiLayerType  = 1;
+            return &m_FrameTiming[i];
         }
-        
-        //release the output bitstream buffer, for the next encoding.
-        AMediaCodec_releaseOutputBuffer(m_VideoEncoder, bufIndex, false);
-        
-        //succeed to output bitstream, return state code.
-        return MCODEC_SUCCEED;
     }
     
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncoder::GetLatencyStats(MSdkLatencyStats* pStats)
+{
+    if (pStats == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the histograms are read without lock, while the encoder is running.
+    for (int32_t i = 0; i < MSDK_LATENCY_STAGES; i++)
+    {
+        latency_Query(&m_Latency[i], &pStats->Stages[i]);
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncoder::GetDropStats(MSdkDropStats* pStats)
+{
+    if (pStats == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    m_DropScheduler.GetStats(pStats);
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncoder::GetBitstream(SLayerBSInfo* pBsLayer)
+{
+    CTraceScope trace("GetBitstream");
+    MSdkBitstream Bitstream;
+    
+    //Borrow the bitstream from encoder, and copy it to the output buffer. the
+    //frame is waited for a bounded number of output waits.
+    int32_t status = LockBitstream(&Bitstream);
+    for (int32_t retry = 1; (status == MCODEC_SKIPPED) && (retry < MSDK_OUTPUT_RETRIES); retry++)
+    {
+        status = LockBitstream(&Bitstream);
+    }
+    if (status != MCODEC_SUCCEED)
+    {
+        return (status == MCODEC_SKIPPED) ? MCODEC_SKIPPED : MCODEC_ERROR;
+    }
+    
+    uint8_t *dst_buf = pBsLayer->pBsBuf;
+    int32_t layer_length = 0;
+    
+    //the first NAL unit of the access unit is output without start code, as before.
+    int32_t sc_len = 0;
+    if (nal_FindStartCode((uint8_t *)Bitstream.Segments[0].iov_base, Bitstream.Segments[0].iov_len, &sc_len) != 0)
+    {
+        sc_len = 0;
+    }
+    
+    for (int32_t i = 0; i < Bitstream.SegmentCount; i++)
+    {
+        int32_t skip = (i == 0) ? sc_len : 0;
+        memcpy(dst_buf + layer_length, (uint8_t *)Bitstream.Segments[i].iov_base + skip, Bitstream.Segments[i].iov_len - skip);
+        layer_length += Bitstream.Segments[i].iov_len - skip;
+    }
+    
+    //every NAL unit is reported with its own length, in the output order.
+    pBsLayer->iNalCount = Bitstream.NalCount;
+    for (int32_t i = 0; i < Bitstream.NalCount; i++)
+    {
+        pBsLayer->pNalLengthInByte[i] = Bitstream.NalLengthInByte[i];
+    }
+    if (Bitstream.NalCount > 0)
+    {
+        pBsLayer->pNalLengthInByte[0] -= sc_len;
+    }
+    
+    //Save the spatial layer encoded parameters to output buffer.
+    pBsLayer->eFrameType   = Bitstream.eFrameType;
+    pBsLayer->uiTemporalId = Bitstream.uiTemporalId;
+    pBsLayer->uiQualityId  = Bitstream.uiQualityId;
+    pBsLayer->uiSpatialId  = Bitstream.uiSpatialId;
+    pBsLayer->uiLayerType  = 1;
+    
     //release the output bitstream buffer, for the next encoding.
-    AMediaCodec_releaseOutputBuffer(m_VideoEncoder, bufIndex, false);
+    UnlockBitstream(&Bitstream);
     
-    //succeed to encode this frame, but no bitstream to output.
-    return MCODEC_ERROR;
+    //succeed to output bitstream, return state code.
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncoder::GetFrameBitstream(SFrameBSInfo* pFrameInfo)
+{
+    CTraceScope trace("GetFrameBitstream");
+    MSdkBitstream Bitstream;
+    
+    if (pFrameInfo == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //Borrow the bitstream from encoder, and copy the whole frame in one pass. the
+    //frame is waited for a bounded number of output waits.
+    int32_t status = LockBitstream(&Bitstream);
+    for (int32_t retry = 1; (status == MCODEC_SKIPPED) && (retry < MSDK_OUTPUT_RETRIES); retry++)
+    {
+        status = LockBitstream(&Bitstream);
+    }
+    if (status != MCODEC_SUCCEED)
+    {
+        return (status == MCODEC_SKIPPED) ? MCODEC_SKIPPED : MCODEC_ERROR;
+    }
+    
+    status = bitstream_CopyToFrame(&Bitstream, m_InitParams.nCodecType, &m_FrameOutput, pFrameInfo);
+    
+    //release the output buffer, the frame stays in the copy until the next call.
+    UnlockBitstream(&Bitstream);
+    
+    return status;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
 int32_t CMSDKEncoder::InsertKeyFrame(void)
 {
+    CTraceScope trace("InsertKeyFrame");
+    
     //if the MSDK device was not opened, do nothing and exit.
     if (m_CodecInitFlag == 0)
     {
         return MCODEC_ERROR;
     }
     
+    //the lent output buffers would be invalid after the encoder is reopened.
+    if (m_nBorrowedBuffers.load() != 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
     //With API between 21~25, setParameters() do not supportted.
     if (MCODEC_SUCCEED != CloseEncoder())
     {
@@ -440,9 +1104,159 @@ int32_t CMSDKEncoder::InsertKeyFrame(void)
     return MCODEC_SUCCEED;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncoder::RequestLtrRecovery(SLTRRecoverRequest* pRequest)
+{
+    CTraceScope trace("RequestLtrRecovery");
+    
+    //if the MSDK device was not opened, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pRequest == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the next frame refers to the newest reference the decoder has marked.
+    if ((pRequest->uiFeedbackType == LTR_RECOVERY_REQUEST) && (m_nLtrFrames > 0))
+    {
+        std::lock_guard<std::mutex> lock(m_LtrLock);
+        if (m_LtrAckedSlot >= 0)
+        {
+            m_LtrUseSlot = m_LtrAckedSlot;
+            return MCODEC_SUCCEED;
+        }
+    }
+    
+    //no long-term reference to recover from, the encoder is reopened for IDR.
+    return InsertKeyFrame();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncoder::SetLtrMarkingFeedback(SLTRMarkingFeedback* pFeedback)
+{
+    //if the MSDK device was not opened, or LTR is disabled, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pFeedback == NULL) || (m_nLtrFrames == 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_LtrLock);
+    
+    //the feedback is matched to the marked frame by frame_num.
+    for (uint32_t i = 0; i < m_nLtrFrames; i++)
+    {
+        MSdkLtrSlot *pSlot = &m_LtrSlots[i];
+        if ((pSlot->FrameNum < 0) || (pSlot->FrameNum != pFeedback->iLTRFrameNum))
+        {
+            continue;
+        }
+        
+        if (pFeedback->uiFeedbackType == LTR_MARKING_SUCCESS)
+        {
+            pSlot->Acked   = true;
+            m_LtrAckedSlot = i;
+        }
+        else if (pFeedback->uiFeedbackType == LTR_MARKING_FAILED)
+        {
+            pSlot->TimeStamp = -1;
+            pSlot->FrameNum  = -1;
+            pSlot->Acked     = false;
+            m_LtrAckedSlot   = (m_LtrAckedSlot == (int32_t)i) ? -1 : m_LtrAckedSlot;
+        }
+        return MCODEC_SUCCEED;
+    }
+    
+    return MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CMSDKEncoder::ApplyLtr(int64_t TimeStamp)
+{
+    if (m_nLtrFrames == 0)
+    {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_LtrLock);
+    
+    //the recovery frame refers to the acknowledged reference, as a bit mask.
+    if (m_LtrUseSlot >= 0)
+    {
+        m_VideoEncoder->SetParameter(MSDK_KEY_LTR_USE, 1 << m_LtrUseSlot);
+        m_LtrUseSlot = -1;
+    }
+    
+    //mark a new reference every period, from the IDR frame. it never replaces
+    //the acknowledged one, unless there is a single slot.
+    if ((m_nLtrMarkFrame++ % MSDK_LTR_MARK_PERIOD) != 0)
+    {
+        return;
+    }
+    
+    int32_t slot = 0;
+    if ((m_nLtrFrames > 1) && (m_LtrAckedSlot == 0))
+    {
+        slot = 1;
+    }
+    
+    if (m_VideoEncoder->SetParameter(MSDK_KEY_LTR_MARK, slot) == MCODEC_SUCCEED)
+    {
+        m_LtrSlots[slot].TimeStamp = TimeStamp;
+        m_LtrSlots[slot].FrameNum  = -1;
+        m_LtrSlots[slot].Acked     = false;
+        m_LtrAckedSlot = (m_LtrAckedSlot == slot) ? -1 : m_LtrAckedSlot;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CMSDKEncoder::UpdateLtr(int64_t TimeStamp, bool IdrFrame, const uint8_t* pBuffer,
+                             const MSdkNalUnit* pNalUnits, int32_t NalCount)
+{
+    if (m_nLtrFrames == 0)
+    {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_LtrLock);
+    
+    for (uint32_t i = 0; i < m_nLtrFrames; i++)
+    {
+        MSdkLtrSlot *pSlot = &m_LtrSlots[i];
+        
+        //an IDR frame of the encoder itself clears the older references, and a
+        //new one is marked on the next queued frame.
+        if (pSlot->TimeStamp != TimeStamp)
+        {
+            if (IdrFrame && (pSlot->TimeStamp >= 0))
+            {
+                pSlot->TimeStamp = -1;
+                pSlot->FrameNum  = -1;
+                pSlot->Acked     = false;
+                m_LtrAckedSlot   = (m_LtrAckedSlot == (int32_t)i) ? -1 : m_LtrAckedSlot;
+                m_nLtrMarkFrame  = 0;
+            }
+            continue;
+        }
+        
+        //the marked frame is output, save the frame_num of its first slice.
+        for (int32_t k = 0; k < NalCount; k++)
+        {
+            int32_t type = pNalUnits[k].NalType;
+            if ((type == NAL_AVC_SLICE) || (type == NAL_AVC_IDR_SLICE))
+            {
+                int32_t sc_len = pNalUnits[k].StartCodeLen;
+                pSlot->FrameNum = m_ParamSets.GetFrameNum(pBuffer + pNalUnits[k].Offset + sc_len,
+                                                          pNalUnits[k].Length - sc_len);
+                break;
+            }
+        }
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////
 int32_t CMSDKEncoder::UpdateBitrate(uint32_t Bitrate, uint32_t Framerate)
 {
+    CTraceScope trace("UpdateBitrate");
+    
     //if the MSDK device was not opened, do nothing and exit.
     if (m_CodecInitFlag == 0)
     {
@@ -455,6 +1269,12 @@ int32_t CMSDKEncoder::UpdateBitrate(uint32_t Bitrate, uint32_t Framerate)
         return MCODEC_ERROR;
     }
     
+    //the lent output buffers would be invalid after the encoder is reopened.
+    if (m_nBorrowedBuffers.load() != 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
     //With API between 21~25, setParameters() do not supportted.
     if (MCODEC_SUCCEED != CloseEncoder())
     {
@@ -13,13 +13,52 @@
 #include <sys/wait.h>
 #include <termios.h>
 #include <unistd.h>
+#include <atomic>
+#include <mutex>
 #include <new>
 
-#include "media/NdkMediaError.h"
-#include "media/NdkMediaFormat.h"
-#include "media/NdkMediaCodec.h"
-
 #include "include/GPU_codec_api.h"
+#include "bitstream_io.h"
+#include "codec_backend.h"
+#include "drop_scheduler.h"
+#include "latency_stats.h"
+#include "nal_parser.h"
+#include "param_sets.h"
+
+#define MSDK_SVC_PREFIX_LENGTH     9
+#define MSDK_MAX_TEMPORAL_LAYERS   3
+
+//the MediaCodec bitrate-mode values, and the overshoot guard window.
+#define MSDK_BITRATE_MODE_DEFAULT  -1
+#define MSDK_BITRATE_MODE_CQ       0
+#define MSDK_BITRATE_MODE_VBR      1
+#define MSDK_BITRATE_MODE_CBR      2
+#define MSDK_RC_BUCKET_MS          500
+
+//the frames in the encoding pipeline, whose stage times are kept.
+#define MSDK_LATENCY_FRAMES        64
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The stage times of a frame in the pipeline, keyed by the frame timestamp. the
+//input thread publishes the slot with TimeStamp, and the output thread reads it.
+typedef struct
+{
+    std::atomic<int64_t>   TimeStamp;
+    std::atomic<int64_t>   StartUs;
+    std::atomic<int64_t>   QueuedUs;
+    std::atomic<int64_t>   OutputUs;
+    
+}MSdkFrameTiming;
+
+//One long-term reference slot of the vendor extension, marked by the input side
+//and completed with its frame_num by the output side.
+typedef struct
+{
+    int64_t                TimeStamp;     // the timestamp of the marked frame, -1 if free
+    int32_t                FrameNum;      // the frame_num of the marked frame, -1 before output
+    bool                   Acked;         // the decoder has marked the reference too
+    
+}MSdkLtrSlot;
 
 /////////////////////////////////////////////////////////////////////////////////////
 class CMSDKEncoder : public VM_MSDKEncoder
@@ -40,23 +79,108 @@ public:
     //Synchronize the encoder and output bitstream data.
     virtual int32_t GetBitstream(SLayerBSInfo* pBsLayer);
     
+    //Wait for the bitstream and output the layers of the frame in encoder memory.
+    virtual int32_t GetFrameBitstream(SFrameBSInfo* pFrameInfo);
+    
+    //Synchronize the encoder and borrow the bitstream in encoder memory.
+    virtual int32_t LockBitstream(MSdkBitstream* pBitstream);
+    
+    //Give the borrowed bitstream buffer back to the encoder.
+    virtual int32_t UnlockBitstream(MSdkBitstream* pBitstream);
+    
     //Update the target bitrate online of specified pipeline.
     virtual int32_t UpdateBitrate(uint32_t Bitrate, uint32_t Framerate);
     
     //Request to encoder the current frame as IDR frame.
     virtual int32_t InsertKeyFrame(void);
     
+    //Recover from the loss with the acknowledged long-term reference, or an IDR.
+    virtual int32_t RequestLtrRecovery(SLTRRecoverRequest* pRequest);
+    
+    //Save the long-term reference marking result of the decoder.
+    virtual int32_t SetLtrMarkingFeedback(SLTRMarkingFeedback* pFeedback);
+    
+    //Get the per-stage latency of the frames encoded since the encoder is created.
+    virtual int32_t GetLatencyStats(MSdkLatencyStats* pStats);
+    
+    //Get the statistics of the frames dropped for the latency budget.
+    virtual int32_t GetDropStats(MSdkDropStats* pStats);
+    
 private:
     
+    //Find out the stage times of a frame in the pipeline, by its timestamp.
+    MSdkFrameTiming* FindTiming(int64_t TimeStamp);
+    
+    //Create the media format with the parameters, and configure the encoder.
+    int32_t ConfigureEncoder(const char *mime);
+    
+    //Check the leaky bucket of output bytes, if the frame should be skipped.
+    bool CheckOvershoot(uint64_t TimeStamp);
+    
+    //Check the input frame rate against the target, if the frame should be skipped.
+    bool CheckFrameRate(int64_t TimeStamp);
+    
+    //Get the temporal id of an AVC picture, with the layering pattern.
+    int32_t GetTemporalId(bool KeyFrame, bool Reference);
+    
+    //Get the temporal id the next queued frame will have, from the input thread.
+    uint32_t GetInputTemporalId(void);
+    
+    //Mark the long-term reference or refer to it, before the frame is queued.
+    void ApplyLtr(int64_t TimeStamp);
+    
+    //Save the frame_num of the marked frame, or drop the references at IDR.
+    void UpdateLtr(int64_t TimeStamp, bool IdrFrame, const uint8_t* pBuffer,
+                   const MSdkNalUnit* pNalUnits, int32_t NalCount);
+    
+    //Dequeue an output buffer with bitstream, and save the SPS/PPS unit. return
+    //MCODEC_SKIPPED if no buffer is output within MSDK_OUTPUT_TIMEOUT_US.
+    int32_t DequeueOutput(MSdkBufferInfo *pBufInfo, uint8_t **ppOutput, ssize_t *pIndex);
+    
     //the local control parameters for the MSDK encoder.
-    AMediaCodec*           m_VideoEncoder;
-    AMediaFormat*          m_VideoFormat;
+    CCodecBackend*         m_VideoEncoder;
     MSdkInputParam         m_InitParams;
     uint32_t               m_CodecInitFlag;
     uint32_t               m_ForDatashare;
     uint32_t               m_nFramesProcessed;
-    uint32_t               m_SpsPpsLength;
-    uint32_t               m_SpsPpsHeader[64];
+    uint32_t               m_nFramesOutput;
+    uint32_t               m_nOpened;
+    std::atomic<uint32_t>  m_nBorrowedBuffers;
+    CParamSetCache         m_ParamSets;
+    uint32_t               m_SentSetGeneration;
+    MSdkFrameBuffer        m_FrameOutput;
+    
+    //the temporal layering state, and the SVC prefix units of every layer.
+    std::atomic<uint32_t>  m_nTemporalLayers;
+    uint32_t               m_nTemporalFrame;
+    bool                   m_LastReference;
+    std::atomic<uint32_t>  m_nKeyFrameInput;
+    uint8_t                m_SvcPrefixNal[2][MSDK_MAX_TEMPORAL_LAYERS][MSDK_SVC_PREFIX_LENGTH];
+    
+    //the bitrate mode accepted by device, and the leaky bucket of output bytes.
+    //the output bytes are added by GetBitstream(), which may run on another thread.
+    int32_t                m_nBitrateMode;
+    std::atomic<int64_t>   m_RcOutputBytes;
+    int64_t                m_RcDrainedBytes;
+    int64_t                m_RcLastTimeStamp;
+    
+    //the due time of the next frame to encode, when the input is decimated.
+    int64_t                m_FrcNextTimeUs;
+    
+    //the stage times of frames in pipeline, and the latency of every stage.
+    MSdkFrameTiming        m_FrameTiming[MSDK_LATENCY_FRAMES];
+    MSdkLatencyHistogram   m_Latency[MSDK_LATENCY_STAGES];
+    
+    //the long-term reference slots, the recovery request and the marking counter.
+    std::mutex             m_LtrLock;
+    MSdkLtrSlot            m_LtrSlots[MSDK_MAX_LTR_FRAMES];
+    uint32_t               m_nLtrFrames;
+    int32_t                m_LtrAckedSlot;
+    int32_t                m_LtrUseSlot;
+    uint32_t               m_nLtrMarkFrame;
+    
+    //the scheduler to drop frames, when the encoder falls behind the budget.
+    CDropScheduler         m_DropScheduler;
 };
 
 #endif  // End of __GPU_MSDK_CODEC_H__
@@ -0,0 +1,512 @@
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "GPU_msdk_decoder.h"
+#include "include/GPU_codec_api.h"
+#include "nal_parser.h"
+
+#include "media/NdkMediaCodec.h"
+#include "media/NdkMediaError.h"
+#include "media/NdkMediaFormat.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMSDKDecoder::CMSDKDecoder(void)
+{
+    //Initialize local control parameters for decoding.
+    m_CodecInitFlag    = 0;
+    m_nFramesProcessed = 0;
+    m_VideoDecoder     = NULL;
+    m_VideoFormat      = NULL;
+    
+    m_OutWidth         = 0;
+    m_OutHeight        = 0;
+    m_OutStride        = 0;
+    m_OutSliceHeight   = 0;
+    m_OutColorFormat   = MSDK_COLOR_FormatI420;
+    
+    //all the frame slots are free at the beginning.
+    for (int32_t i = 0; i < MSDK_MAX_DECODE_FRAMES; i++)
+    {
+        m_FramePool[i].State.store(0);
+        m_FramePool[i].BufferIndex = -1;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMSDKDecoder::~CMSDKDecoder(void)
+{
+    //Destroy the GPU decoder instance if necessary.
+    if (m_CodecInitFlag != 0)
+    {
+        CloseDecoder();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+VM_MSDKDecoder* VM_MSDKDecoder::CreateDecoder(MSdkInputParam *InputParam)
+{
+    CMSDKDecoder *pMDecoder = NULL;
+    
+    //Create the Intel MSDK decoder pipeline, and configure it.
+    pMDecoder = new (std::nothrow)CMSDKDecoder;
+    if (pMDecoder != NULL)
+    {
+        int32_t status = pMDecoder->OpenDecoder(InputParam);
+        if (status != MCODEC_SUCCEED)
+        {
+            delete pMDecoder;
+            return NULL;
+        }
+    }
+    
+    //return the pointer of the allocated decoder instance.
+    return (VM_MSDKDecoder*)pMDecoder;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void VM_MSDKDecoder::DeleteDecoder(VM_MSDKDecoder *pMDecoder)
+{
+    //Delete the Intel MSDK decoder and release memory.
+    if (pMDecoder != NULL)
+    {
+        ((CMSDKDecoder *)pMDecoder)->CloseDecoder();
+        delete pMDecoder;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Append the incoming parameter set to the codec specific data, with a start code
+//if it has none. return the new length of the data, or the old one if it is empty.
+static uint32_t AppendParamSet(uint8_t* pCsd, uint32_t CsdLength, const uint8_t* pNalUnit, uint32_t Length,
+                               uint32_t MaxLength)
+{
+    static const uint8_t StartCode[4] = { 0x00, 0x00, 0x00, 0x01 };
+    
+    if ((Length == 0) || (Length > MaxLength))
+    {
+        return CsdLength;
+    }
+    
+    int32_t sc_len = 0;
+    if (nal_FindStartCode(pNalUnit, Length, &sc_len) != 0)
+    {
+        memcpy(pCsd + CsdLength, StartCode, sizeof(StartCode));
+        CsdLength += sizeof(StartCode);
+    }
+    memcpy(pCsd + CsdLength, pNalUnit, Length);
+    
+    return CsdLength + Length;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKDecoder::OpenDecoder(MSdkInputParam *InputParam)
+{
+    media_status_t sts = AMEDIA_OK;
+    
+    //Every instance keeps its own codec state, and could be opened once.
+    if (m_CodecInitFlag != 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //Save the input MSDK decoder configure parameters.
+    memcpy(&m_InitParams, InputParam, sizeof(MSdkInputParam));
+    
+    //Only the H264/AVC and H265/HEVC decoders are supported now.
+    const char *mime = NULL;
+    if (m_InitParams.nCodecType == VIDEO_CODEC_TYPE_AVC)
+    {
+        mime = "video/avc";
+    }
+    else if (m_InitParams.nCodecType == VIDEO_CODEC_TYPE_HEVC)
+    {
+        mime = "video/hevc";
+    }
+    else
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //create a mediacodec decoder instance.
+    m_VideoDecoder = AMediaCodec_createDecoderByType(mime);
+    if (m_VideoDecoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //create the media format configure instance.
+    if (m_VideoFormat == NULL)
+    {
+        m_VideoFormat = AMediaFormat_new();
+        if (m_VideoFormat == NULL)
+        {
+            AMediaCodec_delete(m_VideoDecoder);
+            m_VideoDecoder = NULL;
+            return MCODEC_ERROR;
+        }
+    }
+    
+    //update the decoder input and output format.
+    AMediaFormat_setString(m_VideoFormat, "mime", mime);
+    AMediaFormat_setInt32(m_VideoFormat, "width", m_InitParams.nWidth);
+    AMediaFormat_setInt32(m_VideoFormat, "height", m_InitParams.nHeight);
+    AMediaFormat_setInt32(m_VideoFormat, "color-format", MSDK_COLOR_FormatI420);
+    
+    //the incoming parameter sets are passed as the codec specific data, the SPS
+    //and PPS units apart for H264/AVC, while H265/HEVC takes the VPS, SPS and PPS
+    //units together in csd-0, without csd-1.
+    if (m_InitParams.nCodecType == VIDEO_CODEC_TYPE_AVC)
+    {
+        if ((m_InitParams.SpsLength > 0) && (m_InitParams.SpsLength <= sizeof(m_InitParams.SpsNalUnit)))
+        {
+            AMediaFormat_setBuffer(m_VideoFormat, "csd-0", m_InitParams.SpsNalUnit, m_InitParams.SpsLength);
+        }
+        if ((m_InitParams.PpsLength > 0) && (m_InitParams.PpsLength <= sizeof(m_InitParams.PpsNalUnit)))
+        {
+            AMediaFormat_setBuffer(m_VideoFormat, "csd-1", m_InitParams.PpsNalUnit, m_InitParams.PpsLength);
+        }
+    }
+    else
+    {
+        uint8_t csd[sizeof(m_InitParams.VpsNalUnit) + sizeof(m_InitParams.SpsNalUnit) + sizeof(m_InitParams.PpsNalUnit) + 12];
+        uint32_t length = 0;
+        length = AppendParamSet(csd, length, m_InitParams.VpsNalUnit, m_InitParams.VpsLength, sizeof(m_InitParams.VpsNalUnit));
+        length = AppendParamSet(csd, length, m_InitParams.SpsNalUnit, m_InitParams.SpsLength, sizeof(m_InitParams.SpsNalUnit));
+        length = AppendParamSet(csd, length, m_InitParams.PpsNalUnit, m_InitParams.PpsLength, sizeof(m_InitParams.PpsNalUnit));
+        if (length > 0)
+        {
+            AMediaFormat_setBuffer(m_VideoFormat, "csd-0", csd, length);
+        }
+    }
+    
+    //configure and initialize the decoder, output to buffers without surface.
+    sts = AMediaCodec_configure(m_VideoDecoder, m_VideoFormat, NULL, NULL, 0);
+    if (sts != AMEDIA_OK)
+    {
+        AMediaCodec_delete(m_VideoDecoder);
+        m_VideoDecoder = NULL;
+        return MCODEC_ERROR;
+    }
+    
+    //start the android hardware video decoder device.
+    sts = AMediaCodec_start(m_VideoDecoder);
+    if (sts != AMEDIA_OK)
+    {
+        AMediaCodec_delete(m_VideoDecoder);
+        m_VideoDecoder = NULL;
+        return MCODEC_ERROR;
+    }
+    
+    //the output layout is the configured one, until the format is changed.
+    m_OutWidth         = m_InitParams.nWidth;
+    m_OutHeight        = m_InitParams.nHeight;
+    m_OutStride        = m_InitParams.nWidth;
+    m_OutSliceHeight   = m_InitParams.nHeight;
+    m_OutColorFormat   = MSDK_COLOR_FormatI420;
+    m_nFramesProcessed = 0;
+    m_CodecInitFlag    = 1;
+    
+    //Succed to open the MSDK decoder, return the result.
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKDecoder::CloseDecoder()
+{
+    //if the MSDK device was not opened, do nothing and exit.
+    if (m_CodecInitFlag == 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the frames still lent to renderers are taken back, and their handles are
+    //refused with the next generation of the slots.
+    for (int32_t i = 0; i < MSDK_MAX_DECODE_FRAMES; i++)
+    {
+        uint64_t state = m_FramePool[i].State.load();
+        while (!m_FramePool[i].State.compare_exchange_weak(state, (((state >> 32) + 1) & MSDK_DECODE_GENERATION_MASK) << 32))
+        {
+        }
+        
+        if ((uint32_t)state > 0)
+        {
+            AMediaCodec_releaseOutputBuffer(m_VideoDecoder, m_FramePool[i].BufferIndex, false);
+        }
+        m_FramePool[i].BufferIndex = -1;
+    }
+    
+    //stop and delete the android hardware video decoder device.
+    if (m_VideoDecoder != NULL)
+    {
+        AMediaCodec_stop(m_VideoDecoder);
+        AMediaCodec_delete(m_VideoDecoder);
+        m_VideoDecoder = NULL;
+    }
+    
+    //delete the video format instance when close device.
+    if (m_VideoFormat != NULL)
+    {
+        AMediaFormat_delete(m_VideoFormat);
+        m_VideoFormat = NULL;
+    }
+    
+    //Update the MSDK initialize flag to close device.
+    m_CodecInitFlag = 0;
+    
+    //Succed to close the decoder, return the result.
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKDecoder::DecodeFrame(uint8_t *pStream, int32_t Length)
+{
+    size_t BufSize = 0;
+    
+    //if the MSDK device was not opened, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pStream == NULL) || (Length <= 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //Get a memory block from buffer array to save the stream data, the decoder
+    //which holds all input buffers too long is reported as an error.
+    ssize_t bufIndex = AMediaCodec_dequeueInputBuffer(m_VideoDecoder, MSDK_DECODE_INPUT_TIMEOUT_US);
+    if (bufIndex < 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //Get an input buffer, with the buffer index that previously obtained.
+    uint8_t *inputBuffer = AMediaCodec_getInputBuffer(m_VideoDecoder, bufIndex, &BufSize);
+    if ((inputBuffer == NULL) || (BufSize < (size_t)Length))
+    {
+        AMediaCodec_queueInputBuffer(m_VideoDecoder, bufIndex, 0, 0, 0, 0);
+        return MCODEC_ERROR;
+    }
+    
+    //the compressed data is small, it is the only copy on the receive path.
+    memcpy(inputBuffer, pStream, Length);
+    
+    //put the incoming stream to the decoding queue to decode.
+    uint64_t time = (uint64_t)m_nFramesProcessed * 1000;
+    media_status_t sts = AMediaCodec_queueInputBuffer(m_VideoDecoder, bufIndex, 0, Length, time, 0);
+    if (sts != AMEDIA_OK)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //Update the total decoded frame counter for debug.
+    m_nFramesProcessed++;
+    
+    //Succeed to start the MSDK decoder, return the results.
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CMSDKDecoder::UpdateOutputFormat(void)
+{
+    int32_t width = 0, height = 0, stride = 0, slice_height = 0, color = 0;
+    
+    AMediaFormat *format = AMediaCodec_getOutputFormat(m_VideoDecoder);
+    if (format == NULL)
+    {
+        return;
+    }
+    
+    //the stride and slice height are optional, default to the picture size.
+    if (AMediaFormat_getInt32(format, "width", &width) && (width > 0))
+    {
+        m_OutWidth = width;
+    }
+    if (AMediaFormat_getInt32(format, "height", &height) && (height > 0))
+    {
+        m_OutHeight = height;
+    }
+    
+    m_OutStride      = AMediaFormat_getInt32(format, "stride", &stride) && (stride > 0) ? stride : m_OutWidth;
+    m_OutSliceHeight = AMediaFormat_getInt32(format, "slice-height", &slice_height) && (slice_height > 0) ? slice_height : m_OutHeight;
+    
+    if (AMediaFormat_getInt32(format, "color-format", &color))
+    {
+        m_OutColorFormat = color;
+    }
+    
+    AMediaFormat_delete(format);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKDecoder::GetDecodeImage(MSdkOutFrame *pOutFrame)
+{
+    AMediaCodecBufferInfo BufInfo;
+    size_t BufSize = 0;
+    int32_t slot = -1;
+    uint64_t state = 0;
+    
+    //if the MSDK device was not opened, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pOutFrame == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    pOutFrame->BufferStatus = 0;
+    pOutFrame->FrameHandle  = -1;
+    
+    //find out a free frame slot, or keep the picture in decoder until one is released.
+    for (int32_t i = 0; i < MSDK_MAX_DECODE_FRAMES; i++)
+    {
+        state = m_FramePool[i].State.load();
+        if ((uint32_t)state == 0)
+        {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //Get the decoded picture from android buffer array, with a short timeout.
+    ssize_t bufIndex = AMediaCodec_dequeueOutputBuffer(m_VideoDecoder, &BufInfo, MSDK_DECODE_TIMEOUT_US);
+    while ((bufIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) || (bufIndex == AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED))
+    {
+        if (bufIndex == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED)
+        {
+            UpdateOutputFormat();
+        }
+        bufIndex = AMediaCodec_dequeueOutputBuffer(m_VideoDecoder, &BufInfo, MSDK_DECODE_TIMEOUT_US);
+    }
+    if (bufIndex < 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //Get an output buffer, with the buffer index that previously obtained.
+    uint8_t *outputBuffer = AMediaCodec_getOutputBuffer(m_VideoDecoder, bufIndex, &BufSize);
+    if ((outputBuffer == NULL) || (BufInfo.size <= 0))
+    {
+        AMediaCodec_releaseOutputBuffer(m_VideoDecoder, bufIndex, false);
+        return MCODEC_ERROR;
+    }
+    
+    //the planes are located in the output buffer, without copy.
+    uint8_t *plane_y = outputBuffer + BufInfo.offset;
+    uint8_t *plane_u = plane_y + m_OutStride * m_OutSliceHeight;
+    
+    pOutFrame->DecWidth     = m_OutWidth;
+    pOutFrame->DecHeight    = m_OutHeight;
+    pOutFrame->DecFormat    = m_OutColorFormat;
+    pOutFrame->DecBuffer[0] = plane_y;
+    pOutFrame->DecStride[0] = m_OutStride;
+    
+    if (m_OutColorFormat == MSDK_COLOR_FormatNV12)
+    {
+        pOutFrame->DecBuffer[1] = plane_u;
+        pOutFrame->DecBuffer[2] = NULL;
+        pOutFrame->DecStride[1] = m_OutStride;
+        pOutFrame->DecStride[2] = 0;
+    }
+    else
+    {
+        pOutFrame->DecBuffer[1] = plane_u;
+        pOutFrame->DecBuffer[2] = plane_u + (m_OutStride >> 1) * (m_OutSliceHeight >> 1);
+        pOutFrame->DecStride[1] = m_OutStride >> 1;
+        pOutFrame->DecStride[2] = m_OutStride >> 1;
+    }
+    
+    pOutFrame->nMemType     = SYSTEM_MEMORY;
+    //the buffer is lent to renderer with the next generation of the slot, until
+    //the last reference is released.
+    uint64_t generation = ((state >> 32) + 1) & MSDK_DECODE_GENERATION_MASK;
+    m_FramePool[slot].BufferIndex = bufIndex;
+    m_FramePool[slot].State.store((generation << 32) | 1);
+    
+    pOutFrame->TimeStamp    = BufInfo.presentationTimeUs / 1000;
+    pOutFrame->FrameHandle  = (int32_t)((generation << MSDK_DECODE_SLOT_BITS) | slot);
+    pOutFrame->BufferStatus = 1;
+    
+    //succeed to output the decoded image, return state code.
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+MSdkFrameSlot* CMSDKDecoder::GetFrameSlot(const MSdkOutFrame* pOutFrame, uint64_t* pGeneration)
+{
+    //the frame should be lent by this decoder, the generation is checked with
+    //the reference count.
+    if ((m_CodecInitFlag == 0) || (pOutFrame == NULL) || (pOutFrame->FrameHandle < 0))
+    {
+        return NULL;
+    }
+    
+    int32_t slot = pOutFrame->FrameHandle & MSDK_DECODE_SLOT_MASK;
+    if (slot >= MSDK_MAX_DECODE_FRAMES)
+    {
+        return NULL;
+    }
+    
+    *pGeneration = (uint64_t)pOutFrame->FrameHandle >> MSDK_DECODE_SLOT_BITS;
+    return &m_FramePool[slot];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKDecoder::AddRefDecodeImage(MSdkOutFrame *pOutFrame)
+{
+    uint64_t generation = 0;
+    MSdkFrameSlot *pSlot = GetFrameSlot(pOutFrame, &generation);
+    if (pSlot == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //never revive a frame slot which has been given back, or reused by another frame.
+    uint64_t state = pSlot->State.load();
+    while (((state >> 32) == generation) && ((uint32_t)state > 0))
+    {
+        if (pSlot->State.compare_exchange_weak(state, state + 1))
+        {
+            return MCODEC_SUCCEED;
+        }
+    }
+    
+    return MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKDecoder::ReleaseDecodeImage(MSdkOutFrame *pOutFrame)
+{
+    uint64_t generation = 0;
+    MSdkFrameSlot *pSlot = GetFrameSlot(pOutFrame, &generation);
+    if (pSlot == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //read the buffer index first, the slot is reused once the count is zero.
+    ssize_t bufIndex = pSlot->BufferIndex;
+    uint64_t state = pSlot->State.load();
+    bool released = false;
+    
+    while (((state >> 32) == generation) && ((uint32_t)state > 0))
+    {
+        if (pSlot->State.compare_exchange_weak(state, state - 1))
+        {
+            released = true;
+            break;
+        }
+    }
+    if (!released)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the last reference gives the output buffer back to the decoder.
+    if ((uint32_t)state == 1)
+    {
+        AMediaCodec_releaseOutputBuffer(m_VideoDecoder, bufIndex, false);
+    }
+    
+    pOutFrame->FrameHandle  = -1;
+    pOutFrame->BufferStatus = 0;
+    
+    return MCODEC_SUCCEED;
+}
@@ -0,0 +1,98 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GPU_MSDK_DECODER_H__
+#define __GPU_MSDK_DECODER_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+
+#include "media/NdkMediaError.h"
+#include "media/NdkMediaFormat.h"
+#include "media/NdkMediaCodec.h"
+
+#include "include/GPU_codec_api.h"
+
+#define MSDK_MAX_DECODE_FRAMES     16
+#define MSDK_DECODE_TIMEOUT_US     10000
+
+//the longest wait for a free input buffer, the receive thread never blocks longer.
+#define MSDK_DECODE_INPUT_TIMEOUT_US   100000
+
+//the frame handle is the slot index in the low bits, and the generation of the
+//slot above them, so the handle of a slot which has been reused is refused.
+#define MSDK_DECODE_SLOT_BITS          8
+#define MSDK_DECODE_SLOT_MASK          0xFF
+#define MSDK_DECODE_GENERATION_MASK    0x7FFFFF
+
+#define MSDK_COLOR_FormatI420      19
+#define MSDK_COLOR_FormatNV12      21
+
+/////////////////////////////////////////////////////////////////////////////////////
+//One slot of the decoded frame pool, which holds a codec output buffer. State is
+//the generation in the high 32 bits and the reference count in the low 32 bits,
+//changed together. The slot is free when the count is zero, and only the decoding
+//thread takes a free slot, with the next generation.
+typedef struct
+{
+    std::atomic<uint64_t>  State;
+    ssize_t                BufferIndex;
+    
+}MSdkFrameSlot;
+
+/////////////////////////////////////////////////////////////////////////////////////
+class CMSDKDecoder : public VM_MSDKDecoder
+{
+public:
+    CMSDKDecoder(void);
+    ~CMSDKDecoder(void);
+    
+    //Create the Intel MSDK decoder pipeline, and configure it.
+    virtual int32_t OpenDecoder(MSdkInputParam *InputParam);
+    
+    //Delete the Intel MSDK decoder and release memory.
+    virtual int32_t CloseDecoder(void);
+    
+    //Start to decode a frame asynchronously, with incoming stream data.
+    virtual int32_t DecodeFrame(uint8_t *pStream, int32_t Length);
+    
+    //Synchronize the GPU decoder and output the decoded YUV image.
+    virtual int32_t GetDecodeImage(MSdkOutFrame *pOutFrame);
+    
+    //Add a reference to the decoded image, for one more renderer of it.
+    virtual int32_t AddRefDecodeImage(MSdkOutFrame *pOutFrame);
+    
+    //Drop a reference of the decoded image, the last one gives it back.
+    virtual int32_t ReleaseDecodeImage(MSdkOutFrame *pOutFrame);
+    
+private:
+    
+    //Read the output picture layout, after the output format is changed.
+    void UpdateOutputFormat(void);
+    
+    //Get the slot of the frame handle, and the generation it was lent with.
+    MSdkFrameSlot* GetFrameSlot(const MSdkOutFrame* pOutFrame, uint64_t* pGeneration);
+    
+    //the local control parameters for the MSDK decoder.
+    AMediaCodec*           m_VideoDecoder;
+    AMediaFormat*          m_VideoFormat;
+    MSdkInputParam         m_InitParams;
+    uint32_t               m_CodecInitFlag;
+    uint32_t               m_nFramesProcessed;
+    
+    //the layout of the decoded picture in the output buffers.
+    uint32_t               m_OutWidth;
+    uint32_t               m_OutHeight;
+    uint32_t               m_OutStride;
+    uint32_t               m_OutSliceHeight;
+    uint32_t               m_OutColorFormat;
+    
+    //the decoded frames lent to renderers.
+    MSdkFrameSlot          m_FramePool[MSDK_MAX_DECODE_FRAMES];
+};
+
+#endif  // End of __GPU_MSDK_DECODER_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,366 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "GPU_msdk_session.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+std::atomic<uint32_t> CMSDKSessionManager::s_nInstances(0);
+std::atomic<uint32_t> CMSDKSessionManager::s_nInstanceLimit(MSDK_DEFAULT_INSTANCE_LIMIT);
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMSDKSessionManager::CMSDKSessionManager(void)
+    : m_nSessions(0), m_nRoundStart(0)
+{
+    //Initialize all the session slots as free slots.
+    for (int32_t i = 0; i < MSDK_MAX_ENCODER_SESSIONS; i++)
+    {
+        m_Sessions[i].pEncoder = NULL;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMSDKSessionManager::~CMSDKSessionManager(void)
+{
+    //Close all the encoder sessions which are still opened.
+    for (int32_t i = 0; i < MSDK_MAX_ENCODER_SESSIONS; i++)
+    {
+        DeleteSession(i);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::SetInstanceLimit(uint32_t Limit)
+{
+    //the limit should not be zero, and not more than the session table.
+    if ((Limit == 0) || (Limit > MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    s_nInstanceLimit.store(Limit);
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+bool CMSDKSessionManager::AcquireInstance(void)
+{
+    uint32_t count = s_nInstances.load();
+    
+    //reserve an instance only if the device limit is not reached.
+    while (count < s_nInstanceLimit.load())
+    {
+        if (s_nInstances.compare_exchange_weak(count, count + 1))
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CMSDKSessionManager::ReleaseInstance(void)
+{
+    s_nInstances.fetch_sub(1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::CreateSession(MSdkInputParam *InputParam)
+{
+    std::lock_guard<std::mutex> table(m_TableLock);
+    int32_t SessionId = -1;
+    
+    //find out a free session slot in the session table.
+    for (int32_t i = 0; i < MSDK_MAX_ENCODER_SESSIONS; i++)
+    {
+        if (m_Sessions[i].pEncoder == NULL)
+        {
+            SessionId = i;
+            break;
+        }
+    }
+    
+    //the session table is full, or the device has no more codec instance.
+    if ((SessionId < 0) || !AcquireInstance())
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //Create the encoder instance of the session, and configure it.
+    VM_MSDKEncoder *pMEncoder = VM_MSDKEncoder::CreateEncoder(InputParam);
+    if (pMEncoder == NULL)
+    {
+        ReleaseInstance();
+        return MCODEC_ERROR;
+    }
+    
+    //publish the encoder to the session slot with both locks held.
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    std::lock_guard<std::mutex> input(pSession->InputLock);
+    std::lock_guard<std::mutex> output(pSession->OutputLock);
+    
+    pSession->pEncoder = pMEncoder;
+    m_nSessions++;
+    
+    return SessionId;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::DeleteSession(int32_t SessionId)
+{
+    if ((SessionId < 0) || (SessionId >= MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    std::lock_guard<std::mutex> table(m_TableLock);
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    
+    //wait for the running encode and output calls of the session.
+    std::lock_guard<std::mutex> input(pSession->InputLock);
+    std::lock_guard<std::mutex> output(pSession->OutputLock);
+    
+    if (pSession->pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //Delete the encoder and give the codec instance back to the device.
+    VM_MSDKEncoder::DeleteEncoder(pSession->pEncoder);
+    pSession->pEncoder = NULL;
+    m_nSessions--;
+    ReleaseInstance();
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::EncodeFrame(int32_t SessionId, SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer)
+{
+    if ((SessionId < 0) || (SessionId >= MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    std::lock_guard<std::mutex> input(pSession->InputLock);
+    
+    if (pSession->pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return pSession->pEncoder->EncodeFrame(pSrcPic, pBsLayer);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::GetBitstream(int32_t SessionId, SLayerBSInfo* pBsLayer)
+{
+    if ((SessionId < 0) || (SessionId >= MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    std::lock_guard<std::mutex> output(pSession->OutputLock);
+    
+    if (pSession->pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return pSession->pEncoder->GetBitstream(pBsLayer);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::GetFrameBitstream(int32_t SessionId, SFrameBSInfo* pFrameInfo)
+{
+    if ((SessionId < 0) || (SessionId >= MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    std::lock_guard<std::mutex> output(pSession->OutputLock);
+    
+    if (pSession->pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return pSession->pEncoder->GetFrameBitstream(pFrameInfo);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::UpdateBitrate(int32_t SessionId, uint32_t Bitrate, uint32_t Framerate)
+{
+    if ((SessionId < 0) || (SessionId >= MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the encoder is reopened, both the input and output side are locked.
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    std::lock_guard<std::mutex> input(pSession->InputLock);
+    std::lock_guard<std::mutex> output(pSession->OutputLock);
+    
+    if (pSession->pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return pSession->pEncoder->UpdateBitrate(Bitrate, Framerate);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::InsertKeyFrame(int32_t SessionId)
+{
+    if ((SessionId < 0) || (SessionId >= MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the encoder is reopened, both the input and output side are locked.
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    std::lock_guard<std::mutex> input(pSession->InputLock);
+    std::lock_guard<std::mutex> output(pSession->OutputLock);
+    
+    if (pSession->pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return pSession->pEncoder->InsertKeyFrame();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::RequestLtrRecovery(int32_t SessionId, SLTRRecoverRequest* pRequest)
+{
+    if ((SessionId < 0) || (SessionId >= MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the encoder is reopened without reference, both sides are locked.
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    std::lock_guard<std::mutex> input(pSession->InputLock);
+    std::lock_guard<std::mutex> output(pSession->OutputLock);
+    
+    if (pSession->pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return pSession->pEncoder->RequestLtrRecovery(pRequest);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::SetLtrMarkingFeedback(int32_t SessionId, SLTRMarkingFeedback* pFeedback)
+{
+    if ((SessionId < 0) || (SessionId >= MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the feedback is taken before the next frame, on the input side.
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    std::lock_guard<std::mutex> input(pSession->InputLock);
+    
+    if (pSession->pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return pSession->pEncoder->SetLtrMarkingFeedback(pFeedback);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::GetLatencyStats(int32_t SessionId, MSdkLatencyStats* pStats)
+{
+    if ((SessionId < 0) || (SessionId >= MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the statistics are lock-free, only keep the session from being deleted.
+    std::lock_guard<std::mutex> table(m_TableLock);
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    
+    if (pSession->pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return pSession->pEncoder->GetLatencyStats(pStats);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::GetDropStats(int32_t SessionId, MSdkDropStats* pStats)
+{
+    if ((SessionId < 0) || (SessionId >= MSDK_MAX_ENCODER_SESSIONS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the statistics are lock-free, only keep the session from being deleted.
+    std::lock_guard<std::mutex> table(m_TableLock);
+    MSdkEncoderSession *pSession = &m_Sessions[SessionId];
+    
+    if (pSession->pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return pSession->pEncoder->GetDropStats(pStats);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::EncodeFrameAll(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayers, int32_t *pLayerNum)
+{
+    bool Encoded[MSDK_MAX_ENCODER_SESSIONS] = {false};
+    int32_t LayerNum = 0;
+    
+    if ((pSrcPic == NULL) || (pBsLayers == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //rotate the first session of this round, for fairness between sessions.
+    uint32_t start = m_nRoundStart.fetch_add(1) % MSDK_MAX_ENCODER_SESSIONS;
+    
+    //feed the picture to all the sessions before waiting for any bitstream,
+    //so the hardware encoders of the sessions could run in parallel.
+    for (uint32_t k = 0; k < MSDK_MAX_ENCODER_SESSIONS; k++)
+    {
+        int32_t i = (start + k) % MSDK_MAX_ENCODER_SESSIONS;
+        pBsLayers[i].iNalCount = 0;
+        Encoded[i] = (EncodeFrame(i, pSrcPic, &pBsLayers[i]) == MCODEC_SUCCEED);
+    }
+    
+    //collect the bitstream of all sessions, with the same rotated order.
+    for (uint32_t k = 0; k < MSDK_MAX_ENCODER_SESSIONS; k++)
+    {
+        int32_t i = (start + k) % MSDK_MAX_ENCODER_SESSIONS;
+        if (Encoded[i] && (GetBitstream(i, &pBsLayers[i]) == MCODEC_SUCCEED))
+        {
+            LayerNum++;
+        }
+        else
+        {
+            pBsLayers[i].iNalCount = 0;
+        }
+    }
+    
+    if (pLayerNum != NULL)
+    {
+        *pLayerNum = LayerNum;
+    }
+    
+    return (LayerNum > 0) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSessionManager::GetSessionCount(void)
+{
+    return (int32_t)m_nSessions.load();
+}
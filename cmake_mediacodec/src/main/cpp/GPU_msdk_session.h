@@ -0,0 +1,98 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GPU_MSDK_SESSION_H__
+#define __GPU_MSDK_SESSION_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#include "GPU_msdk_codec.h"
+#include "include/GPU_codec_api.h"
+
+#define MSDK_MAX_ENCODER_SESSIONS    16
+#define MSDK_DEFAULT_INSTANCE_LIMIT  4
+
+/////////////////////////////////////////////////////////////////////////////////////
+//One encoder session slot. EncodeFrame() and GetBitstream() of the same session
+//could run on two different threads, they only take the input or output lock;
+//the reopen and delete operations take both locks, and are serialized with them.
+typedef struct
+{
+    VM_MSDKEncoder*        pEncoder;
+    std::mutex             InputLock;
+    std::mutex             OutputLock;
+    
+}MSdkEncoderSession;
+
+/////////////////////////////////////////////////////////////////////////////////////
+class CMSDKSessionManager
+{
+public:
+    CMSDKSessionManager(void);
+    ~CMSDKSessionManager(void);
+    
+    //Set the max number of codec instances of the device, shared by all managers.
+    //the value should come from MediaCodecInfo getMaxSupportedInstances().
+    static int32_t SetInstanceLimit(uint32_t Limit);
+    
+    //Create and open a new encoder session, return the session id.
+    int32_t CreateSession(MSdkInputParam *InputParam);
+    
+    //Close the encoder session and release the session slot.
+    int32_t DeleteSession(int32_t SessionId);
+    
+    //Encode a frame of the session asynchronously, without outputing bitstream.
+    int32_t EncodeFrame(int32_t SessionId, SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer);
+    
+    //Synchronize the session encoder and output bitstream data.
+    int32_t GetBitstream(int32_t SessionId, SLayerBSInfo* pBsLayer);
+    
+    //Synchronize the session encoder and output all the layers of one picture.
+    int32_t GetFrameBitstream(int32_t SessionId, SFrameBSInfo* pFrameInfo);
+    
+    //Update the target bitrate online of the session.
+    int32_t UpdateBitrate(int32_t SessionId, uint32_t Bitrate, uint32_t Framerate);
+    
+    //Request the session to encode the current frame as IDR frame.
+    int32_t InsertKeyFrame(int32_t SessionId);
+    
+    //Request the session to recover from the loss, with a long-term reference.
+    int32_t RequestLtrRecovery(int32_t SessionId, SLTRRecoverRequest* pRequest);
+    
+    //Report the long-term reference marking result of the decoder to the session.
+    int32_t SetLtrMarkingFeedback(int32_t SessionId, SLTRMarkingFeedback* pFeedback);
+    
+    //Get the per-stage encoding latency of the session.
+    int32_t GetLatencyStats(int32_t SessionId, MSdkLatencyStats* pStats);
+    
+    //Get the statistics of the frames dropped for the latency budget of the session.
+    int32_t GetDropStats(int32_t SessionId, MSdkDropStats* pStats);
+    
+    //Encode a picture with all the sessions, pBsLayers is indexed by session id
+    //and should have MSDK_MAX_ENCODER_SESSIONS items, iNalCount 0 means no output.
+    //the first session is rotated every call, so no session is always served last.
+    int32_t EncodeFrameAll(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayers, int32_t *pLayerNum);
+    
+    //Get the number of opened sessions in this manager.
+    int32_t GetSessionCount(void);
+    
+private:
+    
+    //reserve or release one codec instance of the device.
+    static bool AcquireInstance(void);
+    static void ReleaseInstance(void);
+    
+    //the session table, and the lock to create or delete sessions.
+    MSdkEncoderSession     m_Sessions[MSDK_MAX_ENCODER_SESSIONS];
+    std::mutex             m_TableLock;
+    std::atomic<uint32_t>  m_nSessions;
+    std::atomic<uint32_t>  m_nRoundStart;
+    
+    //the codec instances opened by all managers, and the device limit.
+    static std::atomic<uint32_t> s_nInstances;
+    static std::atomic<uint32_t> s_nInstanceLimit;
+};
+
+#endif  // End of __GPU_MSDK_SESSION_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
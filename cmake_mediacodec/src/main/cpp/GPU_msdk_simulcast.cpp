@@ -0,0 +1,317 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "GPU_msdk_simulcast.h"
+#include "trace_events.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMSDKSimulcastEncoder::CMSDKSimulcastEncoder(void)
+    : m_LayerNum(0), m_Running(false), m_pPicture(NULL), m_nFrames(0),
+      m_KeyFramePeriod(1), m_KeyFrameRequest(false)
+{
+    //Initialize all the layers as closed layers.
+    for (int32_t i = 0; i < MSDK_MAX_SIMULCAST_LAYERS; i++)
+    {
+        m_Layers[i].pEncoder       = NULL;
+        m_Layers[i].RateReopens    = false;
+        m_Layers[i].Status         = MCODEC_ERROR;
+        m_Layers[i].KeyFrameNeeded = false;
+        m_Layers[i].PendingRate.store(0);
+        sem_init(&m_Layers[i].StartSignal, 0, 0);
+        sem_init(&m_Layers[i].DoneSignal, 0, 0);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMSDKSimulcastEncoder::~CMSDKSimulcastEncoder(void)
+{
+    Close();
+    
+    for (int32_t i = 0; i < MSDK_MAX_SIMULCAST_LAYERS; i++)
+    {
+        sem_destroy(&m_Layers[i].StartSignal);
+        sem_destroy(&m_Layers[i].DoneSignal);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSimulcastEncoder::Open(MSdkInputParam *pInputParams, int32_t LayerNum)
+{
+    //the encoder could be opened once, with 1~4 layers.
+    if ((m_LayerNum != 0) || (pInputParams == NULL) ||
+        (LayerNum < 1) || (LayerNum > MSDK_MAX_SIMULCAST_LAYERS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the layers should be ordered by resolution, the top one is the largest.
+    for (int32_t i = 1; i < LayerNum; i++)
+    {
+        if ((pInputParams[i].nWidth * pInputParams[i].nHeight) <
+            (pInputParams[i - 1].nWidth * pInputParams[i - 1].nHeight))
+        {
+            return MCODEC_ERROR;
+        }
+    }
+    
+    //the top layer takes the backend of its parameters, and falls back to the
+    //software encoder as any encoder; the lower layers are always software.
+    for (int32_t i = 0; i < LayerNum; i++)
+    {
+        MSdkSimulcastLayer *pLayer = &m_Layers[i];
+        pLayer->Param            = pInputParams[i];
+        pLayer->Param.nSpatialId = i;
+        if (i < LayerNum - 1)
+        {
+            pLayer->Param.nBackend = MSDK_BACKEND_OPENH264;
+        }
+        
+        pLayer->Status         = MCODEC_ERROR;
+        pLayer->KeyFrameNeeded = false;
+        pLayer->RateReopens    = (pLayer->Param.nBackend != MSDK_BACKEND_OPENH264);
+        pLayer->PendingRate.store(0);
+        pLayer->pEncoder       = VM_MSDKEncoder::CreateEncoder(&pLayer->Param);
+        m_LayerNum = i + 1;
+        
+        if (pLayer->pEncoder == NULL)
+        {
+            Close();
+            return MCODEC_ERROR;
+        }
+    }
+    
+    //all layers are opened with an IDR frame, and have the next one together
+    //after the 5 seconds key frame interval of the top layer.
+    m_nFrames = 0;
+    m_KeyFramePeriod = m_Layers[LayerNum - 1].Param.nFrameRate * 5;
+    m_KeyFramePeriod = (m_KeyFramePeriod == 0) ? 1 : m_KeyFramePeriod;
+    m_KeyFrameRequest.store(false);
+    
+    //start the worker threads of the software layers.
+    m_Running.store(true);
+    for (int32_t i = 0; i < LayerNum - 1; i++)
+    {
+        m_Layers[i].Worker = std::thread(&CMSDKSimulcastEncoder::WorkerLoop, this, &m_Layers[i]);
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSimulcastEncoder::Close(void)
+{
+    if (m_LayerNum == 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //wake up the worker threads and wait for them to exit.
+    m_Running.store(false);
+    for (int32_t i = 0; i < m_LayerNum; i++)
+    {
+        if (m_Layers[i].Worker.joinable())
+        {
+            sem_post(&m_Layers[i].StartSignal);
+            m_Layers[i].Worker.join();
+        }
+    }
+    
+    for (int32_t i = 0; i < m_LayerNum; i++)
+    {
+        VM_MSDKEncoder::DeleteEncoder(m_Layers[i].pEncoder);
+        m_Layers[i].pEncoder = NULL;
+        
+        //drain the signal left by the exiting worker.
+        while (sem_trywait(&m_Layers[i].StartSignal) == 0)
+        {
+        }
+    }
+    
+    m_LayerNum = 0;
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSimulcastEncoder::EncodeFrame(SSourcePicture* pSrcPic, SFrameBSInfo* pFrameInfo)
+{
+    CTraceScope trace("SimulcastEncodeFrame");
+    
+    //if the encoder was not opened, or no picture, do nothing and exit.
+    if ((m_LayerNum == 0) || (pSrcPic == NULL) || (pFrameInfo == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the IDR frame of all layers, on request, on the key frame interval, or for
+    //a new bitrate of a layer which is reopened.
+    bool KeyFrame = m_KeyFrameRequest.exchange(false);
+    KeyFrame = KeyFrame || (m_nFrames >= m_KeyFramePeriod);
+    
+    uint64_t Rates[MSDK_MAX_SIMULCAST_LAYERS];
+    for (int32_t i = 0; i < m_LayerNum; i++)
+    {
+        Rates[i] = m_Layers[i].PendingRate.exchange(0);
+        KeyFrame = KeyFrame || ((Rates[i] != 0) && m_Layers[i].RateReopens);
+    }
+    
+    //the requests are applied to all layers on this picture, the reopened encoder
+    //has its IDR frame already.
+    int32_t top = m_LayerNum - 1;
+    bool TopKeyFrame = false;
+    for (int32_t i = 0; i < m_LayerNum; i++)
+    {
+        MSdkSimulcastLayer *pLayer = &m_Layers[i];
+        bool Reopened = false;
+        if (Rates[i] != 0)
+        {
+            Reopened = (pLayer->pEncoder->UpdateBitrate((uint32_t)(Rates[i] >> 32), (uint32_t)Rates[i]) == MCODEC_SUCCEED) &&
+                       pLayer->RateReopens;
+        }
+        
+        if ((KeyFrame || pLayer->KeyFrameNeeded) && !Reopened)
+        {
+            pLayer->pEncoder->InsertKeyFrame();
+        }
+        
+        TopKeyFrame = TopKeyFrame || ((i == top) && (KeyFrame || pLayer->KeyFrameNeeded || Reopened));
+        pLayer->KeyFrameNeeded = false;
+    }
+    
+    //the key frame interval restarts with the top layer, as the one of the reopened
+    //hardware encoder, so its own IDR frames stay on the same pictures.
+    m_nFrames = TopKeyFrame ? 1 : (m_nFrames + 1);
+    
+    //the workers encode the lower layers while the hardware encodes the top one.
+    m_pPicture = pSrcPic;
+    for (int32_t i = 0; i < top; i++)
+    {
+        sem_post(&m_Layers[i].StartSignal);
+    }
+    
+    EncodeLayer(&m_Layers[top], pSrcPic);
+    
+    for (int32_t i = 0; i < top; i++)
+    {
+        sem_wait(&m_Layers[i].DoneSignal);
+    }
+    m_pPicture = NULL;
+    
+    //output the layers with bitstream, in spatial id order.
+    int32_t LayerNum = 0;
+    int32_t IdrNum   = 0;
+    pFrameInfo->iFrameSizeInBytes = 0;
+    
+    for (int32_t i = 0; i < m_LayerNum; i++)
+    {
+        MSdkSimulcastLayer *pLayer = &m_Layers[i];
+        if (pLayer->Status != MCODEC_SUCCEED)
+        {
+            continue;
+        }
+        
+        for (int32_t j = 0; j < pLayer->FrameInfo.iLayerNum; j++)
+        {
+            pFrameInfo->sLayerInfo[LayerNum++] = pLayer->FrameInfo.sLayerInfo[j];
+        }
+        pFrameInfo->iFrameSizeInBytes += pLayer->FrameInfo.iFrameSizeInBytes;
+        if (pLayer->FrameInfo.eFrameType == videoFrameTypeIDR)
+        {
+            IdrNum++;
+        }
+    }
+    
+    //a layer which has an IDR frame alone, for its own key frame interval or rate
+    //control, is followed by the other layers on the next picture.
+    for (int32_t i = 0; (IdrNum > 0) && (i < m_LayerNum); i++)
+    {
+        MSdkSimulcastLayer *pLayer = &m_Layers[i];
+        if ((pLayer->Status != MCODEC_SUCCEED) || (pLayer->FrameInfo.eFrameType != videoFrameTypeIDR))
+        {
+            pLayer->KeyFrameNeeded = true;
+        }
+    }
+    
+    pFrameInfo->iLayerNum   = LayerNum;
+    pFrameInfo->eFrameType  = (IdrNum > 0) ? videoFrameTypeIDR : videoFrameTypeP;
+    pFrameInfo->uiTimeStamp = pSrcPic->uiTimeStamp;
+    
+    if (LayerNum == 0)
+    {
+        pFrameInfo->eFrameType = videoFrameTypeSkip;
+        return MCODEC_SKIPPED;
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CMSDKSimulcastEncoder::EncodeLayer(MSdkSimulcastLayer* pLayer, SSourcePicture* pSrcPic)
+{
+    //the skipped or failed frame has no bitstream in this layer.
+    pLayer->Status = pLayer->pEncoder->EncodeFrame(pSrcPic, NULL);
+    if (pLayer->Status != MCODEC_SUCCEED)
+    {
+        return;
+    }
+    
+    //the layers of the frame stay in the encoder memory until its next frame. the
+    //frames of the earlier pictures come out late after their waits timed out,
+    //they are dropped to realign the layer with the picture.
+    pLayer->Status = pLayer->pEncoder->GetFrameBitstream(&pLayer->FrameInfo);
+    for (int32_t i = 0; (i < MSDK_SIMULCAST_MAX_LATE) && (pLayer->Status == MCODEC_SUCCEED) &&
+                        (pLayer->FrameInfo.uiTimeStamp < pSrcPic->uiTimeStamp); i++)
+    {
+        pLayer->Status = pLayer->pEncoder->GetFrameBitstream(&pLayer->FrameInfo);
+    }
+    
+    //the layer without the frame of this picture is skipped, and its receivers
+    //have lost the reference, so it starts again from an IDR frame.
+    if ((pLayer->Status != MCODEC_SUCCEED) || (pLayer->FrameInfo.uiTimeStamp != pSrcPic->uiTimeStamp))
+    {
+        pLayer->Status = MCODEC_SKIPPED;
+        pLayer->KeyFrameNeeded = true;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CMSDKSimulcastEncoder::WorkerLoop(MSdkSimulcastLayer* pLayer)
+{
+    while (true)
+    {
+        //one signal for every picture, and one more to exit.
+        sem_wait(&pLayer->StartSignal);
+        if (!m_Running.load())
+        {
+            break;
+        }
+        
+        EncodeLayer(pLayer, m_pPicture);
+        sem_post(&pLayer->DoneSignal);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSimulcastEncoder::UpdateBitrate(int32_t SpatialId, uint32_t Bitrate, uint32_t Framerate)
+{
+    if ((SpatialId < 0) || (SpatialId >= m_LayerNum) || (Bitrate == 0) || (Framerate == 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //applied by EncodeFrame() before the next picture, the last request wins.
+    m_Layers[SpatialId].PendingRate.store(((uint64_t)Bitrate << 32) | Framerate);
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKSimulcastEncoder::InsertKeyFrame(void)
+{
+    if (m_LayerNum == 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //applied to all layers before the next picture.
+    m_KeyFrameRequest.store(true);
+    return MCODEC_SUCCEED;
+}
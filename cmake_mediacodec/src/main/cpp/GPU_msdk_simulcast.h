@@ -0,0 +1,101 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GPU_MSDK_SIMULCAST_H__
+#define __GPU_MSDK_SIMULCAST_H__
+
+#include <stdint.h>
+#include <semaphore.h>
+#include <atomic>
+#include <thread>
+
+#include "include/GPU_codec_api.h"
+
+#define MSDK_MAX_SIMULCAST_LAYERS    4
+
+//the late frames of the earlier pictures dropped before the one of the picture,
+//after their output waits timed out.
+#define MSDK_SIMULCAST_MAX_LATE      4
+
+/////////////////////////////////////////////////////////////////////////////////////
+//One simulcast layer, its encoder, and its last frame. the software layers are
+//encoded by their own worker thread.
+typedef struct
+{
+    VM_MSDKEncoder*        pEncoder;
+    MSdkInputParam         Param;
+    
+    //the bitrate and frame rate from UpdateBitrate(), 0 if none, and the encoder
+    //is reopened with an IDR frame for it, as the hardware encoder.
+    std::atomic<uint64_t>  PendingRate;
+    bool                   RateReopens;
+    
+    std::thread            Worker;
+    sem_t                  StartSignal;
+    sem_t                  DoneSignal;
+    
+    //the last frame in the encoder memory, valid until the next EncodeFrame().
+    int32_t                Status;
+    bool                   KeyFrameNeeded;
+    SFrameBSInfo           FrameInfo;
+    
+}MSdkSimulcastLayer;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The simulcast encoder on a device with few hardware encoder instances. the top
+//layer is encoded by the hardware encoder on the calling thread, while the lower
+//layers are encoded by OpenH264 encoders, each on a worker thread of a spare core.
+//Every layer encodes the same picture with the same timestamp, the IDR frames are
+//requested on all layers together, and the layers are output as one SFrameBSInfo.
+class CMSDKSimulcastEncoder
+{
+public:
+    CMSDKSimulcastEncoder(void);
+    ~CMSDKSimulcastEncoder(void);
+    
+    //Open the layers, pInputParams are ordered from the lowest resolution to the
+    //highest one, the index of a layer is its spatial id.
+    int32_t Open(MSdkInputParam *pInputParams, int32_t LayerNum);
+    
+    //Stop the worker threads and delete the encoders of all layers.
+    int32_t Close(void);
+    
+    //Encode a picture with all the layers, and output the layers of the frame in
+    //spatial id order, the parameter sets and slices of every spatial layer as
+    //GetFrameBitstream(). the bitstream is in the encoder memory, valid until the
+    //next call. a layer whose frame is not output within the output waits of
+    //GetFrameBitstream() is left out, and encodes an IDR frame on the next picture.
+    //return MCODEC_SKIPPED if no layer has output for the picture.
+    int32_t EncodeFrame(SSourcePicture* pSrcPic, SFrameBSInfo* pFrameInfo);
+    
+    //Request to update the target bitrate of one layer, from any thread. it is
+    //applied before the next picture; the hardware encoder is reopened for it with
+    //an IDR frame, so all the layers encode that picture as IDR frames together.
+    int32_t UpdateBitrate(int32_t SpatialId, uint32_t Bitrate, uint32_t Framerate);
+    
+    //Request to encode the next picture as IDR frame, on all the layers, from any
+    //thread.
+    int32_t InsertKeyFrame(void);
+    
+private:
+    
+    //Encode the picture with one layer, and get the frame of it. the layer is
+    //skipped if its frame is not output in time, or another picture comes out.
+    void EncodeLayer(MSdkSimulcastLayer* pLayer, SSourcePicture* pSrcPic);
+    
+    //the loop of the worker thread of a software layer.
+    void WorkerLoop(MSdkSimulcastLayer* pLayer);
+    
+    MSdkSimulcastLayer     m_Layers[MSDK_MAX_SIMULCAST_LAYERS];
+    int32_t                m_LayerNum;
+    std::atomic<bool>      m_Running;
+    
+    //the picture handed to the workers, and the IDR schedule of all layers, the
+    //frames are counted from the last IDR frame of the top layer.
+    SSourcePicture*        m_pPicture;
+    uint32_t               m_nFrames;
+    uint32_t               m_KeyFramePeriod;
+    std::atomic<bool>      m_KeyFrameRequest;
+};
+
+#endif  // End of __GPU_MSDK_SIMULCAST_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
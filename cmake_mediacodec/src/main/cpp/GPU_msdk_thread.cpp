@@ -0,0 +1,314 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <unistd.h>
+
+#include "GPU_msdk_thread.h"
+#include "latency_stats.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMSDKEncodeThread::CMSDKEncodeThread(void)
+    : m_pEncoder(NULL), m_Running(false), m_nPushers(0), m_OutputRunning(false), m_nInFlight(0),
+      m_nLostFrames(0), m_InFlightHead(0), m_Reopening(false), m_pCallback(NULL), m_pContext(NULL),
+      m_KeyFrameRequest(false), m_BitrateRequest(0)
+{
+    sem_init(&m_FrameSignal, 0, 0);
+    sem_init(&m_OutputSignal, 0, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMSDKEncodeThread::~CMSDKEncodeThread(void)
+{
+    Stop();
+    sem_destroy(&m_FrameSignal);
+    sem_destroy(&m_OutputSignal);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncodeThread::Start(MSdkInputParam *InputParam, uint32_t QueueDepth, int32_t DropPolicy,
+                                 MSdkBitstreamCallback pCallback, void* pContext)
+{
+    //the thread could be started once, and the output callback is required.
+    if ((m_pEncoder != NULL) || (pCallback == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    if (MCODEC_SUCCEED != m_Queue.Create(QueueDepth, DropPolicy))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    m_pEncoder = VM_MSDKEncoder::CreateEncoder(InputParam);
+    if (m_pEncoder == NULL)
+    {
+        m_Queue.Destroy();
+        return MCODEC_ERROR;
+    }
+    
+    m_pCallback = pCallback;
+    m_pContext  = pContext;
+    m_KeyFrameRequest.store(false);
+    m_BitrateRequest.store(0);
+    m_nInFlight.store(0);
+    m_nLostFrames.store(0);
+    m_InFlightHead = 0;
+    m_Reopening.store(false);
+    m_OutputRunning.store(true);
+    m_Running.store(true);
+    
+    //start the output thread first, then the input thread for the queued pictures.
+    m_OutputThread = std::thread(&CMSDKEncodeThread::OutputLoop, this);
+    m_Thread = std::thread(&CMSDKEncodeThread::EncodeLoop, this);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncodeThread::Stop(void)
+{
+    if (m_pEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //no new picture is pushed, and the running pushes finish before the queue
+    //is destroyed.
+    m_Running.store(false);
+    while (m_nPushers.load() != 0)
+    {
+        std::this_thread::yield();
+    }
+    
+    //the input thread ends first, its encoder wait is bounded, and the output
+    //thread still takes the bitstream for it meanwhile.
+    sem_post(&m_FrameSignal);
+    if (m_Thread.joinable())
+    {
+        m_Thread.join();
+    }
+    
+    //the output thread gives up the frames in the codec within one output wait.
+    m_OutputRunning.store(false);
+    sem_post(&m_OutputSignal);
+    if (m_OutputThread.joinable())
+    {
+        m_OutputThread.join();
+    }
+    
+    VM_MSDKEncoder::DeleteEncoder(m_pEncoder);
+    m_pEncoder = NULL;
+    m_Queue.Destroy();
+    
+    //drain the signals of the discarded pictures and frames.
+    while (sem_trywait(&m_FrameSignal) == 0)
+    {
+    }
+    while (sem_trywait(&m_OutputSignal) == 0)
+    {
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncodeThread::PushFrame(SSourcePicture* pSrcPic)
+{
+    //the push is counted before the check, so Stop() either sees it or it sees
+    //the stop, and the queue is never destroyed under it.
+    m_nPushers.fetch_add(1);
+    if (!m_Running.load())
+    {
+        m_nPushers.fetch_sub(1);
+        return MCODEC_ERROR;
+    }
+    
+    //copy the picture to the queue, and wake up the encoder thread.
+    int32_t status = m_Queue.Push(pSrcPic);
+    if (status == MCODEC_SUCCEED)
+    {
+        sem_post(&m_FrameSignal);
+    }
+    
+    m_nPushers.fetch_sub(1);
+    return status;
+}
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncodeThread::UpdateBitrate(uint32_t Bitrate, uint32_t Framerate)
+{
+    if ((Bitrate == 0) && (Framerate == 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the newest request replaces the one not applied yet.
+    m_BitrateRequest.store(((uint64_t)Bitrate << 32) | Framerate);
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncodeThread::InsertKeyFrame(void)
+{
+    m_KeyFrameRequest.store(true);
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+uint32_t CMSDKEncodeThread::GetDroppedFrames(void)
+{
+    return m_Queue.GetDroppedCount();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+uint32_t CMSDKEncodeThread::GetLostFrames(void)
+{
+    return m_nLostFrames.load();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CMSDKEncodeThread::AddInFlight(int64_t TimeStamp)
+{
+    std::lock_guard<std::mutex> lock(m_InFlightLock);
+    
+    //the codec holds more frames than it could, the oldest one never comes out.
+    int32_t count = m_nInFlight.load();
+    if (count == MSDK_THREAD_MAX_IN_FLIGHT)
+    {
+        m_InFlightHead = (m_InFlightHead + 1) % MSDK_THREAD_MAX_IN_FLIGHT;
+        m_nLostFrames.fetch_add(1);
+        count--;
+    }
+    
+    m_InFlightStamps[(m_InFlightHead + count) % MSDK_THREAD_MAX_IN_FLIGHT] = TimeStamp;
+    m_nInFlight.store(count + 1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMSDKEncodeThread::RetireInFlight(int64_t TimeStamp)
+{
+    std::lock_guard<std::mutex> lock(m_InFlightLock);
+    
+    //the output is for the oldest frame at least, and the older frames than it
+    //were dropped or merged by the codec.
+    int32_t count = m_nInFlight.load();
+    int32_t retired = 0;
+    while ((retired < count) &&
+           ((retired == 0) || (m_InFlightStamps[(m_InFlightHead + retired) % MSDK_THREAD_MAX_IN_FLIGHT] <= TimeStamp)))
+    {
+        retired++;
+    }
+    
+    m_InFlightHead = (m_InFlightHead + retired) % MSDK_THREAD_MAX_IN_FLIGHT;
+    m_nInFlight.store(count - retired);
+    return retired;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CMSDKEncodeThread::EncodeLoop(void)
+{
+    while (m_Running.load())
+    {
+        //one signal for every queued picture, the dropped ones leave extra signals.
+        sem_wait(&m_FrameSignal);
+        
+        MSdkPictureSlot *pSlot = m_Queue.Pop();
+        if (pSlot == NULL)
+        {
+            continue;
+        }
+        
+        //the encoder is reopened for the requests, after the output thread has
+        //taken the bitstream of the frames in the codec, or the drain times out
+        //for a frame the codec never outputs.
+        if ((m_BitrateRequest.load() != 0) || m_KeyFrameRequest.load())
+        {
+            int64_t deadline = latency_NowUs() + MSDK_THREAD_DRAIN_TIMEOUT_US;
+            while ((m_nInFlight.load() > 0) && m_Running.load() && (latency_NowUs() < deadline))
+            {
+                usleep(1000);
+            }
+            
+            //the output thread leaves the codec after the frame it is taking, and
+            //the frames still in the codec are discarded by the reopen.
+            m_Reopening.store(true);
+            {
+                std::lock_guard<std::mutex> lock(m_CodecLock);
+                m_nLostFrames.fetch_add(RetireInFlight(INT64_MAX));
+                
+                if (m_Running.load())
+                {
+                    uint64_t request = m_BitrateRequest.exchange(0);
+                    if (request != 0)
+                    {
+                        m_pEncoder->UpdateBitrate((uint32_t)(request >> 32), (uint32_t)request);
+                    }
+                    if (m_KeyFrameRequest.exchange(false))
+                    {
+                        m_pEncoder->InsertKeyFrame();
+                    }
+                }
+            }
+            m_Reopening.store(false);
+        }
+        
+        //the skipped frame has no bitstream, the others are taken by the output thread.
+        int64_t timestamp = pSlot->Picture.uiTimeStamp;
+        int32_t status = m_pEncoder->EncodeFrame(&pSlot->Picture, NULL);
+        m_Queue.Release(pSlot);
+        
+        if (status == MCODEC_SUCCEED)
+        {
+            AddInFlight(timestamp);
+            sem_post(&m_OutputSignal);
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CMSDKEncodeThread::OutputLoop(void)
+{
+    MSdkBitstream Bitstream;
+    
+    while (true)
+    {
+        //one signal for every encoded frame, and one more to exit. the signal of a
+        //frame already retired with an earlier output finds nothing to take.
+        sem_wait(&m_OutputSignal);
+        
+        //the output wait is bounded, and repeated until the frames in the codec
+        //come out, or they are given up by the reopen or Stop().
+        while ((m_nInFlight.load() > 0) && m_OutputRunning.load())
+        {
+            if (m_Reopening.load())
+            {
+                usleep(1000);
+                continue;
+            }
+            
+            std::lock_guard<std::mutex> lock(m_CodecLock);
+            int32_t status = m_pEncoder->LockBitstream(&Bitstream);
+            if (status == MCODEC_SKIPPED)
+            {
+                continue;
+            }
+            
+            //the output retires its own frame, and the older ones are lost.
+            if (status == MCODEC_SUCCEED)
+            {
+                m_pCallback(m_pContext, &Bitstream);
+                m_pEncoder->UnlockBitstream(&Bitstream);
+                m_nLostFrames.fetch_add(RetireInFlight(Bitstream.uiTimeStamp) - 1);
+            }
+            else
+            {
+                m_nLostFrames.fetch_add(RetireInFlight(INT64_MIN));
+            }
+            break;
+        }
+        
+        if (!m_OutputRunning.load())
+        {
+            break;
+        }
+    }
+}
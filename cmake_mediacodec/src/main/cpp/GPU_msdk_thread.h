@@ -0,0 +1,114 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GPU_MSDK_THREAD_H__
+#define __GPU_MSDK_THREAD_H__
+
+#include <stdint.h>
+#include <semaphore.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "frame_queue.h"
+#include "include/GPU_codec_api.h"
+
+//Called on the output thread with the borrowed bitstream of every frame, the
+//bitstream is given back to the encoder after the callback returns.
+typedef void (*MSdkBitstreamCallback)(void* pContext, MSdkBitstream* pBitstream);
+
+//the frames in the codec tracked by their timestamps, and the longest wait for
+//them before the encoder is reopened, the frames left are counted as lost.
+#define MSDK_THREAD_MAX_IN_FLIGHT     32
+#define MSDK_THREAD_DRAIN_TIMEOUT_US  (4 * MSDK_OUTPUT_TIMEOUT_US)
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The encoder driven by dedicated threads. The capture thread only copies the
+//picture into a lock-free queue, and is never blocked by the codec. The input
+//thread queues the pictures to the encoder, while the output thread takes the
+//bitstream of the earlier ones, so several frames are in the codec together. the
+//reopen requests are applied by the input thread, after the frames in the codec
+//are output or the drain times out. every output is matched to the frames by its
+//timestamp, so a frame dropped or merged by the codec is counted as lost, and
+//never waited for. All the codec waits are bounded, so Stop() is never blocked
+//by a stalled codec.
+class CMSDKEncodeThread
+{
+public:
+    CMSDKEncodeThread(void);
+    ~CMSDKEncodeThread(void);
+    
+    //Create the encoder and the frame queue, and start the encoder thread.
+    int32_t Start(MSdkInputParam *InputParam, uint32_t QueueDepth, int32_t DropPolicy,
+                  MSdkBitstreamCallback pCallback, void* pContext);
+    
+    //Stop the encoder threads, the queued pictures are discarded. it waits for
+    //PushFrame() calls running on other threads.
+    int32_t Stop(void);
+    
+    //Queue a picture from the capture thread, return MCODEC_SKIPPED if it is dropped,
+    //or MCODEC_ERROR if the thread is stopped.
+    int32_t PushFrame(SSourcePicture* pSrcPic);
+    
+    //Request to update the target bitrate, before the next frame.
+    int32_t UpdateBitrate(uint32_t Bitrate, uint32_t Framerate);
+    
+    //Request to encode the next frame as IDR frame.
+    int32_t InsertKeyFrame(void);
+    
+    //Get the number of the pictures dropped by the queue.
+    uint32_t GetDroppedFrames(void);
+    
+    //Get the number of the encoded frames which never came out of the codec.
+    uint32_t GetLostFrames(void);
+    
+private:
+    
+    //the loop of the input thread.
+    void EncodeLoop(void);
+    
+    //the loop of the output thread.
+    void OutputLoop(void);
+    
+    //Add the encoded frame to the frames in flight, the oldest is lost if full.
+    void AddInFlight(int64_t TimeStamp);
+    
+    //Remove the oldest frame in flight and the ones up to the timestamp, as they
+    //are output in order. return the number of the removed frames.
+    int32_t RetireInFlight(int64_t TimeStamp);
+    
+    VM_MSDKEncoder*        m_pEncoder;
+    CFrameQueue            m_Queue;
+    std::thread            m_Thread;
+    sem_t                  m_FrameSignal;
+    std::atomic<bool>      m_Running;
+    
+    //the PushFrame() calls in progress, Stop() destroys the queue after them.
+    std::atomic<int32_t>   m_nPushers;
+    
+    //the output thread, and the frames in the codec whose bitstream is not taken.
+    std::thread            m_OutputThread;
+    sem_t                  m_OutputSignal;
+    std::atomic<bool>      m_OutputRunning;
+    std::atomic<int32_t>   m_nInFlight;
+    std::atomic<uint32_t>  m_nLostFrames;
+    
+    //the timestamps of the frames in flight in the encode order, as a ring.
+    std::mutex             m_InFlightLock;
+    int64_t                m_InFlightStamps[MSDK_THREAD_MAX_IN_FLIGHT];
+    int32_t                m_InFlightHead;
+    
+    //the output thread holds the codec while it takes a frame, and leaves it to
+    //the input thread while the encoder is reopened.
+    std::mutex             m_CodecLock;
+    std::atomic<bool>      m_Reopening;
+    
+    MSdkBitstreamCallback  m_pCallback;
+    void*                  m_pContext;
+    
+    //the requests for the encoder thread, the bitrate and framerate are packed.
+    std::atomic<bool>      m_KeyFrameRequest;
+    std::atomic<uint64_t>  m_BitrateRequest;
+};
+
+#endif  // End of __GPU_MSDK_THREAD_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,700 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <time.h>
+
+#include "GPU_soft_codec.h"
+#include "image_scaler.h"
+#include "nal_parser.h"
+#include "trace_events.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Wait for the signal at most TimeoutUs, return false if it times out.
+static bool WaitSignal(sem_t* pSignal, int64_t TimeoutUs)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec  += TimeoutUs / 1000000;
+    deadline.tv_nsec += (TimeoutUs % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    
+    while (sem_timedwait(pSignal, &deadline) != 0)
+    {
+        if (errno != EINTR)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CSoftEncoder::CSoftEncoder(void)
+{
+    //Initialize local control parameters for encoding.
+    m_pEncoder      = NULL;
+    m_CodecInitFlag = 0;
+    m_pPicture      = NULL;
+    m_nWriteFrame.store(0);
+    m_nReadFrame.store(0);
+    m_nOffered.store(0);
+    m_nSkipped.store(0);
+    memset(&m_InitParams, 0, sizeof(MSdkInputParam));
+    memset(&m_FrameOutput, 0, sizeof(MSdkFrameBuffer));
+    
+    for (int32_t i = 0; i < MSDK_SOFT_OUTPUT_FRAMES; i++)
+    {
+        m_Frames[i].pBuffer    = NULL;
+        m_Frames[i].BufferSize = 0;
+    }
+    for (int32_t i = 0; i < MSDK_LATENCY_STAGES; i++)
+    {
+        latency_Reset(&m_Latency[i]);
+    }
+    
+    sem_init(&m_FreeFrames, 0, MSDK_SOFT_OUTPUT_FRAMES);
+    sem_init(&m_ReadyFrames, 0, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CSoftEncoder::~CSoftEncoder(void)
+{
+    //Destroy the software encoder instance if necessary.
+    if (m_CodecInitFlag != 0)
+    {
+        CloseEncoder();
+    }
+    
+    for (int32_t i = 0; i < MSDK_SOFT_OUTPUT_FRAMES; i++)
+    {
+        free(m_Frames[i].pBuffer);
+        m_Frames[i].pBuffer = NULL;
+    }
+    bitstream_FreeFrame(&m_FrameOutput);
+    
+    sem_destroy(&m_FreeFrames);
+    sem_destroy(&m_ReadyFrames);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::OpenEncoder(MSdkInputParam *InputParam)
+{
+    //Every instance could be opened once, and OpenH264 only encodes H264/AVC.
+    if ((m_CodecInitFlag != 0) || (InputParam->nCodecType != VIDEO_CODEC_TYPE_AVC))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    m_InitParams = *InputParam;
+    if ((m_InitParams.nWidth == 0) || (m_InitParams.nHeight == 0) || (m_InitParams.nFrameRate == 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    if (WelsCreateSVCEncoder(&m_pEncoder) != 0)
+    {
+        m_pEncoder = NULL;
+        return MCODEC_ERROR;
+    }
+    
+    //the same settings as the hardware encoder, a single spatial layer with the
+    //key frame every 5 seconds, and the rate control of the input parameters.
+    SEncParamExt param;
+    m_pEncoder->GetDefaultParams(&param);
+    
+    uint32_t layers = m_InitParams.nTemporalLayers;
+    layers = (layers < 1) ? 1 : ((layers > 3) ? 3 : layers);
+    
+    param.iUsageType        = CAMERA_VIDEO_REAL_TIME;
+    param.iPicWidth         = m_InitParams.nWidth;
+    param.iPicHeight        = m_InitParams.nHeight;
+    param.iTargetBitrate    = m_InitParams.nTargetKbps * 1000;
+    param.fMaxFrameRate     = m_InitParams.nFrameRate;
+    param.iTemporalLayerNum = layers;
+    param.iSpatialLayerNum  = 1;
+    param.uiIntraPeriod     = m_InitParams.nFrameRate * 5;
+    param.eSpsPpsIdStrategy = CONSTANT_ID;
+    param.bEnableFrameSkip  = (m_InitParams.nRCMode != MSDK_RC_MODE_CQ);
+    
+    //OpenH264 keeps its default mode, if the rate control is not set.
+    if (m_InitParams.nRCMode == MSDK_RC_MODE_CBR)
+    {
+        param.iRCMode = RC_BITRATE_MODE;
+    }
+    else if (m_InitParams.nRCMode == MSDK_RC_MODE_VBR)
+    {
+        param.iRCMode = RC_QUALITY_MODE;
+    }
+    else if (m_InitParams.nRCMode == MSDK_RC_MODE_CQ)
+    {
+        param.iRCMode = RC_OFF_MODE;
+    }
+    
+    //the long-term references are marked by OpenH264 every period.
+    uint32_t ltr_frames = m_InitParams.nLtrFrames;
+    ltr_frames = (ltr_frames > MSDK_MAX_LTR_FRAMES) ? MSDK_MAX_LTR_FRAMES : ltr_frames;
+    param.bEnableLongTermReference = (ltr_frames > 0);
+    param.iLTRRefNum               = ltr_frames;
+    param.iLtrMarkPeriod           = MSDK_LTR_MARK_PERIOD;
+    
+    param.sSpatialLayers[0].iVideoWidth        = m_InitParams.nWidth;
+    param.sSpatialLayers[0].iVideoHeight       = m_InitParams.nHeight;
+    param.sSpatialLayers[0].fFrameRate         = m_InitParams.nFrameRate;
+    param.sSpatialLayers[0].iSpatialBitrate    = param.iTargetBitrate;
+    param.sSpatialLayers[0].iMaxSpatialBitrate = UNSPECIFIED_BIT_RATE;
+    
+    //the slice mode, every slice is output as its own NAL unit.
+    if (SetSliceArgument(&param) != MCODEC_SUCCEED)
+    {
+        WelsDestroySVCEncoder(m_pEncoder);
+        m_pEncoder = NULL;
+        return MCODEC_ERROR;
+    }
+    
+    int32_t format = videoFormatI420;
+    if ((m_pEncoder->InitializeExt(&param) != 0) ||
+        (m_pEncoder->SetOption(ENCODER_OPTION_DATAFORMAT, &format) != 0))
+    {
+        WelsDestroySVCEncoder(m_pEncoder);
+        m_pEncoder = NULL;
+        return MCODEC_ERROR;
+    }
+    
+    //the picture buffer of the encoder size, for the scaled or mirrored input.
+    size_t luma_size = (size_t)m_InitParams.nWidth * m_InitParams.nHeight;
+    m_pPicture = (uint8_t *)malloc(luma_size + (luma_size >> 1));
+    if (m_pPicture == NULL)
+    {
+        m_pEncoder->Uninitialize();
+        WelsDestroySVCEncoder(m_pEncoder);
+        m_pEncoder = NULL;
+        return MCODEC_ERROR;
+    }
+    
+    m_CodecInitFlag = 1;
+    
+    //Succed to open the software encoder, return the result.
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::CloseEncoder(void)
+{
+    //if the encoder was not opened, do nothing and exit.
+    if (m_CodecInitFlag == 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    m_pEncoder->Uninitialize();
+    WelsDestroySVCEncoder(m_pEncoder);
+    m_pEncoder = NULL;
+    
+    free(m_pPicture);
+    m_pPicture = NULL;
+    
+    //the queued frames are discarded with the encoder.
+    while (sem_trywait(&m_ReadyFrames) == 0)
+    {
+        sem_post(&m_FreeFrames);
+    }
+    m_nReadFrame.store(m_nWriteFrame.load());
+    
+    //Update the initialize flag to close device.
+    m_CodecInitFlag = 0;
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer)
+{
+    CTraceScope trace("EncodeFrame");
+    int64_t StartUs = latency_NowUs();
+    
+    //the frame is output by GetBitstream() later, never to the layer here.
+    (void)pBsLayer;
+    
+    //if the encoder was not opened, or no picture, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pSrcPic == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    m_nOffered.fetch_add(1, std::memory_order_relaxed);
+    
+    //wait for a free output frame, the caller has not taken the older ones.
+    {
+        CTraceScope wait_trace("WaitInputBuffer");
+        if (!WaitSignal(&m_FreeFrames, MSDK_INPUT_TIMEOUT_US))
+        {
+            return MCODEC_ERROR;
+        }
+    }
+    
+    int64_t ScaleUs = latency_NowUs();
+    latency_Record(&m_Latency[MSDK_LATENCY_INPUT_WAIT], ScaleUs - StartUs);
+    
+    int32_t srcWidth  = pSrcPic->iPicWidth;
+    int32_t srcHeight = pSrcPic->iPicHeight;
+    int32_t dstWidth  = m_InitParams.nWidth;
+    int32_t dstHeight = m_InitParams.nHeight;
+    
+    uint8_t *encPlaneY = m_pPicture;
+    uint8_t *encPlaneU = encPlaneY + dstWidth * dstHeight;
+    uint8_t *encPlaneV = encPlaneU + (dstWidth >> 1) * (dstHeight >> 1);
+    
+    //scale the input image to encoder size, or mirror it as the hardware path.
+    if ((srcWidth != dstWidth) || (srcHeight != dstHeight))
+    {
+        CTraceScope scale_trace("I420Scale");
+        scaler_I420Scale(pSrcPic->pData[0], pSrcPic->iStride[0],
+                         pSrcPic->pData[1], pSrcPic->iStride[1],
+                         pSrcPic->pData[2], pSrcPic->iStride[2],
+                         srcWidth, srcHeight,
+                         encPlaneY, dstWidth,
+                         encPlaneU, (dstWidth >> 1),
+                         encPlaneV, (dstWidth >> 1),
+                         dstWidth, dstHeight);
+    }
+    else
+    {
+        CTraceScope scale_trace("I420Mirror");
+        scaler_I420Mirror(pSrcPic->pData[0], pSrcPic->iStride[0],
+                          pSrcPic->pData[1], pSrcPic->iStride[1],
+                          pSrcPic->pData[2], pSrcPic->iStride[2],
+                          encPlaneY, dstWidth,
+                          encPlaneU, (dstWidth >> 1),
+                          encPlaneV, (dstWidth >> 1),
+                          dstWidth, dstHeight);
+    }
+    
+    SSourcePicture EncPic;
+    memset(&EncPic, 0, sizeof(SSourcePicture));
+    EncPic.iColorFormat = videoFormatI420;
+    EncPic.iPicWidth    = dstWidth;
+    EncPic.iPicHeight   = dstHeight;
+    EncPic.iStride[0]   = dstWidth;
+    EncPic.iStride[1]   = dstWidth >> 1;
+    EncPic.iStride[2]   = dstWidth >> 1;
+    EncPic.pData[0]     = encPlaneY;
+    EncPic.pData[1]     = encPlaneU;
+    EncPic.pData[2]     = encPlaneV;
+    EncPic.uiTimeStamp  = pSrcPic->uiTimeStamp;
+    
+    int64_t EncodeUs = latency_NowUs();
+    latency_Record(&m_Latency[MSDK_LATENCY_SCALE], EncodeUs - ScaleUs);
+    
+    //OpenH264 encodes the picture in this call.
+    SFrameBSInfo FrameInfo;
+    memset(&FrameInfo, 0, sizeof(SFrameBSInfo));
+    if (m_pEncoder->EncodeFrame(&EncPic, &FrameInfo) != 0)
+    {
+        sem_post(&m_FreeFrames);
+        return MCODEC_ERROR;
+    }
+    
+    //the rate control skipped the frame, there is no output for it.
+    if ((FrameInfo.eFrameType == videoFrameTypeSkip) || (FrameInfo.iLayerNum == 0))
+    {
+        m_nSkipped.fetch_add(1, std::memory_order_relaxed);
+        sem_post(&m_FreeFrames);
+        return MCODEC_SKIPPED;
+    }
+    
+    MSdkSoftFrame *pFrame = &m_Frames[m_nWriteFrame % MSDK_SOFT_OUTPUT_FRAMES];
+    if (MCODEC_SUCCEED != SaveFrame(&FrameInfo, pFrame))
+    {
+        sem_post(&m_FreeFrames);
+        return MCODEC_ERROR;
+    }
+    
+    pFrame->TimeStamp = pSrcPic->uiTimeStamp;
+    pFrame->StartUs   = StartUs;
+    pFrame->EncodedUs = latency_NowUs();
+    latency_Record(&m_Latency[MSDK_LATENCY_ENCODE], pFrame->EncodedUs - EncodeUs);
+    
+    //publish the encoded frame to the output side.
+    m_nWriteFrame++;
+    sem_post(&m_ReadyFrames);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::SetSliceArgument(SEncParamExt* pParam)
+{
+    SSliceArgument *pSlice = &pParam->sSpatialLayers[0].sSliceArgument;
+    uint32_t argument = m_InitParams.nSliceArgument;
+    
+    pSlice->uiSliceMode = (SliceModeEnum)m_InitParams.nSliceMode;
+    switch (m_InitParams.nSliceMode)
+    {
+        case SM_SINGLE_SLICE:
+            pSlice->uiSliceNum = 1;
+            break;
+        
+        //a fixed number of slices, 0 for one slice of each core.
+        case SM_FIXEDSLCNUM_SLICE:
+            pSlice->uiSliceNum = (argument > MAX_SLICES_NUM_TMP) ? MAX_SLICES_NUM_TMP : argument;
+            break;
+        
+        //the slices of the same macroblocks, the last one takes the rest.
+        case SM_RASTER_SLICE:
+        {
+            uint32_t mbs = ((m_InitParams.nWidth + 15) >> 4) * ((m_InitParams.nHeight + 15) >> 4);
+            argument = (argument == 0) ? ((m_InitParams.nWidth + 15) >> 4) : argument;
+            argument = (argument < (mbs + MAX_SLICES_NUM_TMP - 1) / MAX_SLICES_NUM_TMP) ?
+                       (mbs + MAX_SLICES_NUM_TMP - 1) / MAX_SLICES_NUM_TMP : argument;
+            
+            pSlice->uiSliceNum = 0;
+            for (uint32_t mb = 0; mb < mbs; mb += argument)
+            {
+                pSlice->uiSliceMbNum[pSlice->uiSliceNum++] = (mbs - mb < argument) ? (mbs - mb) : argument;
+            }
+            break;
+        }
+        
+        //the NAL unit of a slice is at most the max bytes, such as the RTP MTU.
+        case SM_SIZELIMITED_SLICE:
+            if (argument <= MSDK_SOFT_SLICE_HEADROOM * 2)
+            {
+                return MCODEC_ERROR;
+            }
+            pParam->uiMaxNalSize          = argument;
+            pSlice->uiSliceSizeConstraint = argument - MSDK_SOFT_SLICE_HEADROOM;
+            break;
+        
+        default:
+            return MCODEC_ERROR;
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::SaveFrame(SFrameBSInfo* pFrameInfo, MSdkSoftFrame* pFrame)
+{
+    int32_t length = 0;
+    
+    //the layers are the parameter sets and the slices, joined in order.
+    for (int32_t i = 0; i < pFrameInfo->iLayerNum; i++)
+    {
+        SLayerBSInfo *pLayer = &pFrameInfo->sLayerInfo[i];
+        for (int32_t j = 0; j < pLayer->iNalCount; j++)
+        {
+            length += pLayer->pNalLengthInByte[j];
+        }
+    }
+    
+    //grow the frame buffer only for a larger frame.
+    if (pFrame->BufferSize < (size_t)length)
+    {
+        uint8_t *pBuffer = (uint8_t *)realloc(pFrame->pBuffer, length);
+        if (pBuffer == NULL)
+        {
+            return MCODEC_ERROR;
+        }
+        pFrame->pBuffer    = pBuffer;
+        pFrame->BufferSize = length;
+    }
+    
+    pFrame->Length       = 0;
+    pFrame->NalCount     = 0;
+    pFrame->eFrameType   = pFrameInfo->eFrameType;
+    pFrame->uiTemporalId = 0;
+    
+    for (int32_t i = 0; i < pFrameInfo->iLayerNum; i++)
+    {
+        SLayerBSInfo *pLayer = &pFrameInfo->sLayerInfo[i];
+        int32_t layer_length = 0;
+        
+        //the NAL units beyond the limit are merged into the last one.
+        for (int32_t j = 0; j < pLayer->iNalCount; j++)
+        {
+            if (pFrame->NalCount < MAX_NAL_UNITS_IN_LAYER)
+            {
+                pFrame->NalLengthInByte[pFrame->NalCount++] = pLayer->pNalLengthInByte[j];
+            }
+            else
+            {
+                pFrame->NalLengthInByte[MAX_NAL_UNITS_IN_LAYER - 1] += pLayer->pNalLengthInByte[j];
+            }
+            layer_length += pLayer->pNalLengthInByte[j];
+        }
+        
+        memcpy(pFrame->pBuffer + pFrame->Length, pLayer->pBsBuf, layer_length);
+        pFrame->Length += layer_length;
+        
+        if (pLayer->uiLayerType == VIDEO_CODING_LAYER)
+        {
+            pFrame->uiTemporalId = pLayer->uiTemporalId;
+        }
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::LockBitstream(MSdkBitstream* pBitstream)
+{
+    CTraceScope trace("LockBitstream");
+    
+    //if the encoder was not opened, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pBitstream == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //wait for the oldest encoded frame, as the hardware encoder does.
+    {
+        CTraceScope wait_trace("WaitOutputBuffer");
+        if (!WaitSignal(&m_ReadyFrames, MSDK_OUTPUT_TIMEOUT_US))
+        {
+            return MCODEC_SKIPPED;
+        }
+    }
+    
+    int32_t index = m_nReadFrame % MSDK_SOFT_OUTPUT_FRAMES;
+    MSdkSoftFrame *pFrame = &m_Frames[index];
+    
+    //the access unit is lent in Annex-B format, every NAL unit with its start code.
+    pBitstream->SegmentCount          = 1;
+    pBitstream->Segments[0].iov_base  = pFrame->pBuffer;
+    pBitstream->Segments[0].iov_len   = pFrame->Length;
+    
+    pBitstream->NalCount = pFrame->NalCount;
+    for (int32_t i = 0; i < pFrame->NalCount; i++)
+    {
+        pBitstream->NalLengthInByte[i] = pFrame->NalLengthInByte[i];
+    }
+    
+    pBitstream->eFrameType   = pFrame->eFrameType;
+    pBitstream->uiTemporalId = pFrame->uiTemporalId;
+    pBitstream->uiQualityId  = 0;
+    pBitstream->uiSpatialId  = m_InitParams.nSpatialId;
+    pBitstream->uiTimeStamp  = pFrame->TimeStamp;
+    pBitstream->BufferIndex  = index;
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::UnlockBitstream(MSdkBitstream* pBitstream)
+{
+    //if the encoder was not opened, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pBitstream == NULL) || (pBitstream->BufferIndex < 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the output stage ends when the bitstream is copied or sent by caller.
+    MSdkSoftFrame *pFrame = &m_Frames[pBitstream->BufferIndex];
+    int64_t DoneUs = latency_NowUs();
+    latency_Record(&m_Latency[MSDK_LATENCY_OUTPUT], DoneUs - pFrame->EncodedUs);
+    latency_Record(&m_Latency[MSDK_LATENCY_TOTAL], DoneUs - pFrame->StartUs);
+    
+    //give the frame back to EncodeFrame(), the frames are taken in order.
+    pBitstream->BufferIndex  = -1;
+    pBitstream->SegmentCount = 0;
+    m_nReadFrame++;
+    sem_post(&m_FreeFrames);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::GetBitstream(SLayerBSInfo* pBsLayer)
+{
+    CTraceScope trace("GetBitstream");
+    MSdkBitstream Bitstream;
+    
+    //Borrow the bitstream from encoder, and copy it to the output buffer. the
+    //frame is waited for a bounded number of output waits.
+    int32_t status = LockBitstream(&Bitstream);
+    for (int32_t retry = 1; (status == MCODEC_SKIPPED) && (retry < MSDK_OUTPUT_RETRIES); retry++)
+    {
+        status = LockBitstream(&Bitstream);
+    }
+    if (status != MCODEC_SUCCEED)
+    {
+        return (status == MCODEC_SKIPPED) ? MCODEC_SKIPPED : MCODEC_ERROR;
+    }
+    
+    //the first NAL unit of the access unit is output without start code, as before.
+    int32_t sc_len = 0;
+    if (nal_FindStartCode((uint8_t *)Bitstream.Segments[0].iov_base, Bitstream.Segments[0].iov_len, &sc_len) != 0)
+    {
+        sc_len = 0;
+    }
+    memcpy(pBsLayer->pBsBuf, (uint8_t *)Bitstream.Segments[0].iov_base + sc_len, Bitstream.Segments[0].iov_len - sc_len);
+    
+    //every NAL unit is reported with its own length, in the output order.
+    pBsLayer->iNalCount = Bitstream.NalCount;
+    for (int32_t i = 0; i < Bitstream.NalCount; i++)
+    {
+        pBsLayer->pNalLengthInByte[i] = Bitstream.NalLengthInByte[i];
+    }
+    if (Bitstream.NalCount > 0)
+    {
+        pBsLayer->pNalLengthInByte[0] -= sc_len;
+    }
+    
+    //Save the spatial layer encoded parameters to output buffer.
+    pBsLayer->eFrameType   = Bitstream.eFrameType;
+    pBsLayer->uiTemporalId = Bitstream.uiTemporalId;
+    pBsLayer->uiQualityId  = Bitstream.uiQualityId;
+    pBsLayer->uiSpatialId  = Bitstream.uiSpatialId;
+    pBsLayer->uiLayerType  = 1;
+    
+    //release the output frame, for the next encoding.
+    UnlockBitstream(&Bitstream);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::GetFrameBitstream(SFrameBSInfo* pFrameInfo)
+{
+    CTraceScope trace("GetFrameBitstream");
+    MSdkBitstream Bitstream;
+    
+    if (pFrameInfo == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //Borrow the bitstream from encoder, and copy the whole frame in one pass. the
+    //frame is waited for a bounded number of output waits.
+    int32_t status = LockBitstream(&Bitstream);
+    for (int32_t retry = 1; (status == MCODEC_SKIPPED) && (retry < MSDK_OUTPUT_RETRIES); retry++)
+    {
+        status = LockBitstream(&Bitstream);
+    }
+    if (status != MCODEC_SUCCEED)
+    {
+        return (status == MCODEC_SKIPPED) ? MCODEC_SKIPPED : MCODEC_ERROR;
+    }
+    
+    status = bitstream_CopyToFrame(&Bitstream, m_InitParams.nCodecType, &m_FrameOutput, pFrameInfo);
+    
+    //release the output buffer, the frame stays in the copy until the next call.
+    UnlockBitstream(&Bitstream);
+    
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::UpdateBitrate(uint32_t Bitrate, uint32_t Framerate)
+{
+    CTraceScope trace("UpdateBitrate");
+    
+    //if the encoder was not opened, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (Framerate == 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //OpenH264 takes the new target at once, no reopen and no IDR frame.
+    SBitrateInfo BitrateInfo;
+    BitrateInfo.iLayer   = SPATIAL_LAYER_ALL;
+    BitrateInfo.iBitrate = Bitrate * 1000;
+    
+    float FrameRate = (float)Framerate;
+    if ((m_pEncoder->SetOption(ENCODER_OPTION_BITRATE, &BitrateInfo) != 0) ||
+        (m_pEncoder->SetOption(ENCODER_OPTION_FRAME_RATE, &FrameRate) != 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    m_InitParams.nTargetKbps = Bitrate;
+    m_InitParams.nFrameRate  = Framerate;
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::InsertKeyFrame(void)
+{
+    CTraceScope trace("InsertKeyFrame");
+    
+    //if the encoder was not opened, do nothing and exit.
+    if (m_CodecInitFlag == 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return (m_pEncoder->ForceIntraFrame(true) == 0) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::RequestLtrRecovery(SLTRRecoverRequest* pRequest)
+{
+    CTraceScope trace("RequestLtrRecovery");
+    
+    //if the encoder was not opened, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pRequest == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //OpenH264 refers to the acknowledged reference, or encodes an IDR frame.
+    if ((pRequest->uiFeedbackType == LTR_RECOVERY_REQUEST) && (m_InitParams.nLtrFrames > 0) &&
+        (m_pEncoder->SetOption(ENCODER_LTR_RECOVERY_REQUEST, pRequest) == 0))
+    {
+        return MCODEC_SUCCEED;
+    }
+    
+    return InsertKeyFrame();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::SetLtrMarkingFeedback(SLTRMarkingFeedback* pFeedback)
+{
+    //if the encoder was not opened, or LTR is disabled, do nothing and exit.
+    if ((m_CodecInitFlag == 0) || (pFeedback == NULL) || (m_InitParams.nLtrFrames == 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return (m_pEncoder->SetOption(ENCODER_LTR_MARKING_FEEDBACK, pFeedback) == 0) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::GetLatencyStats(MSdkLatencyStats* pStats)
+{
+    if (pStats == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the histograms are read without lock, while the encoder is running.
+    for (int32_t i = 0; i < MSDK_LATENCY_STAGES; i++)
+    {
+        latency_Query(&m_Latency[i], &pStats->Stages[i]);
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CSoftEncoder::GetDropStats(MSdkDropStats* pStats)
+{
+    if (pStats == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the encoding is synchronous, there is no frame in flight to drop for.
+    memset(pStats, 0, sizeof(MSdkDropStats));
+    pStats->FramesOffered = m_nOffered.load(std::memory_order_relaxed);
+    pStats->FramesDropped = m_nSkipped.load(std::memory_order_relaxed);
+    pStats->InFlightFrames = m_nWriteFrame.load() - m_nReadFrame.load();
+    
+    return MCODEC_SUCCEED;
+}
@@ -0,0 +1,124 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __GPU_SOFT_CODEC_H__
+#define __GPU_SOFT_CODEC_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <semaphore.h>
+#include <atomic>
+#include <new>
+
+#include "include/GPU_codec_api.h"
+#include "include/codec_api.h"
+#include "bitstream_io.h"
+#include "latency_stats.h"
+
+//the encoded frames waiting for GetBitstream(), before EncodeFrame() blocks.
+#define MSDK_SOFT_OUTPUT_FRAMES    4
+
+//the bytes kept under the max NAL size, for the slice which overruns its target.
+#define MSDK_SOFT_SLICE_HEADROOM   50
+
+/////////////////////////////////////////////////////////////////////////////////////
+//One encoded access unit copied out of the OpenH264 layer buffers, in the same
+//form as the hardware output: an Annex-B stream, every NAL unit with its start code.
+typedef struct
+{
+    uint8_t*               pBuffer;
+    size_t                 BufferSize;
+    int32_t                Length;
+    
+    int32_t                NalCount;
+    int32_t                NalLengthInByte[MAX_NAL_UNITS_IN_LAYER];
+    EVideoFrameType        eFrameType;
+    uint8_t                uiTemporalId;
+    int64_t                TimeStamp;
+    
+    int64_t                StartUs;
+    int64_t                EncodedUs;
+    
+}MSdkSoftFrame;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The software H264/AVC encoder on OpenH264 ISVCEncoder, for the devices without
+//a usable hardware encoder and for the Linux servers. OpenH264 encodes in the
+//EncodeFrame() call, the output is queued until GetBitstream() or LockBitstream()
+//takes it, which could run on another thread, as the hardware encoder.
+class CSoftEncoder : public VM_MSDKEncoder
+{
+public:
+    CSoftEncoder(void);
+    ~CSoftEncoder(void);
+    
+    //Create the OpenH264 encoder, and configure it.
+    virtual int32_t OpenEncoder(MSdkInputParam *InputParam);
+    
+    //Delete the OpenH264 encoder and release memory.
+    virtual int32_t CloseEncoder(void);
+    
+    //Encode a frame, and queue the bitstream for output.
+    virtual int32_t EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer);
+    
+    //Wait for the queued bitstream and output it.
+    virtual int32_t GetBitstream(SLayerBSInfo* pBsLayer);
+    
+    //Wait for the bitstream and output the layers of the frame in encoder memory.
+    virtual int32_t GetFrameBitstream(SFrameBSInfo* pFrameInfo);
+    
+    //Wait for the queued bitstream and borrow it in encoder memory.
+    virtual int32_t LockBitstream(MSdkBitstream* pBitstream);
+    
+    //Give the borrowed bitstream buffer back to the encoder.
+    virtual int32_t UnlockBitstream(MSdkBitstream* pBitstream);
+    
+    //Update the target bitrate and frame rate, without a new IDR frame.
+    virtual int32_t UpdateBitrate(uint32_t Bitrate, uint32_t Framerate);
+    
+    //Request to encoder the next frame as IDR frame.
+    virtual int32_t InsertKeyFrame(void);
+    
+    //Pass the loss recovery request to OpenH264, or request an IDR frame.
+    virtual int32_t RequestLtrRecovery(SLTRRecoverRequest* pRequest);
+    
+    //Pass the long-term reference marking result of the decoder to OpenH264.
+    virtual int32_t SetLtrMarkingFeedback(SLTRMarkingFeedback* pFeedback);
+    
+    //Get the per-stage latency of the frames encoded since the encoder is created.
+    virtual int32_t GetLatencyStats(MSdkLatencyStats* pStats);
+    
+    //Get the frames skipped by the OpenH264 rate control.
+    virtual int32_t GetDropStats(MSdkDropStats* pStats);
+    
+private:
+    
+    //Set the slice mode of the input parameters to the spatial layer.
+    int32_t SetSliceArgument(SEncParamExt* pParam);
+    
+    //Copy the layers of the encoded frame to a queued output frame.
+    int32_t SaveFrame(SFrameBSInfo* pFrameInfo, MSdkSoftFrame* pFrame);
+    
+    //the local control parameters for the OpenH264 encoder.
+    ISVCEncoder*           m_pEncoder;
+    MSdkInputParam         m_InitParams;
+    uint32_t               m_CodecInitFlag;
+    uint8_t*               m_pPicture;
+    MSdkFrameBuffer        m_FrameOutput;
+    
+    //the queue of encoded frames, written by EncodeFrame() and read in order.
+    MSdkSoftFrame          m_Frames[MSDK_SOFT_OUTPUT_FRAMES];
+    std::atomic<uint32_t>  m_nWriteFrame;
+    std::atomic<uint32_t>  m_nReadFrame;
+    sem_t                  m_FreeFrames;
+    sem_t                  m_ReadyFrames;
+    
+    //the frame statistics, and the latency of every stage.
+    std::atomic<uint32_t>  m_nOffered;
+    std::atomic<uint32_t>  m_nSkipped;
+    MSdkLatencyHistogram   m_Latency[MSDK_LATENCY_STAGES];
+};
+
+#endif  // End of __GPU_SOFT_CODEC_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,557 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+
+#include "backend_fake.h"
+#include "latency_stats.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The parameter sets of the fake stream, all with id 0, with emulation prevention.
+static const uint8_t s_AvcParamSets[] =
+{
+    0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x1E, 0xDA, 0x02, 0x80, 0xBF, 0xE5, 0xC0, 0x44,
+    0x00, 0x00, 0x03, 0x00, 0x04, 0x00, 0x00, 0x03, 0x00, 0xF2, 0x3C, 0x58, 0xBA, 0x80,
+    0x00, 0x00, 0x00, 0x01, 0x68, 0xCE, 0x3C, 0x80,
+};
+
+static const uint8_t s_HevcParamSets[] =
+{
+    0x00, 0x00, 0x00, 0x01, 0x40, 0x01, 0x0C, 0x01, 0xFF, 0xFF, 0x01, 0x60, 0x00, 0x00, 0x03,
+    0x00, 0xB0, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x5D, 0xAC, 0x09,
+    0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0xB0, 0x00,
+    0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x5D, 0xA0, 0x02, 0x80, 0x80, 0x2D, 0x16, 0x59, 0x59,
+    0x00, 0x00, 0x00, 0x01, 0x44, 0x01, 0xC1, 0x72, 0xB4, 0x62, 0x40,
+};
+
+//the temporal id of the frames in a GOP, for 1, 2 and 3 layers (0-1-0-1, 0-2-1-2).
+static const uint8_t s_FakeLayerPattern[3][4] =
+{
+    {0, 0, 0, 0},
+    {0, 1, 0, 1},
+    {0, 2, 1, 2},
+};
+
+//the log2_max_frame_num of the fake SPS.
+#define MSDK_FAKE_FRAME_NUM_BITS   4
+
+//the behavior of the next created encoder.
+static MSdkFakeConfig s_FakeConfig;
+static std::mutex     s_FakeConfigLock;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Append an unsigned Exp-Golomb code to the bits, at most 64 bits in total.
+static void PutUE(uint64_t* pBits, int32_t* pCount, uint32_t Value)
+{
+    int32_t length = 0;
+    while (((Value + 1) >> (length + 1)) != 0)
+    {
+        length++;
+    }
+    
+    //the leading zero bits, then the value plus one in length + 1 bits.
+    *pBits  = (*pBits << (2 * length + 1)) | (Value + 1);
+    *pCount += 2 * length + 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void backend_SetFakeConfig(const MSdkFakeConfig* pConfig)
+{
+    std::lock_guard<std::mutex> lock(s_FakeConfigLock);
+    s_FakeConfig = *pConfig;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void backend_GetFakeConfig(MSdkFakeConfig* pConfig)
+{
+    std::lock_guard<std::mutex> lock(s_FakeConfigLock);
+    *pConfig = s_FakeConfig;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CFakeCodecBackend::CFakeCodecBackend(void)
+{
+    memset(&m_Config, 0, sizeof(MSdkFakeConfig));
+    memset(&m_Format, 0, sizeof(MSdkBackendFormat));
+    m_Created       = false;
+    m_Configured    = false;
+    m_Started       = false;
+    m_Hevc          = false;
+    m_FrameHead     = 0;
+    m_FrameCount    = 0;
+    m_LastDueUs     = 0;
+    m_nQueued       = 0;
+    m_nEncoded      = 0;
+    m_nGopFrame     = 0;
+    m_FrameNum      = 0;
+    m_ConfigPending = false;
+    m_FormatPending = false;
+    
+    for (int32_t i = 0; i < MSDK_FAKE_MAX_BUFFERS; i++)
+    {
+        m_InputHeld[i]  = false;
+        m_OutputHeld[i] = false;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CFakeCodecBackend::~CFakeCodecBackend(void)
+{
+    Delete();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CFakeCodecBackend::Create(const char* pMime)
+{
+    Delete();
+    
+    //only the H264/AVC and H265/HEVC streams could be faked.
+    if ((strcmp(pMime, "video/avc") != 0) && (strcmp(pMime, "video/hevc") != 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the behavior is fixed for the life of this instance.
+    backend_GetFakeConfig(&m_Config);
+    if ((m_Config.InputDepth == 0) || (m_Config.InputDepth > MSDK_FAKE_MAX_BUFFERS))
+    {
+        m_Config.InputDepth = 4;
+    }
+    if ((m_Config.OutputDepth == 0) || (m_Config.OutputDepth > MSDK_FAKE_MAX_BUFFERS))
+    {
+        m_Config.OutputDepth = 4;
+    }
+    
+    m_Hevc    = (strcmp(pMime, "video/hevc") == 0);
+    m_Created = true;
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CFakeCodecBackend::Delete(void)
+{
+    Stop();
+    m_Created    = false;
+    m_Configured = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CFakeCodecBackend::Configure(const MSdkBackendFormat* pFormat)
+{
+    if (!m_Created || m_Started || (pFormat->Width <= 0) || (pFormat->Height <= 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //refuse the settings, as a device without the rate control mode or layers.
+    if ((pFormat->BitrateMode >= 0) && ((m_Config.RejectModes >> pFormat->BitrateMode) & 1))
+    {
+        return MCODEC_ERROR;
+    }
+    if ((pFormat->TemporalLayers > 1) && (m_Config.RejectLayers != 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    m_Format = *pFormat;
+    m_Format.Mime = NULL;
+    m_Configured = true;
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CFakeCodecBackend::Start(void)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if (!m_Configured || m_Started)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //every start begins a new stream, with the parameter sets and an IDR frame.
+    size_t input_size = (size_t)m_Format.Width * m_Format.Height * 3 / 2;
+    for (uint32_t i = 0; i < m_Config.InputDepth; i++)
+    {
+        m_InputBuffers[i].resize(input_size);
+        m_InputHeld[i] = false;
+    }
+    for (uint32_t i = 0; i < m_Config.OutputDepth; i++)
+    {
+        m_OutputHeld[i] = false;
+    }
+    
+    m_FrameHead     = 0;
+    m_FrameCount    = 0;
+    m_LastDueUs     = 0;
+    m_nQueued       = 0;
+    m_nEncoded      = 0;
+    m_nGopFrame     = 0;
+    m_FrameNum      = 0;
+    m_ConfigPending = (m_Config.InlineConfig == 0);
+    m_FormatPending = (m_Config.FormatChanged != 0);
+    m_Started       = true;
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CFakeCodecBackend::Stop(void)
+{
+    //wake up the waiting callers, the queued frames are discarded.
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Started    = false;
+    m_FrameCount = 0;
+    m_Cond.notify_all();
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CFakeCodecBackend::SetParameter(const char* pKey, int32_t Value)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if (!m_Started)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the long-term reference keys are taken when the count is configured, the
+    //references do not change the fake slices, so the value is not used.
+    (void)Value;
+    if ((strcmp(pKey, MSDK_KEY_LTR_MARK) == 0) || (strcmp(pKey, MSDK_KEY_LTR_USE) == 0))
+    {
+        return (m_Format.LtrFrames > 0) ? MCODEC_SUCCEED : MCODEC_ERROR;
+    }
+    
+    return MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+ssize_t CFakeCodecBackend::DequeueInputBuffer(int64_t TimeoutUs)
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+    int64_t deadline = (TimeoutUs < 0) ? -1 : latency_NowUs() + TimeoutUs;
+    
+    while (m_Started)
+    {
+        for (uint32_t i = 0; i < m_Config.InputDepth; i++)
+        {
+            if (!m_InputHeld[i])
+            {
+                m_InputHeld[i] = true;
+                return i;
+            }
+        }
+        
+        //all input buffers are queued, wait for a frame to be output.
+        if (deadline < 0)
+        {
+            m_Cond.wait(lock);
+        }
+        else
+        {
+            int64_t now = latency_NowUs();
+            if (now >= deadline)
+            {
+                break;
+            }
+            m_Cond.wait_for(lock, std::chrono::microseconds(deadline - now));
+        }
+    }
+    
+    return MSDK_BACKEND_TRY_AGAIN;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+uint8_t* CFakeCodecBackend::GetInputBuffer(size_t Index, size_t* pSize)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if ((Index >= m_Config.InputDepth) || !m_InputHeld[Index])
+    {
+        return NULL;
+    }
+    
+    *pSize = m_InputBuffers[Index].size();
+    return m_InputBuffers[Index].data();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CFakeCodecBackend::QueueInputBuffer(size_t Index, size_t Size, uint64_t TimeUs, uint32_t Flags)
+{
+    //no input flag is used, the key frames follow the fake interval.
+    (void)Flags;
+    
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if (!m_Started || (Index >= m_Config.InputDepth) || !m_InputHeld[Index] ||
+        (Size > m_InputBuffers[Index].size()) || (m_FrameCount >= MSDK_FAKE_MAX_BUFFERS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the frame starts after the previous one is done, or now if the encoder is idle.
+    int64_t now = latency_NowUs();
+    int64_t start = (m_LastDueUs > now) ? m_LastDueUs : now;
+    
+    MSdkFakeFrame *pFrame = &m_Frames[(m_FrameHead + m_FrameCount) % MSDK_FAKE_MAX_BUFFERS];
+    pFrame->Input   = (int32_t)Index;
+    pFrame->TimeUs  = (int64_t)TimeUs;
+    pFrame->DueUs   = start + m_Config.LatencyUs;
+    pFrame->Dropped = (m_Config.DropInterval > 0) && ((++m_nQueued % m_Config.DropInterval) == 0);
+    m_LastDueUs     = pFrame->DueUs;
+    m_FrameCount++;
+    
+    m_Cond.notify_all();
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+ssize_t CFakeCodecBackend::DequeueOutputBuffer(MSdkBufferInfo* pInfo, int64_t TimeoutUs)
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+    int64_t deadline = (TimeoutUs < 0) ? -1 : latency_NowUs() + TimeoutUs;
+    
+    while (m_Started)
+    {
+        //the format is reported once, before the first output buffer.
+        if (m_FormatPending)
+        {
+            m_FormatPending = false;
+            return MSDK_BACKEND_FORMAT_CHANGED;
+        }
+        
+        int32_t output = -1;
+        for (uint32_t i = 0; i < m_Config.OutputDepth; i++)
+        {
+            if (!m_OutputHeld[i])
+            {
+                output = i;
+                break;
+            }
+        }
+        
+        int64_t now = latency_NowUs();
+        int64_t wake = deadline;
+        
+        if (output >= 0)
+        {
+            std::vector<uint8_t> &Output = m_OutputBuffers[output];
+            pInfo->offset = 0;
+            pInfo->flags  = 0;
+            
+            //the parameter sets come in their own buffer, before the first frame.
+            if (m_ConfigPending)
+            {
+                m_ConfigPending = false;
+                Output.clear();
+                WriteParamSets(Output);
+                
+                m_OutputHeld[output]     = true;
+                pInfo->size               = (int32_t)Output.size();
+                pInfo->presentationTimeUs = 0;
+                pInfo->flags              = MSDK_BACKEND_FLAG_CODEC_CONFIG;
+                return output;
+            }
+            
+            //the oldest frame is done, output it and give back its input buffer.
+            if ((m_FrameCount > 0) && (now >= m_Frames[m_FrameHead].DueUs))
+            {
+                MSdkFakeFrame *pFrame = &m_Frames[m_FrameHead];
+                
+                //the dropped frame only gives back its input buffer.
+                if (pFrame->Dropped)
+                {
+                    m_InputHeld[pFrame->Input] = false;
+                    m_FrameHead = (m_FrameHead + 1) % MSDK_FAKE_MAX_BUFFERS;
+                    m_FrameCount--;
+                    m_Cond.notify_all();
+                    continue;
+                }
+                
+                Output.clear();
+                WriteFrame(Output, &pInfo->flags);
+                
+                m_OutputHeld[output]          = true;
+                m_InputHeld[pFrame->Input]    = false;
+                pInfo->size                   = (int32_t)Output.size();
+                pInfo->presentationTimeUs     = pFrame->TimeUs;
+                m_FrameHead = (m_FrameHead + 1) % MSDK_FAKE_MAX_BUFFERS;
+                m_FrameCount--;
+                
+                m_Cond.notify_all();
+                return output;
+            }
+            
+            //wait until the oldest frame is done, or the timeout.
+            if ((m_FrameCount > 0) && ((wake < 0) || (m_Frames[m_FrameHead].DueUs < wake)))
+            {
+                wake = m_Frames[m_FrameHead].DueUs;
+            }
+        }
+        
+        if ((deadline >= 0) && (now >= deadline))
+        {
+            break;
+        }
+        
+        //no frame is queued, or all output buffers are held by the caller.
+        if (wake < 0)
+        {
+            m_Cond.wait(lock);
+        }
+        else if (wake > now)
+        {
+            m_Cond.wait_for(lock, std::chrono::microseconds(wake - now));
+        }
+    }
+    
+    return MSDK_BACKEND_TRY_AGAIN;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+uint8_t* CFakeCodecBackend::GetOutputBuffer(size_t Index, size_t* pSize)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if ((Index >= m_Config.OutputDepth) || !m_OutputHeld[Index])
+    {
+        return NULL;
+    }
+    
+    *pSize = m_OutputBuffers[Index].size();
+    return m_OutputBuffers[Index].data();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CFakeCodecBackend::ReleaseOutputBuffer(size_t Index)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if ((Index >= m_Config.OutputDepth) || !m_OutputHeld[Index])
+    {
+        return MCODEC_ERROR;
+    }
+    
+    m_OutputHeld[Index] = false;
+    m_Cond.notify_all();
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CFakeCodecBackend::WriteParamSets(std::vector<uint8_t>& Output)
+{
+    if (m_Hevc)
+    {
+        Output.insert(Output.end(), s_HevcParamSets, s_HevcParamSets + sizeof(s_HevcParamSets));
+    }
+    else
+    {
+        Output.insert(Output.end(), s_AvcParamSets, s_AvcParamSets + sizeof(s_AvcParamSets));
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CFakeCodecBackend::WriteSlice(std::vector<uint8_t>& Output, bool KeyFrame, bool Reference,
+                                   int32_t TemporalId, uint32_t FirstMb, uint32_t FrameNum)
+{
+    //the start code and the NAL header of the IDR, P and non-reference P slice.
+    static const uint8_t start_code[4] = {0x00, 0x00, 0x00, 0x01};
+    Output.insert(Output.end(), start_code, start_code + 4);
+    if (m_Hevc)
+    {
+        int32_t nal_type = KeyFrame ? 19 : (Reference ? 1 : 0);
+        Output.push_back((uint8_t)(nal_type << 1));
+        Output.push_back((uint8_t)(TemporalId + 1));
+        return;
+    }
+    
+    Output.push_back(KeyFrame ? 0x65 : (Reference ? 0x41 : 0x01));
+    
+    //first_mb_in_slice, the I or P slice_type, pic_parameter_set_id and frame_num.
+    uint64_t bits  = 0;
+    int32_t  count = 0;
+    PutUE(&bits, &count, FirstMb);
+    PutUE(&bits, &count, KeyFrame ? 7 : 5);
+    PutUE(&bits, &count, 0);
+    bits   = (bits << MSDK_FAKE_FRAME_NUM_BITS) | FrameNum;
+    count += MSDK_FAKE_FRAME_NUM_BITS;
+    
+    //the rest of the last byte is filled with one bits, so it is never zero.
+    int32_t pad = (8 - (count & 7)) & 7;
+    bits   = (bits << pad) | ((1u << pad) - 1);
+    count += pad;
+    for (int32_t i = count - 8; i >= 0; i -= 8)
+    {
+        Output.push_back((uint8_t)(bits >> i));
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CFakeCodecBackend::WriteFrame(std::vector<uint8_t>& Output, uint32_t* pFlags)
+{
+    //the GOP length from the key frame interval in seconds, as the device does.
+    uint32_t gop = m_Config.KeyFrameInterval;
+    if (gop == 0)
+    {
+        gop = (uint32_t)(m_Format.IFrameInterval * m_Format.FrameRate);
+        gop = (gop == 0) ? 1 : gop;
+    }
+    
+    bool key_frame = (m_nGopFrame % gop) == 0;
+    if (key_frame)
+    {
+        m_nGopFrame = 0;
+    }
+    
+    //the frames of the top layer are not referenced, the layering restarts at IDR.
+    int32_t layers = m_Format.TemporalLayers;
+    layers = (layers < 1) ? 1 : ((layers > 3) ? 3 : layers);
+    int32_t tid = s_FakeLayerPattern[layers - 1][m_nGopFrame & 3];
+    bool reference = (layers == 1) || (tid < layers - 1);
+    
+    //the slice size from the bitrate, the key frame is larger.
+    uint32_t bytes = m_Config.FrameBytes;
+    if (bytes == 0)
+    {
+        float rate = (m_Format.FrameRate > 0) ? m_Format.FrameRate : 30;
+        bytes = (uint32_t)(m_Format.Bitrate / 8 / rate);
+    }
+    if (key_frame)
+    {
+        bytes = (m_Config.KeyFrameBytes != 0) ? m_Config.KeyFrameBytes : bytes * 4;
+    }
+    bytes = (bytes < 16) ? 16 : bytes;
+    
+    if (key_frame && (m_Config.InlineConfig != 0))
+    {
+        WriteParamSets(Output);
+    }
+    
+    //the payload is cut into slices of the max slice size, every slice NAL unit
+    //with its header is at most SliceBytes, as a size limited device does.
+    uint32_t slices = 1;
+    if (m_Format.SliceBytes > 0)
+    {
+        uint32_t slice_payload = (m_Format.SliceBytes > 32) ? (m_Format.SliceBytes - 16) : 16;
+        slices = (bytes + slice_payload - 1) / slice_payload;
+        slices = (slices > MAX_SLICES_NUM_TMP) ? MAX_SLICES_NUM_TMP : slices;
+    }
+    
+    uint32_t mbs = ((m_Format.Width + 15) >> 4) * ((m_Format.Height + 15) >> 4);
+    uint32_t frame_num = key_frame ? 0 : m_FrameNum;
+    uint32_t written = 0;
+    
+    for (uint32_t i = 0; i < slices; i++)
+    {
+        WriteSlice(Output, key_frame, reference, tid, (uint32_t)((uint64_t)mbs * i / slices), frame_num);
+        
+        //the payload never has a zero byte, so no start code is emulated.
+        uint32_t end = (uint32_t)((uint64_t)bytes * (i + 1) / slices);
+        for (; written < end; written++)
+        {
+            Output.push_back((uint8_t)(0x80 | ((m_nEncoded + written) & 0x7F)));
+        }
+    }
+    
+    //frame_num starts from 0 at IDR and counts the reference pictures.
+    m_FrameNum = reference ? ((frame_num + 1) % (1 << MSDK_FAKE_FRAME_NUM_BITS)) : frame_num;
+    
+    *pFlags = key_frame ? MSDK_BACKEND_FLAG_KEY_FRAME : 0;
+    m_nEncoded++;
+    m_nGopFrame++;
+}
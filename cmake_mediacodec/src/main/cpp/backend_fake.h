@@ -0,0 +1,117 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __BACKEND_FAKE_H__
+#define __BACKEND_FAKE_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "codec_backend.h"
+
+#define MSDK_FAKE_MAX_BUFFERS      16
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The behavior of the in-process encoder, the zero values take the defaults.
+typedef struct
+{
+    uint32_t  LatencyUs;         // the encode time of a frame, frames are encoded in order
+    uint32_t  InputDepth;        // the input buffers, 1~16, default 4
+    uint32_t  OutputDepth;       // the output buffers, 1~16, default 4
+    uint32_t  KeyFrameInterval;  // the frames of a GOP, default from i-frame-interval
+    uint32_t  FrameBytes;        // the slice size of a P frame, default from bitrate
+    uint32_t  KeyFrameBytes;     // the slice size of a key frame, default 4 P frames
+    uint32_t  InlineConfig;      // 1: parameter sets before the IDR slice, 0: a config buffer
+    uint32_t  FormatChanged;     // 1: report the output format changed before first output
+    uint32_t  RejectModes;       // the bit (1 << bitrate-mode) fails the configure
+    uint32_t  RejectLayers;      // 1: the configure fails with a ts-schema
+    uint32_t  DropInterval;      // every n-th queued frame is dropped without output, 0: none
+    
+}MSdkFakeConfig;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Set the behavior of the fake encoders created after this call, and get it.
+void backend_SetFakeConfig(const MSdkFakeConfig* pConfig);
+void backend_GetFakeConfig(MSdkFakeConfig* pConfig);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The deterministic in-process encoder, to run the pipeline off device. Frames are
+//encoded one by one in queue order, every frame is output LatencyUs after the
+//previous one is done or after it is queued, if the encoder is idle. The output
+//is an Annex-B stream with the parameter sets, and the IDR and P slices marked
+//in the same layer pattern as the android ts-schema, with a fixed payload. The
+//AVC slice header is valid up to frame_num, for the long-term reference marking.
+class CFakeCodecBackend : public CCodecBackend
+{
+public:
+    CFakeCodecBackend(void);
+    ~CFakeCodecBackend(void);
+    
+    virtual int32_t Create(const char* pMime);
+    virtual void Delete(void);
+    virtual int32_t Configure(const MSdkBackendFormat* pFormat);
+    virtual int32_t Start(void);
+    virtual int32_t Stop(void);
+    virtual int32_t SetParameter(const char* pKey, int32_t Value);
+    
+    virtual ssize_t DequeueInputBuffer(int64_t TimeoutUs);
+    virtual uint8_t* GetInputBuffer(size_t Index, size_t* pSize);
+    virtual int32_t QueueInputBuffer(size_t Index, size_t Size, uint64_t TimeUs, uint32_t Flags);
+    
+    virtual ssize_t DequeueOutputBuffer(MSdkBufferInfo* pInfo, int64_t TimeoutUs);
+    virtual uint8_t* GetOutputBuffer(size_t Index, size_t* pSize);
+    virtual int32_t ReleaseOutputBuffer(size_t Index);
+    
+private:
+    
+    //the frame queued for encoding, which holds its input buffer until output.
+    typedef struct
+    {
+        int32_t            Input;
+        int64_t            TimeUs;
+        int64_t            DueUs;
+        bool               Dropped;
+        
+    }MSdkFakeFrame;
+    
+    //Write the parameter sets and the slices of the next frame to the output.
+    void WriteParamSets(std::vector<uint8_t>& Output);
+    void WriteFrame(std::vector<uint8_t>& Output, uint32_t* pFlags);
+    
+    //Write the start code and the header of one slice NAL unit.
+    void WriteSlice(std::vector<uint8_t>& Output, bool KeyFrame, bool Reference,
+                    int32_t TemporalId, uint32_t FirstMb, uint32_t FrameNum);
+    
+    MSdkFakeConfig         m_Config;
+    MSdkBackendFormat      m_Format;
+    bool                   m_Created;
+    bool                   m_Configured;
+    bool                   m_Started;
+    bool                   m_Hevc;
+    
+    //the buffer pools, the input or output buffer is free if it is not held.
+    std::mutex             m_Lock;
+    std::condition_variable m_Cond;
+    std::vector<uint8_t>   m_InputBuffers[MSDK_FAKE_MAX_BUFFERS];
+    std::vector<uint8_t>   m_OutputBuffers[MSDK_FAKE_MAX_BUFFERS];
+    bool                   m_InputHeld[MSDK_FAKE_MAX_BUFFERS];
+    bool                   m_OutputHeld[MSDK_FAKE_MAX_BUFFERS];
+    
+    //the queued frames in encoding order, and the encoding state.
+    MSdkFakeFrame          m_Frames[MSDK_FAKE_MAX_BUFFERS];
+    uint32_t               m_FrameHead;
+    uint32_t               m_FrameCount;
+    int64_t                m_LastDueUs;
+    uint32_t               m_nQueued;
+    uint32_t               m_nEncoded;
+    uint32_t               m_nGopFrame;
+    uint32_t               m_FrameNum;
+    bool                   m_ConfigPending;
+    bool                   m_FormatPending;
+};
+
+#endif  // End of __BACKEND_FAKE_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,203 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <dlfcn.h>
+
+#include "backend_mediacodec.h"
+
+//AMediaCodec_setParameters() is since API 26, it is looked up at run time.
+typedef media_status_t (*PFN_SetParameters)(AMediaCodec* pCodec, const AMediaFormat* pParams);
+
+/////////////////////////////////////////////////////////////////////////////////////
+static PFN_SetParameters LoadSetParameters(void)
+{
+    //the library is loaded by the process already, only the symbol is resolved.
+    void *pLibrary = dlopen("libmediandk.so", RTLD_NOW);
+    if (pLibrary == NULL)
+    {
+        return NULL;
+    }
+    
+    return (PFN_SetParameters)dlsym(pLibrary, "AMediaCodec_setParameters");
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMediaCodecBackend::CMediaCodecBackend(void)
+{
+    m_VideoEncoder = NULL;
+    m_VideoFormat  = NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMediaCodecBackend::~CMediaCodecBackend(void)
+{
+    Delete();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMediaCodecBackend::Create(const char* pMime)
+{
+    //create a mediacodec encoder instance.
+    Delete();
+    m_VideoEncoder = AMediaCodec_createEncoderByType(pMime);
+    return (m_VideoEncoder != NULL) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CMediaCodecBackend::Delete(void)
+{
+    if (m_VideoEncoder != NULL)
+    {
+        AMediaCodec_delete(m_VideoEncoder);
+        m_VideoEncoder = NULL;
+    }
+    
+    //delete the video format instance with the encoder.
+    if (m_VideoFormat != NULL)
+    {
+        AMediaFormat_delete(m_VideoFormat);
+        m_VideoFormat = NULL;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMediaCodecBackend::Configure(const MSdkBackendFormat* pFormat)
+{
+    if (m_VideoEncoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //create the media format configure instance, without any key left.
+    if (m_VideoFormat != NULL)
+    {
+        AMediaFormat_delete(m_VideoFormat);
+    }
+    m_VideoFormat = AMediaFormat_new();
+    if (m_VideoFormat == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //update the encoder input and output format.
+    AMediaFormat_setInt32(m_VideoFormat, "width", pFormat->Width);
+    AMediaFormat_setInt32(m_VideoFormat, "height", pFormat->Height);
+    AMediaFormat_setString(m_VideoFormat, "mime", pFormat->Mime);
+    AMediaFormat_setInt32(m_VideoFormat, "color-format", pFormat->ColorFormat);
+    AMediaFormat_setInt32(m_VideoFormat, "bitrate", pFormat->Bitrate);
+    AMediaFormat_setFloat(m_VideoFormat, "frame-rate", pFormat->FrameRate);
+    AMediaFormat_setInt32(m_VideoFormat, "i-frame-interval", pFormat->IFrameInterval);
+    
+    //request the L1T2 or L1T3 reference structure, since API 25.
+    if (pFormat->TemporalLayers > 1)
+    {
+        char schema[32];
+        snprintf(schema, sizeof(schema), "android.generic.%d", pFormat->TemporalLayers);
+        AMediaFormat_setString(m_VideoFormat, "ts-schema", schema);
+    }
+    
+    //the rate control mode, or the vendor default if it is not set.
+    if (pFormat->BitrateMode >= 0)
+    {
+        AMediaFormat_setInt32(m_VideoFormat, "bitrate-mode", pFormat->BitrateMode);
+    }
+    
+    //the long-term reference frames of the vendor extension, ignored by others.
+    if (pFormat->LtrFrames > 0)
+    {
+        AMediaFormat_setInt32(m_VideoFormat, MSDK_KEY_LTR_COUNT, pFormat->LtrFrames);
+    }
+    
+    //the slices limited by size of the vendor extension, one slice for others.
+    if (pFormat->SliceBytes > 0)
+    {
+        AMediaFormat_setInt32(m_VideoFormat, MSDK_KEY_SLICE_BITS, pFormat->SliceBytes * 8);
+    }
+    
+    uint32_t flags = AMEDIACODEC_CONFIGURE_FLAG_ENCODE;
+    media_status_t sts = AMediaCodec_configure(m_VideoEncoder, m_VideoFormat, NULL, NULL, flags);
+    return (sts == AMEDIA_OK) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMediaCodecBackend::Start(void)
+{
+    media_status_t sts = AMediaCodec_start(m_VideoEncoder);
+    return (sts == AMEDIA_OK) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMediaCodecBackend::Stop(void)
+{
+    media_status_t sts = AMediaCodec_stop(m_VideoEncoder);
+    return (sts == AMEDIA_OK) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMediaCodecBackend::SetParameter(const char* pKey, int32_t Value)
+{
+    static PFN_SetParameters pSetParameters = LoadSetParameters();
+    if ((m_VideoEncoder == NULL) || (pSetParameters == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the parameter is passed in a new format, with the key only.
+    AMediaFormat *pParams = AMediaFormat_new();
+    if (pParams == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    AMediaFormat_setInt32(pParams, pKey, Value);
+    media_status_t sts = pSetParameters(m_VideoEncoder, pParams);
+    AMediaFormat_delete(pParams);
+    
+    return (sts == AMEDIA_OK) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+ssize_t CMediaCodecBackend::DequeueInputBuffer(int64_t TimeoutUs)
+{
+    return AMediaCodec_dequeueInputBuffer(m_VideoEncoder, TimeoutUs);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+uint8_t* CMediaCodecBackend::GetInputBuffer(size_t Index, size_t* pSize)
+{
+    return AMediaCodec_getInputBuffer(m_VideoEncoder, Index, pSize);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMediaCodecBackend::QueueInputBuffer(size_t Index, size_t Size, uint64_t TimeUs, uint32_t Flags)
+{
+    media_status_t sts = AMediaCodec_queueInputBuffer(m_VideoEncoder, Index, 0, Size, TimeUs, Flags);
+    return (sts == AMEDIA_OK) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+ssize_t CMediaCodecBackend::DequeueOutputBuffer(MSdkBufferInfo* pInfo, int64_t TimeoutUs)
+{
+    //the buffer information has the same layout, copy it field by field.
+    AMediaCodecBufferInfo BufInfo;
+    ssize_t bufIndex = AMediaCodec_dequeueOutputBuffer(m_VideoEncoder, &BufInfo, TimeoutUs);
+    
+    pInfo->offset             = BufInfo.offset;
+    pInfo->size               = BufInfo.size;
+    pInfo->presentationTimeUs = BufInfo.presentationTimeUs;
+    pInfo->flags              = BufInfo.flags;
+    return bufIndex;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+uint8_t* CMediaCodecBackend::GetOutputBuffer(size_t Index, size_t* pSize)
+{
+    return AMediaCodec_getOutputBuffer(m_VideoEncoder, Index, pSize);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMediaCodecBackend::ReleaseOutputBuffer(size_t Index)
+{
+    media_status_t sts = AMediaCodec_releaseOutputBuffer(m_VideoEncoder, Index, false);
+    return (sts == AMEDIA_OK) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
@@ -0,0 +1,46 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __BACKEND_MEDIACODEC_H__
+#define __BACKEND_MEDIACODEC_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "media/NdkMediaError.h"
+#include "media/NdkMediaFormat.h"
+#include "media/NdkMediaCodec.h"
+
+#include "codec_backend.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The android hardware encoder, through the NDK AMediaCodec functions.
+class CMediaCodecBackend : public CCodecBackend
+{
+public:
+    CMediaCodecBackend(void);
+    ~CMediaCodecBackend(void);
+    
+    virtual int32_t Create(const char* pMime);
+    virtual void Delete(void);
+    virtual int32_t Configure(const MSdkBackendFormat* pFormat);
+    virtual int32_t Start(void);
+    virtual int32_t Stop(void);
+    virtual int32_t SetParameter(const char* pKey, int32_t Value);
+    
+    virtual ssize_t DequeueInputBuffer(int64_t TimeoutUs);
+    virtual uint8_t* GetInputBuffer(size_t Index, size_t* pSize);
+    virtual int32_t QueueInputBuffer(size_t Index, size_t Size, uint64_t TimeUs, uint32_t Flags);
+    
+    virtual ssize_t DequeueOutputBuffer(MSdkBufferInfo* pInfo, int64_t TimeoutUs);
+    virtual uint8_t* GetOutputBuffer(size_t Index, size_t* pSize);
+    virtual int32_t ReleaseOutputBuffer(size_t Index);
+    
+private:
+    
+    AMediaCodec*           m_VideoEncoder;
+    AMediaFormat*          m_VideoFormat;
+};
+
+#endif  // End of __BACKEND_MEDIACODEC_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
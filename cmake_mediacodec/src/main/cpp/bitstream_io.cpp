@@ -0,0 +1,179 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bitstream_io.h"
+#include "nal_parser.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+size_t bitstream_GetLength(const MSdkBitstream* pBitstream)
+{
+    size_t length = 0;
+    
+    for (int32_t i = 0; i < pBitstream->SegmentCount; i++)
+    {
+        length += pBitstream->Segments[i].iov_len;
+    }
+    
+    return length;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+ssize_t bitstream_WriteFile(int fd, const MSdkBitstream* pBitstream)
+{
+    struct iovec iov[MSDK_MAX_BS_SEGMENTS];
+    int32_t count = pBitstream->SegmentCount;
+    int32_t first = 0;
+    ssize_t total = 0;
+    
+    if ((count <= 0) || (count > MSDK_MAX_BS_SEGMENTS))
+    {
+        return -1;
+    }
+    
+    //the iovec list is updated for partial writes, so work on a local copy.
+    memcpy(iov, pBitstream->Segments, count * sizeof(struct iovec));
+    
+    while (first < count)
+    {
+        ssize_t written = writev(fd, iov + first, count - first);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        total += written;
+        
+        //skip the segments which are fully written, and move into the next one.
+        while ((first < count) && ((size_t)written >= iov[first].iov_len))
+        {
+            written -= iov[first].iov_len;
+            first++;
+        }
+        
+        if (first < count)
+        {
+            iov[first].iov_base = (uint8_t *)iov[first].iov_base + written;
+            iov[first].iov_len -= written;
+        }
+    }
+    
+    return total;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+ssize_t bitstream_SendMsg(int sock, const struct sockaddr* pDestAddr, socklen_t AddrLen,
+                          const MSdkBitstream* pBitstream)
+{
+    struct msghdr msg;
+    
+    if ((pBitstream->SegmentCount <= 0) || (pBitstream->SegmentCount > MSDK_MAX_BS_SEGMENTS))
+    {
+        return -1;
+    }
+    
+    //the message gathers the segments directly from the encoder memory.
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name    = (void *)pDestAddr;
+    msg.msg_namelen = (pDestAddr != NULL) ? AddrLen : 0;
+    msg.msg_iov     = (struct iovec *)pBitstream->Segments;
+    msg.msg_iovlen  = pBitstream->SegmentCount;
+    
+    ssize_t sent;
+    do
+    {
+        sent = sendmsg(sock, &msg, 0);
+    } while ((sent < 0) && (errno == EINTR));
+    
+    return sent;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t bitstream_CopyToFrame(const MSdkBitstream* pBitstream, uint32_t CodecType,
+                              MSdkFrameBuffer* pFrame, SFrameBSInfo* pFrameInfo)
+{
+    if ((pBitstream->SegmentCount <= 0) || (pBitstream->SegmentCount > MSDK_MAX_BS_SEGMENTS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the lent access unit is already in Annex-B format, copy it as it is.
+    size_t length = bitstream_GetLength(pBitstream);
+    if (pFrame->BufferSize < length)
+    {
+        uint8_t *pBuffer = (uint8_t *)realloc(pFrame->pBuffer, length);
+        if (pBuffer == NULL)
+        {
+            return MCODEC_ERROR;
+        }
+        pFrame->pBuffer    = pBuffer;
+        pFrame->BufferSize = length;
+    }
+    
+    size_t offset = 0;
+    for (int32_t i = 0; i < pBitstream->SegmentCount; i++)
+    {
+        memcpy(pFrame->pBuffer + offset, pBitstream->Segments[i].iov_base, pBitstream->Segments[i].iov_len);
+        offset += pBitstream->Segments[i].iov_len;
+    }
+    
+    //split the access unit again, to find out the leading parameter sets.
+    MSdkNalUnit NalUnits[MAX_NAL_UNITS_IN_LAYER];
+    int32_t nal_count = nal_SplitAnnexB(pFrame->pBuffer, (int32_t)length, NalUnits, MAX_NAL_UNITS_IN_LAYER, CodecType);
+    int32_t ps_count  = 0;
+    
+    for (int32_t i = 0; i < nal_count; i++)
+    {
+        pFrame->NalLengthInByte[i] = NalUnits[i].Length;
+        if ((ps_count == i) && nal_IsParamSet(NalUnits[i].NalType, CodecType))
+        {
+            ps_count++;
+        }
+    }
+    
+    int32_t LayerNum = 0;
+    int32_t first    = 0;
+    
+    //one layer for the parameter sets and one for the slices, as OpenH264.
+    for (int32_t k = 0; k < 2; k++)
+    {
+        int32_t count = (k == 0) ? ps_count : (nal_count - ps_count);
+        if (count == 0)
+        {
+            continue;
+        }
+        
+        SLayerBSInfo *pLayer = &pFrameInfo->sLayerInfo[LayerNum++];
+        pLayer->uiTemporalId     = pBitstream->uiTemporalId;
+        pLayer->uiSpatialId      = pBitstream->uiSpatialId;
+        pLayer->uiQualityId      = pBitstream->uiQualityId;
+        pLayer->eFrameType       = pBitstream->eFrameType;
+        pLayer->uiLayerType      = (k == 0) ? NON_VIDEO_CODING_LAYER : VIDEO_CODING_LAYER;
+        pLayer->iSubSeqId        = 0;
+        pLayer->iNalCount        = count;
+        pLayer->pNalLengthInByte = &pFrame->NalLengthInByte[first];
+        pLayer->pBsBuf           = pFrame->pBuffer + NalUnits[first].Offset;
+        first += count;
+    }
+    
+    pFrameInfo->iLayerNum         = LayerNum;
+    pFrameInfo->eFrameType        = pBitstream->eFrameType;
+    pFrameInfo->iFrameSizeInBytes = (int32_t)length;
+    pFrameInfo->uiTimeStamp       = pBitstream->uiTimeStamp;
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void bitstream_FreeFrame(MSdkFrameBuffer* pFrame)
+{
+    free(pFrame->pBuffer);
+    pFrame->pBuffer    = NULL;
+    pFrame->BufferSize = 0;
+}
@@ -0,0 +1,51 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __BITSTREAM_IO_H__
+#define __BITSTREAM_IO_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "include/GPU_codec_api.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Get the total length in bytes of all the segments of a borrowed bitstream.
+size_t bitstream_GetLength(const MSdkBitstream* pBitstream);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Write all the segments of the bitstream to a file with writev(), no reassembly
+//copy is made. the partial writes are continued, return the written bytes or -1.
+ssize_t bitstream_WriteFile(int fd, const MSdkBitstream* pBitstream);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Send all the segments of the bitstream as one message with sendmsg(), the
+//destination could be NULL for a connected socket. return the sent bytes or -1.
+ssize_t bitstream_SendMsg(int sock, const struct sockaddr* pDestAddr, socklen_t AddrLen,
+                          const MSdkBitstream* pBitstream);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The frame-level copy of a borrowed bitstream, the SFrameBSInfo layers point into
+//it. the buffer is reused for the next frames, and only grows.
+typedef struct
+{
+    uint8_t*  pBuffer;
+    size_t    BufferSize;
+    int32_t   NalLengthInByte[MAX_NAL_UNITS_IN_LAYER];
+    
+}MSdkFrameBuffer;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Copy the bitstream to the frame buffer as an Annex-B access unit, every NAL unit
+//with its start code, as OpenH264 outputs a frame: the leading parameter sets are
+//a NON_VIDEO_CODING_LAYER layer, and the other NAL units a VIDEO_CODING_LAYER one.
+int32_t bitstream_CopyToFrame(const MSdkBitstream* pBitstream, uint32_t CodecType,
+                              MSdkFrameBuffer* pFrame, SFrameBSInfo* pFrameInfo);
+
+//Free the memory of the frame buffer.
+void bitstream_FreeFrame(MSdkFrameBuffer* pFrame);
+
+#endif  // End of __BITSTREAM_IO_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,341 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitstream_io.h"
+#include "bitstream_writer.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+CBitstreamWriter::CBitstreamWriter(void)
+    : m_File(-1), m_Running(false), m_pBuffer(NULL), m_BufferSize(0), m_ReadCount(0), m_WriteCount(0),
+      m_FileOffset(0), m_DropUntilKey(false), m_FramesQueued(0), m_FramesDropped(0), m_BytesWritten(0),
+      m_Writes(0), m_WriteErrors(0), m_WriteUs(0), m_PeakBuffered(0)
+{
+    memset(&m_Config, 0, sizeof(m_Config));
+    latency_Reset(&m_WriteLatency);
+    sem_init(&m_DataSignal, 0, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CBitstreamWriter::~CBitstreamWriter(void)
+{
+    Stop();
+    sem_destroy(&m_DataSignal);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CBitstreamWriter::Start(int fd, const MSdkWriterConfig* pConfig)
+{
+    //the writer could be started once, a write is a whole number of blocks.
+    if ((m_pBuffer != NULL) || (fd < 0) || (pConfig == NULL) || (pConfig->AlignBytes <= 0) ||
+        ((pConfig->AlignBytes & (pConfig->AlignBytes - 1)) != 0) || (pConfig->WriteBytes < pConfig->AlignBytes) ||
+        (pConfig->BufferBytes < pConfig->WriteBytes) || (pConfig->FlushMs <= 0) ||
+        ((pConfig->DropPolicy != MSDK_WRITER_DROP_FRAME) && (pConfig->DropPolicy != MSDK_WRITER_DROP_TO_KEY)))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the buffer is the memory budget, nothing is allocated for the access units.
+    m_pBuffer = (uint8_t *)malloc(pConfig->BufferBytes);
+    if (m_pBuffer == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the alignment is of the file offset, the file may not start at 0.
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    
+    m_File         = fd;
+    m_Config       = *pConfig;
+    m_BufferSize   = pConfig->BufferBytes;
+    m_FileOffset   = (offset > 0) ? (uint64_t)offset : 0;
+    m_DropUntilKey = false;
+    m_ReadCount.store(0);
+    m_WriteCount.store(0);
+    m_FramesQueued.store(0);
+    m_FramesDropped.store(0);
+    m_BytesWritten.store(0);
+    m_Writes.store(0);
+    m_WriteErrors.store(0);
+    m_WriteUs.store(0);
+    m_PeakBuffered.store(0);
+    latency_Reset(&m_WriteLatency);
+    m_Running.store(true);
+    
+    m_Thread = std::thread(&CBitstreamWriter::WriteLoop, this);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CBitstreamWriter::Stop(void)
+{
+    if (m_pBuffer == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //wake up the writer thread, it writes the rest and exits.
+    m_Running.store(false);
+    sem_post(&m_DataSignal);
+    if (m_Thread.joinable())
+    {
+        m_Thread.join();
+    }
+    
+    free(m_pBuffer);
+    m_pBuffer = NULL;
+    m_File    = -1;
+    
+    while (sem_trywait(&m_DataSignal) == 0)
+    {
+    }
+    
+    return (m_WriteErrors.load() == 0) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CBitstreamWriter::PushBitstream(const MSdkBitstream* pBitstream)
+{
+    if ((pBitstream == NULL) || (pBitstream->SegmentCount <= 0) || (pBitstream->SegmentCount > MSDK_MAX_BS_SEGMENTS))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return PushSegments(pBitstream->Segments, pBitstream->SegmentCount, pBitstream->eFrameType == videoFrameTypeIDR);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CBitstreamWriter::PushFrame(const SFrameBSInfo* pFrameInfo)
+{
+    if ((pFrameInfo == NULL) || (pFrameInfo->iLayerNum <= 0) || (pFrameInfo->iLayerNum > MAX_LAYER_NUM_OF_FRAME))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the NAL units of a layer are contiguous, one piece for every layer.
+    struct iovec layers[MAX_LAYER_NUM_OF_FRAME];
+    for (int32_t i = 0; i < pFrameInfo->iLayerNum; i++)
+    {
+        const SLayerBSInfo *pLayer = &pFrameInfo->sLayerInfo[i];
+        size_t size = 0;
+        for (int32_t j = 0; j < pLayer->iNalCount; j++)
+        {
+            size += pLayer->pNalLengthInByte[j];
+        }
+        layers[i].iov_base = pLayer->pBsBuf;
+        layers[i].iov_len  = size;
+    }
+    
+    return PushSegments(layers, pFrameInfo->iLayerNum, pFrameInfo->eFrameType == videoFrameTypeIDR);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CBitstreamWriter::OnBitstream(void* pContext, MSdkBitstream* pBitstream)
+{
+    ((CBitstreamWriter *)pContext)->PushBitstream(pBitstream);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CBitstreamWriter::GetStats(MSdkWriterStats* pStats)
+{
+    if (pStats == NULL)
+    {
+        return;
+    }
+    
+    uint64_t read  = m_ReadCount.load();
+    uint64_t write = m_WriteCount.load();
+    uint64_t bytes = m_BytesWritten.load(std::memory_order_relaxed);
+    uint64_t us    = m_WriteUs.load(std::memory_order_relaxed);
+    
+    pStats->FramesQueued      = m_FramesQueued.load(std::memory_order_relaxed);
+    pStats->FramesDropped     = m_FramesDropped.load(std::memory_order_relaxed);
+    pStats->BytesQueued       = write;
+    pStats->BytesWritten      = bytes;
+    pStats->Writes            = m_Writes.load(std::memory_order_relaxed);
+    pStats->WriteErrors       = m_WriteErrors.load(std::memory_order_relaxed);
+    pStats->BufferedBytes     = (uint32_t)(write - read);
+    pStats->PeakBufferedBytes = (uint32_t)m_PeakBuffered.load(std::memory_order_relaxed);
+    pStats->ThroughputKBps    = (us > 0) ? (uint32_t)(bytes * 1000000 / us / 1024) : 0;
+    latency_Query(&m_WriteLatency, &pStats->WriteLatency);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CBitstreamWriter::PushSegments(const struct iovec* pSegments, int32_t Count, bool KeyFrame)
+{
+    if (!m_Running.load(std::memory_order_relaxed))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    uint64_t size = 0;
+    for (int32_t i = 0; i < Count; i++)
+    {
+        size += pSegments[i].iov_len;
+    }
+    
+    //the writer thread frees the space, the new access unit takes it.
+    uint64_t write = m_WriteCount.load(std::memory_order_relaxed);
+    uint64_t read  = m_ReadCount.load(std::memory_order_acquire);
+    bool drop = (size > m_BufferSize - (write - read)) || (m_DropUntilKey && !KeyFrame);
+    if (drop)
+    {
+        //the frames after a dropped one refer to it, drop them until an IDR.
+        m_DropUntilKey = (m_Config.DropPolicy == MSDK_WRITER_DROP_TO_KEY);
+        m_FramesDropped.fetch_add(1, std::memory_order_relaxed);
+        return MCODEC_SKIPPED;
+    }
+    m_DropUntilKey = false;
+    
+    //copy the pieces into the ring, wrapping at the end of the buffer.
+    uint64_t pos = write % m_BufferSize;
+    for (int32_t i = 0; i < Count; i++)
+    {
+        const uint8_t *pData = (const uint8_t *)pSegments[i].iov_base;
+        uint64_t left = pSegments[i].iov_len;
+        while (left > 0)
+        {
+            uint64_t bytes = m_BufferSize - pos;
+            bytes = (bytes < left) ? bytes : left;
+            memcpy(m_pBuffer + pos, pData, bytes);
+            pData += bytes;
+            left  -= bytes;
+            pos    = (pos + bytes == m_BufferSize) ? 0 : (pos + bytes);
+        }
+    }
+    
+    //publish the bytes to the writer thread.
+    m_WriteCount.store(write + size, std::memory_order_release);
+    m_FramesQueued.fetch_add(1, std::memory_order_relaxed);
+    
+    uint64_t queued = write + size - read;
+    if (queued > m_PeakBuffered.load(std::memory_order_relaxed))
+    {
+        m_PeakBuffered.store(queued, std::memory_order_relaxed);
+    }
+    
+    //wake up the writer thread only when a whole write is queued.
+    if ((write - read < (uint64_t)m_Config.WriteBytes) && (queued >= (uint64_t)m_Config.WriteBytes))
+    {
+        sem_post(&m_DataSignal);
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CBitstreamWriter::WriteChunk(bool Flush)
+{
+    uint64_t read  = m_ReadCount.load(std::memory_order_relaxed);
+    uint64_t write = m_WriteCount.load(std::memory_order_acquire);
+    uint64_t size  = write - read;
+    size = (size < (uint64_t)m_Config.WriteBytes) ? size : (uint64_t)m_Config.WriteBytes;
+    
+    //a full write ends at the aligned file offset, after a flushed unaligned one too.
+    if (!Flush)
+    {
+        uint64_t end = (m_FileOffset + size) & ~((uint64_t)m_Config.AlignBytes - 1);
+        size = (end > m_FileOffset) ? (end - m_FileOffset) : 0;
+    }
+    
+    if (size == 0)
+    {
+        return;
+    }
+    
+    //the bytes are one or two pieces of the ring.
+    MSdkBitstream out;
+    uint64_t pos   = read % m_BufferSize;
+    uint64_t first = m_BufferSize - pos;
+    first = (first < size) ? first : size;
+    
+    out.SegmentCount         = (first < size) ? 2 : 1;
+    out.Segments[0].iov_base = m_pBuffer + pos;
+    out.Segments[0].iov_len  = first;
+    out.Segments[1].iov_base = m_pBuffer;
+    out.Segments[1].iov_len  = size - first;
+    
+    int64_t start = latency_NowUs();
+    ssize_t written = bitstream_WriteFile(m_File, &out);
+    int64_t elapsed = latency_NowUs() - start;
+    
+    //the failed bytes are discarded, the encoder is never blocked by the file.
+    if (written == (ssize_t)size)
+    {
+        m_BytesWritten.fetch_add(size, std::memory_order_relaxed);
+    }
+    else
+    {
+        m_WriteErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_Writes.fetch_add(1, std::memory_order_relaxed);
+    m_WriteUs.fetch_add(elapsed, std::memory_order_relaxed);
+    latency_Record(&m_WriteLatency, elapsed);
+    
+    //give the space back to the encoder thread.
+    m_FileOffset += size;
+    m_ReadCount.store(read + size, std::memory_order_release);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CBitstreamWriter::WriteLoop(void)
+{
+    //the time since the queued bytes less than a write are waiting.
+    int64_t idle_us = latency_NowUs();
+    int64_t flush_us = (int64_t)m_Config.FlushMs * 1000;
+    
+    while (true)
+    {
+        bool running = m_Running.load();
+        uint64_t queued = m_WriteCount.load(std::memory_order_acquire) - m_ReadCount.load(std::memory_order_relaxed);
+        int64_t now = latency_NowUs();
+        
+        //write all the rest when stopped.
+        if (!running)
+        {
+            while (m_WriteCount.load(std::memory_order_acquire) != m_ReadCount.load(std::memory_order_relaxed))
+            {
+                WriteChunk(true);
+            }
+            break;
+        }
+        
+        if (queued >= (uint64_t)m_Config.WriteBytes)
+        {
+            WriteChunk(false);
+            idle_us = now;
+            continue;
+        }
+        
+        if ((queued > 0) && (now - idle_us >= flush_us))
+        {
+            WriteChunk(true);
+            idle_us = now;
+            continue;
+        }
+        
+        if (queued == 0)
+        {
+            idle_us = now;
+        }
+        
+        //wait for a whole write, or the time to flush the rest.
+        struct timespec deadline;
+        int64_t wait_us = flush_us - (now - idle_us);
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec  += wait_us / 1000000;
+        deadline.tv_nsec += (wait_us % 1000000) * 1000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        sem_timedwait(&m_DataSignal, &deadline);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
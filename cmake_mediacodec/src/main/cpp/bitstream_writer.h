@@ -0,0 +1,120 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __BITSTREAM_WRITER_H__
+#define __BITSTREAM_WRITER_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <semaphore.h>
+#include <atomic>
+#include <thread>
+
+#include "include/GPU_codec_api.h"
+#include "latency_stats.h"
+
+//the access units to drop when the buffer is full.
+#define MSDK_WRITER_DROP_FRAME     0   // drop the new access unit only
+#define MSDK_WRITER_DROP_TO_KEY    1   // drop until the next IDR, the file stays decodable
+
+//The settings of the writer, fixed when it is started.
+typedef struct
+{
+    int32_t   BufferBytes;       // the memory budget of the queued bytes, such as 8 MB
+    int32_t   WriteBytes;        // the size of a coalesced write, such as 256 KB
+    int32_t   AlignBytes;        // the writes end at this file offset boundary, a power of 2 such as 4096
+    int32_t   FlushMs;           // the time the bytes less than a write wait, such as 500
+    int32_t   DropPolicy;        // MSDK_WRITER_DROP_FRAME or MSDK_WRITER_DROP_TO_KEY
+    
+}MSdkWriterConfig;
+
+//The counters of the writer since it is started.
+typedef struct
+{
+    uint32_t          FramesQueued;      // the access units copied into the buffer
+    uint32_t          FramesDropped;     // the access units dropped by the drop policy
+    uint64_t          BytesQueued;       // the bytes copied into the buffer
+    uint64_t          BytesWritten;      // the bytes written to the file
+    uint32_t          Writes;            // the write calls
+    uint32_t          WriteErrors;       // the failed writes, their bytes are discarded
+    uint32_t          BufferedBytes;     // the bytes waiting in the buffer now
+    uint32_t          PeakBufferedBytes; // the most bytes waiting in the buffer
+    uint32_t          ThroughputKBps;    // the bytes written per second spent in write calls
+    MSdkLatencyStage  WriteLatency;      // the time of one write call
+    
+}MSdkWriterStats;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The asynchronous file writer of the encoded access units, for the recording and
+//debug dumps. The encoder thread only copies an access unit into a ring buffer of
+//the memory budget, a lock-free single producer and single consumer queue of
+//bytes, and never waits for the file. The writer thread coalesces the queued bytes
+//into large writes which end at the aligned file offsets, and writes the rest after
+//FlushMs or at Stop(). When the buffer is full, the access units are dropped by
+//the drop policy instead of blocking the encoder.
+class CBitstreamWriter
+{
+public:
+    CBitstreamWriter(void);
+    ~CBitstreamWriter(void);
+    
+    //Allocate the buffer and start the writer thread, the file is not closed by it.
+    int32_t Start(int fd, const MSdkWriterConfig* pConfig);
+    
+    //Write all the queued bytes, and stop the writer thread, after the encoder thread
+    //has stopped pushing. return MCODEC_ERROR if any write has failed.
+    int32_t Stop(void);
+    
+    //Copy a borrowed bitstream into the buffer as an Annex-B access unit, from the
+    //encoder thread. return MCODEC_SKIPPED if it is dropped.
+    int32_t PushBitstream(const MSdkBitstream* pBitstream);
+    
+    //Copy all the layers of a frame from GetFrameBitstream() into the buffer.
+    int32_t PushFrame(const SFrameBSInfo* pFrameInfo);
+    
+    //The MSdkBitstreamCallback of CMSDKEncodeThread, with the writer as the context.
+    static void OnBitstream(void* pContext, MSdkBitstream* pBitstream);
+    
+    //Get the counters, from any thread.
+    void GetStats(MSdkWriterStats* pStats);
+    
+private:
+    
+    //Copy the pieces of an access unit, or drop it by the drop policy.
+    int32_t PushSegments(const struct iovec* pSegments, int32_t Count, bool KeyFrame);
+    
+    //Write the next part of the queued bytes, all of them if Flush is true.
+    void WriteChunk(bool Flush);
+    
+    //the loop of writer thread.
+    void WriteLoop(void);
+    
+    int                    m_File;
+    MSdkWriterConfig       m_Config;
+    std::thread            m_Thread;
+    sem_t                  m_DataSignal;
+    std::atomic<bool>      m_Running;
+    
+    //the ring buffer, the position of a byte counter is (counter % m_BufferSize).
+    uint8_t*               m_pBuffer;
+    uint64_t               m_BufferSize;
+    std::atomic<uint64_t>  m_ReadCount;
+    std::atomic<uint64_t>  m_WriteCount;
+    
+    //the file offset of the next write, and the access units are dropped until an IDR.
+    uint64_t               m_FileOffset;
+    bool                   m_DropUntilKey;
+    
+    //the counters, updated by one thread and read by any one.
+    std::atomic<uint32_t>  m_FramesQueued;
+    std::atomic<uint32_t>  m_FramesDropped;
+    std::atomic<uint64_t>  m_BytesWritten;
+    std::atomic<uint32_t>  m_Writes;
+    std::atomic<uint32_t>  m_WriteErrors;
+    std::atomic<uint64_t>  m_WriteUs;
+    std::atomic<uint64_t>  m_PeakBuffered;
+    MSdkLatencyHistogram   m_WriteLatency;
+};
+
+#endif  // End of __BITSTREAM_WRITER_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
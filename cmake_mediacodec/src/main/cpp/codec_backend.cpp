@@ -0,0 +1,29 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <new>
+
+#include "codec_backend.h"
+#include "backend_fake.h"
+
+#ifdef __ANDROID__
+#include "backend_mediacodec.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+CCodecBackend* backend_Create(uint32_t Type)
+{
+    switch (Type)
+    {
+#ifdef __ANDROID__
+        case MSDK_BACKEND_MEDIACODEC:
+            return new (std::nothrow)CMediaCodecBackend;
+#endif
+        
+        case MSDK_BACKEND_FAKE:
+            return new (std::nothrow)CFakeCodecBackend;
+        
+        default:
+            return NULL;
+    }
+}
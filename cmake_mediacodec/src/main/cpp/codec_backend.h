@@ -0,0 +1,99 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __CODEC_BACKEND_H__
+#define __CODEC_BACKEND_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "include/GPU_codec_api.h"
+
+//the special buffer index values, the same as the MediaCodec INFO_* values.
+#define MSDK_BACKEND_TRY_AGAIN       -1
+#define MSDK_BACKEND_FORMAT_CHANGED  -2
+#define MSDK_BACKEND_BUFFERS_CHANGED -3
+
+//the output buffer flags, the same as the MediaCodec BUFFER_FLAG_* values.
+#define MSDK_BACKEND_FLAG_KEY_FRAME    1
+#define MSDK_BACKEND_FLAG_CODEC_CONFIG 2
+
+//the long-term reference keys of the Qualcomm MediaCodec vendor extension.
+#define MSDK_KEY_LTR_COUNT  "vendor.qti-ext-enc-ltr-count.num-ltr-frames"
+#define MSDK_KEY_LTR_MARK   "vendor.qti-ext-enc-ltr.mark-frame"
+#define MSDK_KEY_LTR_USE    "vendor.qti-ext-enc-ltr.use-frame"
+
+//the slice size of the Qualcomm MediaCodec vendor extension, in bits.
+#define MSDK_KEY_SLICE_BITS "vendor.qti-ext-enc-error-correction.resync-marker-spacing-bits"
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The encoder settings applied by Configure(), with the MediaCodec format keys.
+typedef struct
+{
+    const char*  Mime;               // "mime", video/avc or video/hevc
+    int32_t      Width;              // "width"
+    int32_t      Height;             // "height"
+    int32_t      ColorFormat;        // "color-format", 19 for I420
+    int32_t      Bitrate;            // "bitrate", bits per second
+    float        FrameRate;          // "frame-rate"
+    int32_t      IFrameInterval;     // "i-frame-interval", seconds
+    int32_t      TemporalLayers;     // "ts-schema" android.generic.N, if above 1
+    int32_t      BitrateMode;        // "bitrate-mode", not set if negative
+    int32_t      LtrFrames;          // MSDK_KEY_LTR_COUNT, if above 0
+    int32_t      SliceBytes;         // MSDK_KEY_SLICE_BITS, the max bytes of a slice, if above 0
+    
+}MSdkBackendFormat;
+
+//The output buffer information, the same layout as AMediaCodecBufferInfo.
+typedef struct
+{
+    int32_t      offset;
+    int32_t      size;
+    int64_t      presentationTimeUs;
+    uint32_t     flags;
+    
+}MSdkBufferInfo;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The video encoder device under CMSDKEncoder, in the buffer model of MediaCodec.
+//the buffer index functions return MSDK_BACKEND_* for no buffer, and the status
+//functions return MCODEC_SUCCEED or MCODEC_ERROR. The input and output buffer
+//functions could be called on two different threads, as MediaCodec.
+class CCodecBackend
+{
+public:
+    CCodecBackend(void) {};
+    virtual ~CCodecBackend(void) {};
+    
+    //Create the encoder instance by mime type, and delete it.
+    virtual int32_t Create(const char* pMime) = 0;
+    virtual void Delete(void) = 0;
+    
+    //Configure the created encoder, it should be created again after a failure.
+    virtual int32_t Configure(const MSdkBackendFormat* pFormat) = 0;
+    
+    //Start or stop the configured encoder.
+    virtual int32_t Start(void) = 0;
+    virtual int32_t Stop(void) = 0;
+    
+    //Set a parameter of the running encoder, for the next queued input buffer.
+    virtual int32_t SetParameter(const char* pKey, int32_t Value) = 0;
+    
+    //Get a free input buffer, and queue it with the picture to encode.
+    virtual ssize_t DequeueInputBuffer(int64_t TimeoutUs) = 0;
+    virtual uint8_t* GetInputBuffer(size_t Index, size_t* pSize) = 0;
+    virtual int32_t QueueInputBuffer(size_t Index, size_t Size, uint64_t TimeUs, uint32_t Flags) = 0;
+    
+    //Get an output buffer with the bitstream, and give it back after use.
+    virtual ssize_t DequeueOutputBuffer(MSdkBufferInfo* pInfo, int64_t TimeoutUs) = 0;
+    virtual uint8_t* GetOutputBuffer(size_t Index, size_t* pSize) = 0;
+    virtual int32_t ReleaseOutputBuffer(size_t Index) = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Create the backend of MSDK_BACKEND_*, return NULL if it is not built in.
+CCodecBackend* backend_Create(uint32_t Type);
+
+#endif  // End of __CODEC_BACKEND_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
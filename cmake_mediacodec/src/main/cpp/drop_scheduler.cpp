@@ -0,0 +1,154 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "drop_scheduler.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+CDropScheduler::CDropScheduler(void)
+    : m_BudgetUs(0), m_nGoodFrames(0), m_nSinceRaise(0), m_nRaiseInFlight(0), m_SlotDropped(false),
+      m_DropLevel(0), m_nQueued(0), m_nOutput(0), m_LatencyUs(0),
+      m_nOffered(0), m_nDropped(0)
+{
+    for (int32_t i = 0; i < 4; i++)
+    {
+        m_nDroppedByLayer[i].store(0);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CDropScheduler::~CDropScheduler(void)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CDropScheduler::Configure(uint32_t BudgetMs)
+{
+    m_BudgetUs = (int64_t)BudgetMs * 1000;
+    m_nGoodFrames = 0;
+    m_nSinceRaise = 0;
+    m_nRaiseInFlight = 0;
+    m_SlotDropped = false;
+    m_DropLevel.store(0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CDropScheduler::ResetInFlight(void)
+{
+    //the pending frames are discarded with the codec, and never output.
+    m_nOutput.store(m_nQueued.load());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+bool CDropScheduler::ShouldDrop(uint32_t TemporalLayers, uint32_t TemporalId)
+{
+    m_nOffered.fetch_add(1, std::memory_order_relaxed);
+    
+    if (m_BudgetUs <= 0)
+    {
+        return false;
+    }
+    
+    //the measured latency includes the wait behind the frames in flight, so it
+    //grows with the backlog, and is taken as the latency of the next frame.
+    uint32_t in_flight = m_nQueued.load() - m_nOutput.load();
+    int64_t predicted  = m_LatencyUs.load(std::memory_order_relaxed);
+    uint32_t level     = m_DropLevel.load(std::memory_order_relaxed);
+    
+    //raise the level when over budget, once the frames in flight and the smoothed
+    //latency have seen the last level. lower it after staying well under budget.
+    //the smoothed latency lags behind, so a backlog which is not larger than at
+    //the last raise is already drained by the current level.
+    m_nSinceRaise++;
+    if ((predicted > m_BudgetUs) && (in_flight > 0))
+    {
+        m_nGoodFrames = 0;
+        if ((level < MSDK_DROP_MAX_LEVEL) && (m_nSinceRaise > in_flight + MSDK_DROP_SMOOTH_FRAMES) &&
+            ((level == 0) || (in_flight >= m_nRaiseInFlight)))
+        {
+            m_nSinceRaise = 0;
+            m_nRaiseInFlight = in_flight;
+            level++;
+        }
+    }
+    else if ((predicted * 2 < m_BudgetUs) && (level > 0))
+    {
+        if (++m_nGoodFrames >= MSDK_DROP_RECOVER_FRAMES)
+        {
+            m_nGoodFrames = 0;
+            level--;
+        }
+    }
+    m_DropLevel.store(level, std::memory_order_relaxed);
+    
+    if (TemporalLayers < 1)
+    {
+        TemporalLayers = 1;
+    }
+    else if (TemporalLayers > 3)
+    {
+        TemporalLayers = 3;
+    }
+    
+    //the levels drop the top layers one by one, and at last any frame which would
+    //wait behind others. the frame into an idle encoder is kept, to measure again.
+    //the encoder gives the layers in the queued order, the frame after a dropped
+    //one takes its slot, so one frame is dropped for every slot of a top layer.
+    uint32_t tid = (TemporalId < TemporalLayers) ? TemporalId : (TemporalLayers - 1);
+    bool drop = false;
+    
+    if (level >= TemporalLayers)
+    {
+        drop = ((tid > 0) && !m_SlotDropped) || ((in_flight > 0) && (predicted > m_BudgetUs));
+    }
+    else if (level > 0)
+    {
+        drop = (tid >= TemporalLayers - level) && !m_SlotDropped;
+    }
+    m_SlotDropped = drop;
+    
+    if (drop)
+    {
+        m_nDropped.fetch_add(1, std::memory_order_relaxed);
+        m_nDroppedByLayer[tid].fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    return drop;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CDropScheduler::OnQueued(void)
+{
+    m_nQueued.fetch_add(1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CDropScheduler::OnOutput(int64_t LatencyUs)
+{
+    m_nOutput.fetch_add(1);
+    
+    //the frame without a measured latency is only counted.
+    if (LatencyUs < 0)
+    {
+        return;
+    }
+    
+    //smooth the encode latency, with the weight of the new sample.
+    int64_t latency = m_LatencyUs.load(std::memory_order_relaxed);
+    latency = (latency == 0) ? LatencyUs : (latency * (MSDK_DROP_SMOOTH_FRAMES - 1) + LatencyUs) / MSDK_DROP_SMOOTH_FRAMES;
+    m_LatencyUs.store(latency, std::memory_order_relaxed);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CDropScheduler::GetStats(MSdkDropStats* pStats)
+{
+    pStats->FramesOffered   = m_nOffered.load(std::memory_order_relaxed);
+    pStats->FramesDropped   = m_nDropped.load(std::memory_order_relaxed);
+    pStats->DropLevel       = m_DropLevel.load(std::memory_order_relaxed);
+    pStats->InFlightFrames  = m_nQueued.load() - m_nOutput.load();
+    pStats->EncodeLatencyUs = (uint32_t)m_LatencyUs.load(std::memory_order_relaxed);
+    
+    for (int32_t i = 0; i < 4; i++)
+    {
+        pStats->DroppedByLayer[i] = m_nDroppedByLayer[i].load(std::memory_order_relaxed);
+    }
+}
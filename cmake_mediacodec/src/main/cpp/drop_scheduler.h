@@ -0,0 +1,70 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __DROP_SCHEDULER_H__
+#define __DROP_SCHEDULER_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#include "include/GPU_codec_api.h"
+
+//the drop levels are raised when the predicted latency is over the budget, and
+//lowered after the latency stays under half of the budget for a while.
+#define MSDK_DROP_MAX_LEVEL        3
+#define MSDK_DROP_RECOVER_FRAMES   30
+#define MSDK_DROP_SMOOTH_FRAMES    8
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The frame drop scheduler in front of the encoder. The latency of a new frame is
+//predicted by the frames in flight and the smoothed encode latency. With temporal
+//layers, the frames which the encoder would put on the top layers are dropped
+//first, so the frame rate is decimated evenly instead of dropping bursts of frames.
+class CDropScheduler
+{
+public:
+    CDropScheduler(void);
+    ~CDropScheduler(void);
+    
+    //Set the latency budget, 0 to never drop frames. the statistics are kept.
+    void Configure(uint32_t BudgetMs);
+    
+    //Forget the frames in flight, when the encoder is reopened.
+    void ResetInFlight(void);
+    
+    //Check if the next input frame should be dropped, with the temporal id the
+    //encoder would give it, from the input thread.
+    bool ShouldDrop(uint32_t TemporalLayers, uint32_t TemporalId);
+    
+    //Count a frame queued to the encoder, from the input thread.
+    void OnQueued(void);
+    
+    //Count a frame output by the encoder with its encode latency, or -1 if it is
+    //not measured, from the output thread.
+    void OnOutput(int64_t LatencyUs);
+    
+    //Get the drop statistics.
+    void GetStats(MSdkDropStats* pStats);
+    
+private:
+    
+    int64_t                m_BudgetUs;
+    uint32_t               m_nGoodFrames;
+    uint32_t               m_nSinceRaise;
+    uint32_t               m_nRaiseInFlight;
+    bool                   m_SlotDropped;
+    
+    //the input side counters, and the output side counters and latency.
+    std::atomic<uint32_t>  m_DropLevel;
+    std::atomic<uint32_t>  m_nQueued;
+    std::atomic<uint32_t>  m_nOutput;
+    std::atomic<int64_t>   m_LatencyUs;
+    
+    std::atomic<uint32_t>  m_nOffered;
+    std::atomic<uint32_t>  m_nDropped;
+    std::atomic<uint32_t>  m_nDroppedByLayer[4];
+};
+
+#endif  // End of __DROP_SCHEDULER_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,197 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+
+#include "frame_queue.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+CFrameQueue::CFrameQueue(void)
+    : m_nSlots(0), m_nDepth(0), m_DropPolicy(MSDK_QUEUE_DROP_OLDEST),
+      m_ReadCount(0), m_WriteCount(0), m_HeldCount(UINT64_MAX), m_nDropped(0)
+{
+    //no slot buffer is allocated until the first picture.
+    for (int32_t i = 0; i <= MSDK_MAX_QUEUE_DEPTH; i++)
+    {
+        memset(&m_Slots[i].Picture, 0, sizeof(SSourcePicture));
+        m_Slots[i].pBuffer    = NULL;
+        m_Slots[i].BufferSize = 0;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CFrameQueue::~CFrameQueue(void)
+{
+    Destroy();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CFrameQueue::Create(uint32_t Depth, int32_t DropPolicy)
+{
+    if ((Depth == 0) || (Depth > MSDK_MAX_QUEUE_DEPTH))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    if ((DropPolicy != MSDK_QUEUE_DROP_OLDEST) && (DropPolicy != MSDK_QUEUE_DROP_NEWEST))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    Destroy();
+    
+    //one more slot for the picture held by the consumer.
+    m_nDepth     = Depth;
+    m_nSlots     = Depth + 1;
+    m_DropPolicy = DropPolicy;
+    m_ReadCount.store(0);
+    m_WriteCount.store(0);
+    m_HeldCount.store(UINT64_MAX);
+    m_nDropped.store(0);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CFrameQueue::Destroy(void)
+{
+    for (int32_t i = 0; i <= MSDK_MAX_QUEUE_DEPTH; i++)
+    {
+        free(m_Slots[i].pBuffer);
+        m_Slots[i].pBuffer    = NULL;
+        m_Slots[i].BufferSize = 0;
+    }
+    
+    m_nSlots = 0;
+    m_nDepth = 0;
+    m_ReadCount.store(0);
+    m_WriteCount.store(0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CFrameQueue::Push(const SSourcePicture* pSrcPic)
+{
+    if ((m_nSlots == 0) || (pSrcPic == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    uint64_t write = m_WriteCount.load(std::memory_order_relaxed);
+    uint64_t read  = m_ReadCount.load();
+    
+    //the queue is full, drop the new picture, or the oldest one in the queue.
+    while (write - read >= m_nDepth)
+    {
+        if (m_DropPolicy == MSDK_QUEUE_DROP_NEWEST)
+        {
+            m_nDropped.fetch_add(1, std::memory_order_relaxed);
+            return MCODEC_SKIPPED;
+        }
+        
+        //if the CAS fails, the consumer has just taken a picture, try again.
+        if (m_ReadCount.compare_exchange_weak(read, read + 1))
+        {
+            m_nDropped.fetch_add(1, std::memory_order_relaxed);
+            read++;
+        }
+    }
+    
+    //the consumer is still on the slot after the oldest ones are dropped.
+    uint64_t held = m_HeldCount.load();
+    if ((held != UINT64_MAX) && ((write % m_nSlots) == (held % m_nSlots)))
+    {
+        m_nDropped.fetch_add(1, std::memory_order_relaxed);
+        return MCODEC_SKIPPED;
+    }
+    
+    //the slot is neither queued nor held by consumer, it is owned by producer now.
+    MSdkPictureSlot *pSlot = &m_Slots[write % m_nSlots];
+    
+    int32_t width  = pSrcPic->iPicWidth;
+    int32_t height = pSrcPic->iPicHeight;
+    int32_t uv_width  = (width + 1) >> 1;
+    int32_t uv_height = (height + 1) >> 1;
+    size_t size = (size_t)width * height + (size_t)uv_width * uv_height * 2;
+    
+    //grow the pooled buffer only for a larger picture.
+    if (pSlot->BufferSize < size)
+    {
+        uint8_t *pBuffer = (uint8_t *)realloc(pSlot->pBuffer, size);
+        if (pBuffer == NULL)
+        {
+            return MCODEC_ERROR;
+        }
+        pSlot->pBuffer    = pBuffer;
+        pSlot->BufferSize = size;
+    }
+    
+    //copy the I420 planes, the capture buffer is reused once this call returns.
+    SSourcePicture *pPic = &pSlot->Picture;
+    *pPic = *pSrcPic;
+    pPic->pData[0]   = pSlot->pBuffer;
+    pPic->pData[1]   = pPic->pData[0] + width * height;
+    pPic->pData[2]   = pPic->pData[1] + uv_width * uv_height;
+    pPic->pData[3]   = NULL;
+    pPic->iStride[0] = width;
+    pPic->iStride[1] = uv_width;
+    pPic->iStride[2] = uv_width;
+    pPic->iStride[3] = 0;
+    
+    for (int32_t plane = 0; plane < 3; plane++)
+    {
+        int32_t rows  = (plane == 0) ? height : uv_height;
+        int32_t bytes = (plane == 0) ? width : uv_width;
+        
+        for (int32_t y = 0; y < rows; y++)
+        {
+            memcpy(pPic->pData[plane] + y * pPic->iStride[plane],
+                   pSrcPic->pData[plane] + y * pSrcPic->iStride[plane], bytes);
+        }
+    }
+    
+    //publish the picture to the consumer.
+    m_WriteCount.store(write + 1, std::memory_order_release);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+MSdkPictureSlot* CFrameQueue::Pop(void)
+{
+    if (m_nSlots == 0)
+    {
+        return NULL;
+    }
+    
+    uint64_t read = m_ReadCount.load();
+    
+    //take the oldest picture, the producer may drop it at the same time. the
+    //slot is marked as held first, so it is never written after it is taken.
+    while (read < m_WriteCount.load(std::memory_order_acquire))
+    {
+        m_HeldCount.store(read);
+        if (m_ReadCount.compare_exchange_weak(read, read + 1))
+        {
+            return &m_Slots[read % m_nSlots];
+        }
+    }
+    
+    m_HeldCount.store(UINT64_MAX);
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CFrameQueue::Release(MSdkPictureSlot* pSlot)
+{
+    //the slot could be written by the producer again.
+    if (pSlot != NULL)
+    {
+        m_HeldCount.store(UINT64_MAX);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+uint32_t CFrameQueue::GetDroppedCount(void)
+{
+    return m_nDropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,78 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __FRAME_QUEUE_H__
+#define __FRAME_QUEUE_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+
+#include "include/GPU_codec_api.h"
+
+#define MSDK_MAX_QUEUE_DEPTH       16
+
+//the frame to drop when the queue is full.
+#define MSDK_QUEUE_DROP_OLDEST     0
+#define MSDK_QUEUE_DROP_NEWEST     1
+
+/////////////////////////////////////////////////////////////////////////////////////
+//One pooled picture slot, the I420 planes are copied into the slot buffer, which
+//is kept and only grown when a larger picture comes.
+typedef struct
+{
+    SSourcePicture         Picture;
+    uint8_t*               pBuffer;
+    size_t                 BufferSize;
+    
+}MSdkPictureSlot;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The lock-free single producer and single consumer queue of pictures. There is
+//one more slot than the depth, for the picture held by the consumer. To drop the
+//oldest picture, the producer moves the read index with CAS, and the consumer
+//also takes a picture with CAS, so both sides never wait for each other. the
+//held slot is published before it is taken, the producer never writes it.
+class CFrameQueue
+{
+public:
+    CFrameQueue(void);
+    ~CFrameQueue(void);
+    
+    //Set up the slots of the queue, with the depth and the drop policy.
+    int32_t Create(uint32_t Depth, int32_t DropPolicy);
+    
+    //Free all the slots, the producer and consumer should be stopped.
+    void Destroy(void);
+    
+    //Copy a picture to the queue, from the producer thread. return MCODEC_SKIPPED
+    //if the new picture is dropped, the dropped old one is only counted.
+    int32_t Push(const SSourcePicture* pSrcPic);
+    
+    //Take the oldest picture, from the consumer thread. return NULL if empty, the
+    //slot should be given back by Release() before the next Pop().
+    MSdkPictureSlot* Pop(void);
+    
+    //Give back the slot taken by Pop(), it could be reused by the producer.
+    void Release(MSdkPictureSlot* pSlot);
+    
+    //Get the number of the dropped pictures.
+    uint32_t GetDroppedCount(void);
+    
+private:
+    
+    MSdkPictureSlot          m_Slots[MSDK_MAX_QUEUE_DEPTH + 1];
+    uint32_t               m_nSlots;
+    uint32_t               m_nDepth;
+    int32_t                m_DropPolicy;
+    
+    //the picture counters, the slot of a counter is (counter % m_nSlots).
+    std::atomic<uint64_t>  m_ReadCount;
+    std::atomic<uint64_t>  m_WriteCount;
+    std::atomic<uint64_t>  m_HeldCount;
+    std::atomic<uint32_t>  m_nDropped;
+};
+
+#endif  // End of __FRAME_QUEUE_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
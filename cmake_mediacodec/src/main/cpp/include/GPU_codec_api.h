@@ -4,8 +4,8 @@
 
 #include "stdio.h"
 #include "stdint.h"
+#include "sys/uio.h"
 #include "codec_app_def.h"
-#include "../../../../../../../../Android/AndroidDeveloper-sdk/Android_NDK/android-ndk-r17b/sysroot/usr/include/stdint.h"
 
 #ifdef INTELHWCODEC_EXPORTS
 #define INTELHWCODEC_DLLEXPORT _declspec(dllexport)
@@ -21,12 +21,27 @@
 
 #define MCODEC_SUCCEED             0
 #define MCODEC_ERROR              -1
+#define MCODEC_SKIPPED             1
 
 #define VIDEO_CODEC_TYPE_AVC       0
 #define VIDEO_CODEC_TYPE_MJPEG     1
 #define VIDEO_CODEC_TYPE_HEVC      2
 #define VIDEO_CODEC_TYPE_VC1       3
 
+#define MSDK_BACKEND_MEDIACODEC    0
+#define MSDK_BACKEND_FAKE          1
+#define MSDK_BACKEND_OPENH264      2
+
+//the rate control of the encoder, the zero value keeps the device default.
+#define MSDK_RC_MODE_DEFAULT       0
+#define MSDK_RC_MODE_CBR           1
+#define MSDK_RC_MODE_VBR           2
+#define MSDK_RC_MODE_CQ            3
+
+//the long-term reference frames kept by the encoder, and the marking period.
+#define MSDK_MAX_LTR_FRAMES        2
+#define MSDK_LTR_MARK_PERIOD       30
+
 //the Intel MSDK encoder single pipeline interface parameters.
 typedef struct
 {
@@ -39,7 +54,7 @@ typedef struct
     uint32_t  nWidth;            // Input picture width
     uint32_t  nHeight;           // Input picture height
     uint32_t  nTargetKbps;       // Target encoding bitrate
-    uint32_t  nTemporalLayers;   // The number of temporal layers
+    uint32_t  nTemporalLayers;   // The number of temporal layers, 1~3
     uint32_t  nSpatialId;        // the output spatial_id, 0~3.
     uint32_t  nMemType;          // the memory type for frame surface
     
@@ -48,8 +63,113 @@ typedef struct
     uint8_t   SpsNalUnit[200];   // The incoming SPS nal_unit data.
     uint8_t   PpsNalUnit[200];   // The incoming PPS nal_unit data.
     
+    uint32_t  nCodecType;        // VIDEO_CODEC_TYPE_AVC or VIDEO_CODEC_TYPE_HEVC
+    int32_t   nRCMode;           // MSDK_RC_MODE_CBR, MSDK_RC_MODE_VBR, MSDK_RC_MODE_CQ for
+                                 // constant quality, or MSDK_RC_MODE_DEFAULT
+    uint32_t  nLatencyBudgetMs;  // the encode latency budget to drop frames, 0: never
+    uint32_t  nBackend;          // MSDK_BACKEND_MEDIACODEC, MSDK_BACKEND_FAKE off device,
+                                 // or MSDK_BACKEND_OPENH264 for the software encoder
+    uint32_t  nLtrFrames;        // the long-term reference frames, 0~2, 0: disabled. the
+                                 // hardware encoder needs the vendor LTR keys, which are
+                                 // listed in getSupportedVendorParameters()
+    int32_t   nSliceMode;        // SliceModeEnum, SM_SINGLE_SLICE by default. the hardware
+                                 // encoder only takes SM_SIZELIMITED_SLICE, with the vendor
+                                 // resync marker key, and encodes one slice for the others
+    uint32_t  nSliceArgument;    // the slices of SM_FIXEDSLCNUM_SLICE, the macroblocks of
+                                 // a slice for SM_RASTER_SLICE, or the max bytes of a slice
+                                 // NAL unit for SM_SIZELIMITED_SLICE, such as the RTP MTU
+    uint32_t  VpsLength;         // The incoming VPS nal_unit length, HEVC only
+    uint8_t   VpsNalUnit[200];   // The incoming VPS nal_unit data.
+    
 }MSdkInputParam;
 
+//The decoded YUV frame lent by the decoder, which points into the codec output
+//buffer directly. It should be given back by ReleaseDecodeImage(), after render.
+typedef struct
+{
+    uint32_t  BufferStatus;      // 1: decode success, 0: decode failed
+    uint32_t  nMemType;          // the memory type for frame surface
+    uint32_t  DecWidth;          // the resoulation of decoded frame
+    uint32_t  DecHeight;         // the resoulation of decoded frame
+    uint32_t  DecStride[3];      // the Y/U/V stride of decoded frame.
+    uint8_t*  DecBuffer[3];      // the Y/U/V plane buffer of decoded image
+    
+    uint32_t  DecFormat;         // 19: I420 planar, 21: NV12, DecBuffer[2] is NULL
+    int64_t   TimeStamp;         // the frame timestamp, ms
+    int32_t   FrameHandle;       // the release handle of decoder
+    
+}MSdkOutFrame;
+
+#define MSDK_MAX_BS_SEGMENTS       16
+
+//the longest wait of the encoder for a free input buffer, and for the output of
+//a frame in LockBitstream(), so the caller thread is never blocked by a stalled
+//codec.
+#define MSDK_INPUT_TIMEOUT_US      1000000
+#define MSDK_OUTPUT_TIMEOUT_US     50000
+
+//the output waits of GetBitstream() and GetFrameBitstream() for one frame, as
+//long as the input wait in all.
+#define MSDK_OUTPUT_RETRIES        (MSDK_INPUT_TIMEOUT_US / MSDK_OUTPUT_TIMEOUT_US)
+
+//The encoded access unit borrowed from the encoder, without any copy. The
+//segments are an iovec list, which could be passed to writev() or sendmsg(),
+//and the segments joined in order are an Annex-B access unit, every NAL unit
+//with its start code, the first one is removed only by GetBitstream().
+typedef struct
+{
+    int32_t         SegmentCount;                     // the number of segments
+    struct iovec    Segments[MSDK_MAX_BS_SEGMENTS];   // SPS/PPS, prefix NAL and payload
+    
+    EVideoFrameType eFrameType;                       // the encoded frame type
+    uint8_t         uiTemporalId;                     // the temporal layer id
+    uint8_t         uiSpatialId;                      // the spatial layer id
+    uint8_t         uiQualityId;                      // the quality layer id
+    int64_t         uiTimeStamp;                      // the frame timestamp, ms
+    
+    int32_t         NalCount;                         // the number of NAL units
+    int32_t         NalLengthInByte[MAX_NAL_UNITS_IN_LAYER];  // NAL lengths, in output order
+    
+    int32_t         BufferIndex;                      // the release handle of encoder
+    
+}MSdkBitstream;
+
+//the encoding stages measured with the monotonic clock, keyed by uiTimeStamp.
+#define MSDK_LATENCY_SCALE         0   // scale or copy the input image
+#define MSDK_LATENCY_INPUT_WAIT    1   // wait for a free input buffer
+#define MSDK_LATENCY_ENCODE        2   // from queued input to dequeued output
+#define MSDK_LATENCY_OUTPUT        3   // from dequeued output to unlock/copy done
+#define MSDK_LATENCY_TOTAL         4   // from EncodeFrame() to bitstream released
+#define MSDK_LATENCY_STAGES        5
+
+//The latency distribution of one stage, in microseconds.
+typedef struct
+{
+    uint32_t  Count;             // the number of samples
+    uint32_t  P50Us;             // the median latency
+    uint32_t  P99Us;             // the 99th percentile latency
+    uint32_t  MaxUs;             // the max latency
+    
+}MSdkLatencyStage;
+
+typedef struct
+{
+    MSdkLatencyStage  Stages[MSDK_LATENCY_STAGES];
+    
+}MSdkLatencyStats;
+
+//The frames dropped by the latency scheduler, in front of the encoder.
+typedef struct
+{
+    uint32_t  FramesOffered;     // the frames passed to EncodeFrame()
+    uint32_t  FramesDropped;     // the frames dropped for the latency budget
+    uint32_t  DroppedByLayer[4]; // the dropped frames, by their temporal layer
+    uint32_t  DropLevel;         // the current level, 0 for no drop
+    uint32_t  InFlightFrames;    // the frames queued but not output yet
+    uint32_t  EncodeLatencyUs;   // the smoothed encode latency
+    
+}MSdkDropStats;
+
 /////////////////////////////////////////////////////////////////////////////////////
 class INTELHWCODEC_DLLEXPORT VM_MSDKEncoder
 {
@@ -57,23 +177,90 @@ public:
     VM_MSDKEncoder(void) {};
     virtual ~VM_MSDKEncoder(void) {};
     
-    //Create an Intel MSDK video encoder pipeline, and configure parameters.
+    //Create an Intel MSDK video encoder pipeline, and configure parameters. if
+    //the hardware encoder fails or is blocked, the OpenH264 encoder is created,
+    //when the library is built with it.
     static VM_MSDKEncoder* CreateEncoder(MSdkInputParam *InputParam);
     
+    //Block the hardware encoder of the device, the encoders created later are
+    //software encoders. It is set from the device blocklist of the application.
+    static void SetHardwareBlocked(bool Blocked);
+    
     //Delete the Intel MSDK encoder and release internal memory.
     static void DeleteEncoder(VM_MSDKEncoder *pMEncoder);
     
-    //Encode a frame asynchronously, without outputing bitstream.
+    //Encode a frame asynchronously, without outputing bitstream. return
+    //MCODEC_SKIPPED if the frame is dropped, and GetBitstream() should not be
+    //called for it: the input is faster than nFrameRate, the encoder is behind
+    //nLatencyBudgetMs (see GetDropStats()), the output is too far above the
+    //target bitrate, or the software encoder skips it for its rate control.
+    //return MCODEC_ERROR if no input buffer is free within MSDK_INPUT_TIMEOUT_US.
     virtual int32_t EncodeFrame(SSourcePicture* pSrcPic, SLayerBSInfo* pBsLayer) = 0;
     
-    //Synchronize the encoder and output bitstream data.
+    //Synchronize the encoder and output bitstream data. return MCODEC_SKIPPED if
+    //the frame is not output within MSDK_OUTPUT_RETRIES output waits.
     virtual int32_t GetBitstream(SLayerBSInfo* pBsLayer) = 0;
     
+    //Synchronize the encoder and output all the layers of one picture in a call,
+    //every NAL unit with its start code. the layers point into encoder memory,
+    //which is valid until the next call, as the output of OpenH264 EncodeFrame().
+    //return MCODEC_SKIPPED as GetBitstream() if the frame is not output.
+    virtual int32_t GetFrameBitstream(SFrameBSInfo* pFrameInfo) = 0;
+    
+    //Synchronize the encoder and borrow the bitstream in encoder memory. return
+    //MCODEC_SKIPPED if the frame is not output within MSDK_OUTPUT_TIMEOUT_US, it
+    //should be called again for the frame.
+    virtual int32_t LockBitstream(MSdkBitstream* pBitstream) = 0;
+    
+    //Give the borrowed bitstream buffer back to the encoder.
+    virtual int32_t UnlockBitstream(MSdkBitstream* pBitstream) = 0;
+    
     //Update the target bitrate online of specified pipeline.
     virtual int32_t UpdateBitrate(uint32_t Bitrate, uint32_t Framerate) = 0;
     
     //Request to encoder the current frame as IDR frame.
     virtual int32_t InsertKeyFrame(void) = 0;
+    
+    //Request to recover from the packet loss. for LTR_RECOVERY_REQUEST the next
+    //frame is a P frame from the last long-term reference the decoder has marked,
+    //without such a reference or for IDR_RECOVERY_REQUEST it is an IDR frame.
+    virtual int32_t RequestLtrRecovery(SLTRRecoverRequest* pRequest) = 0;
+    
+    //Report the long-term reference marked by the decoder, or failed to mark.
+    virtual int32_t SetLtrMarkingFeedback(SLTRMarkingFeedback* pFeedback) = 0;
+    
+    //Get the per-stage latency of the frames encoded since the encoder is created.
+    virtual int32_t GetLatencyStats(MSdkLatencyStats* pStats) = 0;
+    
+    //Get the statistics of the frames dropped for the latency budget.
+    virtual int32_t GetDropStats(MSdkDropStats* pStats) = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////
+class INTELHWCODEC_DLLEXPORT VM_MSDKDecoder
+{
+public:
+    VM_MSDKDecoder(void) {};
+    virtual ~VM_MSDKDecoder(void) {};
+    
+    //Create an Intel MSDK video decoder pipeline and configure parameters.
+    static VM_MSDKDecoder* CreateDecoder(MSdkInputParam *InputParam);
+    
+    //Delete the Intel MSDK decoder and release internal memory.
+    static void DeleteDecoder(VM_MSDKDecoder *pMDecoder);
+    
+    //Start to decode a frame asynchronously, with incoming stream data. return
+    //MCODEC_ERROR if the decoder has no free input buffer within a short timeout.
+    virtual int32_t DecodeFrame(uint8_t *pStream, int32_t Length) = 0;
+    
+    //Synchronize the GPU decoder and output the decoded YUV image.
+    virtual int32_t GetDecodeImage(MSdkOutFrame *pOutFrame) = 0;
+    
+    //Add a reference to the decoded image, for one more renderer of it.
+    virtual int32_t AddRefDecodeImage(MSdkOutFrame *pOutFrame) = 0;
+    
+    //Drop a reference of the decoded image, the last one gives it back.
+    virtual int32_t ReleaseDecodeImage(MSdkOutFrame *pOutFrame) = 0;
 };
 
 #endif  // End of __GPU_CODEC_API_H__
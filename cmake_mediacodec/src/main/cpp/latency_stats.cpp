@@ -0,0 +1,130 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "latency_stats.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Get the bucket of a latency value, the small values have their own buckets.
+static int32_t GetBucket(uint32_t Value)
+{
+    if (Value < (2u << MSDK_LATENCY_SUB_BITS))
+    {
+        return (int32_t)Value;
+    }
+    
+    //the highest bit selects the power of 2, the next bits the linear bucket.
+    int32_t msb = 31 - __builtin_clz(Value);
+    if (msb > MSDK_LATENCY_MAX_BITS)
+    {
+        return MSDK_LATENCY_BUCKETS - 1;
+    }
+    
+    int32_t shift = msb - MSDK_LATENCY_SUB_BITS;
+    return ((shift + 1) << MSDK_LATENCY_SUB_BITS) + (int32_t)((Value >> shift) & ((1u << MSDK_LATENCY_SUB_BITS) - 1));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Get the largest latency value of a bucket, which is reported for percentiles.
+static uint32_t GetBucketLimit(int32_t Bucket)
+{
+    if (Bucket < (2 << MSDK_LATENCY_SUB_BITS))
+    {
+        return (uint32_t)Bucket;
+    }
+    
+    int32_t shift = (Bucket >> MSDK_LATENCY_SUB_BITS) - 1;
+    uint32_t base = (uint32_t)((1 << MSDK_LATENCY_SUB_BITS) + (Bucket & ((1 << MSDK_LATENCY_SUB_BITS) - 1)));
+    return ((base + 1) << shift) - 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int64_t latency_NowUs(void)
+{
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void latency_Reset(MSdkLatencyHistogram* pHist)
+{
+    for (int32_t i = 0; i < MSDK_LATENCY_BUCKETS; i++)
+    {
+        pHist->Buckets[i].store(0, std::memory_order_relaxed);
+    }
+    
+    pHist->Count.store(0, std::memory_order_relaxed);
+    pHist->MaxUs.store(0, std::memory_order_relaxed);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void latency_Record(MSdkLatencyHistogram* pHist, int64_t LatencyUs)
+{
+    uint32_t value = (LatencyUs <= 0) ? 0 : ((LatencyUs > UINT32_MAX) ? UINT32_MAX : (uint32_t)LatencyUs);
+    
+    pHist->Buckets[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    pHist->Count.fetch_add(1, std::memory_order_relaxed);
+    
+    //raise the max value, unless another thread has put a larger one.
+    uint32_t max = pHist->MaxUs.load(std::memory_order_relaxed);
+    while ((value > max) && !pHist->MaxUs.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void latency_Query(const MSdkLatencyHistogram* pHist, MSdkLatencyStage* pStage)
+{
+    uint32_t counts[MSDK_LATENCY_BUCKETS];
+    uint32_t total = 0;
+    
+    //take a snapshot of buckets, the samples recorded meanwhile may be missed.
+    for (int32_t i = 0; i < MSDK_LATENCY_BUCKETS; i++)
+    {
+        counts[i] = pHist->Buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    
+    pStage->Count = total;
+    pStage->P50Us = 0;
+    pStage->P99Us = 0;
+    pStage->MaxUs = pHist->MaxUs.load(std::memory_order_relaxed);
+    
+    if (total == 0)
+    {
+        return;
+    }
+    
+    //find out the buckets of the 50th and 99th sample, rounded up.
+    uint64_t rank50 = ((uint64_t)total * 50 + 99) / 100;
+    uint64_t rank99 = ((uint64_t)total * 99 + 99) / 100;
+    uint64_t seen = 0;
+    
+    //the limit of the first bucket is 0, so each percentile has its own flag.
+    bool found50 = false;
+    for (int32_t i = 0; i < MSDK_LATENCY_BUCKETS; i++)
+    {
+        seen += counts[i];
+        if (!found50 && (seen >= rank50))
+        {
+            pStage->P50Us = GetBucketLimit(i);
+            found50 = true;
+        }
+        if (seen >= rank99)
+        {
+            pStage->P99Us = GetBucketLimit(i);
+            break;
+        }
+    }
+    
+    //the bucket limit is never reported above the real max value.
+    if (pStage->P50Us > pStage->MaxUs)
+    {
+        pStage->P50Us = pStage->MaxUs;
+    }
+    if (pStage->P99Us > pStage->MaxUs)
+    {
+        pStage->P99Us = pStage->MaxUs;
+    }
+}
@@ -0,0 +1,48 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __LATENCY_STATS_H__
+#define __LATENCY_STATS_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+
+#include "include/GPU_codec_api.h"
+
+//the histogram has 8 linear buckets for every power of 2 microseconds, so the
+//percentiles are within 12.5%, and the last bucket takes more than 64 seconds.
+#define MSDK_LATENCY_SUB_BITS      3
+#define MSDK_LATENCY_MAX_BITS      26
+#define MSDK_LATENCY_BUCKETS       ((MSDK_LATENCY_MAX_BITS - MSDK_LATENCY_SUB_BITS + 2) << MSDK_LATENCY_SUB_BITS)
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The lock-free latency histogram of one stage, which could be recorded and
+//queried on different threads without locks. the counters are relaxed atomics.
+typedef struct
+{
+    std::atomic<uint32_t>  Buckets[MSDK_LATENCY_BUCKETS];
+    std::atomic<uint32_t>  Count;
+    std::atomic<uint32_t>  MaxUs;
+    
+}MSdkLatencyHistogram;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Get the current time of the monotonic clock, in microseconds.
+int64_t latency_NowUs(void);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Clear all the samples of the histogram.
+void latency_Reset(MSdkLatencyHistogram* pHist);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Add a latency sample to the histogram, the negative value is taken as 0.
+void latency_Record(MSdkLatencyHistogram* pHist, int64_t LatencyUs);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Get the sample count, p50, p99 and max latency of the histogram.
+void latency_Query(const MSdkLatencyHistogram* pHist, MSdkLatencyStage* pStage);
+
+#endif  // End of __LATENCY_STATS_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
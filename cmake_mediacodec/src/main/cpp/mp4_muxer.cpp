@@ -0,0 +1,564 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+
+#include "bitstream_io.h"
+#include "mp4_muxer.h"
+#include "nal_parser.h"
+
+//the sample_flags of trun, for the sync sample and the others.
+#define MSDK_MP4_SYNC_FLAGS        0x02000000
+#define MSDK_MP4_NON_SYNC_FLAGS    0x01010000
+
+//the frame duration before the second frame is known, 1/30 second.
+#define MSDK_MP4_DEFAULT_DURATION  3000
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Write the big-endian values and the box headers, return the next write position.
+static inline uint8_t* Put16(uint8_t* p, uint32_t Value)
+{
+    p[0] = (uint8_t)(Value >> 8);
+    p[1] = (uint8_t)(Value);
+    return p + 2;
+}
+
+static inline uint8_t* Put32(uint8_t* p, uint32_t Value)
+{
+    p[0] = (uint8_t)(Value >> 24);
+    p[1] = (uint8_t)(Value >> 16);
+    p[2] = (uint8_t)(Value >> 8);
+    p[3] = (uint8_t)(Value);
+    return p + 4;
+}
+
+static inline uint8_t* Put64(uint8_t* p, uint64_t Value)
+{
+    p = Put32(p, (uint32_t)(Value >> 32));
+    return Put32(p, (uint32_t)Value);
+}
+
+static inline uint8_t* PutTag(uint8_t* p, const char* pTag)
+{
+    memcpy(p, pTag, 4);
+    return p + 4;
+}
+
+static inline uint8_t* PutZeros(uint8_t* p, int32_t Count)
+{
+    memset(p, 0, Count);
+    return p + Count;
+}
+
+//the box size is written by EndBox(), when all its children are written.
+static inline uint8_t* BeginBox(uint8_t* p, const char* pType)
+{
+    return PutTag(p + 4, pType);
+}
+
+static inline uint8_t* BeginFullBox(uint8_t* p, const char* pType, uint32_t Version, uint32_t Flags)
+{
+    return Put32(BeginBox(p, pType), (Version << 24) | Flags);
+}
+
+static inline void EndBox(uint8_t* pBox, uint8_t* pEnd)
+{
+    Put32(pBox, (uint32_t)(pEnd - pBox));
+}
+
+//the length of the start code at the NAL unit, 0 if it has no start code.
+static inline int32_t StartCodeLength(const uint8_t* pNal, int32_t Length)
+{
+    int32_t sc_len = 0;
+    int32_t offset = nal_FindStartCode(pNal, (Length < 4) ? Length : 4, &sc_len);
+    return (offset == 0) ? sc_len : 0;
+}
+
+//the unity matrix of the movie and track headers.
+static uint8_t* PutMatrix(uint8_t* p)
+{
+    static const uint32_t matrix[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+    for (int32_t i = 0; i < 9; i++)
+    {
+        p = Put32(p, matrix[i]);
+    }
+    return p;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMp4Muxer::CMp4Muxer(void)
+    : m_File(-1), m_InitWritten(false), m_pHeader(NULL), m_pFragment(NULL), m_FragmentBytes(0),
+      m_nSamples(0), m_SequenceNumber(0), m_DecodeTime(0),
+      m_LastDuration(MSDK_MP4_DEFAULT_DURATION)
+{
+    memset(&m_Config, 0, sizeof(m_Config));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CMp4Muxer::~CMp4Muxer(void)
+{
+    Close();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMp4Muxer::Open(int fd, const MSdkMp4Config* pConfig)
+{
+    //the muxer could be opened once, and only writes the avcC of H264/AVC.
+    if ((m_File >= 0) || (fd < 0) || (pConfig == NULL) || (pConfig->CodecType != VIDEO_CODEC_TYPE_AVC) ||
+        (pConfig->Width == 0) || (pConfig->Height == 0) || (pConfig->MaxFragmentBytes <= 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the memory of the muxer is allocated only here.
+    m_pHeader   = (uint8_t *)malloc(MSDK_MP4_HEADER_BYTES);
+    m_pFragment = (uint8_t *)malloc(pConfig->MaxFragmentBytes);
+    if ((m_pHeader == NULL) || (m_pFragment == NULL))
+    {
+        free(m_pHeader);
+        free(m_pFragment);
+        m_pHeader   = NULL;
+        m_pFragment = NULL;
+        return MCODEC_ERROR;
+    }
+    
+    m_File           = fd;
+    m_Config         = *pConfig;
+    m_InitWritten    = false;
+    m_FragmentBytes  = 0;
+    m_nSamples       = 0;
+    m_SequenceNumber = 0;
+    m_DecodeTime     = 0;
+    m_LastDuration   = MSDK_MP4_DEFAULT_DURATION;
+    m_ParamSets.Reset(pConfig->CodecType);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMp4Muxer::Close(void)
+{
+    if (m_File < 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the last sample lasts as long as the one before it.
+    int32_t sts = MCODEC_SUCCEED;
+    if (m_nSamples > 0)
+    {
+        m_Samples[m_nSamples - 1].Duration = m_LastDuration;
+        sts = FlushFragment();
+    }
+    
+    free(m_pHeader);
+    free(m_pFragment);
+    m_pHeader   = NULL;
+    m_pFragment = NULL;
+    m_File      = -1;
+    
+    return sts;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMp4Muxer::WriteFrame(const SLayerBSInfo* pLayers, int32_t LayerNum, int64_t TimeStamp)
+{
+    if ((m_File < 0) || (pLayers == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the first pass saves the parameter sets, and finds the sample size and the IDR.
+    uint32_t sample_size = 0;
+    bool sync_sample = false;
+    bool ps_changed  = false;
+    
+    for (int32_t i = 0; i < LayerNum; i++)
+    {
+        const uint8_t *pNal = pLayers[i].pBsBuf;
+        for (int32_t j = 0; j < pLayers[i].iNalCount; j++)
+        {
+            int32_t length = pLayers[i].pNalLengthInByte[j];
+            int32_t sc_len = StartCodeLength(pNal, length);
+            
+            int32_t nal_type = (length > sc_len) ? (pNal[sc_len] & 0x1F) : 0;
+            if (nal_IsParamSet(nal_type, VIDEO_CODEC_TYPE_AVC))
+            {
+                ps_changed |= (m_ParamSets.Update(pNal + sc_len, length - sc_len) == MSDK_PS_CHANGED);
+            }
+            else if ((nal_type != 0) && (nal_type != 14))
+            {
+                sample_size += 4 + length - sc_len;
+                sync_sample |= nal_IsIDR(nal_type, VIDEO_CODEC_TYPE_AVC);
+            }
+            pNal += length;
+        }
+    }
+    
+    //the sets are copied out when they are used, the replaced ones are not lent.
+    m_ParamSets.ReleaseRetired();
+    
+    //the avcC of the written init segment could not be changed.
+    if (ps_changed && m_InitWritten)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    if (sample_size == 0)
+    {
+        return MCODEC_SKIPPED;
+    }
+    
+    if ((int32_t)sample_size > m_Config.MaxFragmentBytes)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the recording starts at the first IDR frame with its SPS/PPS.
+    if (!m_InitWritten)
+    {
+        if (!sync_sample)
+        {
+            return MCODEC_SKIPPED;
+        }
+        
+        if (WriteInitSegment() != MCODEC_SUCCEED)
+        {
+            return MCODEC_ERROR;
+        }
+        m_InitWritten = true;
+    }
+    
+    //the new sample ends the duration of the last one.
+    if (m_nSamples > 0)
+    {
+        int64_t duration = (TimeStamp - m_Samples[m_nSamples - 1].TimeStamp) * MSDK_MP4_TIMESCALE / 1000;
+        m_LastDuration = (duration > 0) ? (uint32_t)duration : m_LastDuration;
+        m_Samples[m_nSamples - 1].Duration = m_LastDuration;
+    }
+    
+    //a fragment starts at every IDR frame, or when the buffer is full.
+    if ((m_nSamples > 0) &&
+        (sync_sample || (m_nSamples >= MSDK_MP4_MAX_SAMPLES) ||
+         (m_FragmentBytes + (int32_t)sample_size > m_Config.MaxFragmentBytes)))
+    {
+        if (FlushFragment() != MCODEC_SUCCEED)
+        {
+            return MCODEC_ERROR;
+        }
+    }
+    
+    //the second pass copies the NAL units, with the length instead of the start code.
+    uint8_t *pOut = m_pFragment + m_FragmentBytes;
+    for (int32_t i = 0; i < LayerNum; i++)
+    {
+        const uint8_t *pNal = pLayers[i].pBsBuf;
+        for (int32_t j = 0; j < pLayers[i].iNalCount; j++)
+        {
+            int32_t length = pLayers[i].pNalLengthInByte[j];
+            int32_t sc_len = StartCodeLength(pNal, length);
+            
+            int32_t nal_type = (length > sc_len) ? (pNal[sc_len] & 0x1F) : 0;
+            if (!nal_IsParamSet(nal_type, VIDEO_CODEC_TYPE_AVC) && (nal_type != 0) && (nal_type != 14))
+            {
+                pOut = Put32(pOut, length - sc_len);
+                memcpy(pOut, pNal + sc_len, length - sc_len);
+                pOut += length - sc_len;
+            }
+            pNal += length;
+        }
+    }
+    
+    MSdkMp4Sample *pSample = &m_Samples[m_nSamples++];
+    pSample->TimeStamp  = TimeStamp;
+    pSample->Size       = sample_size;
+    pSample->Duration   = m_LastDuration;
+    pSample->SyncSample = sync_sample ? 1 : 0;
+    m_FragmentBytes += sample_size;
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMp4Muxer::WriteInitSegment(void)
+{
+    //the SPS and PPS units are saved with the 4-byte start code.
+    struct iovec sets[3];
+    int32_t count = m_ParamSets.GetActiveSets(sets, 3);
+    if (count < 2)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    const uint8_t *pSps = (const uint8_t *)sets[0].iov_base + 4;
+    int32_t sps_size = (int32_t)sets[0].iov_len - 4;
+    int32_t ps_size  = 0;
+    for (int32_t i = 0; i < count; i++)
+    {
+        ps_size += (int32_t)sets[i].iov_len;
+    }
+    if ((sps_size < 4) || (ps_size > MSDK_MP4_HEADER_BYTES / 2))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    uint8_t *p = m_pHeader;
+    uint8_t *ftyp = p;
+    p = BeginBox(p, "ftyp");
+    p = PutTag(p, "iso6");
+    p = Put32(p, 0);
+    p = PutTag(p, "iso6");
+    p = PutTag(p, "cmfc");
+    p = PutTag(p, "isom");
+    p = PutTag(p, "mp41");
+    EndBox(ftyp, p);
+    
+    uint8_t *moov = p;
+    p = BeginBox(p, "moov");
+    
+    //the movie header, the duration is in the fragments.
+    uint8_t *mvhd = p;
+    p = BeginFullBox(p, "mvhd", 0, 0);
+    p = Put32(p, 0);
+    p = Put32(p, 0);
+    p = Put32(p, 1000);
+    p = Put32(p, 0);
+    p = Put32(p, 0x00010000);
+    p = Put16(p, 0x0100);
+    p = PutZeros(p, 10);
+    p = PutMatrix(p);
+    p = PutZeros(p, 24);
+    p = Put32(p, 2);
+    EndBox(mvhd, p);
+    
+    uint8_t *trak = p;
+    p = BeginBox(p, "trak");
+    
+    //the enabled track in movie, with the picture size in 16.16 fixed point.
+    uint8_t *tkhd = p;
+    p = BeginFullBox(p, "tkhd", 0, 3);
+    p = Put32(p, 0);
+    p = Put32(p, 0);
+    p = Put32(p, 1);
+    p = Put32(p, 0);
+    p = Put32(p, 0);
+    p = PutZeros(p, 16);
+    p = PutMatrix(p);
+    p = Put32(p, m_Config.Width << 16);
+    p = Put32(p, m_Config.Height << 16);
+    EndBox(tkhd, p);
+    
+    uint8_t *mdia = p;
+    p = BeginBox(p, "mdia");
+    
+    uint8_t *mdhd = p;
+    p = BeginFullBox(p, "mdhd", 0, 0);
+    p = Put32(p, 0);
+    p = Put32(p, 0);
+    p = Put32(p, MSDK_MP4_TIMESCALE);
+    p = Put32(p, 0);
+    p = Put16(p, 0x55C4);
+    p = Put16(p, 0);
+    EndBox(mdhd, p);
+    
+    uint8_t *hdlr = p;
+    p = BeginFullBox(p, "hdlr", 0, 0);
+    p = Put32(p, 0);
+    p = PutTag(p, "vide");
+    p = PutZeros(p, 12);
+    memcpy(p, "VideoHandler", 13);
+    p += 13;
+    EndBox(hdlr, p);
+    
+    uint8_t *minf = p;
+    p = BeginBox(p, "minf");
+    
+    uint8_t *vmhd = p;
+    p = BeginFullBox(p, "vmhd", 0, 1);
+    p = PutZeros(p, 8);
+    EndBox(vmhd, p);
+    
+    //the media data is in the same file.
+    uint8_t *dinf = p;
+    p = BeginBox(p, "dinf");
+    uint8_t *dref = p;
+    p = BeginFullBox(p, "dref", 0, 0);
+    p = Put32(p, 1);
+    uint8_t *url = p;
+    p = BeginFullBox(p, "url ", 0, 1);
+    EndBox(url, p);
+    EndBox(dref, p);
+    EndBox(dinf, p);
+    
+    uint8_t *stbl = p;
+    p = BeginBox(p, "stbl");
+    
+    uint8_t *stsd = p;
+    p = BeginFullBox(p, "stsd", 0, 0);
+    p = Put32(p, 1);
+    
+    //the visual sample entry, with the 72 dpi resolution and 24-bit depth.
+    uint8_t *avc1 = p;
+    p = BeginBox(p, "avc1");
+    p = PutZeros(p, 6);
+    p = Put16(p, 1);
+    p = PutZeros(p, 16);
+    p = Put16(p, m_Config.Width);
+    p = Put16(p, m_Config.Height);
+    p = Put32(p, 0x00480000);
+    p = Put32(p, 0x00480000);
+    p = Put32(p, 0);
+    p = Put16(p, 1);
+    p = PutZeros(p, 32);
+    p = Put16(p, 0x0018);
+    p = Put16(p, 0xFFFF);
+    
+    //the avcC with the 4-byte NAL unit length, the SPS and all the PPS units.
+    uint8_t *avcC = p;
+    p = BeginBox(p, "avcC");
+    *p++ = 1;
+    *p++ = pSps[1];
+    *p++ = pSps[2];
+    *p++ = pSps[3];
+    *p++ = 0xFF;
+    *p++ = 0xE1;
+    p = Put16(p, sps_size);
+    memcpy(p, pSps, sps_size);
+    p += sps_size;
+    *p++ = (uint8_t)(count - 1);
+    for (int32_t i = 1; i < count; i++)
+    {
+        p = Put16(p, (uint32_t)sets[i].iov_len - 4);
+        memcpy(p, (const uint8_t *)sets[i].iov_base + 4, sets[i].iov_len - 4);
+        p += sets[i].iov_len - 4;
+    }
+    
+    //the high profiles have the chroma format and bit depth, the encoders
+    //here always output 8-bit 4:2:0.
+    if ((pSps[1] == 100) || (pSps[1] == 110) || (pSps[1] == 122) || (pSps[1] == 144))
+    {
+        *p++ = 0xFC | 1;
+        *p++ = 0xF8;
+        *p++ = 0xF8;
+        *p++ = 0;
+    }
+    EndBox(avcC, p);
+    EndBox(avc1, p);
+    EndBox(stsd, p);
+    
+    //the sample tables are empty, the samples are in the fragments.
+    uint8_t *stts = p;
+    p = BeginFullBox(p, "stts", 0, 0);
+    p = Put32(p, 0);
+    EndBox(stts, p);
+    
+    uint8_t *stsc = p;
+    p = BeginFullBox(p, "stsc", 0, 0);
+    p = Put32(p, 0);
+    EndBox(stsc, p);
+    
+    uint8_t *stsz = p;
+    p = BeginFullBox(p, "stsz", 0, 0);
+    p = Put32(p, 0);
+    p = Put32(p, 0);
+    EndBox(stsz, p);
+    
+    uint8_t *stco = p;
+    p = BeginFullBox(p, "stco", 0, 0);
+    p = Put32(p, 0);
+    EndBox(stco, p);
+    
+    EndBox(stbl, p);
+    EndBox(minf, p);
+    EndBox(mdia, p);
+    EndBox(trak, p);
+    
+    //the track is fragmented, with the first sample description.
+    uint8_t *mvex = p;
+    p = BeginBox(p, "mvex");
+    uint8_t *trex = p;
+    p = BeginFullBox(p, "trex", 0, 0);
+    p = Put32(p, 1);
+    p = Put32(p, 1);
+    p = Put32(p, 0);
+    p = Put32(p, 0);
+    p = Put32(p, 0);
+    EndBox(trex, p);
+    EndBox(mvex, p);
+    
+    EndBox(moov, p);
+    
+    return WriteOut(m_pHeader, (int32_t)(p - m_pHeader), NULL, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMp4Muxer::FlushFragment(void)
+{
+    uint8_t *p = m_pHeader;
+    uint8_t *moof = p;
+    p = BeginBox(p, "moof");
+    
+    uint8_t *mfhd = p;
+    p = BeginFullBox(p, "mfhd", 0, 0);
+    p = Put32(p, ++m_SequenceNumber);
+    EndBox(mfhd, p);
+    
+    uint8_t *traf = p;
+    p = BeginBox(p, "traf");
+    
+    //the data offset is from the moof box, and the decode time of the fragment.
+    uint8_t *tfhd = p;
+    p = BeginFullBox(p, "tfhd", 0, 0x020000);
+    p = Put32(p, 1);
+    EndBox(tfhd, p);
+    
+    uint8_t *tfdt = p;
+    p = BeginFullBox(p, "tfdt", 1, 0);
+    p = Put64(p, m_DecodeTime);
+    EndBox(tfdt, p);
+    
+    //the data offset, and the duration, size and flags of every sample.
+    uint8_t *trun = p;
+    p = BeginFullBox(p, "trun", 0, 0x000701);
+    p = Put32(p, m_nSamples);
+    uint8_t *data_offset = p;
+    p = Put32(p, 0);
+    for (int32_t i = 0; i < m_nSamples; i++)
+    {
+        p = Put32(p, m_Samples[i].Duration);
+        p = Put32(p, m_Samples[i].Size);
+        p = Put32(p, m_Samples[i].SyncSample ? MSDK_MP4_SYNC_FLAGS : MSDK_MP4_NON_SYNC_FLAGS);
+        m_DecodeTime += m_Samples[i].Duration;
+    }
+    EndBox(trun, p);
+    EndBox(traf, p);
+    EndBox(moof, p);
+    
+    //the samples follow the mdat header, right after the moof box.
+    Put32(data_offset, (uint32_t)(p - moof) + 8);
+    p = Put32(p, 8 + m_FragmentBytes);
+    p = PutTag(p, "mdat");
+    
+    int32_t sts = WriteOut(m_pHeader, (int32_t)(p - m_pHeader), m_pFragment, m_FragmentBytes);
+    
+    m_nSamples      = 0;
+    m_FragmentBytes = 0;
+    return sts;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CMp4Muxer::WriteOut(uint8_t* pHeader, int32_t HeaderSize, uint8_t* pData, int32_t DataSize)
+{
+    //the boxes and the data are written together, with the writev() of bitstream.
+    MSdkBitstream out;
+    out.SegmentCount         = (DataSize > 0) ? 2 : 1;
+    out.Segments[0].iov_base = pHeader;
+    out.Segments[0].iov_len  = HeaderSize;
+    out.Segments[1].iov_base = pData;
+    out.Segments[1].iov_len  = DataSize;
+    
+    ssize_t written = bitstream_WriteFile(m_File, &out);
+    return (written == (ssize_t)(HeaderSize + DataSize)) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
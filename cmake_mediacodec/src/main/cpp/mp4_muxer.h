@@ -0,0 +1,97 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __MP4_MUXER_H__
+#define __MP4_MUXER_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "include/GPU_codec_api.h"
+#include "param_sets.h"
+
+//the samples of a fragment at most, and the media timescale of the track.
+#define MSDK_MP4_MAX_SAMPLES       512
+#define MSDK_MP4_TIMESCALE         90000
+
+//the bytes for the moov or moof box, with the parameter sets or the sample table.
+#define MSDK_MP4_HEADER_BYTES      (4096 + MSDK_MP4_MAX_SAMPLES * 12)
+
+//The settings of the recorded track, fixed when the file is opened.
+typedef struct
+{
+    uint32_t  CodecType;         // VIDEO_CODEC_TYPE_AVC only
+    uint32_t  Width;             // the picture width in the track header
+    uint32_t  Height;            // the picture height in the track header
+    int32_t   MaxFragmentBytes;  // the fragment is flushed before it grows larger, and
+                                 // it should hold the largest frame, such as 4 MB
+                                 
+}MSdkMp4Config;
+
+//One sample in the buffered fragment.
+typedef struct
+{
+    int64_t   TimeStamp;         // the frame timestamp, ms
+    uint32_t  Size;              // the bytes of the length-prefixed NAL units
+    uint32_t  Duration;          // the duration in the timescale, set by the next sample
+    uint8_t   SyncSample;        // 1 for the IDR frame
+    
+}MSdkMp4Sample;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The streaming fragmented MP4 writer of the encoded H264/AVC frames, as a CMAF
+//track. The init segment (ftyp and moov) is written at the first IDR frame, with
+//the avcC of the SPS/PPS units in the stream. the NAL units are converted to the
+//4-byte length-prefixed samples when they are copied to the fragment buffer, and
+//every fragment (moof and mdat) starts at an IDR frame, or when the buffer would
+//overflow. So the file is playable and seekable at every written fragment, with
+//a bounded memory of one fragment.
+class CMp4Muxer
+{
+public:
+    CMp4Muxer(void);
+    ~CMp4Muxer(void);
+    
+    //Start a new recording to the file, the file is not closed by the muxer.
+    int32_t Open(int fd, const MSdkMp4Config* pConfig);
+    
+    //Write the last fragment and free the buffers.
+    int32_t Close(void);
+    
+    //Add an encoded frame from GetBitstream() or GetFrameBitstream(), with the
+    //NAL units in pNalLengthInByte, each with or without its start code, and the
+    //timestamp in ms. the frames before the first IDR are skipped with MCODEC_SKIPPED.
+    //return MCODEC_ERROR if the SPS changes, a new recording should be opened for it.
+    int32_t WriteFrame(const SLayerBSInfo* pLayers, int32_t LayerNum, int64_t TimeStamp);
+    
+private:
+    
+    //Write the ftyp and moov boxes, with the avcC of the active parameter sets.
+    int32_t WriteInitSegment(void);
+    
+    //Write the buffered samples as a moof and mdat fragment.
+    int32_t FlushFragment(void);
+    
+    //Write the boxes in the header buffer and the fragment data, if any.
+    int32_t WriteOut(uint8_t* pHeader, int32_t HeaderSize, uint8_t* pData, int32_t DataSize);
+    
+    int                    m_File;
+    MSdkMp4Config          m_Config;
+    CParamSetCache         m_ParamSets;
+    bool                   m_InitWritten;
+    
+    //the buffer of the box headers, and of the fragment data.
+    uint8_t*               m_pHeader;
+    uint8_t*               m_pFragment;
+    int32_t                m_FragmentBytes;
+    
+    //the samples of the fragment, and the timeline of the track.
+    MSdkMp4Sample          m_Samples[MSDK_MP4_MAX_SAMPLES];
+    int32_t                m_nSamples;
+    uint32_t               m_SequenceNumber;
+    uint64_t               m_DecodeTime;
+    uint32_t               m_LastDuration;
+};
+
+#endif  // End of __MP4_MUXER_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,205 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "nal_parser.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define NAL_SCAN_NEON  1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define NAL_SCAN_SSE2  1
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+static inline int32_t CheckStartCode(const uint8_t* pBuf, int32_t Length, int32_t pos, int32_t* pStartCodeLen)
+{
+    //the zero byte at pos should be followed by "00 01".
+    if ((pos + 2 >= Length) || (pBuf[pos + 1] != 0) || (pBuf[pos + 2] != 1))
+    {
+        return -1;
+    }
+    
+    //one more zero byte before it makes a 4-byte start code.
+    if ((pos > 0) && (pBuf[pos - 1] == 0))
+    {
+        *pStartCodeLen = 4;
+        return pos - 1;
+    }
+    
+    *pStartCodeLen = 3;
+    return pos;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t nal_FindStartCode(const uint8_t* pBuf, int32_t Length, int32_t* pStartCodeLen)
+{
+    int32_t pos = 0;
+    int32_t found;
+
+#if defined(NAL_SCAN_NEON)
+    //skip the 16 bytes blocks without any zero byte, no start code starts there.
+    const uint8x16_t zero = vdupq_n_u8(0);
+    while (pos + 16 <= Length)
+    {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(pBuf + pos), zero);
+        uint64x2_t mask = vreinterpretq_u64_u8(eq);
+        uint64_t lanes[2] = {vgetq_lane_u64(mask, 0), vgetq_lane_u64(mask, 1)};
+        
+        for (int32_t half = 0; half < 2; half++)
+        {
+            uint64_t bits = lanes[half];
+            while (bits != 0)
+            {
+                int32_t byte = __builtin_ctzll(bits) >> 3;
+                found = CheckStartCode(pBuf, Length, pos + (half << 3) + byte, pStartCodeLen);
+                if (found >= 0)
+                {
+                    return found;
+                }
+                bits &= ~(0xFFull << (byte << 3));
+            }
+        }
+        pos += 16;
+    }
+#elif defined(NAL_SCAN_SSE2)
+    //skip the 16 bytes blocks without any zero byte, no start code starts there.
+    const __m128i zero = _mm_setzero_si128();
+    while (pos + 16 <= Length)
+    {
+        __m128i data = _mm_loadu_si128((const __m128i *)(pBuf + pos));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(data, zero));
+        
+        while (mask != 0)
+        {
+            found = CheckStartCode(pBuf, Length, pos + __builtin_ctz(mask), pStartCodeLen);
+            if (found >= 0)
+            {
+                return found;
+            }
+            mask &= mask - 1;
+        }
+        pos += 16;
+    }
+#endif
+    
+    //check the remaining bytes one by one.
+    for (; pos < Length; pos++)
+    {
+        if (pBuf[pos] == 0)
+        {
+            found = CheckStartCode(pBuf, Length, pos, pStartCodeLen);
+            if (found >= 0)
+            {
+                return found;
+            }
+        }
+    }
+    
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t nal_SplitAnnexB(const uint8_t* pBuf, int32_t Length, MSdkNalUnit* pNals, int32_t MaxNals,
+                        uint32_t CodecType)
+{
+    int32_t count = 0;
+    int32_t start = 0;
+    int32_t start_len = 0;
+    int32_t next_len = 0;
+    
+    if ((pBuf == NULL) || (Length <= 0) || (MaxNals <= 0))
+    {
+        return 0;
+    }
+    
+    //the leading data without start code is also taken as a NAL unit.
+    int32_t next = nal_FindStartCode(pBuf, Length, &next_len);
+    if (next == 0)
+    {
+        start_len = next_len;
+        next = nal_FindStartCode(pBuf + start_len, Length - start_len, &next_len);
+        next = (next >= 0) ? (next + start_len) : -1;
+    }
+    
+    while (count < MaxNals)
+    {
+        int32_t end = ((next < 0) || (count == MaxNals - 1)) ? Length : next;
+        
+        const uint8_t *header = pBuf + start + start_len;
+        int32_t header_len = end - start - start_len;
+        
+        //Save the NAL unit, with the nal_unit_type of H264/AVC or H265/HEVC header.
+        pNals[count].Offset       = start;
+        pNals[count].Length       = end - start;
+        pNals[count].StartCodeLen = start_len;
+        pNals[count].NalType      = 0;
+        pNals[count].TemporalId   = 0;
+        pNals[count].Reference    = 1;
+        
+        if ((CodecType == VIDEO_CODEC_TYPE_HEVC) && (header_len >= 2))
+        {
+            pNals[count].NalType    = (header[0] >> 1) & 0x3F;
+            pNals[count].TemporalId = ((header[1] & 0x07) > 0) ? ((header[1] & 0x07) - 1) : 0;
+            
+            //the even VCL types up to RSV_VCL_N14 are sub-layer non-reference pictures.
+            if ((pNals[count].NalType <= NAL_HEVC_RSV_VCL_N14) && ((pNals[count].NalType & 1) == 0))
+            {
+                pNals[count].Reference = 0;
+            }
+        }
+        else if ((CodecType != VIDEO_CODEC_TYPE_HEVC) && (header_len >= 1))
+        {
+            pNals[count].NalType    = header[0] & 0x1F;
+            pNals[count].Reference  = ((header[0] >> 5) & 0x03) ? 1 : 0;
+        }
+        count++;
+        
+        if (end == Length)
+        {
+            break;
+        }
+        
+        //look for the next start code after the current one.
+        start = next;
+        start_len = next_len;
+        next = nal_FindStartCode(pBuf + start + start_len, Length - start - start_len, &next_len);
+        next = (next >= 0) ? (next + start + start_len) : -1;
+    }
+    
+    return count;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+bool nal_IsParamSet(int32_t NalType, uint32_t CodecType)
+{
+    if (CodecType == VIDEO_CODEC_TYPE_HEVC)
+    {
+        return (NalType >= NAL_HEVC_VPS) && (NalType <= NAL_HEVC_PPS);
+    }
+    
+    return (NalType == NAL_AVC_SPS) || (NalType == NAL_AVC_PPS);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+bool nal_IsIDR(int32_t NalType, uint32_t CodecType)
+{
+    if (CodecType == VIDEO_CODEC_TYPE_HEVC)
+    {
+        return (NalType == NAL_HEVC_IDR_W_RADL) || (NalType == NAL_HEVC_IDR_N_LP);
+    }
+    
+    return (NalType == NAL_AVC_IDR_SLICE);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+bool nal_IsIRAP(int32_t NalType, uint32_t CodecType)
+{
+    //the BLA, IDR and CRA pictures are all random access points of HEVC.
+    if (CodecType == VIDEO_CODEC_TYPE_HEVC)
+    {
+        return (NalType >= NAL_HEVC_BLA_W_LP) && (NalType <= NAL_HEVC_IRAP_MAX);
+    }
+    
+    return (NalType == NAL_AVC_IDR_SLICE);
+}
@@ -0,0 +1,65 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __NAL_PARSER_H__
+#define __NAL_PARSER_H__
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "include/GPU_codec_api.h"
+
+//the nal_unit_type values used by the encoder, for H264/AVC and H265/HEVC.
+#define NAL_AVC_SLICE              1
+#define NAL_AVC_IDR_SLICE          5
+#define NAL_AVC_SPS                7
+#define NAL_AVC_PPS                8
+
+#define NAL_HEVC_RSV_VCL_N14       14
+#define NAL_HEVC_BLA_W_LP          16
+#define NAL_HEVC_IDR_W_RADL        19
+#define NAL_HEVC_IDR_N_LP          20
+#define NAL_HEVC_CRA_NUT           21
+#define NAL_HEVC_IRAP_MAX          23
+#define NAL_HEVC_VPS               32
+#define NAL_HEVC_SPS               33
+#define NAL_HEVC_PPS               34
+
+//One NAL unit found in an Annex-B byte stream.
+typedef struct
+{
+    int32_t   Offset;            // the offset of NAL unit, with its start code
+    int32_t   Length;            // the length of NAL unit, with its start code
+    int32_t   StartCodeLen;      // the start code length, 0, 3 or 4 bytes
+    int32_t   NalType;           // the nal_unit_type in the NAL header
+    int32_t   TemporalId;        // the temporal id in HEVC NAL header, 0 for AVC
+    int32_t   Reference;         // 0 for the non-reference pictures, else 1
+    
+}MSdkNalUnit;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Find the first 3-byte or 4-byte start code, return its offset or -1 if no one.
+//the zero bytes are searched with NEON/SSE2 16 bytes a time, when available.
+int32_t nal_FindStartCode(const uint8_t* pBuf, int32_t Length, int32_t* pStartCodeLen);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Split an Annex-B buffer into NAL units, return the number of NAL units. the
+//NAL header is 1 byte for H264/AVC and 2 bytes for H265/HEVC, by CodecType.
+//the data before the first start code is a NAL unit without start code, and
+//the last NAL unit takes the rest of the buffer when MaxNals is reached.
+int32_t nal_SplitAnnexB(const uint8_t* pBuf, int32_t Length, MSdkNalUnit* pNals, int32_t MaxNals,
+                        uint32_t CodecType);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Check if the NAL unit is a VPS/SPS/PPS parameter set.
+bool nal_IsParamSet(int32_t NalType, uint32_t CodecType);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Check if the NAL unit is an IDR slice, or a random access point of HEVC.
+bool nal_IsIDR(int32_t NalType, uint32_t CodecType);
+bool nal_IsIRAP(int32_t NalType, uint32_t CodecType);
+
+#endif  // End of __NAL_PARSER_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
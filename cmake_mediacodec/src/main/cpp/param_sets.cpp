@@ -0,0 +1,574 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "param_sets.h"
+#include "include/GPU_codec_api.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+//the bit reader of RBSP data, which skips the emulation prevention bytes.
+typedef struct
+{
+    const uint8_t* pData;
+    int32_t        Length;
+    int32_t        BytePos;
+    int32_t        BitPos;
+    int32_t        Zeros;
+    
+}RbspReader;
+
+/////////////////////////////////////////////////////////////////////////////////////
+static int32_t ReadBit(RbspReader* pReader)
+{
+    if (pReader->BytePos >= pReader->Length)
+    {
+        return -1;
+    }
+    
+    //the "03" after two zero bytes is not the RBSP data.
+    if ((pReader->BitPos == 0) && (pReader->Zeros >= 2) && (pReader->pData[pReader->BytePos] == 0x03))
+    {
+        pReader->BytePos++;
+        pReader->Zeros = 0;
+        if (pReader->BytePos >= pReader->Length)
+        {
+            return -1;
+        }
+    }
+    
+    uint8_t byte = pReader->pData[pReader->BytePos];
+    int32_t bit  = (byte >> (7 - pReader->BitPos)) & 0x01;
+    
+    if (++pReader->BitPos == 8)
+    {
+        pReader->Zeros = (byte == 0) ? (pReader->Zeros + 1) : 0;
+        pReader->BitPos = 0;
+        pReader->BytePos++;
+    }
+    
+    return bit;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+static int32_t ReadBits(RbspReader* pReader, int32_t Count)
+{
+    int32_t value = 0;
+    
+    for (int32_t i = 0; i < Count; i++)
+    {
+        int32_t bit = ReadBit(pReader);
+        if (bit < 0)
+        {
+            return -1;
+        }
+        value = (value << 1) | bit;
+    }
+    
+    return value;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+static int32_t ReadUE(RbspReader* pReader)
+{
+    int32_t zeros = 0;
+    int32_t bit;
+    
+    //the Exp-Golomb code: leading zero bits, a one bit and the info bits.
+    while ((bit = ReadBit(pReader)) == 0)
+    {
+        if (++zeros > 31)
+        {
+            return -1;
+        }
+    }
+    
+    if (bit < 0)
+    {
+        return -1;
+    }
+    
+    int32_t info = ReadBits(pReader, zeros);
+    if (info < 0)
+    {
+        return -1;
+    }
+    
+    return (int32_t)((1u << zeros) - 1 + info);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+static int32_t ReadSE(RbspReader* pReader)
+{
+    int32_t code = ReadUE(pReader);
+    if (code < 0)
+    {
+        return INT32_MIN;
+    }
+    
+    //the code numbers 1, 2, 3, 4 are the values 1, -1, 2, -2.
+    return (code & 1) ? ((code + 1) >> 1) : -(code >> 1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+static int32_t SkipBits(RbspReader* pReader, int32_t Count)
+{
+    for (int32_t i = 0; i < Count; i++)
+    {
+        if (ReadBit(pReader) < 0)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Skip the profile_tier_level() of HEVC SPS, with profilePresentFlag equal to 1.
+static int32_t SkipProfileTierLevel(RbspReader* pReader, int32_t MaxSubLayersMinus1)
+{
+    int32_t ProfilePresent[8];
+    int32_t LevelPresent[8];
+    
+    //the general profile space, tier, profile and flags, then general_level_idc.
+    if (SkipBits(pReader, 88 + 8) < 0)
+    {
+        return -1;
+    }
+    
+    for (int32_t i = 0; i < MaxSubLayersMinus1; i++)
+    {
+        ProfilePresent[i] = ReadBit(pReader);
+        LevelPresent[i]   = ReadBit(pReader);
+    }
+    
+    //the reserved_zero_2bits up to 8 sub-layers.
+    if ((MaxSubLayersMinus1 > 0) && (SkipBits(pReader, 2 * (8 - MaxSubLayersMinus1)) < 0))
+    {
+        return -1;
+    }
+    
+    for (int32_t i = 0; i < MaxSubLayersMinus1; i++)
+    {
+        if ((ProfilePresent[i] > 0) && (SkipBits(pReader, 88) < 0))
+        {
+            return -1;
+        }
+        
+        if ((LevelPresent[i] > 0) && (SkipBits(pReader, 8) < 0))
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Parse the H264/AVC SPS after seq_parameter_set_id, to the log2_max_frame_num.
+//return the bits of frame_num, or -1 if the SPS is broken.
+static int32_t ParseFrameNumBits(RbspReader* pReader, int32_t ProfileIdc, int32_t* pColourPlane)
+{
+    *pColourPlane = 0;
+    
+    //the high profiles have the chroma format, bit depths and scaling matrices.
+    if ((ProfileIdc == 100) || (ProfileIdc == 110) || (ProfileIdc == 122) || (ProfileIdc == 244) ||
+        (ProfileIdc == 44)  || (ProfileIdc == 83)  || (ProfileIdc == 86)  || (ProfileIdc == 118) ||
+        (ProfileIdc == 128) || (ProfileIdc == 138) || (ProfileIdc == 139) || (ProfileIdc == 134) ||
+        (ProfileIdc == 135))
+    {
+        int32_t chroma_format_idc = ReadUE(pReader);
+        if (chroma_format_idc == 3)
+        {
+            *pColourPlane = ReadBit(pReader);
+        }
+        
+        //bit_depth_luma/chroma_minus8, qpprime_y_zero_transform_bypass_flag.
+        ReadUE(pReader);
+        ReadUE(pReader);
+        ReadBit(pReader);
+        
+        if (ReadBit(pReader) == 1)
+        {
+            int32_t lists = (chroma_format_idc != 3) ? 8 : 12;
+            for (int32_t i = 0; i < lists; i++)
+            {
+                if (ReadBit(pReader) != 1)
+                {
+                    continue;
+                }
+                
+                //skip the delta_scale values of the 4x4 or 8x8 scaling list.
+                int32_t size = (i < 6) ? 16 : 64;
+                int32_t last_scale = 8;
+                int32_t next_scale = 8;
+                for (int32_t j = 0; (j < size) && (next_scale != 0); j++)
+                {
+                    int32_t delta = ReadSE(pReader);
+                    if (delta == INT32_MIN)
+                    {
+                        return -1;
+                    }
+                    next_scale = (last_scale + delta + 256) % 256;
+                    last_scale = (next_scale == 0) ? last_scale : next_scale;
+                }
+            }
+        }
+    }
+    
+    int32_t log2_max_frame_num_minus4 = ReadUE(pReader);
+    if ((log2_max_frame_num_minus4 < 0) || (log2_max_frame_num_minus4 > 12) || (*pColourPlane < 0))
+    {
+        return -1;
+    }
+    
+    return log2_max_frame_num_minus4 + 4;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CParamSetCache::CParamSetCache(void)
+{
+    memset(m_Vps, 0, sizeof(m_Vps));
+    memset(m_Sps, 0, sizeof(m_Sps));
+    memset(m_Pps, 0, sizeof(m_Pps));
+    m_Generation = 0;
+    
+    //Initialize the set references and the active SPS as empty.
+    Reset(VIDEO_CODEC_TYPE_AVC);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CParamSetCache::~CParamSetCache(void)
+{
+    Reset(m_CodecType);
+    ReleaseRetired();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CParamSetCache::Reset(uint32_t CodecType)
+{
+    //the sets could still be lent to the output, so only retire them here.
+    for (int32_t i = 0; i < MSDK_MAX_VPS_COUNT; i++)
+    {
+        if (m_Vps[i] != NULL)
+        {
+            m_Retired.push_back(m_Vps[i]);
+            m_Vps[i] = NULL;
+        }
+    }
+    
+    for (int32_t i = 0; i < MSDK_MAX_SPS_COUNT; i++)
+    {
+        if (m_Sps[i] != NULL)
+        {
+            m_Retired.push_back(m_Sps[i]);
+            m_Sps[i] = NULL;
+        }
+        m_SpsVpsId[i] = -1;
+        m_SpsFrameNumBits[i] = -1;
+        m_SpsColourPlane[i]  = 0;
+    }
+    
+    for (int32_t i = 0; i < MSDK_MAX_PPS_COUNT; i++)
+    {
+        if (m_Pps[i] != NULL)
+        {
+            m_Retired.push_back(m_Pps[i]);
+            m_Pps[i] = NULL;
+        }
+        m_PpsSpsId[i] = -1;
+    }
+    
+    m_ActiveSpsId = -1;
+    m_CodecType   = CodecType;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CParamSetCache::ReleaseRetired(void)
+{
+    for (size_t i = 0; i < m_Retired.size(); i++)
+    {
+        delete m_Retired[i];
+    }
+    m_Retired.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CParamSetCache::Store(NalBuffer** ppEntry, const uint8_t* pNal, int32_t Length)
+{
+    NalBuffer *pOld = *ppEntry;
+    
+    //the same parameter set is repeated, keep the stored one.
+    if ((pOld != NULL) && (pOld->size() == (size_t)Length + 4) &&
+        (memcmp(pOld->data() + 4, pNal, Length) == 0))
+    {
+        return MSDK_PS_SAME;
+    }
+    
+    //save the new parameter set with a 4-byte start code.
+    NalBuffer *pNew = new (std::nothrow) NalBuffer(Length + 4);
+    if (pNew == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    uint8_t *dst = pNew->data();
+    dst[0] = 0x00;
+    dst[1] = 0x00;
+    dst[2] = 0x00;
+    dst[3] = 0x01;
+    memcpy(dst + 4, pNal, Length);
+    
+    //the old one may be still lent to the output, free it later. the retired
+    //list is bounded for a caller which never gives all the bitstreams back.
+    if (pOld != NULL)
+    {
+        if (m_Retired.size() >= MSDK_MAX_RETIRED_SETS)
+        {
+            delete m_Retired.front();
+            m_Retired.erase(m_Retired.begin());
+        }
+        m_Retired.push_back(pOld);
+    }
+    
+    *ppEntry = pNew;
+    m_Generation++;
+    
+    return (pOld != NULL) ? MSDK_PS_CHANGED : MSDK_PS_NEW;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CParamSetCache::Update(const uint8_t* pNal, int32_t Length)
+{
+    if ((pNal == NULL) || (Length < 3))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    if (m_CodecType == VIDEO_CODEC_TYPE_HEVC)
+    {
+        return UpdateHEVC(pNal, Length);
+    }
+    
+    return UpdateAVC(pNal, Length);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CParamSetCache::UpdateAVC(const uint8_t* pNal, int32_t Length)
+{
+    RbspReader reader;
+    int32_t nal_type = pNal[0] & 0x1F;
+    
+    //parse the parameter set id after the 1-byte NAL header.
+    reader.pData   = pNal + 1;
+    reader.Length  = Length - 1;
+    reader.BytePos = 0;
+    reader.BitPos  = 0;
+    reader.Zeros   = 0;
+    
+    //SPS: profile_idc, constraint flags, level_idc, then seq_parameter_set_id.
+    if (nal_type == 7)
+    {
+        int32_t profile_idc = ReadBits(&reader, 8);
+        if ((profile_idc < 0) || (ReadBits(&reader, 16) < 0))
+        {
+            return MCODEC_ERROR;
+        }
+        
+        int32_t sps_id = ReadUE(&reader);
+        if ((sps_id < 0) || (sps_id >= MSDK_MAX_SPS_COUNT))
+        {
+            return MCODEC_ERROR;
+        }
+        
+        //the frame_num length is kept for the slice headers, -1 if it is unknown.
+        int32_t colour_plane   = 0;
+        int32_t frame_num_bits = ParseFrameNumBits(&reader, profile_idc, &colour_plane);
+        
+        //the SPS is active only after it is saved, the old one stays otherwise.
+        int32_t status = Store(&m_Sps[sps_id], pNal, Length);
+        if (status != MCODEC_ERROR)
+        {
+            m_SpsFrameNumBits[sps_id] = frame_num_bits;
+            m_SpsColourPlane[sps_id]  = colour_plane;
+            m_ActiveSpsId = sps_id;
+        }
+        return status;
+    }
+    
+    //PPS: pic_parameter_set_id, then the seq_parameter_set_id it refers to.
+    if (nal_type == 8)
+    {
+        int32_t pps_id = ReadUE(&reader);
+        int32_t sps_id = ReadUE(&reader);
+        if ((pps_id < 0) || (pps_id >= MSDK_MAX_PPS_COUNT) ||
+            (sps_id < 0) || (sps_id >= MSDK_MAX_SPS_COUNT))
+        {
+            return MCODEC_ERROR;
+        }
+        
+        int32_t status = Store(&m_Pps[pps_id], pNal, Length);
+        if (status != MCODEC_ERROR)
+        {
+            m_PpsSpsId[pps_id] = sps_id;
+        }
+        return status;
+    }
+    
+    return MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CParamSetCache::UpdateHEVC(const uint8_t* pNal, int32_t Length)
+{
+    RbspReader reader;
+    int32_t nal_type = (pNal[0] >> 1) & 0x3F;
+    
+    //parse the parameter set id after the 2-byte NAL header.
+    reader.pData   = pNal + 2;
+    reader.Length  = Length - 2;
+    reader.BytePos = 0;
+    reader.BitPos  = 0;
+    reader.Zeros   = 0;
+    
+    //VPS: vps_video_parameter_set_id is the first 4 bits.
+    if (nal_type == 32)
+    {
+        int32_t vps_id = ReadBits(&reader, 4);
+        if (vps_id < 0)
+        {
+            return MCODEC_ERROR;
+        }
+        
+        return Store(&m_Vps[vps_id], pNal, Length);
+    }
+    
+    //SPS: the VPS id, sub-layers, profile_tier_level, then sps_seq_parameter_set_id.
+    if (nal_type == 33)
+    {
+        int32_t vps_id = ReadBits(&reader, 4);
+        int32_t max_sub_layers_minus1 = ReadBits(&reader, 3);
+        if ((vps_id < 0) || (max_sub_layers_minus1 < 0) || (ReadBit(&reader) < 0) ||
+            (SkipProfileTierLevel(&reader, max_sub_layers_minus1) < 0))
+        {
+            return MCODEC_ERROR;
+        }
+        
+        int32_t sps_id = ReadUE(&reader);
+        if ((sps_id < 0) || (sps_id >= MSDK_MAX_SPS_COUNT))
+        {
+            return MCODEC_ERROR;
+        }
+        
+        int32_t status = Store(&m_Sps[sps_id], pNal, Length);
+        if (status != MCODEC_ERROR)
+        {
+            m_SpsVpsId[sps_id] = vps_id;
+            m_ActiveSpsId = sps_id;
+        }
+        return status;
+    }
+    
+    //PPS: pps_pic_parameter_set_id, then the pps_seq_parameter_set_id.
+    if (nal_type == 34)
+    {
+        int32_t pps_id = ReadUE(&reader);
+        int32_t sps_id = ReadUE(&reader);
+        if ((pps_id < 0) || (pps_id >= MSDK_MAX_PPS_COUNT) ||
+            (sps_id < 0) || (sps_id >= MSDK_MAX_SPS_COUNT))
+        {
+            return MCODEC_ERROR;
+        }
+        
+        int32_t status = Store(&m_Pps[pps_id], pNal, Length);
+        if (status != MCODEC_ERROR)
+        {
+            m_PpsSpsId[pps_id] = sps_id;
+        }
+        return status;
+    }
+    
+    return MCODEC_ERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CParamSetCache::GetActiveSets(struct iovec* pSets, int32_t MaxCount)
+{
+    int32_t count = 0;
+    
+    if ((m_ActiveSpsId < 0) || (m_Sps[m_ActiveSpsId] == NULL) || (MaxCount <= 0))
+    {
+        return 0;
+    }
+    
+    //for HEVC, the VPS referred by the active SPS goes first.
+    int32_t vps_id = m_SpsVpsId[m_ActiveSpsId];
+    if ((m_CodecType == VIDEO_CODEC_TYPE_HEVC) && (vps_id >= 0) && (m_Vps[vps_id] != NULL))
+    {
+        pSets[count].iov_base = m_Vps[vps_id]->data();
+        pSets[count].iov_len  = m_Vps[vps_id]->size();
+        count++;
+    }
+    
+    if (count >= MaxCount)
+    {
+        return count;
+    }
+    
+    //then the active SPS, and the PPS units in the id order.
+    pSets[count].iov_base = m_Sps[m_ActiveSpsId]->data();
+    pSets[count].iov_len  = m_Sps[m_ActiveSpsId]->size();
+    count++;
+    
+    for (int32_t i = 0; (i < MSDK_MAX_PPS_COUNT) && (count < MaxCount); i++)
+    {
+        if ((m_Pps[i] != NULL) && (m_PpsSpsId[i] == m_ActiveSpsId))
+        {
+            pSets[count].iov_base = m_Pps[i]->data();
+            pSets[count].iov_len  = m_Pps[i]->size();
+            count++;
+        }
+    }
+    
+    return count;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CParamSetCache::GetFrameNum(const uint8_t* pNal, int32_t Length)
+{
+    RbspReader reader;
+    
+    if ((m_CodecType != VIDEO_CODEC_TYPE_AVC) || (pNal == NULL) || (Length < 2))
+    {
+        return -1;
+    }
+    
+    //parse the slice header after the 1-byte NAL header.
+    reader.pData   = pNal + 1;
+    reader.Length  = Length - 1;
+    reader.BytePos = 0;
+    reader.BitPos  = 0;
+    reader.Zeros   = 0;
+    
+    //first_mb_in_slice, slice_type, then pic_parameter_set_id.
+    ReadUE(&reader);
+    ReadUE(&reader);
+    int32_t pps_id = ReadUE(&reader);
+    if ((pps_id < 0) || (pps_id >= MSDK_MAX_PPS_COUNT) || (m_PpsSpsId[pps_id] < 0))
+    {
+        return -1;
+    }
+    
+    int32_t sps_id = m_PpsSpsId[pps_id];
+    if (m_SpsFrameNumBits[sps_id] < 0)
+    {
+        return -1;
+    }
+    
+    //colour_plane_id is present for the separate colour planes of 4:4:4.
+    if ((m_SpsColourPlane[sps_id] != 0) && (SkipBits(&reader, 2) < 0))
+    {
+        return -1;
+    }
+    
+    return ReadBits(&reader, m_SpsFrameNumBits[sps_id]);
+}
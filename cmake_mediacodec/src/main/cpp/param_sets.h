@@ -0,0 +1,82 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __PARAM_SETS_H__
+#define __PARAM_SETS_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <new>
+#include <vector>
+
+#define MSDK_MAX_VPS_COUNT         16
+#define MSDK_MAX_SPS_COUNT         32
+#define MSDK_MAX_PPS_COUNT         256
+
+//the replaced sets kept for the lent output at most, the oldest ones are freed
+//beyond it, so a bitstream is given back before so many sets are replaced.
+#define MSDK_MAX_RETIRED_SETS      64
+
+#define MSDK_PS_SAME               0
+#define MSDK_PS_NEW                1
+#define MSDK_PS_CHANGED            2
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The parameter sets of the encoded stream, keyed by VPS/SPS/PPS id. Each set is
+//parsed and stored once, with a 4-byte start code, and lent to output by pointer.
+class CParamSetCache
+{
+public:
+    CParamSetCache(void);
+    ~CParamSetCache(void);
+    
+    //Remove all the parameter sets, when the encoder is reopened.
+    void Reset(uint32_t CodecType);
+    
+    //Save a VPS/SPS/PPS NAL unit without start code, return MSDK_PS_SAME, MSDK_PS_NEW,
+    //MSDK_PS_CHANGED, or MCODEC_ERROR if it is not a valid parameter set or it could
+    //not be saved, and the active SPS is not changed then.
+    int32_t Update(const uint8_t* pNal, int32_t Length);
+    
+    //Get the active SPS with its VPS for HEVC, and all the PPS that refer to it,
+    //with start codes. return the number of the sets put to the iovec list.
+    int32_t GetActiveSets(struct iovec* pSets, int32_t MaxCount);
+    
+    //Free the replaced parameter sets, when no output buffer refers to them.
+    void ReleaseRetired(void);
+    
+    //Get the frame_num of a H264/AVC slice NAL unit without start code, by the SPS
+    //of its PPS. return -1 for HEVC, or if the SPS or the PPS is not saved.
+    int32_t GetFrameNum(const uint8_t* pNal, int32_t Length);
+    
+    //The generation is increased each time a parameter set is new or changed.
+    uint32_t GetGeneration(void) { return m_Generation; }
+    
+private:
+    
+    typedef std::vector<uint8_t> NalBuffer;
+    
+    //Replace the stored parameter set, and retire the old one. return MCODEC_ERROR
+    //if it could not be saved, the stored one is kept then.
+    int32_t Store(NalBuffer** ppEntry, const uint8_t* pNal, int32_t Length);
+    
+    //Parse the parameter set ids of H264/AVC and H265/HEVC.
+    int32_t UpdateAVC(const uint8_t* pNal, int32_t Length);
+    int32_t UpdateHEVC(const uint8_t* pNal, int32_t Length);
+    
+    uint32_t                m_CodecType;
+    NalBuffer*              m_Vps[MSDK_MAX_VPS_COUNT];
+    NalBuffer*              m_Sps[MSDK_MAX_SPS_COUNT];
+    NalBuffer*              m_Pps[MSDK_MAX_PPS_COUNT];
+    int32_t                 m_SpsVpsId[MSDK_MAX_SPS_COUNT];
+    int32_t                 m_PpsSpsId[MSDK_MAX_PPS_COUNT];
+    int32_t                 m_SpsFrameNumBits[MSDK_MAX_SPS_COUNT];
+    int32_t                 m_SpsColourPlane[MSDK_MAX_SPS_COUNT];
+    int32_t                 m_ActiveSpsId;
+    uint32_t                m_Generation;
+    std::vector<NalBuffer*> m_Retired;
+};
+
+#endif  // End of __PARAM_SETS_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,505 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+
+#include "nal_parser.h"
+#include "rtp_depacketizer.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Check if the sequence number a is after b, with the 16-bit wrap around.
+static inline bool SeqNewer(uint16_t a, uint16_t b)
+{
+    return (int16_t)(a - b) > 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CRtpDepacketizer::CRtpDepacketizer(void)
+    : m_NalHeaderLen(1), m_pPool(NULL), m_pSlots(NULL), m_pFrame(NULL), m_FrameLength(0),
+      m_FrameKey(0), m_Started(false), m_LastSeq(0), m_HighestSeq(0), m_BaseFixed(false),
+      m_StartMs(-1), m_BlockedMs(-1), m_WaitKeyFrame(true), m_PliTimeMs(0)
+{
+    memset(&m_Config, 0, sizeof(m_Config));
+    memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CRtpDepacketizer::~CRtpDepacketizer(void)
+{
+    Destroy();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpDepacketizer::Create(const MSdkJitterConfig* pConfig)
+{
+    //the slots are indexed by the sequence number, a window of at most 32768.
+    if ((pConfig == NULL) || (pConfig->MaxPackets <= 0) || (pConfig->MaxPackets > 32768) ||
+        (pConfig->MaxFrameBytes <= 0) || (pConfig->MaxDelayMs < 0) ||
+        (pConfig->PacketSize <= MSDK_RTP_HEADER_SIZE) || (pConfig->PacketSize > MSDK_RTP_MAX_PACKET_SIZE))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    if ((pConfig->CodecType != VIDEO_CODEC_TYPE_AVC) && (pConfig->CodecType != VIDEO_CODEC_TYPE_HEVC))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    Destroy();
+    
+    //the packets and the frame buffer are allocated only here.
+    m_pPool  = (uint8_t *)malloc((size_t)pConfig->PacketSize * pConfig->MaxPackets);
+    m_pSlots = (MSdkRtpSlot *)calloc(pConfig->MaxPackets, sizeof(MSdkRtpSlot));
+    m_pFrame = (uint8_t *)malloc(pConfig->MaxFrameBytes);
+    if ((m_pPool == NULL) || (m_pSlots == NULL) || (m_pFrame == NULL))
+    {
+        Destroy();
+        return MCODEC_ERROR;
+    }
+    
+    for (int32_t i = 0; i < pConfig->MaxPackets; i++)
+    {
+        m_pSlots[i].pData = m_pPool + (size_t)pConfig->PacketSize * i;
+    }
+    
+    m_Config       = *pConfig;
+    m_NalHeaderLen = (pConfig->CodecType == VIDEO_CODEC_TYPE_HEVC) ? 2 : 1;
+    m_Started      = false;
+    m_BaseFixed    = false;
+    m_StartMs      = -1;
+    m_BlockedMs    = -1;
+    m_WaitKeyFrame = true;
+    m_PliTimeMs    = 0;
+    memset(&m_Stats, 0, sizeof(m_Stats));
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CRtpDepacketizer::Destroy(void)
+{
+    free(m_pPool);
+    free(m_pSlots);
+    free(m_pFrame);
+    m_pPool  = NULL;
+    m_pSlots = NULL;
+    m_pFrame = NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpDepacketizer::InsertPacket(const uint8_t* pPacket, int32_t Length)
+{
+    if ((m_pSlots == NULL) || (pPacket == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the fixed header of version 2, followed by the CSRC list and the extension.
+    if ((Length < MSDK_RTP_HEADER_SIZE) || (Length > m_Config.PacketSize) || ((pPacket[0] >> 6) != 2))
+    {
+        m_Stats.PacketsDiscarded++;
+        return MCODEC_ERROR;
+    }
+    
+    int32_t offset = MSDK_RTP_HEADER_SIZE + (pPacket[0] & 0x0F) * 4;
+    int32_t end    = Length;
+    if ((pPacket[0] & 0x10) && (offset + 4 <= end))
+    {
+        offset += 4 + ((pPacket[offset + 2] << 8) | pPacket[offset + 3]) * 4;
+    }
+    if ((pPacket[0] & 0x20) && (end > offset))
+    {
+        end -= pPacket[end - 1];
+    }
+    if (end - offset <= m_NalHeaderLen)
+    {
+        m_Stats.PacketsDiscarded++;
+        return MCODEC_ERROR;
+    }
+    
+    uint16_t seq = (uint16_t)((pPacket[2] << 8) | pPacket[3]);
+    
+    //the stream starts from the first packet received, or from an older one in the
+    //window before the first frame is output.
+    if (!m_Started)
+    {
+        m_Started    = true;
+        m_BaseFixed  = false;
+        m_StartMs    = -1;
+        m_LastSeq    = seq - 1;
+        m_HighestSeq = seq - 1;
+    }
+    else if (!m_BaseFixed && !SeqNewer(seq, m_LastSeq) &&
+             ((uint16_t)(m_HighestSeq - seq) < (uint16_t)m_Config.MaxPackets))
+    {
+        m_LastSeq = seq - 1;
+    }
+    
+    //the packet of an output or dropped frame is too late.
+    if (!SeqNewer(seq, m_LastSeq))
+    {
+        m_Stats.PacketsDiscarded++;
+        return MCODEC_SKIPPED;
+    }
+    
+    //the duplicate packet, or the one behind the window of a newer packet, is
+    //discarded. an older packet in the slot is out of the window and lost.
+    MSdkRtpSlot *pSlot = &m_pSlots[seq % m_Config.MaxPackets];
+    if (pSlot->Used && !SeqNewer(seq, pSlot->SequenceNumber))
+    {
+        m_Stats.PacketsDiscarded++;
+        return MCODEC_SKIPPED;
+    }
+    
+    memcpy(pSlot->pData, pPacket, Length);
+    pSlot->Used           = 1;
+    pSlot->SequenceNumber = seq;
+    pSlot->RtpTimeStamp   = ((uint32_t)pPacket[4] << 24) | (pPacket[5] << 16) | (pPacket[6] << 8) | pPacket[7];
+    pSlot->Marker         = pPacket[1] >> 7;
+    pSlot->PayloadOffset  = offset;
+    pSlot->PayloadLength  = end - offset;
+    m_Stats.PacketsReceived++;
+    
+    //report the gap before the new packet at once, the retransmission is the
+    //only thing the head frame waits for.
+    if (SeqNewer(seq, m_HighestSeq))
+    {
+        uint16_t lost[MSDK_JITTER_MAX_NACKS];
+        int32_t count = 0;
+        for (uint16_t s = m_HighestSeq + 1; (s != seq) && (count < MSDK_JITTER_MAX_NACKS); s++)
+        {
+            lost[count++] = s;
+        }
+        
+        if ((count > 0) && (m_Config.pNackCallback != NULL))
+        {
+            m_Config.pNackCallback(m_Config.pContext, lost, count);
+        }
+        m_Stats.PacketsNacked += count;
+        m_HighestSeq = seq;
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpDepacketizer::PopFrame(MSdkRtpFrame* pFrame, int64_t NowMs)
+{
+    if ((m_pSlots == NULL) || (pFrame == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the first frame waits for the packets reordered before its first one.
+    if (m_Started && !m_BaseFixed)
+    {
+        m_StartMs = (m_StartMs < 0) ? NowMs : m_StartMs;
+        if (NowMs - m_StartMs < m_Config.MaxDelayMs)
+        {
+            return MCODEC_SKIPPED;
+        }
+        m_BaseFixed = true;
+    }
+    
+    while (m_Started && SeqNewer(m_HighestSeq, m_LastSeq))
+    {
+        //the frame starts after the last one, and ends at the marker, or before
+        //the packet of the next timestamp.
+        uint16_t first = m_LastSeq + 1;
+        uint16_t last  = first;
+        bool complete  = false;
+        
+        MSdkRtpSlot *pFirst = FindSlot(first);
+        for (uint16_t s = first; pFirst != NULL; s++)
+        {
+            MSdkRtpSlot *pSlot = FindSlot(s);
+            if (pSlot == NULL)
+            {
+                last = s;
+                break;
+            }
+            
+            if (pSlot->RtpTimeStamp != pFirst->RtpTimeStamp)
+            {
+                last = s - 1;
+                complete = true;
+                break;
+            }
+            
+            if (pSlot->Marker)
+            {
+                last = s;
+                complete = true;
+                break;
+            }
+        }
+        
+        if (complete)
+        {
+            m_BlockedMs = -1;
+            m_LastSeq   = last;
+            
+            //the frame after a loss is dropped, until the key frame comes.
+            int32_t sts = AssembleFrame(first, last, pFrame);
+            if ((sts == MCODEC_SUCCEED) && (pFrame->KeyFrame || !m_WaitKeyFrame))
+            {
+                m_WaitKeyFrame = false;
+                m_Stats.FramesOutput++;
+                return MCODEC_SUCCEED;
+            }
+            
+            m_Stats.FramesDropped++;
+            RequestKeyFrame(NowMs);
+            continue;
+        }
+        
+        //the frame is still coming in order, or waits for the lost packet.
+        if (!SeqNewer(m_HighestSeq, last))
+        {
+            break;
+        }
+        
+        if (m_BlockedMs < 0)
+        {
+            m_BlockedMs = NowMs;
+        }
+        if (NowMs - m_BlockedMs < m_Config.MaxDelayMs)
+        {
+            break;
+        }
+        
+        m_BlockedMs = -1;
+        DropHeadFrame();
+        m_Stats.FramesDropped++;
+        RequestKeyFrame(NowMs);
+    }
+    
+    return MCODEC_SKIPPED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpDepacketizer::DecodeFrames(VM_MSDKDecoder* pDecoder, int64_t NowMs)
+{
+    if (pDecoder == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the frame buffer is passed to the decoder, it is the only copy to decode.
+    MSdkRtpFrame frame;
+    while (PopFrame(&frame, NowMs) == MCODEC_SUCCEED)
+    {
+        if (pDecoder->DecodeFrame(frame.pData, frame.Length) != MCODEC_SUCCEED)
+        {
+            RequestKeyFrame(NowMs);
+            return MCODEC_ERROR;
+        }
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CRtpDepacketizer::GetStats(MSdkJitterStats* pStats)
+{
+    if (pStats != NULL)
+    {
+        *pStats = m_Stats;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+MSdkRtpSlot* CRtpDepacketizer::FindSlot(uint16_t SequenceNumber)
+{
+    MSdkRtpSlot *pSlot = &m_pSlots[SequenceNumber % m_Config.MaxPackets];
+    return (pSlot->Used && (pSlot->SequenceNumber == SequenceNumber)) ? pSlot : NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpDepacketizer::AssembleFrame(uint16_t FirstSeq, uint16_t LastSeq, MSdkRtpFrame* pFrame)
+{
+    bool fragment = false;
+    bool broken   = false;
+    uint32_t codec = m_Config.CodecType;
+    
+    m_FrameLength = 0;
+    m_FrameKey    = 0;
+    pFrame->RtpTimeStamp = FindSlot(FirstSeq)->RtpTimeStamp;
+    
+    for (uint16_t s = FirstSeq; s != (uint16_t)(LastSeq + 1); s++)
+    {
+        MSdkRtpSlot *pSlot = FindSlot(s);
+        const uint8_t *pPayload = pSlot->pData + pSlot->PayloadOffset;
+        int32_t length = pSlot->PayloadLength;
+        pSlot->Used = 0;
+        
+        if (broken)
+        {
+            continue;
+        }
+        
+        int32_t nal_type = (codec == VIDEO_CODEC_TYPE_HEVC) ? ((pPayload[0] >> 1) & 0x3F) : (pPayload[0] & 0x1F);
+        bool aggregation = (codec == VIDEO_CODEC_TYPE_HEVC) ? (nal_type == MSDK_RTP_HEVC_AP) : (nal_type == MSDK_RTP_AVC_STAP_A);
+        bool fragmentation = (codec == VIDEO_CODEC_TYPE_HEVC) ? (nal_type == MSDK_RTP_HEVC_FU) : (nal_type == MSDK_RTP_AVC_FU_A);
+        
+        if (aggregation)
+        {
+            //the units with 2 bytes size after the payload header.
+            int32_t offset = m_NalHeaderLen;
+            while (!broken && (offset + 2 <= length))
+            {
+                int32_t size = (pPayload[offset] << 8) | pPayload[offset + 1];
+                offset += 2;
+                broken = (size <= m_NalHeaderLen) || (offset + size > length) || !AppendNal(pPayload + offset, size);
+                offset += size;
+            }
+            broken = broken || (offset != length) || fragment;
+        }
+        else if (fragmentation)
+        {
+            //the NAL header is rebuilt from the payload header and the FU header.
+            uint8_t fu_header = pPayload[m_NalHeaderLen];
+            uint8_t nal_header[2];
+            if (codec == VIDEO_CODEC_TYPE_HEVC)
+            {
+                nal_header[0] = (pPayload[0] & 0x81) | ((fu_header & 0x3F) << 1);
+                nal_header[1] = pPayload[1];
+                nal_type      = fu_header & 0x3F;
+            }
+            else
+            {
+                nal_header[0] = (pPayload[0] & 0xE0) | (fu_header & 0x1F);
+                nal_type      = fu_header & 0x1F;
+            }
+            
+            if (fu_header & 0x80)
+            {
+                broken   = fragment || !AppendNal(nal_header, m_NalHeaderLen);
+                fragment = true;
+            }
+            else
+            {
+                broken = !fragment;
+            }
+            
+            broken   = broken || !AppendData(pPayload + m_NalHeaderLen + 1, length - m_NalHeaderLen - 1);
+            fragment = (fu_header & 0x40) ? false : fragment;
+        }
+        else if ((codec == VIDEO_CODEC_TYPE_AVC) && (nal_type >= 25))
+        {
+            //the interleaved mode and the reserved types are not supported.
+            broken = true;
+        }
+        else if ((codec == VIDEO_CODEC_TYPE_HEVC) && (nal_type > MSDK_RTP_HEVC_FU))
+        {
+            //the PACI and the reserved types are not supported.
+            broken = true;
+        }
+        else
+        {
+            broken = fragment || !AppendNal(pPayload, length);
+        }
+    }
+    
+    //the fragmented NAL unit must be ended in the frame.
+    if (broken || fragment || (m_FrameLength == 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    pFrame->pData    = m_pFrame;
+    pFrame->Length   = m_FrameLength;
+    pFrame->FirstSeq = FirstSeq;
+    pFrame->LastSeq  = LastSeq;
+    pFrame->KeyFrame = m_FrameKey;
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+bool CRtpDepacketizer::AppendData(const uint8_t* pData, int32_t Length)
+{
+    if ((Length < 0) || (m_FrameLength + Length > m_Config.MaxFrameBytes))
+    {
+        return false;
+    }
+    
+    memcpy(m_pFrame + m_FrameLength, pData, Length);
+    m_FrameLength += Length;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+bool CRtpDepacketizer::AppendNal(const uint8_t* pNal, int32_t Length)
+{
+    //the key frame has an IDR or IRAP slice, in any of the NAL units.
+    uint32_t codec = m_Config.CodecType;
+    int32_t nal_type = (codec == VIDEO_CODEC_TYPE_HEVC) ? ((pNal[0] >> 1) & 0x3F) : (pNal[0] & 0x1F);
+    m_FrameKey |= nal_IsIRAP(nal_type, codec) ? 1 : 0;
+    
+    static const uint8_t start_code[4] = {0x00, 0x00, 0x00, 0x01};
+    return AppendData(start_code, 4) && AppendData(pNal, Length);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CRtpDepacketizer::DropHeadFrame(void)
+{
+    //the timestamp of the first packet after the last frame, the frame to drop.
+    MSdkRtpSlot *pHead = NULL;
+    for (uint16_t s = m_LastSeq + 1; (pHead == NULL) && (s != (uint16_t)(m_HighestSeq + 1)); s++)
+    {
+        pHead = FindSlot(s);
+    }
+    
+    if (pHead == NULL)
+    {
+        m_LastSeq = m_HighestSeq;
+        return;
+    }
+    
+    //free all packets of the timestamp, the next frame starts after the last one.
+    uint32_t time_stamp = pHead->RtpTimeStamp;
+    uint16_t last = pHead->SequenceNumber;
+    for (int32_t i = 0; i < m_Config.MaxPackets; i++)
+    {
+        MSdkRtpSlot *pSlot = &m_pSlots[i];
+        if (pSlot->Used && (pSlot->RtpTimeStamp == time_stamp))
+        {
+            last = SeqNewer(pSlot->SequenceNumber, last) ? pSlot->SequenceNumber : last;
+            pSlot->Used = 0;
+        }
+    }
+    
+    //the packets between them, of any other timestamp, are dropped too.
+    for (uint16_t s = m_LastSeq + 1; s != last; s++)
+    {
+        MSdkRtpSlot *pSlot = FindSlot(s);
+        if (pSlot != NULL)
+        {
+            pSlot->Used = 0;
+        }
+    }
+    
+    m_LastSeq = last;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CRtpDepacketizer::RequestKeyFrame(int64_t NowMs)
+{
+    //the request is repeated by the interval, until the key frame comes.
+    if (m_WaitKeyFrame && (NowMs - m_PliTimeMs < MSDK_JITTER_PLI_INTERVAL) && (m_Stats.KeyFrameRequests > 0))
+    {
+        return;
+    }
+    
+    m_WaitKeyFrame = true;
+    m_PliTimeMs    = NowMs;
+    m_Stats.KeyFrameRequests++;
+    
+    if (m_Config.pPliCallback != NULL)
+    {
+        m_Config.pPliCallback(m_Config.pContext);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,166 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __RTP_DEPACKETIZER_H__
+#define __RTP_DEPACKETIZER_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "include/GPU_codec_api.h"
+#include "rtp_packetizer.h"
+
+//the lost sequence numbers reported by one NACK at most, and the interval of the
+//repeated key frame requests while no key frame comes.
+#define MSDK_JITTER_MAX_NACKS      64
+#define MSDK_JITTER_PLI_INTERVAL   200
+
+//Called with the sequence numbers of the lost packets, once when the gap is found.
+typedef void (*MSdkNackCallback)(void* pContext, const uint16_t* pSeqNums, int32_t Count);
+
+//Called to request a key frame, when the decoding can not go on without one.
+typedef void (*MSdkPliCallback)(void* pContext);
+
+//The settings of the received RTP stream, fixed when the buffer is created.
+typedef struct
+{
+    uint32_t          CodecType;     // VIDEO_CODEC_TYPE_AVC (RFC 6184) or VIDEO_CODEC_TYPE_HEVC (RFC 7798)
+    int32_t           PacketSize;    // the max bytes of a received RTP packet
+    int32_t           MaxPackets;    // the packets kept, more than the packets of the largest frame
+    int32_t           MaxFrameBytes; // the max bytes of an assembled access unit
+    int32_t           MaxDelayMs;    // the time to wait for a lost packet, such as one RTT
+    MSdkNackCallback  pNackCallback; // the NACK hook, or NULL
+    MSdkPliCallback   pPliCallback;  // the PLI hook, or NULL
+    void*             pContext;      // the context passed to the hooks
+    
+}MSdkJitterConfig;
+
+//One complete access unit in Annex-B format, every NAL unit has a 4-byte start
+//code. the data is in the buffer of the depacketizer, valid until the next pop.
+typedef struct
+{
+    uint8_t*  pData;             // the access unit
+    int32_t   Length;            // the bytes of the access unit
+    uint32_t  RtpTimeStamp;      // the 90kHz RTP timestamp
+    uint16_t  FirstSeq;          // the sequence number of the first packet
+    uint16_t  LastSeq;           // the sequence number of the last packet
+    uint8_t   KeyFrame;          // 1 for the IDR or IRAP access unit
+    
+}MSdkRtpFrame;
+
+//The packet and frame counters of the receive side.
+typedef struct
+{
+    uint32_t  PacketsReceived;   // the packets kept in the buffer
+    uint32_t  PacketsDiscarded;  // the late, duplicate or malformed packets
+    uint32_t  PacketsNacked;     // the sequence numbers reported as lost
+    uint32_t  FramesOutput;      // the complete access units output
+    uint32_t  FramesDropped;     // the lost, broken or undecodable access units
+    uint32_t  KeyFrameRequests;  // the PLI requests
+    
+}MSdkJitterStats;
+
+//One received packet in the buffer, at the slot of its sequence number.
+typedef struct
+{
+    int32_t   Used;
+    uint16_t  SequenceNumber;
+    uint32_t  RtpTimeStamp;
+    uint8_t   Marker;
+    int32_t   PayloadOffset;
+    int32_t   PayloadLength;
+    uint8_t*  pData;
+    
+}MSdkRtpSlot;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The RTP depacketizer with a jitter buffer of the lowest delay, in non-interleaved
+//mode. An access unit is output as soon as its packets from the last output one
+//to the marker are all received, without any playout delay. A lost packet is
+//reported by the NACK hook at once, and waited for up to MaxDelayMs, then the
+//frame is dropped, a key frame is requested by the PLI hook, and the frames are
+//dropped until the key frame comes. Only the first frame waits MaxDelayMs, the
+//stream starts at the lowest packet received in that time, so the packets of the
+//first frame reordered behind a later one are kept. The single NAL unit, STAP-A
+//and FU-A packets are joined into the frame buffer, which is handed to the decoder
+//directly. The buffer is not thread-safe, it should be used on the receive thread
+//only.
+class CRtpDepacketizer
+{
+public:
+    CRtpDepacketizer(void);
+    ~CRtpDepacketizer(void);
+    
+    //Allocate the packet slots and the frame buffer, with the stream settings.
+    int32_t Create(const MSdkJitterConfig* pConfig);
+    
+    //Free the packet slots and the frame buffer.
+    void Destroy(void);
+    
+    //Copy a received RTP packet into the buffer, and report the lost packets before
+    //it. return MCODEC_SKIPPED for the late or duplicate packet.
+    int32_t InsertPacket(const uint8_t* pPacket, int32_t Length);
+    
+    //Output the next complete access unit, with the monotonic time in ms for the
+    //lost packet timeout. return MCODEC_SKIPPED if there is none.
+    int32_t PopFrame(MSdkRtpFrame* pFrame, int64_t NowMs);
+    
+    //Pop all the complete access units, and start to decode them one by one. the
+    //decoder waits a short timeout at most for its input buffer, and the frames
+    //after a failed one are dropped without decoding until the key frame comes, so
+    //a stalled decoder never stops the receive thread.
+    int32_t DecodeFrames(VM_MSDKDecoder* pDecoder, int64_t NowMs);
+    
+    //Get the counters since the buffer is created.
+    void GetStats(MSdkJitterStats* pStats);
+    
+private:
+    
+    //Get the slot holding a sequence number, NULL if it is not received.
+    MSdkRtpSlot* FindSlot(uint16_t SequenceNumber);
+    
+    //Join the payloads of the packets into the frame buffer, and free the slots.
+    int32_t AssembleFrame(uint16_t FirstSeq, uint16_t LastSeq, MSdkRtpFrame* pFrame);
+    
+    //Append a NAL unit with start code, or a part of it, to the frame buffer.
+    bool AppendData(const uint8_t* pData, int32_t Length);
+    bool AppendNal(const uint8_t* pNal, int32_t Length);
+    
+    //Drop the packets of the first frame in the buffer, which can not be completed.
+    void DropHeadFrame(void);
+    
+    //Request a key frame by the PLI hook, and drop the frames until it comes.
+    void RequestKeyFrame(int64_t NowMs);
+    
+    MSdkJitterConfig       m_Config;
+    int32_t                m_NalHeaderLen;
+    
+    //the packet slots, and the frame buffer of the output access unit.
+    uint8_t*               m_pPool;
+    MSdkRtpSlot*           m_pSlots;
+    uint8_t*               m_pFrame;
+    int32_t                m_FrameLength;
+    uint8_t                m_FrameKey;
+    
+    //the last packet of the output or dropped frames, and the newest one received.
+    bool                   m_Started;
+    uint16_t               m_LastSeq;
+    uint16_t               m_HighestSeq;
+    
+    //the last packet follows the lowest one received, until the first frame has
+    //waited MaxDelayMs from the time it is seen, -1 if not seen yet.
+    bool                   m_BaseFixed;
+    int64_t                m_StartMs;
+    
+    //the time since the first frame is blocked by a lost packet, -1 if not.
+    int64_t                m_BlockedMs;
+    
+    //the frames are dropped until a key frame, and the time of the last request.
+    bool                   m_WaitKeyFrame;
+    int64_t                m_PliTimeMs;
+    
+    MSdkJitterStats        m_Stats;
+};
+
+#endif  // End of __RTP_DEPACKETIZER_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
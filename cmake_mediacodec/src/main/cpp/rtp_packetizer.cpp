@@ -0,0 +1,346 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+
+#include "rtp_packetizer.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Write a 16-bit or 32-bit value in network byte order.
+static inline void PutBE16(uint8_t* pBuf, uint32_t Value)
+{
+    pBuf[0] = (uint8_t)(Value >> 8);
+    pBuf[1] = (uint8_t)(Value);
+}
+
+static inline void PutBE32(uint8_t* pBuf, uint32_t Value)
+{
+    pBuf[0] = (uint8_t)(Value >> 24);
+    pBuf[1] = (uint8_t)(Value >> 16);
+    pBuf[2] = (uint8_t)(Value >> 8);
+    pBuf[3] = (uint8_t)(Value);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CRtpPacketizer::CRtpPacketizer(void)
+    : m_NalHeaderLen(1), m_MaxPayload(0), m_SequenceNumber(0), m_RtpTimeStamp(0),
+      m_pPool(NULL), m_pPackets(NULL), m_nPackets(0), m_nAggNals(0), m_AggSize(0)
+{
+    memset(&m_Config, 0, sizeof(m_Config));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CRtpPacketizer::~CRtpPacketizer(void)
+{
+    Destroy();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpPacketizer::Create(const MSdkRtpConfig* pConfig)
+{
+    if ((pConfig == NULL) || (pConfig->MaxPackets <= 0) || (pConfig->PayloadType > 127) ||
+        (pConfig->PacketSize < MSDK_RTP_MIN_PACKET_SIZE) || (pConfig->PacketSize > MSDK_RTP_MAX_PACKET_SIZE))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    if ((pConfig->CodecType != VIDEO_CODEC_TYPE_AVC) && (pConfig->CodecType != VIDEO_CODEC_TYPE_HEVC))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    Destroy();
+    
+    //all the packets of a frame are in one buffer, allocated only here.
+    m_pPool    = (uint8_t *)malloc((size_t)pConfig->PacketSize * pConfig->MaxPackets);
+    m_pPackets = (MSdkRtpPacket *)malloc(sizeof(MSdkRtpPacket) * pConfig->MaxPackets);
+    if ((m_pPool == NULL) || (m_pPackets == NULL))
+    {
+        Destroy();
+        return MCODEC_ERROR;
+    }
+    
+    m_Config         = *pConfig;
+    m_NalHeaderLen   = (pConfig->CodecType == VIDEO_CODEC_TYPE_HEVC) ? 2 : 1;
+    m_MaxPayload     = pConfig->PacketSize - MSDK_RTP_HEADER_SIZE;
+    m_SequenceNumber = pConfig->SequenceNumber;
+    
+    for (int32_t i = 0; i < pConfig->MaxPackets; i++)
+    {
+        m_pPackets[i].pData = m_pPool + (size_t)pConfig->PacketSize * i;
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CRtpPacketizer::Destroy(void)
+{
+    free(m_pPool);
+    free(m_pPackets);
+    m_pPool    = NULL;
+    m_pPackets = NULL;
+    m_nPackets = 0;
+    m_nAggNals = 0;
+    m_AggSize  = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpPacketizer::PacketizeLayers(const SLayerBSInfo* pLayers, int32_t LayerNum, uint32_t RtpTimeStamp,
+                                        MSdkRtpPacket** ppPackets, int32_t* pPacketCount)
+{
+    if ((m_pPool == NULL) || (pLayers == NULL) || (ppPackets == NULL) || (pPacketCount == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    uint16_t first_sequence = m_SequenceNumber;
+    m_RtpTimeStamp = RtpTimeStamp;
+    m_nPackets = 0;
+    m_nAggNals = 0;
+    m_AggSize  = 0;
+    *ppPackets    = m_pPackets;
+    *pPacketCount = 0;
+    
+    //the NAL units of all layers in order, the start code is skipped if present.
+    int32_t sts = MCODEC_SUCCEED;
+    for (int32_t i = 0; (i < LayerNum) && (sts == MCODEC_SUCCEED); i++)
+    {
+        const uint8_t *pNal = pLayers[i].pBsBuf;
+        for (int32_t j = 0; (j < pLayers[i].iNalCount) && (sts == MCODEC_SUCCEED); j++)
+        {
+            int32_t length = pLayers[i].pNalLengthInByte[j];
+            int32_t sc_len = 0;
+            if ((length >= 4) && (pNal[0] == 0) && (pNal[1] == 0) && (pNal[2] == 0) && (pNal[3] == 1))
+            {
+                sc_len = 4;
+            }
+            else if ((length >= 3) && (pNal[0] == 0) && (pNal[1] == 0) && (pNal[2] == 1))
+            {
+                sc_len = 3;
+            }
+            
+            //the empty NAL unit, without a whole header, is not sent.
+            if (length - sc_len > m_NalHeaderLen)
+            {
+                sts = AddNal(pNal + sc_len, length - sc_len);
+            }
+            pNal += length;
+        }
+    }
+    
+    if (sts == MCODEC_SUCCEED)
+    {
+        sts = FlushNals();
+    }
+    
+    //the sequence numbers of a failed frame are used again by the next one.
+    if ((sts != MCODEC_SUCCEED) || (m_nPackets == 0))
+    {
+        m_SequenceNumber = first_sequence;
+        m_nPackets = 0;
+        return MCODEC_ERROR;
+    }
+    
+    //the marker bit ends the access unit.
+    MSdkRtpPacket *pLast = &m_pPackets[m_nPackets - 1];
+    pLast->pData[1] |= 0x80;
+    pLast->Marker    = 1;
+    
+    *pPacketCount = m_nPackets;
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpPacketizer::PacketizeFrame(const SFrameBSInfo* pFrameInfo, MSdkRtpPacket** ppPackets,
+                                       int32_t* pPacketCount)
+{
+    if (pFrameInfo == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    uint32_t rtp_time = (uint32_t)(pFrameInfo->uiTimeStamp * 90);
+    return PacketizeLayers(pFrameInfo->sLayerInfo, pFrameInfo->iLayerNum, rtp_time, ppPackets, pPacketCount);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+MSdkRtpPacket* CRtpPacketizer::NewPacket(void)
+{
+    if (m_nPackets >= m_Config.MaxPackets)
+    {
+        return NULL;
+    }
+    
+    MSdkRtpPacket *pPacket = &m_pPackets[m_nPackets++];
+    pPacket->Length         = MSDK_RTP_HEADER_SIZE;
+    pPacket->SequenceNumber = m_SequenceNumber++;
+    pPacket->Marker         = 0;
+    
+    //version 2, no padding, no extension, no CSRC, and the marker bit is clear.
+    uint8_t *pHeader = pPacket->pData;
+    pHeader[0] = 0x80;
+    pHeader[1] = m_Config.PayloadType;
+    PutBE16(pHeader + 2, pPacket->SequenceNumber);
+    PutBE32(pHeader + 4, m_RtpTimeStamp);
+    PutBE32(pHeader + 8, m_Config.Ssrc);
+    
+    return pPacket;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpPacketizer::AddNal(const uint8_t* pNal, int32_t Length)
+{
+    //a NAL unit larger than a packet is always fragmented.
+    if (Length > m_MaxPayload)
+    {
+        if (FlushNals() != MCODEC_SUCCEED)
+        {
+            return MCODEC_ERROR;
+        }
+        return FragmentNal(pNal, Length);
+    }
+    
+    //the aggregation packet has the payload header, and 2 bytes size of every unit.
+    if ((m_nAggNals > 0) &&
+        ((m_nAggNals >= MSDK_RTP_MAX_AGGREGATED) || (m_AggSize + 2 + Length > m_MaxPayload)))
+    {
+        if (FlushNals() != MCODEC_SUCCEED)
+        {
+            return MCODEC_ERROR;
+        }
+    }
+    
+    if (m_nAggNals == 0)
+    {
+        m_AggSize = m_NalHeaderLen;
+    }
+    
+    m_pAggNals[m_nAggNals]   = pNal;
+    m_AggLengths[m_nAggNals] = Length;
+    m_AggSize += 2 + Length;
+    m_nAggNals++;
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpPacketizer::FlushNals(void)
+{
+    if (m_nAggNals == 0)
+    {
+        return MCODEC_SUCCEED;
+    }
+    
+    MSdkRtpPacket *pPacket = NewPacket();
+    if (pPacket == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    uint8_t *pPayload = pPacket->pData + MSDK_RTP_HEADER_SIZE;
+    int32_t length = 0;
+    
+    //one NAL unit is sent as it is, in a single NAL unit packet.
+    if (m_nAggNals == 1)
+    {
+        memcpy(pPayload, m_pAggNals[0], m_AggLengths[0]);
+        length = m_AggLengths[0];
+    }
+    else
+    {
+        //the F bit is set if any unit has it, with the highest NRI for AVC, and
+        //the lowest LayerId and TID for HEVC.
+        if (m_Config.CodecType == VIDEO_CODEC_TYPE_HEVC)
+        {
+            uint8_t forbidden = 0;
+            uint32_t layer_id = 0x3F;
+            uint32_t tid      = 0x07;
+            for (int32_t i = 0; i < m_nAggNals; i++)
+            {
+                uint32_t nal_layer = ((m_pAggNals[i][0] & 0x01) << 5) | (m_pAggNals[i][1] >> 3);
+                uint32_t nal_tid   = m_pAggNals[i][1] & 0x07;
+                forbidden |= m_pAggNals[i][0] & 0x80;
+                layer_id   = (nal_layer < layer_id) ? nal_layer : layer_id;
+                tid        = (nal_tid < tid) ? nal_tid : tid;
+            }
+            pPayload[0] = forbidden | (MSDK_RTP_HEVC_AP << 1) | (uint8_t)(layer_id >> 5);
+            pPayload[1] = (uint8_t)(((layer_id & 0x1F) << 3) | tid);
+        }
+        else
+        {
+            uint8_t forbidden = 0;
+            uint8_t nri       = 0;
+            for (int32_t i = 0; i < m_nAggNals; i++)
+            {
+                forbidden |= m_pAggNals[i][0] & 0x80;
+                nri        = ((m_pAggNals[i][0] & 0x60) > nri) ? (m_pAggNals[i][0] & 0x60) : nri;
+            }
+            pPayload[0] = forbidden | nri | MSDK_RTP_AVC_STAP_A;
+        }
+        
+        length = m_NalHeaderLen;
+        for (int32_t i = 0; i < m_nAggNals; i++)
+        {
+            PutBE16(pPayload + length, m_AggLengths[i]);
+            memcpy(pPayload + length + 2, m_pAggNals[i], m_AggLengths[i]);
+            length += 2 + m_AggLengths[i];
+        }
+    }
+    
+    pPacket->Length += length;
+    m_nAggNals = 0;
+    m_AggSize  = 0;
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CRtpPacketizer::FragmentNal(const uint8_t* pNal, int32_t Length)
+{
+    //the fragments carry the NAL unit without its header, in about equal sizes.
+    const uint8_t *pData = pNal + m_NalHeaderLen;
+    int32_t data_size    = Length - m_NalHeaderLen;
+    int32_t max_fragment = m_MaxPayload - m_NalHeaderLen - 1;
+    int32_t fragments    = (data_size + max_fragment - 1) / max_fragment;
+    int32_t fragment     = (data_size + fragments - 1) / fragments;
+    
+    //the payload header of the FU-A indicator for AVC, or the FU payload header
+    //for HEVC, followed by the FU header with the type of the NAL unit.
+    uint8_t fu_header[3];
+    uint8_t nal_type = 0;
+    if (m_Config.CodecType == VIDEO_CODEC_TYPE_HEVC)
+    {
+        fu_header[0] = (pNal[0] & 0x81) | (MSDK_RTP_HEVC_FU << 1);
+        fu_header[1] = pNal[1];
+        nal_type     = (pNal[0] >> 1) & 0x3F;
+    }
+    else
+    {
+        fu_header[0] = (pNal[0] & 0xE0) | MSDK_RTP_AVC_FU_A;
+        nal_type     = pNal[0] & 0x1F;
+    }
+    
+    for (int32_t offset = 0; offset < data_size; offset += fragment)
+    {
+        MSdkRtpPacket *pPacket = NewPacket();
+        if (pPacket == NULL)
+        {
+            return MCODEC_ERROR;
+        }
+        
+        int32_t size = (data_size - offset < fragment) ? (data_size - offset) : fragment;
+        uint8_t start = (offset == 0) ? 0x80 : 0;
+        uint8_t end   = (offset + size == data_size) ? 0x40 : 0;
+        fu_header[m_NalHeaderLen] = start | end | nal_type;
+        
+        uint8_t *pPayload = pPacket->pData + MSDK_RTP_HEADER_SIZE;
+        memcpy(pPayload, fu_header, m_NalHeaderLen + 1);
+        memcpy(pPayload + m_NalHeaderLen + 1, pData + offset, size);
+        pPacket->Length += m_NalHeaderLen + 1 + size;
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,108 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __RTP_PACKETIZER_H__
+#define __RTP_PACKETIZER_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "include/GPU_codec_api.h"
+
+#define MSDK_RTP_HEADER_SIZE       12
+#define MSDK_RTP_MIN_PACKET_SIZE   64
+#define MSDK_RTP_MAX_PACKET_SIZE   65535
+
+//the NAL units aggregated into one STAP-A or AP packet at most.
+#define MSDK_RTP_MAX_AGGREGATED    32
+
+//the payload types of the aggregation and fragmentation units, for AVC and HEVC.
+#define MSDK_RTP_AVC_STAP_A        24
+#define MSDK_RTP_AVC_FU_A          28
+#define MSDK_RTP_HEVC_AP           48
+#define MSDK_RTP_HEVC_FU           49
+
+//The settings of a RTP stream, fixed when the packetizer is created.
+typedef struct
+{
+    uint32_t  CodecType;         // VIDEO_CODEC_TYPE_AVC (RFC 6184) or VIDEO_CODEC_TYPE_HEVC (RFC 7798)
+    int32_t   PacketSize;        // the max bytes of a RTP packet with its header, such as 1200
+    int32_t   MaxPackets;        // the packets in the pool, the most packets of a frame
+    uint8_t   PayloadType;       // the RTP payload type, 96~127 for dynamic types
+    uint32_t  Ssrc;              // the RTP synchronization source
+    uint16_t  SequenceNumber;    // the sequence number of the first packet
+    
+}MSdkRtpConfig;
+
+//One RTP packet with its fixed header, in the packet pool of the packetizer.
+typedef struct
+{
+    uint8_t*  pData;             // the RTP header and the payload
+    int32_t   Length;            // the bytes of the packet
+    uint16_t  SequenceNumber;    // the RTP sequence number
+    uint8_t   Marker;            // 1 for the last packet of the access unit
+    
+}MSdkRtpPacket;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The RTP packetizer of the encoded access units, in non-interleaved mode. The NAL
+//units are taken by the lengths in pNalLengthInByte, with or without the start
+//code. the small ones in a row, as the parameter sets and the prefix NAL unit,
+//are aggregated into a STAP-A packet, the ones larger than a packet are cut into
+//FU-A packets, and the others are sent as single NAL unit packets. All packets
+//are written into the pool allocated by Create(), nothing is allocated per frame.
+class CRtpPacketizer
+{
+public:
+    CRtpPacketizer(void);
+    ~CRtpPacketizer(void);
+    
+    //Allocate the packet pool, with the settings of the RTP stream.
+    int32_t Create(const MSdkRtpConfig* pConfig);
+    
+    //Free the packet pool.
+    void Destroy(void);
+    
+    //Packetize the layers of an access unit, with the 90kHz RTP timestamp. the
+    //packets are valid until the next call, and the marker is set on the last one.
+    //return MCODEC_ERROR if the pool is too small, and no packet is output.
+    int32_t PacketizeLayers(const SLayerBSInfo* pLayers, int32_t LayerNum, uint32_t RtpTimeStamp,
+                            MSdkRtpPacket** ppPackets, int32_t* pPacketCount);
+    
+    //Packetize all the layers of a frame, the timestamp in ms is converted to 90kHz.
+    int32_t PacketizeFrame(const SFrameBSInfo* pFrameInfo, MSdkRtpPacket** ppPackets, int32_t* pPacketCount);
+    
+private:
+    
+    //Get a packet from the pool and write the RTP header, NULL if the pool is empty.
+    MSdkRtpPacket* NewPacket(void);
+    
+    //Add a NAL unit to the aggregation, or send the aggregated ones first.
+    int32_t AddNal(const uint8_t* pNal, int32_t Length);
+    
+    //Send the aggregated NAL units, as a single NAL unit or an aggregation packet.
+    int32_t FlushNals(void);
+    
+    //Cut a large NAL unit into fragmentation unit packets.
+    int32_t FragmentNal(const uint8_t* pNal, int32_t Length);
+    
+    MSdkRtpConfig          m_Config;
+    int32_t                m_NalHeaderLen;
+    int32_t                m_MaxPayload;
+    uint16_t               m_SequenceNumber;
+    uint32_t               m_RtpTimeStamp;
+    
+    //the packet pool, and the packets of the current access unit.
+    uint8_t*               m_pPool;
+    MSdkRtpPacket*         m_pPackets;
+    int32_t                m_nPackets;
+    
+    //the NAL units waiting for aggregation, and the payload size of them.
+    const uint8_t*         m_pAggNals[MSDK_RTP_MAX_AGGREGATED];
+    int32_t                m_AggLengths[MSDK_RTP_MAX_AGGREGATED];
+    int32_t                m_nAggNals;
+    int32_t                m_AggSize;
+};
+
+#endif  // End of __RTP_PACKETIZER_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
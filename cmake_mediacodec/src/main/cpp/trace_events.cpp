@@ -0,0 +1,166 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <mutex>
+#include <new>
+
+#include "trace_events.h"
+#include "latency_stats.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+std::atomic<bool> g_TraceEnabled(false);
+
+//all the thread rings, which are reused after the threads exit.
+static std::atomic<MSdkTraceRing*> s_TraceRings(NULL);
+static std::mutex s_TraceLock;
+static std::atomic<int64_t> s_TraceStartUs(0);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The ring of the current thread, given back when the thread exits.
+class CTraceThread
+{
+public:
+    CTraceThread(void) : m_pRing(NULL) {}
+    
+    ~CTraceThread(void)
+    {
+        if (m_pRing != NULL)
+        {
+            m_pRing->InUse.store(false);
+        }
+    }
+    
+    MSdkTraceRing*  m_pRing;
+};
+
+static thread_local CTraceThread s_TraceThread;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Get the ring of the current thread, take a free one or create it for the first event.
+static MSdkTraceRing* GetThreadRing(void)
+{
+    if (s_TraceThread.m_pRing != NULL)
+    {
+        return s_TraceThread.m_pRing;
+    }
+    
+    std::lock_guard<std::mutex> lock(s_TraceLock);
+    MSdkTraceRing *pRing = s_TraceRings.load();
+    
+    //reuse the ring of an exited thread, its events are cleared.
+    while ((pRing != NULL) && pRing->InUse.load())
+    {
+        pRing = pRing->pNext;
+    }
+    
+    if (pRing == NULL)
+    {
+        pRing = new (std::nothrow)MSdkTraceRing;
+        if (pRing == NULL)
+        {
+            return NULL;
+        }
+        pRing->pNext = s_TraceRings.load();
+        s_TraceRings.store(pRing);
+    }
+    
+    pRing->WriteCount.store(0);
+    pRing->ThreadId = (int32_t)syscall(SYS_gettid);
+    pRing->InUse.store(true);
+    
+    s_TraceThread.m_pRing = pRing;
+    return pRing;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void trace_Start(void)
+{
+    //the rings are not cleared, the events before the start time are skipped.
+    s_TraceStartUs.store(latency_NowUs());
+    g_TraceEnabled.store(true);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void trace_Stop(void)
+{
+    g_TraceEnabled.store(false);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void trace_Record(const char* pName, char Phase)
+{
+    MSdkTraceRing *pRing = GetThreadRing();
+    if (pRing == NULL)
+    {
+        return;
+    }
+    
+    //only the owner thread writes the ring, publish the event after filled.
+    uint64_t count = pRing->WriteCount.load(std::memory_order_relaxed);
+    MSdkTraceEvent *pEvent = &pRing->Events[count % MSDK_TRACE_RING_EVENTS];
+    
+    pEvent->Name   = pName;
+    pEvent->TimeUs = latency_NowUs();
+    pEvent->Phase  = Phase;
+    
+    pRing->WriteCount.store(count + 1, std::memory_order_release);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t trace_WriteFile(const char* pFileName)
+{
+    static MSdkTraceEvent Events[MSDK_TRACE_RING_EVENTS];
+    
+    FILE *pFile = fopen(pFileName, "w");
+    if (pFile == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    std::lock_guard<std::mutex> lock(s_TraceLock);
+    int32_t pid = (int32_t)getpid();
+    int64_t start_us = s_TraceStartUs.load();
+    bool first = true;
+    
+    fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    
+    for (MSdkTraceRing *pRing = s_TraceRings.load(); pRing != NULL; pRing = pRing->pNext)
+    {
+        //copy out the newest events, which may be written by the owner meanwhile.
+        uint64_t end   = pRing->WriteCount.load(std::memory_order_acquire);
+        uint64_t first_copied = (end > MSDK_TRACE_RING_EVENTS) ? (end - MSDK_TRACE_RING_EVENTS) : 0;
+        
+        for (uint64_t i = first_copied; i < end; i++)
+        {
+            Events[i - first_copied] = pRing->Events[i % MSDK_TRACE_RING_EVENTS];
+        }
+        
+        //the events overwritten during the copy are dropped, and the one in the
+        //slot of the event being written now.
+        uint64_t begin = first_copied;
+        uint64_t now = pRing->WriteCount.load(std::memory_order_acquire);
+        if (now >= begin + MSDK_TRACE_RING_EVENTS)
+        {
+            begin = now - MSDK_TRACE_RING_EVENTS + 1;
+        }
+        
+        for (uint64_t i = begin; i < end; i++)
+        {
+            MSdkTraceEvent *pEvent = &Events[i - first_copied];
+            if (pEvent->TimeUs < start_us)
+            {
+                continue;
+            }
+            
+            fprintf(pFile, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRId64 ",\"pid\":%d,\"tid\":%d}",
+                    first ? "" : ",", pEvent->Name, pEvent->Phase, pEvent->TimeUs, pid, pRing->ThreadId);
+            first = false;
+        }
+    }
+    
+    fprintf(pFile, "\n]}\n");
+    
+    return (fclose(pFile) == 0) ? MCODEC_SUCCEED : MCODEC_ERROR;
+}
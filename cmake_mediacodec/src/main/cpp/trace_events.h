@@ -0,0 +1,92 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __TRACE_EVENTS_H__
+#define __TRACE_EVENTS_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#include "include/GPU_codec_api.h"
+
+//the events kept for every thread, the oldest ones are overwritten.
+#define MSDK_TRACE_RING_EVENTS     8192
+
+/////////////////////////////////////////////////////////////////////////////////////
+//One begin, end or instant event, the name should be a string literal without quotes.
+typedef struct
+{
+    const char*  Name;
+    int64_t      TimeUs;
+    char         Phase;              // 'B' for begin, 'E' for end, 'i' for an instant
+    
+}MSdkTraceEvent;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The event ring of one thread, only written by the owner thread. the writer
+//publishes each event with WriteCount, the flush reads the ring without lock.
+typedef struct MSdkTraceRing
+{
+    MSdkTraceEvent         Events[MSDK_TRACE_RING_EVENTS];
+    std::atomic<uint64_t>  WriteCount;
+    std::atomic<bool>      InUse;
+    int32_t                ThreadId;
+    struct MSdkTraceRing*  pNext;
+    
+}MSdkTraceRing;
+
+extern std::atomic<bool> g_TraceEnabled;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Start to record events, the events recorded before are not written any more.
+void trace_Start(void);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Stop recording events, the recorded events are kept for trace_WriteFile().
+void trace_Stop(void);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Write the events of all threads to a Chrome JSON trace file, which could be
+//opened by chrome://tracing or Perfetto. return MCODEC_SUCCEED or MCODEC_ERROR.
+int32_t trace_WriteFile(const char* pFileName);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Record an event to the ring of the calling thread.
+void trace_Record(const char* pName, char Phase);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Check if the tracing is enabled, which is only a relaxed load when disabled.
+static inline bool trace_IsEnabled(void)
+{
+    return g_TraceEnabled.load(std::memory_order_relaxed);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Record the begin and end events of a scope, when the tracing is enabled.
+class CTraceScope
+{
+public:
+    explicit CTraceScope(const char* pName) : m_pName(NULL)
+    {
+        if (trace_IsEnabled())
+        {
+            m_pName = pName;
+            trace_Record(pName, 'B');
+        }
+    }
+    
+    ~CTraceScope(void)
+    {
+        if (m_pName != NULL)
+        {
+            trace_Record(m_pName, 'E');
+        }
+    }
+
+private:
+    const char*  m_pName;
+};
+
+#endif  // End of __TRACE_EVENTS_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
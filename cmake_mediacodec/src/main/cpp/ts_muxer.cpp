@@ -0,0 +1,526 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+
+#include "bitstream_io.h"
+#include "nal_parser.h"
+#include "ts_muxer.h"
+
+//the PTS and PCR base are 33-bit values.
+#define MSDK_TS_CLOCK_MASK         0x1FFFFFFFFull
+
+//the stream types of the PMT.
+#define MSDK_TS_STREAM_AVC         0x1B
+#define MSDK_TS_STREAM_HEVC        0x24
+
+//the access unit delimiters of any picture type, with the 4-byte start code.
+static const uint8_t s_AudAVC[]    = {0x00, 0x00, 0x00, 0x01, 0x09, 0xF0};
+static const uint8_t s_AudHEVC[]   = {0x00, 0x00, 0x00, 0x01, 0x46, 0x01, 0x50};
+static const uint8_t s_StartCode[] = {0x00, 0x00, 0x00, 0x01};
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The CRC32 of the PSI sections, the MSB-first polynomial 0x04C11DB7.
+static uint32_t Crc32(const uint8_t* pData, int32_t Length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (int32_t i = 0; i < Length; i++)
+    {
+        crc ^= (uint32_t)pData[i] << 24;
+        for (int32_t k = 0; k < 8; k++)
+        {
+            crc = (crc & 0x80000000) ? ((crc << 1) ^ 0x04C11DB7) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Write the 32-bit CRC after the section, and stuff the rest of the packet.
+static void EndSection(uint8_t* pPacket, uint8_t* pSection, uint8_t* pEnd)
+{
+    uint32_t crc = Crc32(pSection, (int32_t)(pEnd - pSection));
+    pEnd[0] = (uint8_t)(crc >> 24);
+    pEnd[1] = (uint8_t)(crc >> 16);
+    pEnd[2] = (uint8_t)(crc >> 8);
+    pEnd[3] = (uint8_t)(crc);
+    memset(pEnd + 4, 0xFF, pPacket + MSDK_TS_PACKET_SIZE - (pEnd + 4));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//the length of the start code at the NAL unit, 0 if it has no start code.
+static inline int32_t StartCodeLength(const uint8_t* pNal, int32_t Length)
+{
+    if ((Length >= 4) && (pNal[0] == 0) && (pNal[1] == 0) && (pNal[2] == 0) && (pNal[3] == 1))
+    {
+        return 4;
+    }
+    if ((Length >= 3) && (pNal[0] == 0) && (pNal[1] == 0) && (pNal[2] == 1))
+    {
+        return 3;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CTsMuxer::CTsMuxer(void)
+    : m_File(-1), m_Started(false), m_PatCounter(0), m_PmtCounter(0), m_VideoCounter(0),
+      m_pBatch(NULL), m_nBatched(0), m_nPieces(0), m_LastTimeStamp(0), m_LastInterval(0)
+{
+    memset(&m_Config, 0, sizeof(m_Config));
+    memset(&m_Segment, 0, sizeof(m_Segment));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+CTsMuxer::~CTsMuxer(void)
+{
+    Close();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CTsMuxer::Open(int fd, const MSdkTsConfig* pConfig)
+{
+    if ((m_File >= 0) || (fd < 0) || (pConfig == NULL) ||
+        ((pConfig->CodecType != VIDEO_CODEC_TYPE_AVC) && (pConfig->CodecType != VIDEO_CODEC_TYPE_HEVC)) ||
+        (pConfig->PmtPid < 0x10) || (pConfig->PmtPid > 0x1FFE) || (pConfig->VideoPid < 0x10) ||
+        (pConfig->VideoPid > 0x1FFE) || (pConfig->PmtPid == pConfig->VideoPid) ||
+        (pConfig->SegmentMs < 0) || (pConfig->BatchPackets <= 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the batch is the only memory allocated by the muxer.
+    m_pBatch = (uint8_t *)malloc(pConfig->BatchPackets * MSDK_TS_PACKET_SIZE);
+    if (m_pBatch == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    m_File         = fd;
+    m_Config       = *pConfig;
+    m_Started      = false;
+    m_PatCounter   = 0;
+    m_PmtCounter   = 0;
+    m_VideoCounter = 0;
+    m_nBatched     = 0;
+    m_ParamSets.Reset(pConfig->CodecType);
+    memset(&m_Segment, 0, sizeof(m_Segment));
+    BuildTables();
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CTsMuxer::Close(void)
+{
+    if (m_File < 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    int32_t sts = FlushBatch();
+    
+    //the last segment lasts to the end of its last frame.
+    if (m_Started && (m_Config.pSegmentCallback != NULL))
+    {
+        m_Segment.Duration = m_LastTimeStamp + m_LastInterval - m_Segment.StartTimeStamp;
+        m_Config.pSegmentCallback(m_Config.pContext, &m_Segment);
+    }
+    
+    free(m_pBatch);
+    m_pBatch = NULL;
+    m_File   = -1;
+    
+    return sts;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CTsMuxer::WriteFrame(const SLayerBSInfo* pLayers, int32_t LayerNum, int64_t TimeStamp)
+{
+    if ((m_File < 0) || (pLayers == NULL))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the first pass saves the parameter sets, and finds the IDR and the delimiter.
+    bool hevc       = (m_Config.CodecType == VIDEO_CODEC_TYPE_HEVC);
+    int32_t aud     = hevc ? 35 : 9;
+    bool key_frame  = false;
+    bool has_sets   = false;
+    bool has_aud    = false;
+    bool first_nal  = true;
+    
+    for (int32_t i = 0; i < LayerNum; i++)
+    {
+        const uint8_t *pNal = pLayers[i].pBsBuf;
+        for (int32_t j = 0; j < pLayers[i].iNalCount; j++)
+        {
+            int32_t length = pLayers[i].pNalLengthInByte[j];
+            int32_t sc_len = StartCodeLength(pNal, length);
+            if (length > sc_len)
+            {
+                int32_t nal_type = hevc ? ((pNal[sc_len] >> 1) & 0x3F) : (pNal[sc_len] & 0x1F);
+                if (nal_IsParamSet(nal_type, m_Config.CodecType))
+                {
+                    m_ParamSets.Update(pNal + sc_len, length - sc_len);
+                    has_sets = true;
+                }
+                key_frame |= nal_IsIRAP(nal_type, m_Config.CodecType);
+                has_aud   |= first_nal && (nal_type == aud);
+                first_nal  = false;
+            }
+            pNal += length;
+        }
+    }
+    
+    //the sets are copied into the packets, the replaced ones are not lent.
+    m_ParamSets.ReleaseRetired();
+    
+    if (first_nal)
+    {
+        return MCODEC_SKIPPED;
+    }
+    
+    //the stream starts at the first IDR frame, with the parameter sets known.
+    struct iovec sets[MSDK_TS_MAX_PIECES / 4];
+    int32_t set_count = (key_frame && !has_sets) ? m_ParamSets.GetActiveSets(sets, MSDK_TS_MAX_PIECES / 4) : 0;
+    if (!m_Started)
+    {
+        if (!key_frame || (!has_sets && (set_count == 0)))
+        {
+            return MCODEC_SKIPPED;
+        }
+        
+        m_Started                = true;
+        m_Segment.StartTimeStamp = TimeStamp;
+        m_LastTimeStamp          = TimeStamp;
+    }
+    
+    //the segment is cut at the IDR frame, and the tables lead every IDR frame.
+    if (key_frame)
+    {
+        if ((TimeStamp - m_Segment.StartTimeStamp >= m_Config.SegmentMs) && (TimeStamp > m_Segment.StartTimeStamp))
+        {
+            if (CutSegment(TimeStamp) != MCODEC_SUCCEED)
+            {
+                return MCODEC_ERROR;
+            }
+        }
+        
+        if (WriteTables() != MCODEC_SUCCEED)
+        {
+            return MCODEC_ERROR;
+        }
+    }
+    m_LastInterval  = (TimeStamp > m_LastTimeStamp) ? (TimeStamp - m_LastTimeStamp) : m_LastInterval;
+    m_LastTimeStamp = TimeStamp;
+    
+    //the second pass lists the pieces of the PES packet, the delimiter goes first,
+    //and the cached parameter sets go before the first NAL unit of the frame.
+    m_nPieces = 0;
+    m_Pieces[m_nPieces].iov_base = m_PesHeader;
+    m_Pieces[m_nPieces].iov_len  = sizeof(m_PesHeader);
+    m_nPieces++;
+    
+    if (!has_aud)
+    {
+        m_Pieces[m_nPieces].iov_base = (void *)(hevc ? s_AudHEVC : s_AudAVC);
+        m_Pieces[m_nPieces].iov_len  = hevc ? sizeof(s_AudHEVC) : sizeof(s_AudAVC);
+        m_nPieces++;
+    }
+    
+    int32_t pes_size = 0;
+    first_nal = true;
+    for (int32_t i = 0; i < LayerNum; i++)
+    {
+        const uint8_t *pNal = pLayers[i].pBsBuf;
+        for (int32_t j = 0; j < pLayers[i].iNalCount; j++)
+        {
+            int32_t length = pLayers[i].pNalLengthInByte[j];
+            int32_t sc_len = StartCodeLength(pNal, length);
+            if (length > sc_len)
+            {
+                if (m_nPieces + set_count + 2 > MSDK_TS_MAX_PIECES)
+                {
+                    return MCODEC_ERROR;
+                }
+                
+                if (!(first_nal && has_aud))
+                {
+                    for (int32_t k = 0; k < set_count; k++)
+                    {
+                        m_Pieces[m_nPieces++] = sets[k];
+                    }
+                    set_count = 0;
+                }
+                first_nal = false;
+                
+                if (sc_len == 0)
+                {
+                    m_Pieces[m_nPieces].iov_base = (void *)s_StartCode;
+                    m_Pieces[m_nPieces].iov_len  = sizeof(s_StartCode);
+                    m_nPieces++;
+                }
+                m_Pieces[m_nPieces].iov_base = (void *)pNal;
+                m_Pieces[m_nPieces].iov_len  = length;
+                m_nPieces++;
+            }
+            pNal += length;
+        }
+    }
+    
+    for (int32_t i = 1; i < m_nPieces; i++)
+    {
+        pes_size += (int32_t)m_Pieces[i].iov_len;
+    }
+    
+    //the PES header of the video stream with the PTS, the length is 0 if too large.
+    uint64_t pcr = ((uint64_t)TimeStamp * 90) & MSDK_TS_CLOCK_MASK;
+    uint64_t pts = (pcr + MSDK_TS_PTS_DELAY) & MSDK_TS_CLOCK_MASK;
+    int32_t pes_length = pes_size + 8;
+    pes_length = (pes_length > 0xFFFF) ? 0 : pes_length;
+    
+    m_PesHeader[0]  = 0x00;
+    m_PesHeader[1]  = 0x00;
+    m_PesHeader[2]  = 0x01;
+    m_PesHeader[3]  = 0xE0;
+    m_PesHeader[4]  = (uint8_t)(pes_length >> 8);
+    m_PesHeader[5]  = (uint8_t)(pes_length);
+    m_PesHeader[6]  = 0x80;
+    m_PesHeader[7]  = 0x80;
+    m_PesHeader[8]  = 0x05;
+    m_PesHeader[9]  = (uint8_t)(0x21 | ((pts >> 29) & 0x0E));
+    m_PesHeader[10] = (uint8_t)(pts >> 22);
+    m_PesHeader[11] = (uint8_t)(((pts >> 14) & 0xFE) | 1);
+    m_PesHeader[12] = (uint8_t)(pts >> 7);
+    m_PesHeader[13] = (uint8_t)(((pts << 1) & 0xFE) | 1);
+    
+    return WritePes(pes_size + (int32_t)sizeof(m_PesHeader), pcr, key_frame);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CTsMuxer::WriteFrame(const SFrameBSInfo* pFrameInfo)
+{
+    if (pFrameInfo == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return WriteFrame(pFrameInfo->sLayerInfo, pFrameInfo->iLayerNum, pFrameInfo->uiTimeStamp);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void CTsMuxer::BuildTables(void)
+{
+    //the PAT of one program, at the PID 0.
+    uint8_t *p = m_Pat;
+    *p++ = 0x47;
+    *p++ = 0x40;
+    *p++ = 0x00;
+    *p++ = 0x10;
+    *p++ = 0x00;
+    
+    uint8_t *section = p;
+    *p++ = 0x00;
+    *p++ = 0xB0;
+    *p++ = 13;
+    *p++ = 0x00;
+    *p++ = 0x01;
+    *p++ = 0xC1;
+    *p++ = 0x00;
+    *p++ = 0x00;
+    *p++ = 0x00;
+    *p++ = 0x01;
+    *p++ = (uint8_t)(0xE0 | (m_Config.PmtPid >> 8));
+    *p++ = (uint8_t)(m_Config.PmtPid);
+    EndSection(m_Pat, section, p);
+    
+    //the PMT of the video stream, which also carries the PCR.
+    p = m_Pmt;
+    *p++ = 0x47;
+    *p++ = (uint8_t)(0x40 | (m_Config.PmtPid >> 8));
+    *p++ = (uint8_t)(m_Config.PmtPid);
+    *p++ = 0x10;
+    *p++ = 0x00;
+    
+    section = p;
+    *p++ = 0x02;
+    *p++ = 0xB0;
+    *p++ = 18;
+    *p++ = 0x00;
+    *p++ = 0x01;
+    *p++ = 0xC1;
+    *p++ = 0x00;
+    *p++ = 0x00;
+    *p++ = (uint8_t)(0xE0 | (m_Config.VideoPid >> 8));
+    *p++ = (uint8_t)(m_Config.VideoPid);
+    *p++ = 0xF0;
+    *p++ = 0x00;
+    *p++ = (m_Config.CodecType == VIDEO_CODEC_TYPE_HEVC) ? MSDK_TS_STREAM_HEVC : MSDK_TS_STREAM_AVC;
+    *p++ = (uint8_t)(0xE0 | (m_Config.VideoPid >> 8));
+    *p++ = (uint8_t)(m_Config.VideoPid);
+    *p++ = 0xF0;
+    *p++ = 0x00;
+    EndSection(m_Pmt, section, p);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CTsMuxer::WriteTables(void)
+{
+    uint8_t *pPacket = NextPacket();
+    if (pPacket == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    memcpy(pPacket, m_Pat, MSDK_TS_PACKET_SIZE);
+    pPacket[3] = 0x10 | (m_PatCounter++ & 0x0F);
+    
+    pPacket = NextPacket();
+    if (pPacket == NULL)
+    {
+        return MCODEC_ERROR;
+    }
+    memcpy(pPacket, m_Pmt, MSDK_TS_PACKET_SIZE);
+    pPacket[3] = 0x10 | (m_PmtCounter++ & 0x0F);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CTsMuxer::WritePes(int32_t PesSize, uint64_t Pcr, bool RandomAccess)
+{
+    int32_t remaining = PesSize;
+    int32_t piece  = 0;
+    int32_t offset = 0;
+    bool first     = true;
+    
+    while (remaining > 0)
+    {
+        uint8_t *pPacket = NextPacket();
+        if (pPacket == NULL)
+        {
+            return MCODEC_ERROR;
+        }
+        
+        //the adaptation field has the PCR in the first packet, and the stuffing in
+        //the last one, the payload fills the rest of the packet.
+        int32_t capacity = first ? (MSDK_TS_PACKET_SIZE - 4 - 8) : (MSDK_TS_PACKET_SIZE - 4);
+        int32_t payload  = (remaining < capacity) ? remaining : capacity;
+        int32_t af_size  = MSDK_TS_PACKET_SIZE - 4 - payload;
+        
+        pPacket[0] = 0x47;
+        pPacket[1] = (uint8_t)((first ? 0x40 : 0x00) | (m_Config.VideoPid >> 8));
+        pPacket[2] = (uint8_t)(m_Config.VideoPid);
+        pPacket[3] = (uint8_t)(((af_size > 0) ? 0x30 : 0x10) | (m_VideoCounter++ & 0x0F));
+        
+        uint8_t *p = pPacket + 4;
+        if (af_size > 0)
+        {
+            p[0] = (uint8_t)(af_size - 1);
+            if (af_size > 1)
+            {
+                p[1] = first ? (uint8_t)(0x10 | (RandomAccess ? 0x40 : 0x00)) : 0x00;
+                int32_t used = 2;
+                if (first)
+                {
+                    p[2] = (uint8_t)(Pcr >> 25);
+                    p[3] = (uint8_t)(Pcr >> 17);
+                    p[4] = (uint8_t)(Pcr >> 9);
+                    p[5] = (uint8_t)(Pcr >> 1);
+                    p[6] = (uint8_t)(((Pcr & 1) << 7) | 0x7E);
+                    p[7] = 0x00;
+                    used = 8;
+                }
+                memset(p + used, 0xFF, af_size - used);
+            }
+            p += af_size;
+        }
+        
+        //copy the payload from the pieces of the PES packet.
+        int32_t left = payload;
+        while (left > 0)
+        {
+            int32_t size = (int32_t)m_Pieces[piece].iov_len - offset;
+            size = (size < left) ? size : left;
+            memcpy(p, (const uint8_t *)m_Pieces[piece].iov_base + offset, size);
+            p      += size;
+            left   -= size;
+            offset += size;
+            if (offset == (int32_t)m_Pieces[piece].iov_len)
+            {
+                piece++;
+                offset = 0;
+            }
+        }
+        
+        remaining -= payload;
+        first = false;
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+uint8_t* CTsMuxer::NextPacket(void)
+{
+    if ((m_nBatched >= m_Config.BatchPackets) && (FlushBatch() != MCODEC_SUCCEED))
+    {
+        return NULL;
+    }
+    
+    return m_pBatch + (m_nBatched++) * MSDK_TS_PACKET_SIZE;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CTsMuxer::FlushBatch(void)
+{
+    if (m_nBatched == 0)
+    {
+        return MCODEC_SUCCEED;
+    }
+    
+    MSdkBitstream out;
+    out.SegmentCount         = 1;
+    out.Segments[0].iov_base = m_pBatch;
+    out.Segments[0].iov_len  = m_nBatched * MSDK_TS_PACKET_SIZE;
+    
+    ssize_t written = bitstream_WriteFile(m_File, &out);
+    if (written != (ssize_t)out.Segments[0].iov_len)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    m_Segment.Bytes += written;
+    m_nBatched = 0;
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t CTsMuxer::CutSegment(int64_t TimeStamp)
+{
+    if (FlushBatch() != MCODEC_SUCCEED)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    //the hook gives the file of the next segment.
+    if (m_Config.pSegmentCallback != NULL)
+    {
+        m_Segment.Duration = TimeStamp - m_Segment.StartTimeStamp;
+        int fd = m_Config.pSegmentCallback(m_Config.pContext, &m_Segment);
+        if (fd < 0)
+        {
+            return MCODEC_ERROR;
+        }
+        m_File = fd;
+    }
+    
+    m_Segment.Index++;
+    m_Segment.StartTimeStamp = TimeStamp;
+    m_Segment.Duration       = 0;
+    m_Segment.Bytes          = 0;
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,126 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __TS_MUXER_H__
+#define __TS_MUXER_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "include/GPU_codec_api.h"
+#include "param_sets.h"
+
+//the size of a TS packet, and the PES pieces of one access unit at most, with the
+//start codes added to the NAL units.
+#define MSDK_TS_PACKET_SIZE        188
+#define MSDK_TS_MAX_PIECES         512
+
+//the PTS is later than the PCR, as the decoding delay of the receiver, 90kHz.
+#define MSDK_TS_PTS_DELAY          9000
+
+//One finished segment, every segment starts with the PAT, PMT and an IDR frame.
+typedef struct
+{
+    uint32_t  Index;             // the segment number from 0
+    int64_t   StartTimeStamp;    // the timestamp of the first frame, ms
+    int64_t   Duration;          // the time to the next segment, ms
+    int64_t   Bytes;             // the written bytes of the segment
+    
+}MSdkTsSegment;
+
+//Called when a segment is finished at an IDR frame, return the file for the next
+//segment, such as a new HLS segment file, or the same file to go on. the finished
+//file is not closed by the muxer. the return value is ignored at Close().
+typedef int (*MSdkTsSegmentCallback)(void* pContext, const MSdkTsSegment* pSegment);
+
+//The settings of the muxed program, fixed when the muxer is opened.
+typedef struct
+{
+    uint32_t               CodecType;        // VIDEO_CODEC_TYPE_AVC or VIDEO_CODEC_TYPE_HEVC
+    uint16_t               PmtPid;           // the PID of the PMT, such as 0x1000
+    uint16_t               VideoPid;         // the PID of the video and PCR, such as 0x100
+    int32_t                SegmentMs;        // the segment is cut at the first IDR after it, 0 for every IDR
+    int32_t                BatchPackets;     // the TS packets of one write, such as 256
+    MSdkTsSegmentCallback  pSegmentCallback; // the segment hook, or NULL for one stream
+    void*                  pContext;         // the context passed to the hook
+    
+}MSdkTsConfig;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The MPEG-TS writer of the encoded frames, for the live HLS segments. Every frame
+//is one PES packet with the PTS, packed into the 188-byte TS packets with the PCR
+//in the first one, both from the frame timestamp. The NAL units are copied from
+//the layers straight into a batch of TS packets, which is written at once when
+//full, so nothing is allocated after Open(). An access unit delimiter is added,
+//and the PAT, PMT and the cached parameter sets are repeated before every IDR,
+//where the segments are cut.
+class CTsMuxer
+{
+public:
+    CTsMuxer(void);
+    ~CTsMuxer(void);
+    
+    //Start muxing to the file of the first segment, and allocate the batch buffer.
+    int32_t Open(int fd, const MSdkTsConfig* pConfig);
+    
+    //Write the batched packets, report the last segment, and free the buffer.
+    int32_t Close(void);
+    
+    //Add an encoded frame from GetBitstream(), with the timestamp in ms. a NAL unit
+    //without start code, as the first one of GetBitstream(), gets one in the PES.
+    //the frames before the first IDR are skipped with MCODEC_SKIPPED.
+    int32_t WriteFrame(const SLayerBSInfo* pLayers, int32_t LayerNum, int64_t TimeStamp);
+    
+    //Add an encoded frame from GetFrameBitstream(), with its uiTimeStamp.
+    int32_t WriteFrame(const SFrameBSInfo* pFrameInfo);
+    
+private:
+    
+    //Build the PAT and PMT packets, only the continuity counter changes later.
+    void BuildTables(void);
+    
+    //Add the PAT and PMT packets to the batch.
+    int32_t WriteTables(void);
+    
+    //Pack the PES pieces into TS packets, the PCR is in the first one.
+    int32_t WritePes(int32_t PesSize, uint64_t Pcr, bool RandomAccess);
+    
+    //Get the next TS packet of the batch, the full batch is written first.
+    uint8_t* NextPacket(void);
+    
+    //Write the batched TS packets to the file.
+    int32_t FlushBatch(void);
+    
+    //Finish the segment at the IDR frame, and switch to the next file.
+    int32_t CutSegment(int64_t TimeStamp);
+    
+    int                    m_File;
+    MSdkTsConfig           m_Config;
+    CParamSetCache         m_ParamSets;
+    bool                   m_Started;
+    
+    //the PAT and PMT packets, and the continuity counters of the PIDs.
+    uint8_t                m_Pat[MSDK_TS_PACKET_SIZE];
+    uint8_t                m_Pmt[MSDK_TS_PACKET_SIZE];
+    uint8_t                m_PatCounter;
+    uint8_t                m_PmtCounter;
+    uint8_t                m_VideoCounter;
+    
+    //the TS packets waiting for the write.
+    uint8_t*               m_pBatch;
+    int32_t                m_nBatched;
+    
+    //the PES header and the pieces of the access unit in order.
+    uint8_t                m_PesHeader[14];
+    struct iovec           m_Pieces[MSDK_TS_MAX_PIECES];
+    int32_t                m_nPieces;
+    
+    //the current segment, and the last frame for its duration.
+    MSdkTsSegment          m_Segment;
+    int64_t                m_LastTimeStamp;
+    int64_t                m_LastInterval;
+};
+
+#endif  // End of __TS_MUXER_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
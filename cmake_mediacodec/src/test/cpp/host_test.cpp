@@ -0,0 +1,160 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include "host_test.h"
+#include "backend_fake.h"
+#include "nal_parser.h"
+
+typedef int32_t (*HostTestFunc)(void);
+
+typedef struct
+{
+    const char*   pName;
+    HostTestFunc  pFunc;
+    
+}HostTestCase;
+
+//the test cases by name, one ctest test runs one of them.
+static const HostTestCase s_TestCases[] =
+{
+    { "fake_backend_encode",    test_FakeBackendEncode },
+    { "encode_thread_requests", test_EncodeThreadRequests },
+    { "nal_start_code_scan",    test_StartCodeScan },
+    { "frame_queue_enqueue",    test_FrameQueueEnqueue },
+    { "rtp_loopback",           test_RtpLoopback },
+    { "rtp_round_trip",         test_RtpRoundTrip },
+    { "mp4_muxer",              test_Mp4Muxer },
+    { "ts_muxer",               test_TsMuxer },
+    { "bitstream_write_file",   test_BitstreamWriteFile },
+};
+
+//the gray I420 picture of the test encoders.
+static uint8_t s_Picture[HOST_TEST_WIDTH * HOST_TEST_HEIGHT * 3 / 2];
+
+/////////////////////////////////////////////////////////////////////////////////////
+void test_InitParam(MSdkInputParam* pParam, uint32_t CodecType)
+{
+    memset(pParam, 0, sizeof(MSdkInputParam));
+    pParam->nWidth          = HOST_TEST_WIDTH;
+    pParam->nHeight         = HOST_TEST_HEIGHT;
+    pParam->nFrameRate      = 30;
+    pParam->nTargetKbps     = 100000;
+    pParam->nTemporalLayers = 1;
+    pParam->nCodecType      = CodecType;
+    pParam->nBackend        = MSDK_BACKEND_FAKE;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+VM_MSDKEncoder* test_CreateEncoder(MSdkInputParam* pParam, uint32_t KeyFrameInterval,
+                                   uint32_t FrameBytes, uint32_t KeyFrameBytes)
+{
+    MSdkFakeConfig config;
+    memset(&config, 0, sizeof(config));
+    config.LatencyUs        = 100;
+    config.KeyFrameInterval = KeyFrameInterval;
+    config.FrameBytes       = FrameBytes;
+    config.KeyFrameBytes    = KeyFrameBytes;
+    backend_SetFakeConfig(&config);
+    
+    return VM_MSDKEncoder::CreateEncoder(pParam);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t test_EncodeFrame(VM_MSDKEncoder* pEncoder, int64_t TimeStamp)
+{
+    SSourcePicture picture;
+    memset(&picture, 0, sizeof(picture));
+    picture.iColorFormat = videoFormatI420;
+    picture.iPicWidth    = HOST_TEST_WIDTH;
+    picture.iPicHeight   = HOST_TEST_HEIGHT;
+    picture.iStride[0]   = HOST_TEST_WIDTH;
+    picture.iStride[1]   = HOST_TEST_WIDTH / 2;
+    picture.iStride[2]   = HOST_TEST_WIDTH / 2;
+    picture.pData[0]     = s_Picture;
+    picture.pData[1]     = s_Picture + HOST_TEST_WIDTH * HOST_TEST_HEIGHT;
+    picture.pData[2]     = picture.pData[1] + HOST_TEST_WIDTH * HOST_TEST_HEIGHT / 4;
+    picture.uiTimeStamp  = TimeStamp;
+    
+    return pEncoder->EncodeFrame(&picture, NULL);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+int32_t test_ReadFile(FILE* pFile, std::vector<uint8_t>* pData)
+{
+    if (fseek(pFile, 0, SEEK_END) != 0)
+    {
+        return MCODEC_ERROR;
+    }
+    
+    long size = ftell(pFile);
+    if ((size < 0) || (fseek(pFile, 0, SEEK_SET) != 0))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    pData->resize(size);
+    if ((size > 0) && (fread(&(*pData)[0], 1, size, pFile) != (size_t)size))
+    {
+        return MCODEC_ERROR;
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+void test_GetFrameNals(const SFrameBSInfo* pFrameInfo, std::vector<std::vector<uint8_t> >* pNals)
+{
+    for (int32_t i = 0; i < pFrameInfo->iLayerNum; i++)
+    {
+        const SLayerBSInfo *pLayer = &pFrameInfo->sLayerInfo[i];
+        const uint8_t *pNal = pLayer->pBsBuf;
+        
+        for (int32_t k = 0; k < pLayer->iNalCount; k++)
+        {
+            int32_t length = pLayer->pNalLengthInByte[k];
+            int32_t start_code = 0;
+            if (nal_FindStartCode(pNal, length, &start_code) != 0)
+            {
+                start_code = 0;
+            }
+            
+            pNals->push_back(std::vector<uint8_t>(pNal + start_code, pNal + length));
+            pNal += length;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Run the test case of the name, or all of them without a name.
+int main(int argc, char** argv)
+{
+    int32_t count  = (int32_t)(sizeof(s_TestCases) / sizeof(s_TestCases[0]));
+    int32_t failed = 0;
+    int32_t run    = 0;
+    
+    memset(s_Picture, 0x80, sizeof(s_Picture));
+    
+    for (int32_t i = 0; i < count; i++)
+    {
+        if ((argc > 1) && (strcmp(argv[1], s_TestCases[i].pName) != 0))
+        {
+            continue;
+        }
+        
+        int32_t status = s_TestCases[i].pFunc();
+        printf("%s: %s\n", s_TestCases[i].pName, (status == MCODEC_SUCCEED) ? "passed" : "FAILED");
+        
+        failed += (status == MCODEC_SUCCEED) ? 0 : 1;
+        run++;
+    }
+    
+    if (run == 0)
+    {
+        fprintf(stderr, "no test case %s\n", (argc > 1) ? argv[1] : "");
+        return 1;
+    }
+    
+    return (failed == 0) ? 0 : 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,63 @@
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "include/GPU_codec_api.h"
+
+//Fail the running test case with the file and line of the broken check.
+#define HOST_CHECK(cond)                                                                \
+    do                                                                                  \
+    {                                                                                   \
+        if (!(cond))                                                                    \
+        {                                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);    \
+            return MCODEC_ERROR;                                                        \
+        }                                                                               \
+    } while (0)
+
+//the picture size of the test pictures and encoders, small to run fast.
+#define HOST_TEST_WIDTH            64
+#define HOST_TEST_HEIGHT           64
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The test cases run on the host, each returns MCODEC_SUCCEED or MCODEC_ERROR after
+//it printed the failed check.
+int32_t test_FakeBackendEncode(void);
+int32_t test_EncodeThreadRequests(void);
+int32_t test_StartCodeScan(void);
+int32_t test_FrameQueueEnqueue(void);
+int32_t test_RtpLoopback(void);
+int32_t test_RtpRoundTrip(void);
+int32_t test_Mp4Muxer(void);
+int32_t test_TsMuxer(void);
+int32_t test_BitstreamWriteFile(void);
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Set the parameters of a test encoder, at a generous bitrate so no frame is skipped
+//for the overshoot. the slices or the layers could be changed after it.
+void test_InitParam(MSdkInputParam* pParam, uint32_t CodecType);
+
+//Create the encoder of the fake backend, with the frame sizes and the IDR interval
+//of the fake stream. return NULL if it could not be opened.
+VM_MSDKEncoder* test_CreateEncoder(MSdkInputParam* pParam, uint32_t KeyFrameInterval,
+                                   uint32_t FrameBytes, uint32_t KeyFrameBytes);
+
+//Encode a gray picture with the timestamp in ms. return MCODEC_SUCCEED when the
+//frame is queued to the encoder, so its output could be waited for.
+int32_t test_EncodeFrame(VM_MSDKEncoder* pEncoder, int64_t TimeStamp);
+
+//Read the whole file back from the start.
+int32_t test_ReadFile(FILE* pFile, std::vector<uint8_t>* pData);
+
+//Get the NAL units of the frame without start codes, in the output order.
+void test_GetFrameNals(const SFrameBSInfo* pFrameInfo, std::vector<std::vector<uint8_t> >* pNals);
+
+#endif  // End of __HOST_TEST_H__
+
+/////////////////////////////////////////////////////////////////////////////////////
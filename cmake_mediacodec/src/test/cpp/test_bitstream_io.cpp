@@ -0,0 +1,99 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <unistd.h>
+
+#include "host_test.h"
+#include "bitstream_io.h"
+#include "nal_parser.h"
+
+#define TEST_FRAMES                12
+#define TEST_KEY_INTERVAL          10
+#define TEST_NAL_SVC_PREFIX        14
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Encode with the fake backend, write the lent bitstreams to a file, and check that
+//the file is the whole Annex-B stream, from the first start code on.
+int32_t test_BitstreamWriteFile(void)
+{
+    MSdkInputParam param;
+    test_InitParam(&param, VIDEO_CODEC_TYPE_AVC);
+    
+    VM_MSDKEncoder *pEncoder = test_CreateEncoder(&param, TEST_KEY_INTERVAL, 300, 1200);
+    HOST_CHECK(pEncoder != NULL);
+    
+    FILE *pFile = tmpfile();
+    HOST_CHECK(pFile != NULL);
+    
+    int64_t written = 0;
+    int32_t nal_count = 0;
+    int32_t key_frames = 0;
+    
+    for (int32_t i = 0; i < TEST_FRAMES; i++)
+    {
+        HOST_CHECK(test_EncodeFrame(pEncoder, i * 33) == MCODEC_SUCCEED);
+        
+        MSdkBitstream bitstream;
+        int32_t status = MCODEC_SKIPPED;
+        while (status == MCODEC_SKIPPED)
+        {
+            status = pEncoder->LockBitstream(&bitstream);
+        }
+        HOST_CHECK(status == MCODEC_SUCCEED);
+        
+        int64_t bytes = 0;
+        for (int32_t k = 0; k < bitstream.NalCount; k++)
+        {
+            bytes += bitstream.NalLengthInByte[k];
+        }
+        
+        HOST_CHECK(bitstream_WriteFile(fileno(pFile), &bitstream) == bytes);
+        HOST_CHECK(pEncoder->UnlockBitstream(&bitstream) == MCODEC_SUCCEED);
+        
+        written += bytes;
+        nal_count += bitstream.NalCount;
+        key_frames += (bitstream.eFrameType == videoFrameTypeIDR) ? 1 : 0;
+    }
+    
+    VM_MSDKEncoder::DeleteEncoder(pEncoder);
+    
+    std::vector<uint8_t> data;
+    HOST_CHECK(test_ReadFile(pFile, &data) == MCODEC_SUCCEED);
+    fclose(pFile);
+    
+    HOST_CHECK((int64_t)data.size() == written);
+    HOST_CHECK(key_frames == 2);
+    
+    //the file starts with the start code of the SPS, and every IDR frame has its
+    //SPS and PPS in front of it.
+    std::vector<MSdkNalUnit> nals(nal_count + 1);
+    int32_t count = nal_SplitAnnexB(&data[0], (int32_t)data.size(), &nals[0], (int32_t)nals.size(), VIDEO_CODEC_TYPE_AVC);
+    HOST_CHECK(count == nal_count);
+    HOST_CHECK((nals[0].Offset == 0) && (nals[0].StartCodeLen == 4));
+    HOST_CHECK(nals[0].NalType == NAL_AVC_SPS);
+    
+    int32_t idr_frames = 0;
+    for (int32_t i = 0; i < count; i++)
+    {
+        HOST_CHECK(nals[i].StartCodeLen > 0);
+        
+        //the slices of the H264/SVC stream follow their prefix NAL units.
+        int32_t prev = i - 1;
+        if ((prev >= 0) && (nals[prev].NalType == TEST_NAL_SVC_PREFIX))
+        {
+            prev--;
+        }
+        
+        if (nal_IsIDR(nals[i].NalType, VIDEO_CODEC_TYPE_AVC) &&
+            ((prev < 0) || !nal_IsIDR(nals[prev].NalType, VIDEO_CODEC_TYPE_AVC)))
+        {
+            HOST_CHECK((prev >= 1) && (nals[prev - 1].NalType == NAL_AVC_SPS) && (nals[prev].NalType == NAL_AVC_PPS));
+            idr_frames++;
+        }
+    }
+    HOST_CHECK(idr_frames == key_frames);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
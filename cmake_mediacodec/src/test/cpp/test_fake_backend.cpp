@@ -0,0 +1,197 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "host_test.h"
+#include "backend_fake.h"
+#include "GPU_msdk_thread.h"
+#include "latency_stats.h"
+
+#define TEST_FRAMES                120
+#define TEST_KEY_INTERVAL          30
+
+//the frames pushed to the encoder thread, every few of them from the start or the
+//reopen of the codec is never output, and the frames after the reopen requests.
+#define TEST_THREAD_FRAMES         60
+#define TEST_THREAD_DROP_INTERVAL  7
+#define TEST_THREAD_BITRATE_FRAME  21
+#define TEST_THREAD_KEY_FRAME      42
+#define TEST_THREAD_WAIT_US        2000000
+
+//the bitstream seen by the output callback of the encoder thread.
+typedef struct
+{
+    std::atomic<uint32_t>  Count;
+    uint32_t               KeyFrames;
+    int64_t                LastTimeStamp;
+    bool                   Broken;
+    
+}TestThreadOutput;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Encode with the fake backend frame by frame, and check every access unit comes
+//back in order with the timestamp of its picture, an IDR with the parameter sets
+//at every key frame interval, and the segments as long as the NAL units. then
+//print the frame rate and the encode latency.
+int32_t test_FakeBackendEncode(void)
+{
+    MSdkInputParam param;
+    test_InitParam(&param, VIDEO_CODEC_TYPE_AVC);
+    
+    VM_MSDKEncoder *pEncoder = test_CreateEncoder(&param, TEST_KEY_INTERVAL, 1000, 4000);
+    HOST_CHECK(pEncoder != NULL);
+    
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    
+    for (int32_t i = 0; i < TEST_FRAMES; i++)
+    {
+        HOST_CHECK(test_EncodeFrame(pEncoder, i * 33) == MCODEC_SUCCEED);
+        
+        MSdkBitstream bitstream;
+        int32_t status = MCODEC_SKIPPED;
+        while (status == MCODEC_SKIPPED)
+        {
+            status = pEncoder->LockBitstream(&bitstream);
+        }
+        HOST_CHECK(status == MCODEC_SUCCEED);
+        
+        bool key_frame = ((i % TEST_KEY_INTERVAL) == 0);
+        HOST_CHECK(bitstream.uiTimeStamp == i * 33);
+        HOST_CHECK((bitstream.eFrameType == videoFrameTypeIDR) == key_frame);
+        HOST_CHECK(bitstream.NalCount >= (key_frame ? 3 : 1));
+        
+        int64_t nal_bytes = 0;
+        int64_t segment_bytes = 0;
+        for (int32_t k = 0; k < bitstream.NalCount; k++)
+        {
+            nal_bytes += bitstream.NalLengthInByte[k];
+        }
+        for (int32_t k = 0; k < bitstream.SegmentCount; k++)
+        {
+            segment_bytes += bitstream.Segments[k].iov_len;
+        }
+        HOST_CHECK(segment_bytes == nal_bytes);
+        
+        HOST_CHECK(pEncoder->UnlockBitstream(&bitstream) == MCODEC_SUCCEED);
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    
+    MSdkLatencyStats stats;
+    HOST_CHECK(pEncoder->GetLatencyStats(&stats) == MCODEC_SUCCEED);
+    HOST_CHECK(stats.Stages[MSDK_LATENCY_ENCODE].Count == TEST_FRAMES);
+    
+    printf("fake backend: %d frames at %.0f fps, encode p50 %u us, p99 %u us\n", TEST_FRAMES,
+           TEST_FRAMES / seconds, stats.Stages[MSDK_LATENCY_ENCODE].P50Us, stats.Stages[MSDK_LATENCY_ENCODE].P99Us);
+    
+    VM_MSDKEncoder::DeleteEncoder(pEncoder);
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Take the output of the encoder thread, the frames come in order.
+static void OnThreadBitstream(void* pContext, MSdkBitstream* pBitstream)
+{
+    TestThreadOutput *pOutput = (TestThreadOutput *)pContext;
+    
+    if (pBitstream->uiTimeStamp <= pOutput->LastTimeStamp)
+    {
+        pOutput->Broken = true;
+    }
+    if (pBitstream->eFrameType == videoFrameTypeIDR)
+    {
+        pOutput->KeyFrames++;
+    }
+    pOutput->LastTimeStamp = pBitstream->uiTimeStamp;
+    pOutput->Count.fetch_add(1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Push the frames to the encoder thread on a codec which never outputs some of
+//them, with a bitrate and a key frame request right after such a frame. check the
+//requests are applied after the drain times out, every frame is either output or
+//counted as lost, and the encoding goes on to the last frame.
+int32_t test_EncodeThreadRequests(void)
+{
+    MSdkFakeConfig config;
+    memset(&config, 0, sizeof(config));
+    config.LatencyUs        = 1000;
+    config.KeyFrameInterval = 1000;
+    config.FrameBytes       = 1000;
+    config.KeyFrameBytes    = 4000;
+    config.DropInterval     = TEST_THREAD_DROP_INTERVAL;
+    backend_SetFakeConfig(&config);
+    
+    MSdkInputParam param;
+    test_InitParam(&param, VIDEO_CODEC_TYPE_AVC);
+    
+    TestThreadOutput output;
+    output.Count.store(0);
+    output.KeyFrames     = 0;
+    output.LastTimeStamp = -1;
+    output.Broken        = false;
+    
+    CMSDKEncodeThread thread;
+    HOST_CHECK(thread.Start(&param, 4, MSDK_QUEUE_DROP_OLDEST, OnThreadBitstream, &output) == MCODEC_SUCCEED);
+    
+    std::vector<uint8_t> buffer(HOST_TEST_WIDTH * HOST_TEST_HEIGHT * 3 / 2, 0x80);
+    SSourcePicture picture;
+    memset(&picture, 0, sizeof(picture));
+    picture.iColorFormat = videoFormatI420;
+    picture.iPicWidth    = HOST_TEST_WIDTH;
+    picture.iPicHeight   = HOST_TEST_HEIGHT;
+    picture.iStride[0]   = HOST_TEST_WIDTH;
+    picture.iStride[1]   = HOST_TEST_WIDTH / 2;
+    picture.iStride[2]   = HOST_TEST_WIDTH / 2;
+    picture.pData[0]     = &buffer[0];
+    picture.pData[1]     = picture.pData[0] + HOST_TEST_WIDTH * HOST_TEST_HEIGHT;
+    picture.pData[2]     = picture.pData[1] + HOST_TEST_WIDTH * HOST_TEST_HEIGHT / 4;
+    
+    for (int32_t i = 0; i < TEST_THREAD_FRAMES; i++)
+    {
+        //the frame before each request is one never output.
+        bool request = (i == TEST_THREAD_BITRATE_FRAME) || (i == TEST_THREAD_KEY_FRAME);
+        if (i == TEST_THREAD_BITRATE_FRAME)
+        {
+            HOST_CHECK(thread.UpdateBitrate(50000, 30) == MCODEC_SUCCEED);
+        }
+        if (i == TEST_THREAD_KEY_FRAME)
+        {
+            HOST_CHECK(thread.InsertKeyFrame() == MCODEC_SUCCEED);
+        }
+        
+        picture.uiTimeStamp = i * 33;
+        HOST_CHECK(thread.PushFrame(&picture) == MCODEC_SUCCEED);
+        
+        //the reopen waits out the drain, the next pictures wait for it.
+        std::this_thread::sleep_for(std::chrono::microseconds(request ? 2 * MSDK_THREAD_DRAIN_TIMEOUT_US : 3000));
+    }
+    
+    //every pushed frame is output, lost in the codec, or dropped by the queue.
+    int64_t deadline = latency_NowUs() + TEST_THREAD_WAIT_US;
+    while ((output.Count.load() + thread.GetLostFrames() + thread.GetDroppedFrames() < TEST_THREAD_FRAMES) &&
+           (latency_NowUs() < deadline))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    uint32_t lost    = thread.GetLostFrames();
+    uint32_t dropped = thread.GetDroppedFrames();
+    HOST_CHECK(thread.Stop() == MCODEC_SUCCEED);
+    
+    HOST_CHECK(!output.Broken);
+    HOST_CHECK(output.Count.load() + lost + dropped == TEST_THREAD_FRAMES);
+    HOST_CHECK(lost >= TEST_THREAD_FRAMES / TEST_THREAD_DROP_INTERVAL - 2);
+    HOST_CHECK(output.KeyFrames >= 3);
+    HOST_CHECK(output.LastTimeStamp == (TEST_THREAD_FRAMES - 1) * 33);
+    
+    printf("encode thread: %u frames output, %u lost in the codec, %u dropped by the queue\n",
+           output.Count.load(), lost, dropped);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
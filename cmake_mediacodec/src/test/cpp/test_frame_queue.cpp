@@ -0,0 +1,198 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "host_test.h"
+#include "frame_queue.h"
+#include "latency_stats.h"
+
+//the pictures pushed while the consumer runs, at 720p for the copy cost.
+#define TEST_BENCH_WIDTH           1280
+#define TEST_BENCH_HEIGHT          720
+#define TEST_BENCH_PICTURES        300
+
+//the pictures pushed to a consumer far slower than the producer.
+#define TEST_SLOW_PICTURES         2000
+#define TEST_SLOW_CONSUMER_US      1000
+
+#define TEST_QUEUE_DEPTH           4
+
+//the consumer side of the queue, and what it has seen.
+typedef struct
+{
+    CFrameQueue*           pQueue;
+    int32_t                DelayUs;
+    std::atomic<bool>      Done;
+    uint32_t               Count;
+    int64_t                LastTimeStamp;
+    bool                   Broken;
+    
+}TestConsumer;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Set up an I420 picture on the buffer, the first luma and the last chroma bytes
+//carry the timestamp, to find a torn or reordered copy.
+static void InitPicture(SSourcePicture* pPicture, std::vector<uint8_t>* pBuffer, int32_t Width, int32_t Height)
+{
+    pBuffer->assign(Width * Height * 3 / 2, 0x80);
+    
+    memset(pPicture, 0, sizeof(SSourcePicture));
+    pPicture->iColorFormat = videoFormatI420;
+    pPicture->iPicWidth    = Width;
+    pPicture->iPicHeight   = Height;
+    pPicture->iStride[0]   = Width;
+    pPicture->iStride[1]   = Width / 2;
+    pPicture->iStride[2]   = Width / 2;
+    pPicture->pData[0]     = &(*pBuffer)[0];
+    pPicture->pData[1]     = pPicture->pData[0] + Width * Height;
+    pPicture->pData[2]     = pPicture->pData[1] + Width * Height / 4;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+static uint8_t* GetLastChroma(const SSourcePicture* pPicture)
+{
+    return pPicture->pData[2] + (pPicture->iPicHeight / 2 - 1) * pPicture->iStride[2] + pPicture->iPicWidth / 2 - 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+static void StampPicture(SSourcePicture* pPicture, int64_t TimeStamp)
+{
+    pPicture->uiTimeStamp = TimeStamp;
+    pPicture->pData[0][0] = (uint8_t)TimeStamp;
+    *GetLastChroma(pPicture) = (uint8_t)(TimeStamp >> 8);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Take the pictures until the producer is done and the queue is empty, and check
+//they come in order and whole.
+static void ConsumeLoop(TestConsumer* pConsumer)
+{
+    while (true)
+    {
+        bool done = pConsumer->Done.load();
+        
+        MSdkPictureSlot *pSlot = pConsumer->pQueue->Pop();
+        if (pSlot == NULL)
+        {
+            if (done)
+            {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        
+        const SSourcePicture *pPicture = &pSlot->Picture;
+        int64_t timestamp = pPicture->uiTimeStamp;
+        
+        if ((timestamp <= pConsumer->LastTimeStamp) || (pPicture->pData[0][0] != (uint8_t)timestamp) ||
+            (*GetLastChroma(pPicture) != (uint8_t)(timestamp >> 8)))
+        {
+            pConsumer->Broken = true;
+        }
+        pConsumer->LastTimeStamp = timestamp;
+        pConsumer->Count++;
+        
+        if (pConsumer->DelayUs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(pConsumer->DelayUs));
+        }
+        pConsumer->pQueue->Release(pSlot);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Push the pictures with the consumer running, and get the push latency. every
+//picture is either seen by the consumer or counted as dropped.
+static int32_t RunProducer(CFrameQueue* pQueue, int32_t Width, int32_t Height, int32_t Pictures, int32_t DelayUs,
+                           MSdkLatencyStage* pLatency, TestConsumer* pConsumer)
+{
+    std::vector<uint8_t> buffer;
+    SSourcePicture picture;
+    InitPicture(&picture, &buffer, Width, Height);
+    
+    pConsumer->pQueue        = pQueue;
+    pConsumer->DelayUs       = DelayUs;
+    pConsumer->Count         = 0;
+    pConsumer->LastTimeStamp = -1;
+    pConsumer->Broken        = false;
+    pConsumer->Done.store(false);
+    
+    MSdkLatencyHistogram *pHist = new MSdkLatencyHistogram;
+    latency_Reset(pHist);
+    
+    std::thread consumer(ConsumeLoop, pConsumer);
+    
+    for (int32_t i = 0; i < Pictures; i++)
+    {
+        StampPicture(&picture, i);
+        
+        int64_t begin = latency_NowUs();
+        pQueue->Push(&picture);
+        latency_Record(pHist, latency_NowUs() - begin);
+    }
+    
+    pConsumer->Done.store(true);
+    consumer.join();
+    
+    latency_Query(pHist, pLatency);
+    delete pHist;
+    
+    HOST_CHECK(!pConsumer->Broken);
+    HOST_CHECK(pConsumer->Count + pQueue->GetDroppedCount() == (uint32_t)Pictures);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Print the push latency of 720p pictures with the consumer running, then check a
+//far slower consumer still sees the pictures in order and whole, and the newest
+//picture is rejected by the other policy.
+int32_t test_FrameQueueEnqueue(void)
+{
+    TestConsumer consumer;
+    MSdkLatencyStage latency;
+    
+    CFrameQueue queue;
+    HOST_CHECK(queue.Create(TEST_QUEUE_DEPTH, MSDK_QUEUE_DROP_OLDEST) == MCODEC_SUCCEED);
+    HOST_CHECK(RunProducer(&queue, TEST_BENCH_WIDTH, TEST_BENCH_HEIGHT, TEST_BENCH_PICTURES, 0,
+                           &latency, &consumer) == MCODEC_SUCCEED);
+    HOST_CHECK(latency.Count == TEST_BENCH_PICTURES);
+    
+    printf("frame queue push, %dx%d: p50 %u us, p99 %u us, max %u us, %u dropped\n",
+           TEST_BENCH_WIDTH, TEST_BENCH_HEIGHT, latency.P50Us, latency.P99Us, latency.MaxUs, queue.GetDroppedCount());
+    queue.Destroy();
+    
+    HOST_CHECK(queue.Create(TEST_QUEUE_DEPTH, MSDK_QUEUE_DROP_OLDEST) == MCODEC_SUCCEED);
+    HOST_CHECK(RunProducer(&queue, HOST_TEST_WIDTH, HOST_TEST_HEIGHT, TEST_SLOW_PICTURES, TEST_SLOW_CONSUMER_US,
+                           &latency, &consumer) == MCODEC_SUCCEED);
+    HOST_CHECK((queue.GetDroppedCount() > 0) && (consumer.Count > 0));
+    queue.Destroy();
+    
+    //the full queue keeps the oldest pictures, and rejects the new one.
+    std::vector<uint8_t> buffer;
+    SSourcePicture picture;
+    InitPicture(&picture, &buffer, HOST_TEST_WIDTH, HOST_TEST_HEIGHT);
+    
+    HOST_CHECK(queue.Create(TEST_QUEUE_DEPTH, MSDK_QUEUE_DROP_NEWEST) == MCODEC_SUCCEED);
+    for (int32_t i = 0; i <= TEST_QUEUE_DEPTH; i++)
+    {
+        StampPicture(&picture, i);
+        HOST_CHECK(queue.Push(&picture) == ((i < TEST_QUEUE_DEPTH) ? MCODEC_SUCCEED : MCODEC_SKIPPED));
+    }
+    for (int32_t i = 0; i < TEST_QUEUE_DEPTH; i++)
+    {
+        MSdkPictureSlot *pSlot = queue.Pop();
+        HOST_CHECK((pSlot != NULL) && (pSlot->Picture.uiTimeStamp == i));
+        queue.Release(pSlot);
+    }
+    HOST_CHECK((queue.Pop() == NULL) && (queue.GetDroppedCount() == 1));
+    queue.Destroy();
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
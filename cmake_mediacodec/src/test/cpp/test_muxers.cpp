@@ -0,0 +1,386 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include "host_test.h"
+#include "mp4_muxer.h"
+#include "nal_parser.h"
+#include "ts_muxer.h"
+
+#define TEST_FRAMES                25
+#define TEST_KEY_INTERVAL          10
+#define TEST_KEY_FRAMES            3
+
+//the output buffer of GetBitstream(), far above the frames of the fake stream.
+#define TEST_LAYER_BYTES           (1 << 20)
+
+#define TEST_NAL_AVC_AUD           9
+#define TEST_NAL_SVC_PREFIX        14
+
+#define TEST_PMT_PID               0x1000
+#define TEST_VIDEO_PID             0x100
+
+//the segments reported by the TS muxer, all written to the same file.
+typedef struct
+{
+    int       fd;
+    uint32_t  Count;
+    int64_t   Bytes;
+    
+}TestSegments;
+
+//the NAL units of every muxed frame without start codes, in the output order.
+typedef std::vector<std::vector<std::vector<uint8_t> > > TestFrameNals;
+
+/////////////////////////////////////////////////////////////////////////////////////
+static uint32_t ReadBE32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Find the box of the type among the boxes from Begin to End, and get the range of
+//its payload. return false if there is none, or a box runs over the end.
+static bool FindBox(const std::vector<uint8_t>& Data, size_t Begin, size_t End, const char* pType,
+                    size_t* pPayload, size_t* pBoxEnd)
+{
+    while (Begin + 8 <= End)
+    {
+        size_t size = ReadBE32(&Data[Begin]);
+        if ((size < 8) || (Begin + size > End))
+        {
+            return false;
+        }
+        
+        if (memcmp(&Data[Begin + 4], pType, 4) == 0)
+        {
+            *pPayload = Begin + 8;
+            *pBoxEnd  = Begin + size;
+            return true;
+        }
+        Begin += size;
+    }
+    
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Get the nal_unit_type of the NAL unit without start code.
+static int32_t GetNalType(const std::vector<uint8_t>& Nal, uint32_t CodecType)
+{
+    return (CodecType == VIDEO_CODEC_TYPE_HEVC) ? ((Nal[0] >> 1) & 0x3F) : (Nal[0] & 0x1F);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Encode the frames of the fake backend and pass them to the muxer writer, and get
+//the NAL units of every frame. the layer is copied out by GetBitstream() with the
+//first NAL unit without its start code if CopyLayer, or lent by GetFrameBitstream().
+template <typename Writer>
+static int32_t MuxFrames(Writer* pWriter, uint32_t CodecType, bool CopyLayer, TestFrameNals* pFrames)
+{
+    MSdkInputParam param;
+    test_InitParam(&param, CodecType);
+    
+    VM_MSDKEncoder *pEncoder = test_CreateEncoder(&param, TEST_KEY_INTERVAL, 500, 2000);
+    HOST_CHECK(pEncoder != NULL);
+    
+    std::vector<uint8_t> buffer(TEST_LAYER_BYTES);
+    std::vector<int32_t> lengths(MAX_NAL_UNITS_IN_LAYER);
+    pFrames->clear();
+    
+    for (int32_t i = 0; i < TEST_FRAMES; i++)
+    {
+        HOST_CHECK(test_EncodeFrame(pEncoder, i * 33) == MCODEC_SUCCEED);
+        
+        SFrameBSInfo frame_info;
+        if (CopyLayer)
+        {
+            memset(&frame_info, 0, sizeof(frame_info));
+            frame_info.iLayerNum = 1;
+            frame_info.sLayerInfo[0].pBsBuf           = &buffer[0];
+            frame_info.sLayerInfo[0].pNalLengthInByte = &lengths[0];
+            HOST_CHECK(pEncoder->GetBitstream(&frame_info.sLayerInfo[0]) == MCODEC_SUCCEED);
+            
+            int32_t start_code = 0;
+            HOST_CHECK(nal_FindStartCode(&buffer[0], lengths[0], &start_code) != 0);
+        }
+        else
+        {
+            HOST_CHECK(pEncoder->GetFrameBitstream(&frame_info) == MCODEC_SUCCEED);
+        }
+        
+        pFrames->push_back(std::vector<std::vector<uint8_t> >());
+        test_GetFrameNals(&frame_info, &pFrames->back());
+        HOST_CHECK(pWriter->WriteFrame(frame_info.sLayerInfo, frame_info.iLayerNum, i * 33) == MCODEC_SUCCEED);
+    }
+    
+    VM_MSDKEncoder::DeleteEncoder(pEncoder);
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Read the samples of a fragment back to the NAL units, by their length prefixes,
+//from the data offset and the sample sizes of the track run.
+static int32_t ReadSamples(const std::vector<uint8_t>& Data, size_t Moof, size_t Trun, size_t TrunEnd,
+                           size_t MdatEnd, TestFrameNals* pSamples)
+{
+    uint32_t count = ReadBE32(&Data[Trun + 4]);
+    size_t offset = Moof + ReadBE32(&Data[Trun + 8]);
+    HOST_CHECK(Trun + 12 + 12 * (size_t)count <= TrunEnd);
+    
+    for (uint32_t k = 0; k < count; k++)
+    {
+        size_t end = offset + ReadBE32(&Data[Trun + 12 + 12 * k + 4]);
+        HOST_CHECK(end <= MdatEnd);
+        
+        pSamples->push_back(std::vector<std::vector<uint8_t> >());
+        while (offset < end)
+        {
+            HOST_CHECK(offset + 4 <= end);
+            size_t length = ReadBE32(&Data[offset]);
+            offset += 4;
+            HOST_CHECK((length > 0) && (offset + length <= end));
+            
+            pSamples->back().push_back(std::vector<uint8_t>(Data.begin() + offset, Data.begin() + offset + length));
+            offset += length;
+        }
+    }
+    HOST_CHECK(offset == MdatEnd);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Record the fake stream to a fragmented MP4, and check the init segment with the
+//avcC, then one moof and mdat for every IDR, and the samples read back are the
+//NAL units of the frames without the parameter sets and the prefix NAL units.
+static int32_t RunMp4Muxer(bool CopyLayer)
+{
+    FILE *pFile = tmpfile();
+    HOST_CHECK(pFile != NULL);
+    
+    MSdkMp4Config config;
+    memset(&config, 0, sizeof(config));
+    config.CodecType        = VIDEO_CODEC_TYPE_AVC;
+    config.Width            = HOST_TEST_WIDTH;
+    config.Height           = HOST_TEST_HEIGHT;
+    config.MaxFragmentBytes = 1 << 20;
+    
+    TestFrameNals frames;
+    CMp4Muxer muxer;
+    HOST_CHECK(muxer.Open(fileno(pFile), &config) == MCODEC_SUCCEED);
+    HOST_CHECK(MuxFrames(&muxer, VIDEO_CODEC_TYPE_AVC, CopyLayer, &frames) == MCODEC_SUCCEED);
+    HOST_CHECK(muxer.Close() == MCODEC_SUCCEED);
+    
+    std::vector<uint8_t> data;
+    HOST_CHECK(test_ReadFile(pFile, &data) == MCODEC_SUCCEED);
+    fclose(pFile);
+    
+    size_t payload = 0;
+    size_t box_end = 0;
+    HOST_CHECK(FindBox(data, 0, data.size(), "ftyp", &payload, &box_end) && (payload == 8));
+    HOST_CHECK(FindBox(data, box_end, data.size(), "moov", &payload, &box_end));
+    
+    const char avcc[] = "avcC";
+    HOST_CHECK(std::search(data.begin() + payload, data.begin() + box_end, avcc, avcc + 4) != data.begin() + box_end);
+    
+    //the fragments follow the init segment, each moof with one track run.
+    size_t offset = box_end;
+    uint32_t fragments = 0;
+    TestFrameNals samples;
+    
+    while (offset < data.size())
+    {
+        size_t moof = offset;
+        size_t traf = 0;
+        size_t trun = 0;
+        size_t moof_end = 0;
+        size_t traf_end = 0;
+        size_t trun_end = 0;
+        HOST_CHECK(FindBox(data, offset, data.size(), "moof", &payload, &moof_end) && (payload == offset + 8));
+        HOST_CHECK(FindBox(data, payload, moof_end, "traf", &traf, &traf_end));
+        HOST_CHECK(FindBox(data, traf, traf_end, "trun", &trun, &trun_end) && (trun + 12 <= trun_end));
+        HOST_CHECK(FindBox(data, moof_end, data.size(), "mdat", &payload, &offset) && (payload == moof_end + 8));
+        HOST_CHECK(ReadSamples(data, moof, trun, trun_end, offset, &samples) == MCODEC_SUCCEED);
+        fragments++;
+    }
+    
+    HOST_CHECK(fragments == TEST_KEY_FRAMES);
+    HOST_CHECK(samples.size() == TEST_FRAMES);
+    
+    for (int32_t i = 0; i < TEST_FRAMES; i++)
+    {
+        std::vector<std::vector<uint8_t> > sent;
+        for (size_t k = 0; k < frames[i].size(); k++)
+        {
+            int32_t nal_type = GetNalType(frames[i][k], VIDEO_CODEC_TYPE_AVC);
+            if (!nal_IsParamSet(nal_type, VIDEO_CODEC_TYPE_AVC) && (nal_type != TEST_NAL_SVC_PREFIX))
+            {
+                sent.push_back(frames[i][k]);
+            }
+        }
+        HOST_CHECK(samples[i] == sent);
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The frames lent by GetFrameBitstream(), and the ones copied out by GetBitstream()
+//without the first start code.
+int32_t test_Mp4Muxer(void)
+{
+    HOST_CHECK(RunMp4Muxer(false) == MCODEC_SUCCEED);
+    HOST_CHECK(RunMp4Muxer(true) == MCODEC_SUCCEED);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+static int SegmentCallback(void* pContext, const MSdkTsSegment* pSegment)
+{
+    TestSegments *pSegments = (TestSegments*)pContext;
+    pSegments->Count++;
+    pSegments->Bytes += pSegment->Bytes;
+    return pSegments->fd;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Mux the fake stream to MPEG-TS cut at every IDR, and check the TS packets, the
+//PAT and PMT before every segment, one PES for every frame, and the continuity.
+//the elementary stream of every PES has the NAL units of the frame, each with a
+//start code, after the delimiter and the parameter sets.
+static int32_t RunTsMuxer(bool CopyLayer)
+{
+    FILE *pFile = tmpfile();
+    HOST_CHECK(pFile != NULL);
+    
+    TestSegments segments;
+    memset(&segments, 0, sizeof(segments));
+    segments.fd = fileno(pFile);
+    
+    MSdkTsConfig config;
+    memset(&config, 0, sizeof(config));
+    config.CodecType        = VIDEO_CODEC_TYPE_AVC;
+    config.PmtPid           = TEST_PMT_PID;
+    config.VideoPid         = TEST_VIDEO_PID;
+    config.SegmentMs        = 0;
+    config.BatchPackets     = 16;
+    config.pSegmentCallback = SegmentCallback;
+    config.pContext         = &segments;
+    
+    TestFrameNals frames;
+    CTsMuxer muxer;
+    HOST_CHECK(muxer.Open(fileno(pFile), &config) == MCODEC_SUCCEED);
+    HOST_CHECK(MuxFrames(&muxer, VIDEO_CODEC_TYPE_AVC, CopyLayer, &frames) == MCODEC_SUCCEED);
+    HOST_CHECK(muxer.Close() == MCODEC_SUCCEED);
+    
+    std::vector<uint8_t> data;
+    HOST_CHECK(test_ReadFile(pFile, &data) == MCODEC_SUCCEED);
+    fclose(pFile);
+    
+    HOST_CHECK(!data.empty() && (data.size() % 188 == 0));
+    HOST_CHECK(segments.Count == TEST_KEY_FRAMES);
+    HOST_CHECK(segments.Bytes == (int64_t)data.size());
+    
+    uint32_t pat = 0;
+    uint32_t pmt = 0;
+    int32_t counter = -1;
+    std::vector<std::vector<uint8_t> > pes;
+    
+    for (size_t offset = 0; offset < data.size(); offset += 188)
+    {
+        const uint8_t *p = &data[offset];
+        HOST_CHECK(p[0] == 0x47);
+        
+        uint16_t pid   = ((p[1] & 0x1F) << 8) | p[2];
+        bool pusi      = (p[1] & 0x40) != 0;
+        bool has_data  = (p[3] & 0x10) != 0;
+        
+        if (pid == 0)
+        {
+            pat++;
+        }
+        else if (pid == TEST_PMT_PID)
+        {
+            //the PAT of the segment is right before its PMT.
+            HOST_CHECK((offset >= 188) && (data[offset - 188 + 2] == 0));
+            pmt++;
+        }
+        else
+        {
+            HOST_CHECK(pid == TEST_VIDEO_PID);
+            HOST_CHECK(has_data);
+            
+            //the continuity counter of the video PID goes on across the segments.
+            HOST_CHECK((counter < 0) || ((p[3] & 0x0F) == ((counter + 1) & 0x0F)));
+            counter = p[3] & 0x0F;
+            
+            //the payload follows the adaptation field, a new PES starts at the flag.
+            size_t start = 4 + (((p[3] & 0x20) != 0) ? 1 + p[4] : 0);
+            HOST_CHECK(start <= 188);
+            HOST_CHECK(pusi || !pes.empty());
+            if (pusi)
+            {
+                pes.push_back(std::vector<uint8_t>());
+            }
+            pes.back().insert(pes.back().end(), p + start, p + 188);
+        }
+    }
+    
+    HOST_CHECK((pat == TEST_KEY_FRAMES) && (pmt == TEST_KEY_FRAMES));
+    HOST_CHECK(pes.size() == TEST_FRAMES);
+    
+    for (int32_t i = 0; i < TEST_FRAMES; i++)
+    {
+        //the PES header of the video stream, then the elementary stream.
+        const std::vector<uint8_t>& packet = pes[i];
+        HOST_CHECK((packet.size() > 9) && (packet[0] == 0) && (packet[1] == 0) && (packet[2] == 1) &&
+                   (packet[3] == 0xE0));
+        
+        int32_t header = 9 + packet[8];
+        int32_t length = (int32_t)packet.size() - header;
+        HOST_CHECK(length > 0);
+        
+        std::vector<MSdkNalUnit> nals(length / 3 + 1);
+        int32_t count = nal_SplitAnnexB(&packet[header], length, &nals[0], (int32_t)nals.size(), VIDEO_CODEC_TYPE_AVC);
+        HOST_CHECK((count > 0) && (nals[0].Offset == 0));
+        
+        std::vector<std::vector<uint8_t> > received;
+        for (int32_t k = 0; k < count; k++)
+        {
+            HOST_CHECK(nals[k].StartCodeLen > 0);
+            if ((nals[k].NalType != TEST_NAL_AVC_AUD) && !nal_IsParamSet(nals[k].NalType, VIDEO_CODEC_TYPE_AVC))
+            {
+                const uint8_t *pNal = &packet[header] + nals[k].Offset;
+                received.push_back(std::vector<uint8_t>(pNal + nals[k].StartCodeLen, pNal + nals[k].Length));
+            }
+        }
+        
+        std::vector<std::vector<uint8_t> > sent;
+        for (size_t k = 0; k < frames[i].size(); k++)
+        {
+            if (!nal_IsParamSet(GetNalType(frames[i][k], VIDEO_CODEC_TYPE_AVC), VIDEO_CODEC_TYPE_AVC))
+            {
+                sent.push_back(frames[i][k]);
+            }
+        }
+        HOST_CHECK(received == sent);
+    }
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The frames lent by GetFrameBitstream(), and the ones copied out by GetBitstream()
+//without the first start code, which the muxer writes.
+int32_t test_TsMuxer(void)
+{
+    HOST_CHECK(RunTsMuxer(false) == MCODEC_SUCCEED);
+    HOST_CHECK(RunTsMuxer(true) == MCODEC_SUCCEED);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
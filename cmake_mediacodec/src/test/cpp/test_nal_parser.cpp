@@ -0,0 +1,154 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+
+#include "host_test.h"
+#include "nal_parser.h"
+
+#define TEST_RANDOM_BUFFERS        2000
+#define TEST_RANDOM_MAX_BYTES      300
+
+//the benchmark frame, of the NAL units with the zero bytes of a real payload.
+#define TEST_BENCH_BYTES           (1 << 20)
+#define TEST_BENCH_NAL_BYTES       1000
+#define TEST_BENCH_LOOPS           20
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The byte by byte scan, as the reference of the vector scan.
+static int32_t FindStartCodeNaive(const uint8_t* pBuf, int32_t Length, int32_t* pStartCodeLen)
+{
+    for (int32_t pos = 0; pos + 2 < Length; pos++)
+    {
+        if ((pBuf[pos] == 0) && (pBuf[pos + 1] == 0) && (pBuf[pos + 2] == 1))
+        {
+            bool four = (pos > 0) && (pBuf[pos - 1] == 0);
+            *pStartCodeLen = four ? 4 : 3;
+            return four ? (pos - 1) : pos;
+        }
+    }
+    
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Get all the start codes of the buffer, with the scan function.
+template <typename ScanFunc>
+static void FindAllStartCodes(const uint8_t* pBuf, int32_t Length, ScanFunc Scan, std::vector<int32_t>* pOffsets,
+                              std::vector<int32_t>* pLengths)
+{
+    int32_t pos = 0;
+    while (pos < Length)
+    {
+        int32_t start_code = 0;
+        int32_t found = Scan(pBuf + pos, Length - pos, &start_code);
+        if (found < 0)
+        {
+            break;
+        }
+        
+        pOffsets->push_back(pos + found);
+        pLengths->push_back(start_code);
+        pos += found + start_code;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Compare the vector scan with the byte by byte scan on the random buffers full of
+//zero bytes, at every alignment, and the split NAL units with the start codes.
+//then print the throughput of both on a frame of 1000-byte NAL units.
+int32_t test_StartCodeScan(void)
+{
+    std::vector<uint8_t> buffer(TEST_RANDOM_MAX_BYTES + 16);
+    std::vector<MSdkNalUnit> nals(TEST_RANDOM_MAX_BYTES);
+    uint32_t seed = 1;
+    
+    for (int32_t i = 0; i < TEST_RANDOM_BUFFERS; i++)
+    {
+        int32_t shift  = i & 15;
+        int32_t length = (int32_t)(rand_r(&seed) % TEST_RANDOM_MAX_BYTES);
+        uint8_t *pBuf  = &buffer[shift];
+        
+        //the zero bytes are the most, then the ones for the start codes.
+        for (int32_t k = 0; k < length; k++)
+        {
+            uint32_t r = (uint32_t)rand_r(&seed);
+            pBuf[k] = ((r & 3) != 0) ? 0 : (((r & 12) == 0) ? 1 : (uint8_t)(r >> 8));
+        }
+        
+        //the half of the buffers starts with a start code, to be split.
+        if (((i & 16) != 0) && (length >= 4))
+        {
+            pBuf[0] = 0;
+            pBuf[1] = 0;
+            pBuf[2] = 0;
+            pBuf[3] = 1;
+        }
+        
+        std::vector<int32_t> offsets, lengths, ref_offsets, ref_lengths;
+        FindAllStartCodes(pBuf, length, nal_FindStartCode, &offsets, &lengths);
+        FindAllStartCodes(pBuf, length, FindStartCodeNaive, &ref_offsets, &ref_lengths);
+        HOST_CHECK((offsets == ref_offsets) && (lengths == ref_lengths));
+        
+        if (ref_offsets.empty() || (ref_offsets[0] != 0))
+        {
+            continue;
+        }
+        
+        int32_t count = nal_SplitAnnexB(pBuf, length, &nals[0], (int32_t)nals.size(), VIDEO_CODEC_TYPE_AVC);
+        HOST_CHECK(count == (int32_t)ref_offsets.size());
+        for (int32_t k = 0; k < count; k++)
+        {
+            HOST_CHECK((nals[k].Offset == ref_offsets[k]) && (nals[k].StartCodeLen == ref_lengths[k]));
+            HOST_CHECK(nals[k].Offset + nals[k].Length == ((k + 1 < count) ? ref_offsets[k + 1] : length));
+        }
+    }
+    
+    //the payload has single zero bytes, but no two in a row as the emulation
+    //prevention leaves it.
+    std::vector<uint8_t> frame(TEST_BENCH_BYTES);
+    for (int32_t k = 0; k < TEST_BENCH_BYTES; k++)
+    {
+        uint32_t r = (uint32_t)rand_r(&seed);
+        frame[k] = (((r & 63) == 0) && (k > 0) && (frame[k - 1] != 0)) ? 0 : (uint8_t)(0x80 | (r >> 8));
+    }
+    for (int32_t k = 0; k + 4 <= TEST_BENCH_BYTES; k += TEST_BENCH_NAL_BYTES)
+    {
+        frame[k]     = 0;
+        frame[k + 1] = 0;
+        frame[k + 2] = 0;
+        frame[k + 3] = 1;
+    }
+    
+    double seconds[2] = {0, 0};
+    size_t found[2]   = {0, 0};
+    for (int32_t pass = 0; pass < 2; pass++)
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (int32_t loop = 0; loop < TEST_BENCH_LOOPS; loop++)
+        {
+            std::vector<int32_t> offsets, lengths;
+            if (pass == 0)
+            {
+                FindAllStartCodes(&frame[0], TEST_BENCH_BYTES, nal_FindStartCode, &offsets, &lengths);
+            }
+            else
+            {
+                FindAllStartCodes(&frame[0], TEST_BENCH_BYTES, FindStartCodeNaive, &offsets, &lengths);
+            }
+            found[pass] = offsets.size();
+        }
+        seconds[pass] = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+    
+    HOST_CHECK(found[0] == found[1]);
+    HOST_CHECK(found[0] == (TEST_BENCH_BYTES + TEST_BENCH_NAL_BYTES - 4) / TEST_BENCH_NAL_BYTES);
+    
+    double bytes = (double)TEST_BENCH_BYTES * TEST_BENCH_LOOPS;
+    printf("start code scan: %.0f MB/s, byte by byte: %.0f MB/s\n",
+           bytes / seconds[0] / 1e6, bytes / seconds[1] / 1e6);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,243 @@
+/////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+
+#include "host_test.h"
+#include "nal_parser.h"
+#include "rtp_depacketizer.h"
+#include "rtp_packetizer.h"
+
+#define TEST_FRAMES                12
+#define TEST_KEY_INTERVAL          10
+#define TEST_PACKET_SIZE           400
+#define TEST_SLICE_BYTES           300
+
+//the benchmark frame, of the NAL units cut into FU-A fragments.
+#define TEST_BENCH_NALS            8
+#define TEST_BENCH_NAL_BYTES       (128 * 1024)
+#define TEST_BENCH_PACKET_SIZE     1200
+#define TEST_BENCH_MAX_PACKETS     2048
+#define TEST_BENCH_LOOPS           50
+
+//the counters of a loopback run.
+typedef struct
+{
+    int32_t  KeyFrames;
+    int32_t  FragmentedFrames;
+    int32_t  MaxNalsInFrame;
+    
+}TestLoopback;
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Get the NAL units of an assembled access unit without start codes.
+static int32_t GetAccessUnitNals(const MSdkRtpFrame* pFrame, uint32_t CodecType,
+                                 std::vector<std::vector<uint8_t> >* pNals)
+{
+    MSdkNalUnit nals[MAX_NAL_UNITS_IN_LAYER];
+    int32_t count = nal_SplitAnnexB(pFrame->pData, pFrame->Length, nals, MAX_NAL_UNITS_IN_LAYER, CodecType);
+    
+    for (int32_t i = 0; i < count; i++)
+    {
+        const uint8_t *pNal = pFrame->pData + nals[i].Offset;
+        pNals->push_back(std::vector<uint8_t>(pNal + nals[i].StartCodeLen, pNal + nals[i].Length));
+    }
+    
+    return count;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Packetize the frames of the fake backend and pass the packets to the depacketizer
+//in order, and check it gives back the same NAL units for every frame, with no
+//packet lost or discarded. the slices are limited to SliceBytes if above 0.
+static int32_t RunLoopback(uint32_t CodecType, uint32_t SliceBytes, TestLoopback* pResult)
+{
+    MSdkInputParam param;
+    test_InitParam(&param, CodecType);
+    if (SliceBytes > 0)
+    {
+        param.nSliceMode     = SM_SIZELIMITED_SLICE;
+        param.nSliceArgument = SliceBytes;
+    }
+    
+    VM_MSDKEncoder *pEncoder = test_CreateEncoder(&param, TEST_KEY_INTERVAL, 300, 1500);
+    HOST_CHECK(pEncoder != NULL);
+    
+    MSdkRtpConfig rtp_config;
+    memset(&rtp_config, 0, sizeof(rtp_config));
+    rtp_config.CodecType      = CodecType;
+    rtp_config.PacketSize     = TEST_PACKET_SIZE;
+    rtp_config.MaxPackets     = 64;
+    rtp_config.PayloadType    = 96;
+    rtp_config.Ssrc           = 0x12345678;
+    rtp_config.SequenceNumber = 65530;
+    
+    CRtpPacketizer packetizer;
+    HOST_CHECK(packetizer.Create(&rtp_config) == MCODEC_SUCCEED);
+    
+    MSdkJitterConfig jitter_config;
+    memset(&jitter_config, 0, sizeof(jitter_config));
+    jitter_config.CodecType     = CodecType;
+    jitter_config.PacketSize    = TEST_PACKET_SIZE;
+    jitter_config.MaxPackets    = 256;
+    jitter_config.MaxFrameBytes = 1 << 16;
+    jitter_config.MaxDelayMs    = 0;
+    
+    CRtpDepacketizer depacketizer;
+    HOST_CHECK(depacketizer.Create(&jitter_config) == MCODEC_SUCCEED);
+    
+    memset(pResult, 0, sizeof(TestLoopback));
+    
+    for (int32_t i = 0; i < TEST_FRAMES; i++)
+    {
+        HOST_CHECK(test_EncodeFrame(pEncoder, i * 33) == MCODEC_SUCCEED);
+        
+        SFrameBSInfo frame_info;
+        HOST_CHECK(pEncoder->GetFrameBitstream(&frame_info) == MCODEC_SUCCEED);
+        
+        std::vector<std::vector<uint8_t> > sent;
+        test_GetFrameNals(&frame_info, &sent);
+        
+        MSdkRtpPacket *pPackets = NULL;
+        int32_t packet_count = 0;
+        HOST_CHECK(packetizer.PacketizeFrame(&frame_info, &pPackets, &packet_count) == MCODEC_SUCCEED);
+        HOST_CHECK(packet_count > 0);
+        
+        for (int32_t k = 0; k < packet_count; k++)
+        {
+            HOST_CHECK(pPackets[k].Length <= TEST_PACKET_SIZE);
+            HOST_CHECK(depacketizer.InsertPacket(pPackets[k].pData, pPackets[k].Length) == MCODEC_SUCCEED);
+        }
+        
+        //the marker packet completes the frame, it is output at once.
+        MSdkRtpFrame frame;
+        HOST_CHECK(depacketizer.PopFrame(&frame, i * 33) == MCODEC_SUCCEED);
+        
+        std::vector<std::vector<uint8_t> > received;
+        GetAccessUnitNals(&frame, CodecType, &received);
+        HOST_CHECK(received == sent);
+        HOST_CHECK(frame.KeyFrame == ((frame_info.eFrameType == videoFrameTypeIDR) ? 1 : 0));
+        
+        HOST_CHECK(depacketizer.PopFrame(&frame, i * 33) == MCODEC_SKIPPED);
+        
+        pResult->KeyFrames += frame.KeyFrame;
+        pResult->FragmentedFrames += (packet_count > (int32_t)sent.size()) ? 1 : 0;
+        pResult->MaxNalsInFrame = std::max(pResult->MaxNalsInFrame, (int32_t)sent.size());
+    }
+    
+    VM_MSDKEncoder::DeleteEncoder(pEncoder);
+    
+    MSdkJitterStats stats;
+    depacketizer.GetStats(&stats);
+    HOST_CHECK(stats.FramesOutput == TEST_FRAMES);
+    HOST_CHECK((stats.PacketsDiscarded == 0) && (stats.PacketsNacked == 0) && (stats.FramesDropped == 0));
+    HOST_CHECK(pResult->KeyFrames == 2);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//The H264/AVC frames of one slice, with the IDR frames fragmented and the parameter
+//sets aggregated.
+int32_t test_RtpRoundTrip(void)
+{
+    TestLoopback result;
+    HOST_CHECK(RunLoopback(VIDEO_CODEC_TYPE_AVC, 0, &result) == MCODEC_SUCCEED);
+    HOST_CHECK(result.FragmentedFrames >= result.KeyFrames);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//Both codecs with and without the size limited slices, which fit the packets and
+//are never fragmented. then print the throughput of a 1 MB frame packetized and
+//assembled again.
+int32_t test_RtpLoopback(void)
+{
+    const uint32_t codecs[2] = {VIDEO_CODEC_TYPE_AVC, VIDEO_CODEC_TYPE_HEVC};
+    
+    for (int32_t i = 0; i < 2; i++)
+    {
+        TestLoopback result;
+        HOST_CHECK(RunLoopback(codecs[i], 0, &result) == MCODEC_SUCCEED);
+        HOST_CHECK(result.FragmentedFrames >= result.KeyFrames);
+        
+        HOST_CHECK(RunLoopback(codecs[i], TEST_SLICE_BYTES, &result) == MCODEC_SUCCEED);
+        HOST_CHECK(result.FragmentedFrames == 0);
+        HOST_CHECK(result.MaxNalsInFrame > 4);
+    }
+    
+    std::vector<uint8_t> frame;
+    std::vector<int32_t> lengths(TEST_BENCH_NALS, TEST_BENCH_NAL_BYTES);
+    for (int32_t i = 0; i < TEST_BENCH_NALS; i++)
+    {
+        const uint8_t header[5] = {0x00, 0x00, 0x00, 0x01, 0x65};
+        frame.insert(frame.end(), header, header + sizeof(header));
+        for (int32_t k = (int32_t)sizeof(header); k < TEST_BENCH_NAL_BYTES; k++)
+        {
+            frame.push_back((uint8_t)(0x80 | (k & 0x7F)));
+        }
+    }
+    
+    SLayerBSInfo layer;
+    memset(&layer, 0, sizeof(layer));
+    layer.pBsBuf           = &frame[0];
+    layer.iNalCount        = TEST_BENCH_NALS;
+    layer.pNalLengthInByte = &lengths[0];
+    
+    MSdkRtpConfig rtp_config;
+    memset(&rtp_config, 0, sizeof(rtp_config));
+    rtp_config.CodecType   = VIDEO_CODEC_TYPE_AVC;
+    rtp_config.PacketSize  = TEST_BENCH_PACKET_SIZE;
+    rtp_config.MaxPackets  = TEST_BENCH_MAX_PACKETS;
+    rtp_config.PayloadType = 96;
+    
+    CRtpPacketizer packetizer;
+    HOST_CHECK(packetizer.Create(&rtp_config) == MCODEC_SUCCEED);
+    
+    MSdkJitterConfig jitter_config;
+    memset(&jitter_config, 0, sizeof(jitter_config));
+    jitter_config.CodecType     = VIDEO_CODEC_TYPE_AVC;
+    jitter_config.PacketSize    = TEST_BENCH_PACKET_SIZE;
+    jitter_config.MaxPackets    = TEST_BENCH_MAX_PACKETS;
+    jitter_config.MaxFrameBytes = 2 * (int32_t)frame.size();
+    
+    CRtpDepacketizer depacketizer;
+    HOST_CHECK(depacketizer.Create(&jitter_config) == MCODEC_SUCCEED);
+    
+    double packetize_us   = 0;
+    double depacketize_us = 0;
+    int32_t packet_count  = 0;
+    
+    for (int32_t loop = 0; loop < TEST_BENCH_LOOPS; loop++)
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        
+        MSdkRtpPacket *pPackets = NULL;
+        HOST_CHECK(packetizer.PacketizeLayers(&layer, 1, loop * 3000, &pPackets, &packet_count) == MCODEC_SUCCEED);
+        
+        std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+        
+        for (int32_t k = 0; k < packet_count; k++)
+        {
+            HOST_CHECK(depacketizer.InsertPacket(pPackets[k].pData, pPackets[k].Length) == MCODEC_SUCCEED);
+        }
+        
+        MSdkRtpFrame assembled;
+        HOST_CHECK(depacketizer.PopFrame(&assembled, loop) == MCODEC_SUCCEED);
+        HOST_CHECK(assembled.Length == (int32_t)frame.size());
+        
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        packetize_us   += std::chrono::duration<double, std::micro>(middle - begin).count();
+        depacketize_us += std::chrono::duration<double, std::micro>(end - middle).count();
+    }
+    
+    double bytes = (double)frame.size() * TEST_BENCH_LOOPS;
+    printf("rtp: %d bytes in %d packets, packetize %.0f MB/s, depacketize %.0f MB/s\n",
+           (int32_t)frame.size(), packet_count, bytes / packetize_us, bytes / depacketize_us);
+    
+    return MCODEC_SUCCEED;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////